@@ -0,0 +1,213 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BatchCompiler.h"
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDomDocument>
+#include <QXmlStreamWriter>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <sstream>
+
+namespace Aseba
+{
+	/** \addtogroup batchcompiler */
+	/*@{*/
+
+	//! Create one job per node of an aesl project whose description is known, return false and fill errorMessage if the project cannot be read
+	bool BatchCompiler::addProject(const QString& fileName, const DescriptionsManager& descriptions, Jobs& jobs, QStringList& missingNodes, QString& errorMessage)
+	{
+		QFile file(fileName);
+		if (!file.open(QFile::ReadOnly))
+		{
+			errorMessage = QString("Cannot open file %0").arg(fileName);
+			return false;
+		}
+
+		QDomDocument document("aesl-source");
+		QString errorMsg;
+		int errorLine;
+		int errorColumn;
+		if (!document.setContent(&file, false, &errorMsg, &errorLine, &errorColumn))
+		{
+			errorMessage = QString("Error in XML source file %0: %1 at line %2, column %3").arg(fileName).arg(errorMsg).arg(errorLine).arg(errorColumn);
+			return false;
+		}
+
+		// read events and constants first, as nodes may appear before them in the file
+		QSharedPointer<CommonDefinitions> commonDefinitions(new CommonDefinitions);
+		for (QDomElement element(document.documentElement().firstChildElement()); !element.isNull(); element = element.nextSiblingElement())
+		{
+			if (element.tagName() == "event")
+			{
+				const QString eventName(element.attribute("name"));
+				const unsigned eventSize(element.attribute("size").toUInt());
+				if (eventSize > ASEBA_MAX_EVENT_ARG_SIZE)
+				{
+					errorMessage = QString("Event %1 has a length %2 larger than maximum %3").arg(eventName).arg(eventSize).arg(ASEBA_MAX_EVENT_ARG_SIZE);
+					return false;
+				}
+				commonDefinitions->events.push_back(NamedValue(eventName.toStdWString(), eventSize));
+			}
+			else if (element.tagName() == "constant")
+			{
+				commonDefinitions->constants.push_back(NamedValue(element.attribute("name").toStdWString(), element.attribute("value").toInt()));
+			}
+		}
+
+		// then create a job for each node
+		for (QDomElement element(document.documentElement().firstChildElement("node")); !element.isNull(); element = element.nextSiblingElement("node"))
+		{
+			const QString nodeName(element.attribute("name"));
+			bool ok;
+			const unsigned nodeId(descriptions.getNodeId(nodeName.toStdWString(), element.attribute("nodeId", 0).toUInt(), &ok));
+			if (!ok)
+			{
+				missingNodes.append(QString("%0:%1").arg(fileName).arg(nodeName));
+				continue;
+			}
+
+			Job job;
+			job.projectFileName = fileName;
+			job.nodeName = nodeName;
+			job.nodeId = nodeId;
+			job.description = *descriptions.getDescription(nodeId);
+			job.commonDefinitions = commonDefinitions;
+			job.source = element.text().toStdWString();
+			jobs.append(job);
+		}
+		return true;
+	}
+
+	//! Constructing a compiler sets the error messages and the translation callback, which are static
+	static QMutex compilerConstructionMutex;
+
+	//! Compile a single job, this function is reentrant
+	BatchCompiler::Result BatchCompiler::compile(const Job& job)
+	{
+		Result result;
+		result.job = job;
+
+		const long long unsigned startTime(monotonicMicroseconds());
+		QMutexLocker locker(&compilerConstructionMutex);
+		Compiler compiler;
+		locker.unlock();
+		compiler.setTargetDescription(&job.description);
+		compiler.setCommonDefinitions(job.commonDefinitions.data());
+		std::wistringstream is(job.source);
+		result.success = compiler.compile(is, result.bytecode, result.allocatedVariablesCount, result.error);
+		result.duration = monotonicMicroseconds() - startTime;
+
+		return result;
+	}
+
+	//! Compile all jobs concurrently using threadCount threads (or as many as cores if 0), return results in the order of jobs
+	BatchCompiler::Results BatchCompiler::compileAll(const Jobs& jobs, int threadCount)
+	{
+		if (threadCount > 0)
+			QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+		return QtConcurrent::blockingMapped<Results>(jobs, &BatchCompiler::compile);
+	}
+
+	static void write16(QIODevice& dev, const uint16 v)
+	{
+		dev.write((const char*)&v, 2);
+	}
+
+	//! Write the bytecode of a successful compilation as an Aseba Binary Object; product id and firmware version are unknown offline and set to 0
+	bool BatchCompiler::writeBytecodeImage(const QString& fileName, const Result& result)
+	{
+		QFile file(fileName);
+		if (!file.open(QFile::WriteOnly | QFile::Truncate))
+			return false;
+
+		// See AS001 at https://aseba.wikidot.com/asebaspecifications
+
+		// header
+		const char* magic = "ABO";
+		file.write(magic, 4);
+		write16(file, 0); // binary format version
+		write16(file, ASEBA_PROTOCOL_VERSION);
+		write16(file, 0); // product identifier
+		write16(file, 0); // firmware version
+		write16(file, result.job.nodeId);
+		write16(file, crcXModem(0, result.job.nodeName.toStdWString()));
+		write16(file, result.job.description.crc());
+
+		// bytecode
+		write16(file, result.bytecode.size());
+		uint16 crc(0);
+		for (size_t i = 0; i < result.bytecode.size(); ++i)
+		{
+			const uint16 bc(result.bytecode[i]);
+			write16(file, bc);
+			crc = crcXModem(crc, bc);
+		}
+		write16(file, crc);
+		return true;
+	}
+
+	//! Write an XML manifest listing, for each result, its status and the file holding its bytecode (empty if compilation failed)
+	bool BatchCompiler::writeManifest(const QString& fileName, const Results& results, const QStringList& imagesFileNames)
+	{
+		Q_ASSERT(results.size() == imagesFileNames.size());
+
+		QFile file(fileName);
+		if (!file.open(QFile::WriteOnly | QFile::Truncate))
+			return false;
+
+		QXmlStreamWriter xml(&file);
+		xml.setAutoFormatting(true);
+		xml.writeStartDocument();
+		xml.writeStartElement("batch-compilation");
+		for (int i = 0; i < results.size(); ++i)
+		{
+			const Result& result(results[i]);
+			xml.writeStartElement("node");
+			xml.writeAttribute("project", result.job.projectFileName);
+			xml.writeAttribute("name", result.job.nodeName);
+			xml.writeAttribute("nodeId", QString::number(result.job.nodeId));
+			xml.writeAttribute("success", result.success ? "true" : "false");
+			xml.writeAttribute("duration-us", QString::number(result.duration));
+			if (result.success)
+			{
+				xml.writeAttribute("file", QFileInfo(imagesFileNames[i]).fileName());
+				xml.writeAttribute("bytecode-size", QString::number(result.bytecode.size()));
+				xml.writeAttribute("variables-count", QString::number(result.allocatedVariablesCount));
+				xml.writeAttribute("description-crc", QString::number(result.job.description.crc()));
+			}
+			else
+			{
+				xml.writeAttribute("error", QString::fromStdWString(result.error.toWString()));
+			}
+			xml.writeEndElement();
+		}
+		xml.writeEndElement();
+		xml.writeEndDocument();
+		return true;
+	}
+
+	/*@}*/
+} // namespace Aseba
@@ -0,0 +1,82 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_COMPILER_H
+#define BATCH_COMPILER_H
+
+#include <QString>
+#include <QList>
+#include <QStringList>
+#include <QSharedPointer>
+#include "../../compiler/compiler.h"
+#include "../../common/msg/descriptions-manager.h"
+
+namespace Aseba
+{
+	/**
+		\defgroup batchcompiler Batch compiler
+	*/
+	/*@{*/
+
+	//! Compile the programs of many nodes, possibly from many projects, on a thread pool
+	class BatchCompiler
+	{
+	public:
+		//! The program of one node, along with everything needed to compile it
+		struct Job
+		{
+			QString projectFileName; //!< aesl project this program comes from
+			QString nodeName; //!< name of the node in the project
+			unsigned nodeId; //!< identifier of the node whose description is used
+			TargetDescription description; //!< description of the target, copied so that jobs are independent
+			QSharedPointer<const CommonDefinitions> commonDefinitions; //!< events and constants of the project, shared by its nodes
+			std::wstring source; //!< program text
+
+			Job() : nodeId(0) {}
+		};
+		typedef QList<Job> Jobs;
+
+		//! The outcome of the compilation of a Job
+		struct Result
+		{
+			Job job; //!< the compiled job
+			bool success; //!< whether compilation succeeded
+			BytecodeVector bytecode; //!< generated bytecode, if successful
+			unsigned allocatedVariablesCount; //!< number of words of variables used by the program
+			Error error; //!< compilation error, if not successful
+			long long unsigned duration; //!< compilation time in microseconds
+
+			Result() : success(false), allocatedVariablesCount(0), duration(0) {}
+		};
+		typedef QList<Result> Results;
+
+	public:
+		static bool addProject(const QString& fileName, const DescriptionsManager& descriptions, Jobs& jobs, QStringList& missingNodes, QString& errorMessage);
+		static Result compile(const Job& job);
+		static Results compileAll(const Jobs& jobs, int threadCount = 0);
+
+		static bool writeBytecodeImage(const QString& fileName, const Result& result);
+		static bool writeManifest(const QString& fileName, const Results& results, const QStringList& imagesFileNames);
+	};
+
+	/*@}*/
+} // namespace Aseba
+
+#endif // BATCH_COMPILER_H
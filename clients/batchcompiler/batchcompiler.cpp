@@ -0,0 +1,341 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+#include <iostream>
+#include <dashel/dashel.h>
+#include "BatchCompiler.h"
+#include "../../common/consts.h"
+#include "../../common/msg/msg.h"
+#include "../../common/utils/utils.h"
+#include "../../transport/dashel_plugins/dashel-plugins.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFileInfo>
+#include <QDir>
+
+namespace Aseba
+{
+	using namespace Dashel;
+	using namespace std;
+
+	//! Gather target descriptions from files or from live networks
+	class DescriptionsCollector: public Hub, public DescriptionsManager
+	{
+	public:
+		bool loadFile(const string& fileName);
+		void fetchFromTarget(const string& target, unsigned timeout);
+		bool saveFile(const string& fileName);
+		size_t count() const { return nodesDescriptions.size(); }
+
+	protected:
+		// from Hub
+		virtual void incomingData(Stream *stream);
+	};
+
+	//! Read a file containing the description messages of one or several nodes
+	bool DescriptionsCollector::loadFile(const string& fileName)
+	{
+		Stream* stream(0);
+		try
+		{
+			stream = connect("file:name=" + fileName + ";mode=read");
+			while (true)
+			{
+				auto_ptr<Message> message(Message::receive(stream));
+				processMessage(message.get());
+			}
+		}
+		catch (DashelException e)
+		{
+			// end of file or error opening it
+			if (!stream)
+			{
+				cerr << "Cannot read descriptions from " << fileName << ": " << e.what() << endl;
+				return false;
+			}
+		}
+		closeStream(stream);
+		return true;
+	}
+
+	//! Connect to target, request descriptions and collect answers during timeout ms
+	void DescriptionsCollector::fetchFromTarget(const string& target, unsigned timeout)
+	{
+		try
+		{
+			Stream* stream(connect(target));
+			GetDescription().serialize(stream);
+			stream->flush();
+			const UnifiedTime startTime;
+			while (true)
+			{
+				const UnifiedTime::Value delta((UnifiedTime() - startTime).value);
+				if (delta >= timeout)
+					break;
+				step(timeout - delta);
+			}
+			closeStream(stream);
+		}
+		catch (DashelException e)
+		{
+			cerr << "Cannot fetch descriptions from " << target << ": " << e.what() << endl;
+		}
+	}
+
+	//! Write all complete descriptions to a file, in the same format as the network messages
+	bool DescriptionsCollector::saveFile(const string& fileName)
+	{
+		try
+		{
+			Stream* stream(connect("file:name=" + fileName + ";mode=write"));
+			for (NodesDescriptionsMap::const_iterator it(nodesDescriptions.begin()); it != nodesDescriptions.end(); ++it)
+			{
+				const NodeDescription& nodeDescription(it->second);
+
+				Description description;
+				static_cast<TargetDescription&>(description) = nodeDescription;
+				description.source = it->first;
+				description.serialize(stream);
+
+				for (size_t i = 0; i < nodeDescription.namedVariables.size(); ++i)
+				{
+					NamedVariableDescription message;
+					static_cast<TargetDescription::NamedVariable&>(message) = nodeDescription.namedVariables[i];
+					message.source = it->first;
+					message.serialize(stream);
+				}
+				for (size_t i = 0; i < nodeDescription.localEvents.size(); ++i)
+				{
+					LocalEventDescription message;
+					static_cast<TargetDescription::LocalEvent&>(message) = nodeDescription.localEvents[i];
+					message.source = it->first;
+					message.serialize(stream);
+				}
+				for (size_t i = 0; i < nodeDescription.nativeFunctions.size(); ++i)
+				{
+					NativeFunctionDescription message;
+					static_cast<TargetDescription::NativeFunction&>(message) = nodeDescription.nativeFunctions[i];
+					message.source = it->first;
+					message.serialize(stream);
+				}
+			}
+			stream->flush();
+			closeStream(stream);
+		}
+		catch (DashelException e)
+		{
+			cerr << "Cannot write descriptions to " << fileName << ": " << e.what() << endl;
+			return false;
+		}
+		return true;
+	}
+
+	void DescriptionsCollector::incomingData(Stream *stream)
+	{
+		auto_ptr<Message> message(Message::receive(stream));
+		processMessage(message.get());
+	}
+
+	void dumpHelp(ostream &stream, const char *programName)
+	{
+		stream << "Aseba batch compiler, compile the programs of aesl projects in parallel, usage:\n";
+		stream << programName << " [options] project.aesl ... project.aesl\n";
+		stream << "For every node of every project whose description is known, write its\n";
+		stream << "bytecode to PROJECT-NODE-ID.abo in the output directory, and list all\n";
+		stream << "results in manifest.xml there.\n";
+		stream << "Options:\n";
+		stream << "    -d file         : read target descriptions from file (can be repeated)\n";
+		stream << "    -t target       : fetch target descriptions from a live network (can be repeated)\n";
+		stream << "    -w ms           : time to wait for descriptions from following -t (default: 1000)\n";
+		stream << "    -s file         : save all known target descriptions to file, for later use with -d\n";
+		stream << "    -o directory    : where to write bytecode images and manifest (default: .)\n";
+		stream << "    -j threads      : number of compilation threads (default: number of cores)\n";
+		stream << "    -h, --help      : shows this help\n";
+		stream << "    -V, --version   : shows the version number\n";
+		stream << "Return 0 if all programs compiled successfully.\n";
+		stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+	}
+
+	void dumpVersion(std::ostream &stream)
+	{
+		stream << "Aseba batch compiler " << ASEBA_VERSION << std::endl;
+		stream << "Aseba protocol " << ASEBA_PROTOCOL_VERSION << std::endl;
+		stream << "Licence LGPLv3: GNU LGPL version 3 <http://www.gnu.org/licenses/lgpl.html>\n";
+	}
+
+	//! Produce an error message and dump help and quit
+	void errorMissingArgument(const char *programName)
+	{
+		cerr << "Error, missing argument.\n";
+		dumpHelp(cerr, programName);
+		exit(4);
+	}
+
+	//! Make a string usable as part of a file name
+	QString sanitizeFileName(const QString& name)
+	{
+		QString sanitized(name);
+		for (int i = 0; i < sanitized.size(); ++i)
+			if (!sanitized[i].isLetterOrNumber() && sanitized[i] != '-' && sanitized[i] != '_')
+				sanitized[i] = '_';
+		return sanitized;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	Dashel::initPlugins();
+
+	Aseba::DescriptionsCollector descriptions;
+	QStringList projects;
+	std::string descriptionsOutput;
+	QString outputDirectory(".");
+	unsigned timeout(1000);
+	int threadCount(0);
+
+	const QStringList args(app.arguments());
+	for (int i = 1; i < args.size(); ++i)
+	{
+		const QString& arg(args[i]);
+		const bool hasValue(i + 1 < args.size());
+		if (arg == "-d")
+		{
+			if (!hasValue)
+				Aseba::errorMissingArgument(argv[0]);
+			if (!descriptions.loadFile(args[++i].toStdString()))
+				return 3;
+		}
+		else if (arg == "-t")
+		{
+			if (!hasValue)
+				Aseba::errorMissingArgument(argv[0]);
+			descriptions.fetchFromTarget(args[++i].toStdString(), timeout);
+		}
+		else if (arg == "-w")
+		{
+			if (!hasValue)
+				Aseba::errorMissingArgument(argv[0]);
+			timeout = args[++i].toUInt();
+		}
+		else if (arg == "-s")
+		{
+			if (!hasValue)
+				Aseba::errorMissingArgument(argv[0]);
+			descriptionsOutput = args[++i].toStdString();
+		}
+		else if (arg == "-o")
+		{
+			if (!hasValue)
+				Aseba::errorMissingArgument(argv[0]);
+			outputDirectory = args[++i];
+		}
+		else if (arg == "-j")
+		{
+			if (!hasValue)
+				Aseba::errorMissingArgument(argv[0]);
+			threadCount = args[++i].toInt();
+		}
+		else if ((arg == "-h") || (arg == "--help"))
+		{
+			Aseba::dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if ((arg == "-V") || (arg == "--version"))
+		{
+			Aseba::dumpVersion(std::cout);
+			return 0;
+		}
+		else
+			projects.append(arg);
+	}
+
+	if (!descriptionsOutput.empty() && !descriptions.saveFile(descriptionsOutput))
+		return 3;
+	if (projects.isEmpty())
+	{
+		if (descriptionsOutput.empty())
+			Aseba::dumpHelp(std::cerr, argv[0]);
+		return descriptionsOutput.empty() ? 1 : 0;
+	}
+	if (descriptions.count() == 0)
+	{
+		std::cerr << "No target description available, use -d or -t" << std::endl;
+		return 3;
+	}
+
+	// collect jobs
+	Aseba::BatchCompiler::Jobs jobs;
+	QStringList missingNodes;
+	for (int i = 0; i < projects.size(); ++i)
+	{
+		QString errorMessage;
+		if (!Aseba::BatchCompiler::addProject(projects[i], descriptions, jobs, missingNodes, errorMessage))
+		{
+			std::wcerr << errorMessage.toStdWString() << std::endl;
+			return 2;
+		}
+	}
+	for (int i = 0; i < missingNodes.size(); ++i)
+		std::wcerr << L"No description for node " << missingNodes[i].toStdWString() << L", skipped" << std::endl;
+
+	// compile
+	const long long unsigned startTime(Aseba::monotonicMicroseconds());
+	const Aseba::BatchCompiler::Results results(Aseba::BatchCompiler::compileAll(jobs, threadCount));
+	const long long unsigned duration(Aseba::monotonicMicroseconds() - startTime);
+
+	// write results
+	const QDir outputDir(outputDirectory);
+	QStringList imagesFileNames;
+	int failureCount(0);
+	for (int i = 0; i < results.size(); ++i)
+	{
+		const Aseba::BatchCompiler::Result& result(results[i]);
+		const QString imageFileName(outputDir.filePath(
+			Aseba::sanitizeFileName(QFileInfo(result.job.projectFileName).completeBaseName()) + "-" +
+			Aseba::sanitizeFileName(result.job.nodeName) + "-" + QString::number(result.job.nodeId) + ".abo"
+		));
+		imagesFileNames.append(imageFileName);
+		if (result.success)
+		{
+			if (!Aseba::BatchCompiler::writeBytecodeImage(imageFileName, result))
+			{
+				std::wcerr << L"Cannot write " << imageFileName.toStdWString() << std::endl;
+				return 3;
+			}
+			std::wcout << result.job.projectFileName.toStdWString() << L":" << result.job.nodeName.toStdWString() << L": " << result.bytecode.size() << L" words of bytecode" << std::endl;
+		}
+		else
+		{
+			std::wcout << result.job.projectFileName.toStdWString() << L":" << result.job.nodeName.toStdWString() << L": " << result.error.toWString() << std::endl;
+			++failureCount;
+		}
+	}
+	if (!Aseba::BatchCompiler::writeManifest(outputDir.filePath("manifest.xml"), results, imagesFileNames))
+	{
+		std::wcerr << L"Cannot write manifest" << std::endl;
+		return 3;
+	}
+	// once wide, standard streams only accept wide output
+	std::wcout << results.size() << L" programs compiled in " << duration / 1000 << L" ms, " << failureCount << L" failed" << std::endl;
+
+	return (failureCount || !missingNodes.isEmpty()) ? 1 : 0;
+}
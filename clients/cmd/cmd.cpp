@@ -25,6 +25,7 @@
 #include "../../common/utils/HexFile.h"
 #include "../../common/utils/FormatableString.h"
 #include "../../common/utils/BootloaderInterface.h"
+#include "../../common/utils/MultiBootloaderInterface.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
 #include <iostream>
 #include <fstream>
@@ -52,17 +53,21 @@ namespace Aseba
 		stream << "* sb: switch into bootloader: reboot node, then enter bootloader for a while [dest]\n";
 		stream << "* sleep: put the vm to sleep [dest]\n";
 		stream << "* wusb : write hex file to [dest] [file name] [reset]\n";
+		stream << "* mwhex : write hex file to several nodes at once [file name] [reset] [dest or target@dest] ...; must be last\n";
 	}
 	
 	//! Show usage
 	void dumpHelp(ostream &stream, const char *programName)
 	{
 		stream << "Aseba cmd, send message over the aseba network, usage:\n";
-		stream << programName << " [-t target] [cmd destId (args)] ... [cmd destId (args)]\n";
+		stream << programName << " [-t target] [-w] [-d] [-r retries] [cmd destId (args)] ... [cmd destId (args)]\n";
 		stream << "where cmd is one af the following:\n";
 		dumpCommandList(stream);
 		stream << std::endl;
 		stream << "Other options:\n";
+		stream << "    -w              : for following whex and mwhex, send the command of a page while the previous one is programmed\n";
+		stream << "    -d              : for following whex, read back pages and only write those that differ\n";
+		stream << "    -r retries      : for following mwhex, number of times a failed page is written again (default: 3)\n";
 		stream << "    -h, --help      : shows this help\n";
 		stream << "    -V, --version   : shows the version number\n";
 		stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
@@ -161,6 +166,11 @@ namespace Aseba
 			cout << "Failure" << endl;
 		}
 		
+		virtual void writePageSkipped(unsigned pageNumber)
+		{
+			cout << "Page " << pageNumber << " unchanged, skipped" << endl;
+		}
+		
 		virtual void writeHexStart(const string &fileName, bool reset, bool simple)
 		{
 			cout << "Flashing " << fileName << endl;
@@ -192,6 +202,87 @@ namespace Aseba
 		}
 	};
 	
+	class CmdMultiBootloaderInterface:public MultiBootloaderInterface
+	{
+	protected:
+		// reporting function
+		virtual void deviceStarted(unsigned device, unsigned pagesCount)
+		{
+			cout << describe(device) << ": in bootloader, about to write " << pagesCount << " pages" << endl;
+		}
+		
+		virtual void devicePageRetry(unsigned device, unsigned pageNumber, unsigned attempt)
+		{
+			cout << describe(device) << ": error while writing page " << pageNumber << ", retry " << attempt << endl;
+		}
+		
+		virtual void deviceFinished(unsigned device)
+		{
+			const Device& d(getDevice(device));
+			if (d.state == Device::DONE)
+				cout << describe(device) << ": write completed" << endl;
+			else
+				cout << describe(device) << ": failure, " << d.error << endl;
+		}
+		
+		string describe(unsigned device) const
+		{
+			const Device& d(getDevice(device));
+			return FormatableString("%0 node %1").arg(d.target).arg(d.dest);
+		}
+	};
+	
+	//! Whether to send the command of a page while the previous one is programmed when writing hex files
+	static bool flashPipelined(false);
+	//! Whether to skip pages already in flash when writing hex files
+	static bool flashDifferential(false);
+	//! Number of times a failed page is written again when writing hex files to several nodes
+	static unsigned flashRetries(3);
+	
+	//! Write an hex file to several nodes at once, each being dest or target@dest, return whether all succeeded
+	bool writeHexMulti(const char* defaultTarget, int argc, char *argv[])
+	{
+		// first arg is file name, then optionally reset, then devices
+		int argIndex(1);
+		if (argc < 2)
+			errorMissingArgument(argv[0]);
+		const char* fileName(argv[argIndex++]);
+		bool reset(false);
+		if (argIndex < argc && !strcmp(argv[argIndex], "reset"))
+		{
+			reset = true;
+			++argIndex;
+		}
+		if (argIndex >= argc)
+			errorMissingArgument(argv[0]);
+		
+		CmdMultiBootloaderInterface bootloader;
+		bootloader.setPipelined(flashPipelined);
+		bootloader.setRetries(flashRetries);
+		for (; argIndex < argc; ++argIndex)
+		{
+			const string device(argv[argIndex]);
+			const size_t atPos(device.rfind('@'));
+			if (atPos == string::npos)
+				bootloader.addDevice(defaultTarget, atoi(device.c_str()));
+			else
+				bootloader.addDevice(device.substr(0, atPos), atoi(device.c_str() + atPos + 1));
+		}
+		
+		bool success(false);
+		try
+		{
+			cout << "Flashing " << fileName << " to " << bootloader.getDevicesCount() << " nodes" << endl;
+			success = bootloader.writeHex(fileName, reset);
+		}
+		catch (HexFile::Error &e)
+		{
+			errorHexFile(e.toString());
+		}
+		bootloader.dumpSummary(cout);
+		return success;
+	}
+	
 	//! Process a command, return the number of arguments eaten (not counting the command itself)
 	int processCommand(Stream* stream, int argc, char *argv[])
 	{
@@ -279,6 +370,8 @@ namespace Aseba
 			try
 			{
 				CmdBootloaderInterface bootloader(stream, atoi(argv[1]));
+				bootloader.setPipelined(flashPipelined);
+				bootloader.setDifferential(flashDifferential);
 				bootloader.writeHex(argv[2], reset, false);
 			}
 			catch (HexFile::Error &e)
@@ -416,6 +509,28 @@ int main(int argc, char *argv[])
 			else
 				Aseba::errorMissingArgument(argv[0]);
 		}
+		else if (strcmp(arg, "-w") == 0)
+		{
+			Aseba::flashPipelined = true;
+		}
+		else if (strcmp(arg, "-d") == 0)
+		{
+			Aseba::flashDifferential = true;
+		}
+		else if (strcmp(arg, "-r") == 0)
+		{
+			if (++argCounter < argc)
+				Aseba::flashRetries = atoi(argv[argCounter]);
+			else
+				Aseba::errorMissingArgument(argv[0]);
+		}
+		else if (strcmp(arg, "mwhex") == 0)
+		{
+			// connects by itself to every target, and takes all remaining arguments
+			if (!Aseba::writeHexMulti(target, argc - argCounter, &argv[argCounter]))
+				return 9;
+			return 0;
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			Aseba::dumpHelp(std::cout, argv[0]);
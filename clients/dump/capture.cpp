@@ -0,0 +1,297 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "capture.h"
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // WIN32
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup dump */
+	/*@{*/
+
+	//! Parse a number or a range "min-max" of numbers, in decimal or hexadecimal
+	static bool parseRange(const string& text, uint16& minValue, uint16& maxValue)
+	{
+		const char* start(text.c_str());
+		char* end;
+		minValue = uint16(strtoul(start, &end, 0));
+		if (end == start)
+			return false;
+		maxValue = minValue;
+		if (*end == '-')
+		{
+			start = end + 1;
+			maxValue = uint16(strtoul(start, &end, 0));
+			if (end == start)
+				return false;
+		}
+		return *end == 0 && minValue <= maxValue;
+	}
+
+	//! Add an expression of the form "node=A[-B],type=C[-D]"; both parts are optional and must match.
+	//! Packets are accepted if they match any of the expressions. Return false if expression is invalid.
+	bool PacketFilter::addExpression(const string& expression)
+	{
+		Term term;
+		const vector<string> parts(split<string>(expression, ","));
+		for (size_t i = 0; i < parts.size(); ++i)
+		{
+			const size_t equalPos(parts[i].find('='));
+			if (equalPos == string::npos)
+				return false;
+			const string key(parts[i].substr(0, equalPos));
+			const string value(parts[i].substr(equalPos + 1));
+			if (key == "node")
+			{
+				if (!parseRange(value, term.minSource, term.maxSource))
+					return false;
+			}
+			else if (key == "type")
+			{
+				if (!parseRange(value, term.minType, term.maxType))
+					return false;
+			}
+			else
+				return false;
+		}
+		terms.push_back(term);
+		return true;
+	}
+
+	//! Layout of the start of a capture file
+	struct CaptureRing::Header
+	{
+		char magic[4]; //!< "ACAP"
+		uint16 version; //!< version of the format
+		uint16 headerSize; //!< offset of the ring storage in the file
+		uint64 capacity; //!< size of the ring storage
+		uint64 begin; //!< total bytes written before the oldest packet
+		uint64 end; //!< total bytes written
+		uint64 dropped; //!< number of overwritten packets
+	};
+
+	static const char captureMagic[4] = { 'A', 'C', 'A', 'P' };
+	static const uint16 captureVersion = 1;
+	static const uint16 captureHeaderSize = 64;
+	//! Time stamp (8), then the packet as on the wire: length (2), source (2), type (2)
+	static const size_t recordHeaderSize = 14;
+
+	CaptureRing::CaptureRing():
+		fd(-1),
+		mapping(0),
+		mappingSize(0),
+		header(0),
+		data(0)
+	{}
+
+	CaptureRing::~CaptureRing()
+	{
+		close();
+	}
+
+	//! Create fileName able to hold capacity bytes of packets and map it for writing, return false on error
+	bool CaptureRing::create(const string& fileName, uint64 capacity)
+	{
+		if (capacity < recordHeaderSize + ASEBA_MAX_EVENT_ARG_SIZE)
+		{
+			cerr << "Capture size too small" << endl;
+			return false;
+		}
+		if (!map(fileName, true, captureHeaderSize + capacity))
+			return false;
+		memset(header, 0, captureHeaderSize);
+		memcpy(header->magic, captureMagic, 4);
+		header->version = captureVersion;
+		header->headerSize = captureHeaderSize;
+		header->capacity = capacity;
+		return true;
+	}
+
+	//! Map an existing capture for reading, return false on error
+	bool CaptureRing::open(const string& fileName)
+	{
+		if (!map(fileName, false, 0))
+			return false;
+		if (mappingSize < captureHeaderSize || memcmp(header->magic, captureMagic, 4) != 0 || header->version != captureVersion ||
+			header->headerSize != captureHeaderSize || captureHeaderSize + header->capacity != mappingSize)
+		{
+			cerr << "File " << fileName << " is not a valid Aseba capture" << endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool CaptureRing::map(const string& fileName, bool writable, uint64 fileSize)
+	{
+		#ifndef WIN32
+		fd = ::open(fileName.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+		if (fd < 0)
+		{
+			cerr << "Cannot open capture file " << fileName << ": " << strerror(errno) << endl;
+			return false;
+		}
+		if (writable)
+		{
+			if (ftruncate(fd, fileSize) != 0)
+			{
+				cerr << "Cannot resize capture file " << fileName << ": " << strerror(errno) << endl;
+				close();
+				return false;
+			}
+		}
+		else
+		{
+			struct stat fileStat;
+			if (fstat(fd, &fileStat) != 0)
+			{
+				close();
+				return false;
+			}
+			fileSize = fileStat.st_size;
+		}
+		void* address(mmap(0, fileSize, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0));
+		if (address == MAP_FAILED)
+		{
+			cerr << "Cannot map capture file " << fileName << ": " << strerror(errno) << endl;
+			close();
+			return false;
+		}
+		mapping = static_cast<uint8*>(address);
+		mappingSize = fileSize;
+		header = reinterpret_cast<Header*>(mapping);
+		data = mapping + captureHeaderSize;
+		return true;
+		#else // WIN32
+		cerr << "Capture files are not supported on this platform" << endl;
+		return false;
+		#endif // WIN32
+	}
+
+	//! Unmap and close the file, data are written back by the system
+	void CaptureRing::close()
+	{
+		#ifndef WIN32
+		if (mapping)
+			munmap(mapping, mappingSize);
+		if (fd >= 0)
+			::close(fd);
+		#endif // WIN32
+		fd = -1;
+		mapping = 0;
+		mappingSize = 0;
+		header = 0;
+		data = 0;
+	}
+
+	void CaptureRing::copyIn(uint64 position, const void* source, size_t size)
+	{
+		const size_t offset(position % header->capacity);
+		const size_t firstPart(min<uint64>(size, header->capacity - offset));
+		memcpy(data + offset, source, firstPart);
+		memcpy(data, static_cast<const uint8*>(source) + firstPart, size - firstPart);
+	}
+
+	void CaptureRing::copyOut(uint64 position, void* dest, size_t size) const
+	{
+		const size_t offset(position % header->capacity);
+		const size_t firstPart(min<uint64>(size, header->capacity - offset));
+		memcpy(dest, data + offset, firstPart);
+		memcpy(static_cast<uint8*>(dest) + firstPart, data, size - firstPart);
+	}
+
+	//! Append a packet, overwriting the oldest ones if there is not enough room
+	void CaptureRing::write(uint64 timeStamp, uint16 source, uint16 type, const vector<uint8>& payload)
+	{
+		const uint16 length(payload.size());
+		const uint64 recordSize(recordHeaderSize + length);
+
+		// make room
+		while (header->end + recordSize - header->begin > header->capacity)
+		{
+			uint16 oldLength;
+			copyOut(header->begin + 8, &oldLength, 2);
+			header->begin += recordHeaderSize + oldLength;
+			++header->dropped;
+		}
+
+		uint8 record[recordHeaderSize];
+		memcpy(record, &timeStamp, 8);
+		memcpy(record + 8, &length, 2);
+		memcpy(record + 10, &source, 2);
+		memcpy(record + 12, &type, 2);
+		copyIn(header->end, record, recordHeaderSize);
+		if (length)
+			copyIn(header->end + recordHeaderSize, &payload[0], length);
+		header->end += recordSize;
+	}
+
+	//! Read the packet at position and move position to the next one, return false at the end or if the capture is inconsistent
+	bool CaptureRing::read(uint64& position, CapturedPacket& packet) const
+	{
+		if (position < header->begin || position + recordHeaderSize > header->end)
+			return false;
+		uint8 record[recordHeaderSize];
+		copyOut(position, record, recordHeaderSize);
+		uint16 length;
+		memcpy(&packet.timeStamp, record, 8);
+		memcpy(&length, record + 8, 2);
+		memcpy(&packet.source, record + 10, 2);
+		memcpy(&packet.type, record + 12, 2);
+		if (position + recordHeaderSize + length > header->end)
+			return false;
+		packet.payload.resize(length);
+		if (length)
+			copyOut(position + recordHeaderSize, &packet.payload[0], length);
+		position += recordHeaderSize + length;
+		return true;
+	}
+
+	uint64 CaptureRing::begin() const
+	{
+		return header->begin;
+	}
+
+	uint64 CaptureRing::end() const
+	{
+		return header->end;
+	}
+
+	uint64 CaptureRing::droppedCount() const
+	{
+		return header->dropped;
+	}
+
+	/*@}*/
+} // namespace Aseba
@@ -0,0 +1,112 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_CAPTURE_H
+#define ASEBA_CAPTURE_H
+
+#include "../../common/types.h"
+#include <string>
+#include <vector>
+
+namespace Aseba
+{
+	/** \addtogroup dump */
+	/*@{*/
+
+	//! Selection of packets by ranges of source node and type, applied before any decoding
+	class PacketFilter
+	{
+	public:
+		//! Ranges of source and type that a packet must both match
+		struct Term
+		{
+			uint16 minSource, maxSource;
+			uint16 minType, maxType;
+
+			Term() : minSource(0), maxSource(0xffff), minType(0), maxType(0xffff) {}
+		};
+
+	public:
+		bool addExpression(const std::string& expression);
+		//! Return whether a packet is selected, i.e. if there is no expression or if any matches
+		bool accepts(uint16 source, uint16 type) const
+		{
+			if (terms.empty())
+				return true;
+			for (size_t i = 0; i < terms.size(); ++i)
+				if (source >= terms[i].minSource && source <= terms[i].maxSource && type >= terms[i].minType && type <= terms[i].maxType)
+					return true;
+			return false;
+		}
+
+	protected:
+		std::vector<Term> terms;
+	};
+
+	//! A packet as stored in a capture
+	struct CapturedPacket
+	{
+		uint64 timeStamp; //!< reception time in us since epoch
+		uint16 source;
+		uint16 type;
+		std::vector<uint8> payload;
+	};
+
+	//! A ring buffer of raw packets in a memory-mapped file.
+	//! Once full, the oldest packets are overwritten. The file is in the byte order of the host.
+	class CaptureRing
+	{
+	public:
+		CaptureRing();
+		~CaptureRing();
+
+		bool create(const std::string& fileName, uint64 capacity);
+		bool open(const std::string& fileName);
+		void close();
+
+		void write(uint64 timeStamp, uint16 source, uint16 type, const std::vector<uint8>& payload);
+		bool read(uint64& position, CapturedPacket& packet) const;
+
+		//! Return the position of the oldest packet in the ring
+		uint64 begin() const;
+		//! Return the position after the newest packet in the ring
+		uint64 end() const;
+		//! Return the number of packets overwritten because the ring was full
+		uint64 droppedCount() const;
+
+	protected:
+		struct Header;
+
+		bool map(const std::string& fileName, bool writable, uint64 fileSize);
+		void copyIn(uint64 position, const void* source, size_t size);
+		void copyOut(uint64 position, void* dest, size_t size) const;
+
+	protected:
+		int fd; //!< descriptor of the mapped file, -1 if none
+		uint8* mapping; //!< start of the mapped file
+		uint64 mappingSize; //!< size of the mapped file
+		Header* header; //!< header at the start of the mapping
+		uint8* data; //!< ring storage, after the header
+	};
+
+	/*@}*/
+} // namespace Aseba
+
+#endif // ASEBA_CAPTURE_H
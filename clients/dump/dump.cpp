@@ -22,10 +22,14 @@
 #include "../../common/consts.h"
 #include "../../common/msg/msg.h"
 #include "../../common/utils/utils.h"
+#include "../../common/msg/endian.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
+#include "capture.h"
 #include <time.h>
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <iomanip>
 
 namespace Aseba
 {
@@ -37,16 +41,36 @@ namespace Aseba
 	*/
 	/*@{*/
 	
+	//! Write a message in human-readable form
+	void dumpMessage(const Message *message)
+	{
+		if (message)
+			message->dump(wcout);
+		else
+			cout << "unknown message received";
+		cout << endl;
+	}
+	
 	//! A simple message dumper.
-	//! This class calls Aseba::Message::dump() for each message
+	//! This class calls Aseba::Message::dump() for each message selected by filter,
+	//! or, if a capture is given, stores their raw packets in it without decoding them
 	class Dump : public Hub
 	{
 	private:
 		bool rawTime; //!< should displayed timestamps be of the form sec:usec since 1970
+		const PacketFilter& filter; //!< messages to dump
+		CaptureRing* capture; //!< if not null, where to store raw packets
+		UnifiedTime::Value startTime; //!< time since epoch at creation, in ms
+		long long unsigned startMonotonicTime; //!< monotonic time at creation, in us
+		std::vector<uint8> payload; //!< buffer for the packet being received
 	
 	public:
-		Dump(bool rawTime) :
-			rawTime(rawTime)
+		Dump(bool rawTime, const PacketFilter& filter, CaptureRing* capture = 0) :
+			rawTime(rawTime),
+			filter(filter),
+			capture(capture),
+			startTime(UnifiedTime().value),
+			startMonotonicTime(monotonicMicroseconds())
 		{
 		}
 	
@@ -54,25 +78,48 @@ namespace Aseba
 		
 		void connectionCreated(Stream *stream)
 		{
+			if (capture)
+				return;
 			dumpTime(cout, rawTime);
 			cout << stream->getTargetName()  << " connection created." << endl;
 		}
 		
 		void incomingData(Stream *stream)
 		{
-			Message *message = Message::receive(stream);
+			// read raw packet, so that filtered ones are never decoded
+			uint16 len, source, type;
+			stream->read(&len, 2);
+			swapEndian(len);
+			stream->read(&source, 2);
+			swapEndian(source);
+			stream->read(&type, 2);
+			swapEndian(type);
+			payload.resize(len);
+			if (len)
+				stream->read(&payload[0], len);
+			
+			if (!filter.accepts(source, type))
+				return;
+			
+			if (capture)
+			{
+				// microseconds since epoch, from the monotonic clock so that close packets are ordered
+				capture->write(startTime * 1000 + (monotonicMicroseconds() - startMonotonicTime), source, type, payload);
+				return;
+			}
+			
+			Message *message = Message::create(source, type, payload);
 			
 			dumpTime(cout, rawTime);
 			cout << stream->getTargetName()  << " ";
-			if (message)
-				message->dump(wcout);
-			else
-				cout << "unknown message received";
-			cout << endl;
+			dumpMessage(message);
+			delete message;
 		}
 		
 		void connectionClosed(Stream *stream, bool abnormal)
 		{
+			if (capture)
+				return;
 			dumpTime(cout);
 			cout << stream->getTargetName() << " connection closed";
 			if (abnormal)
@@ -81,6 +128,30 @@ namespace Aseba
 		}
 	};
 	
+	//! Print the packets of a capture selected by filter, from the oldest to the newest
+	void decodeCapture(const CaptureRing& capture, bool rawTime, const PacketFilter& filter)
+	{
+		if (capture.droppedCount())
+			cout << capture.droppedCount() << " older messages were overwritten" << endl;
+		
+		CapturedPacket packet;
+		uint64 position(capture.begin());
+		while (capture.read(position, packet))
+		{
+			if (!filter.accepts(packet.source, packet.type))
+				continue;
+			
+			const UnifiedTime time(packet.timeStamp / 1000);
+			if (rawTime)
+				cout << packet.timeStamp / 1000000 << "." << setfill('0') << setw(6) << packet.timeStamp % 1000000 << setfill(' ') << " ";
+			else
+				cout << time.toHumanReadableStringFromEpoch() << " ";
+			Message *message = Message::create(packet.source, packet.type, packet.payload);
+			dumpMessage(message);
+			delete message;
+		}
+	}
+	
 	/*@}*/
 }
 
@@ -92,6 +163,11 @@ void dumpHelp(std::ostream &stream, const char *programName)
 	stream << programName << " [options] [targets]*\n";
 	stream << "Options:\n";
 	stream << "--rawtime       : shows time in the form of sec:usec since 1970\n";
+	stream << "--filter EXPR   : only consider messages matching EXPR, of the form node=A[-B],type=C[-D],\n";
+	stream << "                  numbers can be hexadecimal; can be repeated to accept several kinds of messages\n";
+	stream << "--capture FILE  : do not print messages but store them raw in a ring buffer in FILE\n";
+	stream << "--capture-size MB : size of the ring buffer, older messages are overwritten (default: 64)\n";
+	stream << "--decode FILE   : print the messages stored in capture FILE and quit\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
 	stream << "Targets are any valid Dashel targets." << std::endl << std::endl;
@@ -111,6 +187,10 @@ int main(int argc, char *argv[])
 	Dashel::initPlugins();
 	bool rawTime = false;
 	std::vector<std::string> targets;
+	Aseba::PacketFilter filter;
+	const char* captureFile = 0;
+	const char* decodeFile = 0;
+	unsigned captureSize = 64;
 	
 	int argCounter = 1;
 	
@@ -122,6 +202,29 @@ int main(int argc, char *argv[])
 		{
 			rawTime = true;
 		}
+		else if ((strcmp(arg, "--filter") == 0) || (strcmp(arg, "--capture") == 0) || (strcmp(arg, "--capture-size") == 0) || (strcmp(arg, "--decode") == 0))
+		{
+			argCounter++;
+			if (argCounter >= argc)
+			{
+				dumpHelp(std::cout, argv[0]);
+				return 1;
+			}
+			else if (strcmp(arg, "--filter") == 0)
+			{
+				if (!filter.addExpression(argv[argCounter]))
+				{
+					std::cerr << "Invalid filter expression " << argv[argCounter] << std::endl;
+					return 1;
+				}
+			}
+			else if (strcmp(arg, "--capture") == 0)
+				captureFile = argv[argCounter];
+			else if (strcmp(arg, "--capture-size") == 0)
+				captureSize = atoi(argv[argCounter]);
+			else
+				decodeFile = argv[argCounter];
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			dumpHelp(std::cout, argv[0]);
@@ -139,12 +242,25 @@ int main(int argc, char *argv[])
 		argCounter++;
 	}
 	
+	if (decodeFile)
+	{
+		Aseba::CaptureRing capture;
+		if (!capture.open(decodeFile))
+			return 2;
+		Aseba::decodeCapture(capture, rawTime, filter);
+		return 0;
+	}
+	
 	if (targets.empty())
 		targets.push_back(ASEBA_DEFAULT_TARGET);
 	
+	Aseba::CaptureRing capture;
+	if (captureFile && !capture.create(captureFile, uint64(captureSize) * 1024 * 1024))
+		return 2;
+	
 	try
 	{
-		Aseba::Dump dump(rawTime);
+		Aseba::Dump dump(rawTime, filter, captureFile ? &capture : 0);
 		for (size_t i = 0; i < targets.size(); i++)
 			dump.connect(targets[i]);
 		dump.run();
@@ -0,0 +1,189 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include "recording.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup recording */
+	/*@{*/
+
+	//! Write the user messages of a binary recording in the text format of asebarec, return the number of skipped messages
+	unsigned binaryToText(RecordingReader& reader, ostream& out)
+	{
+		unsigned skipped(0);
+		RecordedMessage message;
+		while (reader.read(message))
+		{
+			if (!message.isUserMessage())
+			{
+				++skipped;
+				continue;
+			}
+			const size_t count(message.payload.size() / 2);
+			out << UnifiedTime(message.timeStamp).toRawTimeString() << " ";
+			out << message.source << " ";
+			out << message.type << " ";
+			out << count << " ";
+			for (size_t i = 0; i < count; ++i)
+				out << sint16(message.payload[2*i] | (message.payload[2*i+1] << 8)) << " ";
+			out << "\n";
+		}
+		return skipped;
+	}
+
+	//! Read lines in the text format of asebarec and write them to a binary recording, return the number of invalid lines
+	unsigned textToBinary(istream& in, RecordingWriter& writer)
+	{
+		unsigned invalid(0);
+		string line;
+		while (getline(in, line))
+		{
+			istringstream iss(line);
+			string timeStamp;
+			unsigned source, type, count;
+			if (!(iss >> timeStamp >> source >> type >> count) || (timeStamp.find('.') == string::npos))
+			{
+				if (!line.empty())
+					++invalid;
+				continue;
+			}
+			RecordedMessage message;
+			message.timeStamp = UnifiedTime::fromRawTimeString(timeStamp).value;
+			message.source = source;
+			message.type = type;
+			message.payload.reserve(count * 2);
+			int value;
+			while (iss >> value)
+			{
+				message.payload.push_back(uint8(value));
+				message.payload.push_back(uint8(value >> 8));
+			}
+			writer.write(message);
+		}
+		return invalid;
+	}
+
+	/*@}*/
+}
+
+
+//! Show usage
+void dumpHelp(std::ostream &stream, const char *programName)
+{
+	stream << "Aseba rec convert, convert recordings between the text and binary formats, usage:\n";
+	stream << programName << " [options] INPUT_FILE OUTPUT_FILE\n";
+	stream << "If INPUT_FILE is a binary recording, its user messages are written as text to\n";
+	stream << "OUTPUT_FILE (- for stdout), other messages are skipped. Otherwise INPUT_FILE\n";
+	stream << "(- for stdin) is read as text and written as a binary recording to OUTPUT_FILE.\n";
+	stream << "Options:\n";
+	stream << "-h, --help      : shows this help\n";
+	stream << "-V, --version   : shows the version number\n";
+	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+}
+
+//! Show version
+void dumpVersion(std::ostream &stream)
+{
+	stream << "Aseba rec convert " << ASEBA_VERSION << std::endl;
+	stream << "Aseba protocol " << ASEBA_PROTOCOL_VERSION << std::endl;
+	stream << "Licence LGPLv3: GNU LGPL version 3 <http://www.gnu.org/licenses/lgpl.html>\n";
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> files;
+
+	for (int argCounter = 1; argCounter < argc; argCounter++)
+	{
+		const char *arg = argv[argCounter];
+
+		if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
+		{
+			dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if ((strcmp(arg, "-V") == 0) || (strcmp(arg, "--version") == 0))
+		{
+			dumpVersion(std::cout);
+			return 0;
+		}
+		else
+			files.push_back(arg);
+	}
+
+	if (files.size() != 2)
+	{
+		dumpHelp(std::cerr, argv[0]);
+		return 1;
+	}
+	const std::string& inputFile(files[0]);
+	const std::string& outputFile(files[1]);
+
+	if (inputFile != "-" && Aseba::RecordingReader::isRecording(inputFile))
+	{
+		Aseba::RecordingReader reader;
+		if (!reader.open(inputFile))
+			return 2;
+		std::ofstream file;
+		if (outputFile != "-")
+		{
+			file.open(outputFile.c_str());
+			if (!file.good())
+			{
+				std::cerr << "Cannot open " << outputFile << " for writing" << std::endl;
+				return 2;
+			}
+		}
+		const unsigned skipped(Aseba::binaryToText(reader, outputFile != "-" ? file : std::cout));
+		if (skipped)
+			std::cerr << skipped << " messages skipped as they are not user messages" << std::endl;
+	}
+	else
+	{
+		std::ifstream file;
+		if (inputFile != "-")
+		{
+			file.open(inputFile.c_str());
+			if (!file.good())
+			{
+				std::cerr << "Cannot open " << inputFile << " for reading" << std::endl;
+				return 2;
+			}
+		}
+		Aseba::RecordingWriter writer;
+		if (!writer.open(outputFile))
+			return 2;
+		const unsigned invalid(Aseba::textToBinary(inputFile != "-" ? file : std::cin, writer));
+		writer.close();
+		if (invalid)
+			std::cerr << invalid << " invalid lines skipped" << std::endl;
+	}
+
+	return 0;
+}
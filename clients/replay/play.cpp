@@ -22,12 +22,18 @@
 #include "../../common/consts.h"
 #include "../../common/msg/msg.h"
 #include "../../common/utils/utils.h"
+#include "../../common/msg/endian.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
+#include "recording.h"
 #include <time.h>
 #include <iostream>
 #include <cstring>
 #include <string>
-#include <deque>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 
 namespace Aseba
 {
@@ -39,25 +45,150 @@ namespace Aseba
 	*/
 	/*@{*/
 	
+	//! Which messages to send to a destination, an empty set means all
+	struct MessageFilter
+	{
+		set<uint16> sources;
+		set<uint16> types;
+		
+		bool accepts(const RecordedMessage& message) const
+		{
+			return (sources.empty() || sources.count(message.source)) && (types.empty() || types.count(message.type));
+		}
+	};
+	
+	//! Common part of message players.
+	//! Messages are sent at deadlines computed from the start of the replay, so that sleeping errors do not accumulate.
+	//! Writes are flushed only before sleeping, or every burstSize messages in burst mode.
+	class PlayerBase : public Hub
+	{
+	protected:
+		typedef map<Stream*, MessageFilter> FiltersMap;
+		
+		bool respectTimings;
+		double speedFactor;
+		unsigned burstSize; //!< if non-zero, do not respect timings and flush every burstSize messages
+		FiltersMap filters; //!< filters of destinations, other streams receive all messages
+		set<Stream*> pendingFlush; //!< streams written to since last flush
+		unsigned pendingCount; //!< messages sent since last flush
+		
+		long long unsigned startTime; //!< monotonic time at which the first message was sent, in us
+		UnifiedTime::Value startTimeStamp; //!< time stamp of the first message
+		unsigned messagesCount; //!< number of messages sent so far
+		long long unsigned totalLateness; //!< sum of the delays after deadline of sent messages, in us
+		long long unsigned maxLateness; //!< maximum delay after deadline, in us
+		
+	public:
+		PlayerBase(bool respectTimings, double speedFactor, unsigned burstSize) :
+			respectTimings(respectTimings && !burstSize),
+			speedFactor(speedFactor),
+			burstSize(burstSize),
+			pendingCount(0),
+			startTime(0),
+			startTimeStamp(0),
+			messagesCount(0),
+			totalLateness(0),
+			maxLateness(0)
+		{}
+		
+		//! Connect to target and only send it messages accepted by filter
+		void connectDestination(const string& target, const MessageFilter& filter)
+		{
+			Stream* stream(connect(target));
+			filters[stream] = filter;
+		}
+		
+		//! Write statistics about the replay and the achieved timing accuracy
+		void dumpReport(ostream& stream) const
+		{
+			if (!messagesCount)
+				return;
+			const double duration(double(monotonicMicroseconds() - startTime) / 1000000.);
+			stream << messagesCount << " messages replayed in " << duration << " s";
+			if (duration > 0)
+				stream << " (" << unsigned(messagesCount / duration) << " messages/s)";
+			stream << endl;
+			if (respectTimings)
+				stream << "timing error: mean " << double(totalLateness) / (1000. * messagesCount) << " ms, max " << double(maxLateness) / 1000. << " ms" << endl;
+		}
+		
+	protected:
+		//! Wait until the deadline of a message with timeStamp, flushing pending writes before sleeping
+		void waitFor(UnifiedTime::Value timeStamp)
+		{
+			if (messagesCount == 0)
+			{
+				startTime = monotonicMicroseconds();
+				startTimeStamp = timeStamp;
+			}
+			if (!respectTimings)
+				return;
+			
+			// time stamps of recordings are not guaranteed to be monotonic
+			const long long unsigned offset(timeStamp > startTimeStamp ? timeStamp - startTimeStamp : 0);
+			const long long unsigned deadline(startTime + (long long unsigned)(double(offset) * 1000. / speedFactor));
+			long long unsigned now(monotonicMicroseconds());
+			if (now < deadline)
+			{
+				flushAll();
+				// sleep leaving a margin for the scheduler, then spin until the deadline
+				now = monotonicMicroseconds();
+				if (deadline > now + 2000)
+					UnifiedTime((deadline - now - 2000) / 1000).sleep();
+				while ((now = monotonicMicroseconds()) < deadline);
+			}
+			const long long unsigned lateness(now - deadline);
+			totalLateness += lateness;
+			maxLateness = max(maxLateness, lateness);
+		}
+		
+		//! Write message to all destinations accepting it, flushing in burst mode when enough messages are pending
+		void send(const RecordedMessage& message, Stream* exclude = 0)
+		{
+			for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
+			{
+				Stream* destStream(*it);
+				if (destStream == exclude)
+					continue;
+				FiltersMap::const_iterator filterIt(filters.find(destStream));
+				if (filterIt != filters.end() && !filterIt->second.accepts(message))
+					continue;
+				message.serialize(destStream);
+				pendingFlush.insert(destStream);
+			}
+			++messagesCount;
+			++pendingCount;
+			if (burstSize && pendingCount >= burstSize)
+				flushAll();
+		}
+		
+		//! Flush all streams written to since last flush
+		void flushAll()
+		{
+			for (set<Stream*>::iterator it = pendingFlush.begin(); it != pendingFlush.end(); ++it)
+				(*it)->flush();
+			pendingFlush.clear();
+			pendingCount = 0;
+		}
+		
+		void connectionClosed(Stream *stream, bool abnormal)
+		{
+			filters.erase(stream);
+			pendingFlush.erase(stream);
+		}
+	};
+	
 	//! A message player
 	//! This class replay saved user messages
-	class Player : public Hub
+	class Player : public PlayerBase
 	{
 	private:
-		typedef deque<string> StringList;
-		
-		bool respectTimings;
-		int speedFactor;
 		Stream* in;
 		string line;
-		UnifiedTime lastTimeStamp;
-		UnifiedTime lastEventTime;
 	
 	public:
-		Player(const char* inputFile, bool respectTimings, int speedFactor) :
-			respectTimings(respectTimings),
-			speedFactor(speedFactor),
-			lastTimeStamp(0)
+		Player(const char* inputFile, bool respectTimings, double speedFactor, unsigned burstSize) :
+			PlayerBase(respectTimings, speedFactor, burstSize)
 		{
 			if (inputFile)
 				in = connect("file:" + string(inputFile) + ";mode=read");
@@ -65,79 +196,44 @@ namespace Aseba
 				in = connect("stdin:");
 		}
 		
-		StringList tokenize(const string& input)
-		{
-			StringList list;
-			const size_t inputSize(input.size());
-			
-			size_t pos(0);
-			while ((pos != string::npos) && (pos < inputSize))
-			{
-				const size_t next = input.find(' ', pos);
-				string word;
-				if (next != string::npos)
-					word = input.substr(pos, next-pos);
-				else
-					word = input.substr(pos);
-				if (!word.empty())
-					list.push_back(word);
-				pos = next + 1;
-			}
-			
-			return list;
-		}
-		
 		void sendLine()
 		{
-			// parse line and build user message
-			UserMessage userMessage;
-			
-			StringList tokenizedLine(tokenize(line));
-			
-			UnifiedTime timeStamp(UnifiedTime::fromRawTimeString(tokenizedLine.front()));
-			tokenizedLine.pop_front();
+			// parse line and build user message, fields are separated by spaces
+			RecordedMessage message;
+			const char* pos(line.c_str());
+			char* end;
 			
-			userMessage.source = atoi(tokenizedLine.front().c_str());
-			tokenizedLine.pop_front();
-			
-			userMessage.type = atoi(tokenizedLine.front().c_str());
-			tokenizedLine.pop_front();
-			
-			userMessage.data.reserve(size_t(atoi(tokenizedLine.front().c_str())));
-			tokenizedLine.pop_front();
-			
-			while (!tokenizedLine.empty())
+			message.timeStamp = UnifiedTime::Value(strtoul(pos, &end, 10)) * 1000;
+			if (*end == '.')
 			{
-				userMessage.data.push_back(atoi(tokenizedLine.front().c_str()));
-				tokenizedLine.pop_front();
+				pos = end + 1;
+				message.timeStamp += strtoul(pos, &end, 10);
 			}
+			pos = end;
 			
-			// if required, sleep
-			if ((respectTimings) && (lastTimeStamp.value != 0))
-			{
-				const UnifiedTime lostTime(UnifiedTime() - lastEventTime);
-				const UnifiedTime deltaTimeStamp(timeStamp - lastTimeStamp);
-				if (lostTime < deltaTimeStamp)
-				{
-					UnifiedTime waitTime(deltaTimeStamp - lostTime);
-					waitTime /= speedFactor;
-					waitTime.sleep();
-				}
-			}
+			message.source = strtol(pos, &end, 10);
+			pos = end;
+			message.type = strtol(pos, &end, 10);
+			pos = end;
+			message.payload.reserve(2 * strtol(pos, &end, 10));
+			pos = end;
 			
-			// write message on all connected streams
-			for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
+			while (true)
 			{
-				Stream* destStream(*it);
-				if (destStream != in)
-				{
-					userMessage.serialize(destStream);
-					destStream->flush();
-				}
+				const long value(strtol(pos, &end, 10));
+				if (end == pos)
+					break;
+				message.payload.push_back(uint8(value));
+				message.payload.push_back(uint8(value >> 8));
+				pos = end;
 			}
 			
-			lastEventTime = UnifiedTime();
-			lastTimeStamp = timeStamp;
+			// wait until it is time to send it, and send it to all connected streams
+			waitFor(message.timeStamp);
+			send(message, in);
+			// the next line might arrive late, so do not keep it pending
+			if (!burstSize)
+				flushAll();
 			
 			line.clear();
 		}
@@ -163,8 +259,56 @@ namespace Aseba
 		
 		void connectionClosed(Stream *stream, bool abnormal)
 		{
+			PlayerBase::connectionClosed(stream, abnormal);
 			if (stream == in)
+			{
+				flushAll();
 				stop();
+			}
+		}
+	};
+	
+	//! A message player for binary recordings
+	//! This class replays all recorded messages, possibly starting later in the recording
+	class RecordingPlayer : public PlayerBase
+	{
+	private:
+		RecordingReader& reader;
+		
+	public:
+		RecordingPlayer(RecordingReader& reader, bool respectTimings, double speedFactor, unsigned burstSize) :
+			PlayerBase(respectTimings, speedFactor, burstSize),
+			reader(reader)
+		{}
+		
+		//! Replay messages until the end of the recording or until stopped
+		void play()
+		{
+			RecordedMessage message;
+			while (reader.read(message))
+			{
+				waitFor(message.timeStamp);
+				send(message);
+				// without pacing, each message is flushed as soon as written
+				if (!respectTimings && !burstSize)
+					flushAll();
+				
+				// process incoming data and connections
+				if (!step(0))
+					break;
+			}
+			flushAll();
+		}
+		
+	protected:
+		void incomingData(Stream *stream)
+		{
+			// discard messages sent by targets
+			uint16 len;
+			stream->read(&len, 2);
+			swapEndian(len);
+			std::vector<uint8> discarded(len + 4);
+			stream->read(&discarded[0], discarded.size());
 		}
 	};
 	
@@ -176,15 +320,23 @@ namespace Aseba
 void dumpHelp(std::ostream &stream, const char *programName)
 {
 	stream << "Aseba play, play recorded user messages from a file or stdin, usage:\n";
-	stream << programName << " [options] [targets]*\n";
+	stream << programName << " [options] [[filters] target]*\n";
 	stream << "Options:\n";
 	stream << "--fast          : replay messages twice the speed of real time\n";
 	stream << "--faster        : replay messages four times the speed of real time\n";
+	stream << "--speed FACTOR  : replay messages FACTOR times the speed of real time, can be fractional\n";
 	stream << "--fastest       : replay messages as fast as possible\n";
-	stream << "-f INPUT_FILE   : open INPUT_FILE instead of stdin\n";
+	stream << "--burst [SIZE]  : replay messages as fast as possible, flushing every SIZE messages (default: 256)\n";
+	stream << "-f INPUT_FILE   : open INPUT_FILE instead of stdin, it can be a text or a binary recording\n";
+	stream << "-s SECONDS      : for binary recordings, start SECONDS after the beginning\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
+	stream << "Filters apply to the targets following them:\n";
+	stream << "--nodes ID,...  : only send messages from these nodes\n";
+	stream << "--types TYPE,...: only send messages of these types\n";
+	stream << "--all           : send all messages\n";
 	stream << "Targets are any valid Dashel targets." << std::endl;
+	stream << "At the end, the achieved timing error is written to stderr." << std::endl;
 	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
 }
 
@@ -196,13 +348,26 @@ void dumpVersion(std::ostream &stream)
 	stream << "Licence LGPLv3: GNU LGPL version 3 <http://www.gnu.org/licenses/lgpl.html>\n";
 }
 
+//! Parse a comma-separated list of numbers
+std::set<uint16> parseNumbersList(const std::string& list)
+{
+	std::set<uint16> numbers;
+	const std::vector<std::string> items(Aseba::split<std::string>(list, ","));
+	for (size_t i = 0; i < items.size(); ++i)
+		numbers.insert(atoi(items[i].c_str()));
+	return numbers;
+}
+
 int main(int argc, char *argv[])
 {
 	Dashel::initPlugins();
 	bool respectTimings = true;
-	int speedFactor = 1;
-	std::vector<std::string> targets;
+	double speedFactor = 1;
+	unsigned burstSize = 0;
+	std::vector<std::pair<std::string, Aseba::MessageFilter> > targets;
+	Aseba::MessageFilter filter;
 	const char* inputFile = 0;
+	double startOffset = 0;
 	
 	int argCounter = 1;
 	
@@ -222,6 +387,12 @@ int main(int argc, char *argv[])
 		{
 			speedFactor = 4;
 		}
+		else if (strcmp(arg, "--burst") == 0)
+		{
+			burstSize = 256;
+			if ((argCounter + 1 < argc) && isdigit(argv[argCounter + 1][0]))
+				burstSize = std::max(1, atoi(argv[++argCounter]));
+		}
 		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
 		{
 			dumpHelp(std::cout, argv[0]);
@@ -232,7 +403,11 @@ int main(int argc, char *argv[])
 			dumpVersion(std::cout);
 			return 0;
 		}
-		else if (strcmp(arg, "-f") == 0)
+		else if (strcmp(arg, "--all") == 0)
+		{
+			filter = Aseba::MessageFilter();
+		}
+		else if ((strcmp(arg, "-f") == 0) || (strcmp(arg, "-s") == 0) || (strcmp(arg, "--speed") == 0) || (strcmp(arg, "--nodes") == 0) || (strcmp(arg, "--types") == 0))
 		{
 			argCounter++;
 			if (argCounter >= argc)
@@ -240,25 +415,62 @@ int main(int argc, char *argv[])
 				dumpHelp(std::cout, argv[0]);
 				return 1;
 			}
-			else
+			else if (strcmp(arg, "-f") == 0)
 				inputFile = argv[argCounter];
+			else if (strcmp(arg, "-s") == 0)
+				startOffset = atof(argv[argCounter]);
+			else if (strcmp(arg, "--speed") == 0)
+				speedFactor = atof(argv[argCounter]);
+			else if (strcmp(arg, "--nodes") == 0)
+				filter.sources = parseNumbersList(argv[argCounter]);
+			else
+				filter.types = parseNumbersList(argv[argCounter]);
 		}
 		else
 		{
-			targets.push_back(argv[argCounter]);
+			targets.push_back(std::make_pair(std::string(argv[argCounter]), filter));
 		}
 		argCounter++;
 	}
 	
+	if (speedFactor <= 0)
+	{
+		std::cerr << "Speed factor must be positive" << std::endl;
+		return 1;
+	}
 	if (targets.empty())
-		targets.push_back(ASEBA_DEFAULT_TARGET);
+		targets.push_back(std::make_pair(std::string(ASEBA_DEFAULT_TARGET), filter));
+	
+	// binary recordings are read directly, without going through a Dashel stream
+	if (inputFile && Aseba::RecordingReader::isRecording(inputFile))
+	{
+		Aseba::RecordingReader reader;
+		if (!reader.open(inputFile))
+			return 2;
+		if (!reader.seek(reader.startTime() + Aseba::UnifiedTime::Value(startOffset * 1000)))
+			return 2;
+		try
+		{
+			Aseba::RecordingPlayer player(reader, respectTimings, speedFactor, burstSize);
+			for (size_t i = 0; i < targets.size(); i++)
+				player.connectDestination(targets[i].first, targets[i].second);
+			player.play();
+			player.dumpReport(std::cerr);
+		}
+		catch(Dashel::DashelException e)
+		{
+			std::cerr << e.what() << std::endl;
+		}
+		return 0;
+	}
 	
 	try
 	{
-		Aseba::Player player(inputFile, respectTimings, speedFactor);
+		Aseba::Player player(inputFile, respectTimings, speedFactor, burstSize);
 		for (size_t i = 0; i < targets.size(); i++)
-			player.connect(targets[i]);
+			player.connectDestination(targets[i].first, targets[i].second);
 		player.run();
+		player.dumpReport(std::cerr);
 	}
 	catch(Dashel::DashelException e)
 	{
@@ -22,8 +22,11 @@
 #include "../../common/consts.h"
 #include "../../common/msg/msg.h"
 #include "../../common/utils/utils.h"
+#include "../../common/msg/endian.h"
 #include "../../transport/dashel_plugins/dashel-plugins.h"
+#include "recording.h"
 #include <time.h>
+#include <signal.h>
 #include <iostream>
 #include <cstring>
 
@@ -38,13 +41,43 @@ namespace Aseba
 	/*@{*/
 	
 	//! A message recorder.
-	//! This class saves user messages
+	//! This class saves user messages as text to stdout, or all messages to a binary recording if a writer is given
 	class Recorder : public Hub
 	{
+	public:
+		Recorder(RecordingWriter* writer = 0) : writer(writer) {}
+		
+		//! Write buffered messages to the file if they are older than maxDelay ms, so that little is lost if the recorder is killed
+		void flushIfOlderThan(UnifiedTime::Value maxDelay)
+		{
+			if (writer && writer->pendingSince() && (UnifiedTime().value - writer->pendingSince() > maxDelay))
+				writer->flush();
+		}
+		
 	protected:
+		RecordingWriter* writer;
 		
 		void incomingData(Stream *stream)
 		{
+			if (writer)
+			{
+				// keep the packet as it is on the wire, without parsing it
+				RecordedMessage message;
+				message.timeStamp = UnifiedTime().value;
+				uint16 len;
+				stream->read(&len, 2);
+				swapEndian(len);
+				stream->read(&message.source, 2);
+				swapEndian(message.source);
+				stream->read(&message.type, 2);
+				swapEndian(message.type);
+				message.payload.resize(len);
+				if (len)
+					stream->read(&message.payload[0], len);
+				writer->write(message);
+				return;
+			}
+			
 			Message *message = Message::receive(stream);
 			UserMessage *userMessage = dynamic_cast<UserMessage *>(message);
 			if (userMessage)
@@ -64,12 +97,22 @@ namespace Aseba
 }
 
 
+//! Set when the user asks the recorder to stop, so that it closes the recording cleanly
+static volatile sig_atomic_t interrupted = 0;
+
+//! Handle SIGINT and SIGTERM by requesting the recording loop to end
+static void interrupt(int)
+{
+	interrupted = 1;
+}
+
 //! Show usage
 void dumpHelp(std::ostream &stream, const char *programName)
 {
 	stream << "Aseba rec, record the user messages to stdout for later replay, usage:\n";
 	stream << programName << " [options] [targets]*\n";
 	stream << "Options:\n";
+	stream << "-o OUTPUT_FILE  : record all messages to OUTPUT_FILE in binary format instead\n";
 	stream << "-h, --help      : shows this help\n";
 	stream << "-V, --version   : shows the version number\n";
 	stream << "Targets are any valid Dashel targets." << std::endl;
@@ -88,6 +131,7 @@ int main(int argc, char *argv[])
 {
 	Dashel::initPlugins();
 	std::vector<std::string> targets;
+	const char* outputFile = 0;
 	
 	int argCounter = 1;
 	
@@ -105,6 +149,17 @@ int main(int argc, char *argv[])
 			dumpVersion(std::cout);
 			return 0;
 		}
+		else if (strcmp(arg, "-o") == 0)
+		{
+			argCounter++;
+			if (argCounter >= argc)
+			{
+				dumpHelp(std::cout, argv[0]);
+				return 1;
+			}
+			else
+				outputFile = argv[argCounter];
+		}
 		else
 		{
 			targets.push_back(argv[argCounter]);
@@ -115,17 +170,29 @@ int main(int argc, char *argv[])
 	if (targets.empty())
 		targets.push_back(ASEBA_DEFAULT_TARGET);
 	
+	Aseba::RecordingWriter writer;
+	if (outputFile && !writer.open(outputFile))
+		return 2;
+	
+	signal(SIGINT, interrupt);
+	signal(SIGTERM, interrupt);
+	
 	try
 	{
-		Aseba::Recorder recorder;
+		Aseba::Recorder recorder(outputFile ? &writer : 0);
 		for (size_t i = 0; i < targets.size(); i++)
 			recorder.connect(targets[i]);
-		recorder.run();
+		// step until interrupted, then close the writer to write the remaining messages and the index
+		while (!interrupted && recorder.step(100))
+			recorder.flushIfOlderThan(1000);
 	}
 	catch(Dashel::DashelException e)
 	{
-		std::cerr << e.what() << std::endl;
+		// a signal interrupts the poll of the hub, which is not an error
+		if (!interrupted)
+			std::cerr << e.what() << std::endl;
 	}
+	writer.close();
 	
 	return 0;
 }
@@ -0,0 +1,418 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "recording.h"
+#include <dashel/dashel.h>
+#include <iostream>
+#include <cstring>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif // HAVE_ZLIB
+
+namespace Aseba
+{
+	using namespace std;
+
+	/** \addtogroup recording */
+	/*@{*/
+
+	static const char fileMagic[4] = { 'A', 'R', 'E', 'C' };
+	static const char indexMagic[4] = { 'A', 'I', 'D', 'X' };
+	static const uint16 fileVersion = 1;
+	static const size_t fileHeaderSize = 6;
+	//! codec (1), raw size (4), stored size (4), time stamp (8), message count (4)
+	static const size_t blockHeaderSize = 21;
+	static const size_t indexEntrySize = 16;
+	//! Blocks are written once their content reaches that size
+	static const size_t maxBlockSize = 65536;
+
+	enum BlockCodec
+	{
+		CODEC_STORED = 0,
+		CODEC_ZLIB = 1
+	};
+
+	template<typename T>
+	static void append(vector<uint8>& buffer, T value, size_t size = sizeof(T))
+	{
+		for (size_t i = 0; i < size; ++i)
+			buffer.push_back(uint8(uint64(value) >> (8 * i)));
+	}
+
+	template<typename T>
+	static T extract(const uint8* data, size_t size = sizeof(T))
+	{
+		uint64 value(0);
+		for (size_t i = 0; i < size; ++i)
+			value |= uint64(data[i]) << (8 * i);
+		return T(value);
+	}
+
+	static void appendVarInt(vector<uint8>& buffer, uint64 value)
+	{
+		while (value >= 0x80)
+		{
+			buffer.push_back(uint8(value) | 0x80);
+			value >>= 7;
+		}
+		buffer.push_back(uint8(value));
+	}
+
+	//! Read a variable-length integer at pos in buffer, return false if it goes past the end
+	static bool extractVarInt(const vector<uint8>& buffer, size_t& pos, uint64& value)
+	{
+		value = 0;
+		for (unsigned shift = 0; pos < buffer.size() && shift < 64; shift += 7)
+		{
+			const uint8 byte(buffer[pos++]);
+			value |= uint64(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	void RecordedMessage::serialize(Dashel::Stream* stream) const
+	{
+		vector<uint8> packet;
+		packet.reserve(6 + payload.size());
+		append<uint16>(packet, payload.size());
+		append<uint16>(packet, source);
+		append<uint16>(packet, type);
+		packet.insert(packet.end(), payload.begin(), payload.end());
+		stream->write(&packet[0], packet.size());
+	}
+
+	RecordingWriter::RecordingWriter():
+		blockMessageCount(0),
+		blockTimeStamp(0),
+		lastTimeStamp(0)
+	{}
+
+	RecordingWriter::~RecordingWriter()
+	{
+		close();
+	}
+
+	//! Create fileName and write the header, return false on error
+	bool RecordingWriter::open(const string& fileName)
+	{
+		file.open(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+		if (!file.good())
+		{
+			cerr << "Cannot open recording file " << fileName << " for writing" << endl;
+			return false;
+		}
+		vector<uint8> header(fileMagic, fileMagic + 4);
+		append<uint16>(header, fileVersion);
+		file.write((const char*)&header[0], header.size());
+		index.clear();
+		return file.good();
+	}
+
+	//! Add a message to the current block, writing the block to the file once it is full
+	void RecordingWriter::write(const RecordedMessage& message)
+	{
+		if (blockMessageCount == 0)
+		{
+			blockTimeStamp = message.timeStamp;
+			lastTimeStamp = message.timeStamp;
+		}
+		// time stamps should be monotonic, but do not trust the system clock
+		appendVarInt(block, message.timeStamp >= lastTimeStamp ? message.timeStamp - lastTimeStamp : 0);
+		lastTimeStamp = max(lastTimeStamp, message.timeStamp);
+		append<uint16>(block, message.payload.size());
+		append<uint16>(block, message.source);
+		append<uint16>(block, message.type);
+		block.insert(block.end(), message.payload.begin(), message.payload.end());
+		++blockMessageCount;
+
+		if (block.size() >= maxBlockSize)
+			flush();
+	}
+
+	//! Compress the current block if possible and write it to the file
+	void RecordingWriter::flush()
+	{
+		if (!file.is_open() || blockMessageCount == 0)
+			return;
+
+		uint8 codec(CODEC_STORED);
+		const vector<uint8>* stored(&block);
+		#ifdef HAVE_ZLIB
+		vector<uint8> compressed(compressBound(block.size()));
+		uLongf compressedSize(compressed.size());
+		if (compress2(&compressed[0], &compressedSize, &block[0], block.size(), Z_BEST_SPEED) == Z_OK && compressedSize < block.size())
+		{
+			compressed.resize(compressedSize);
+			codec = CODEC_ZLIB;
+			stored = &compressed;
+		}
+		#endif // HAVE_ZLIB
+
+		index.push_back(RecordingIndexEntry(blockTimeStamp, uint64(file.tellp())));
+		vector<uint8> header;
+		append<uint8>(header, codec);
+		append<uint32>(header, block.size(), 4);
+		append<uint32>(header, stored->size(), 4);
+		append<uint64>(header, blockTimeStamp, 8);
+		append<uint32>(header, blockMessageCount, 4);
+		file.write((const char*)&header[0], header.size());
+		file.write((const char*)&(*stored)[0], stored->size());
+		file.flush();
+
+		block.clear();
+		blockMessageCount = 0;
+	}
+
+	//! Write the pending block and the index, and close the file
+	void RecordingWriter::close()
+	{
+		if (!file.is_open())
+			return;
+		flush();
+		vector<uint8> trailer;
+		for (size_t i = 0; i < index.size(); ++i)
+		{
+			append<uint64>(trailer, index[i].timeStamp, 8);
+			append<uint64>(trailer, index[i].offset, 8);
+		}
+		append<uint32>(trailer, index.size(), 4);
+		trailer.insert(trailer.end(), indexMagic, indexMagic + 4);
+		file.write((const char*)&trailer[0], trailer.size());
+		file.close();
+	}
+
+	RecordingReader::RecordingReader():
+		nextBlock(0),
+		blockPos(0),
+		blockMessagesLeft(0),
+		lastTimeStamp(0)
+	{}
+
+	//! Return whether fileName starts like a binary recording
+	bool RecordingReader::isRecording(const string& fileName)
+	{
+		ifstream file(fileName.c_str(), ios::in | ios::binary);
+		char magic[4];
+		file.read(magic, 4);
+		return file.good() && memcmp(magic, fileMagic, 4) == 0;
+	}
+
+	//! Open fileName and load its index, return false on error
+	bool RecordingReader::open(const string& fileName)
+	{
+		file.open(fileName.c_str(), ios::in | ios::binary);
+		uint8 header[fileHeaderSize];
+		file.read((char*)header, fileHeaderSize);
+		if (!file.good() || memcmp(header, fileMagic, 4) != 0)
+		{
+			cerr << "File " << fileName << " is not an Aseba recording" << endl;
+			return false;
+		}
+		if (extract<uint16>(header + 4) != fileVersion)
+		{
+			cerr << "Recording " << fileName << " has unsupported version " << extract<uint16>(header + 4) << endl;
+			return false;
+		}
+		if (!readIndex() && !rebuildIndex())
+		{
+			cerr << "Recording " << fileName << " is corrupted" << endl;
+			return false;
+		}
+		nextBlock = 0;
+		blockMessagesLeft = 0;
+		return true;
+	}
+
+	//! Read the index at the end of the file, return false if there is none
+	bool RecordingReader::readIndex()
+	{
+		file.clear();
+		file.seekg(0, ios::end);
+		const uint64 fileSize(file.tellg());
+		if (fileSize < fileHeaderSize + 8)
+			return false;
+		uint8 trailer[8];
+		file.seekg(fileSize - 8);
+		file.read((char*)trailer, 8);
+		if (!file.good() || memcmp(trailer + 4, indexMagic, 4) != 0)
+			return false;
+		const uint32 count(extract<uint32>(trailer, 4));
+		if (fileSize < fileHeaderSize + 8 + uint64(count) * indexEntrySize)
+			return false;
+
+		vector<uint8> entries(count * indexEntrySize);
+		file.seekg(fileSize - 8 - entries.size());
+		if (count)
+			file.read((char*)&entries[0], entries.size());
+		if (!file.good())
+			return false;
+		index.clear();
+		index.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const uint8* entry(&entries[i * indexEntrySize]);
+			index.push_back(RecordingIndexEntry(extract<uint64>(entry, 8), extract<uint64>(entry + 8, 8)));
+		}
+		return true;
+	}
+
+	//! Walk through all block headers to build the index of an unterminated file; keep complete blocks only
+	bool RecordingReader::rebuildIndex()
+	{
+		index.clear();
+		file.clear();
+		file.seekg(0, ios::end);
+		const uint64 fileSize(file.tellg());
+		uint64 offset(fileHeaderSize);
+		while (offset + blockHeaderSize <= fileSize)
+		{
+			uint8 header[blockHeaderSize];
+			file.seekg(offset);
+			file.read((char*)header, blockHeaderSize);
+			if (!file.good() || header[0] > CODEC_ZLIB)
+				break;
+			const uint32 storedSize(extract<uint32>(header + 5, 4));
+			if (offset + blockHeaderSize + storedSize > fileSize)
+				break;
+			index.push_back(RecordingIndexEntry(extract<uint64>(header + 9, 8), offset));
+			offset += blockHeaderSize + storedSize;
+		}
+		file.clear();
+		return !index.empty() || fileSize == fileHeaderSize;
+	}
+
+	//! Read and decompress a block, return false on error
+	bool RecordingReader::loadBlock(size_t blockIndex)
+	{
+		uint8 header[blockHeaderSize];
+		file.clear();
+		file.seekg(index[blockIndex].offset);
+		file.read((char*)header, blockHeaderSize);
+		if (!file.good())
+			return false;
+		const uint8 codec(header[0]);
+		const uint32 rawSize(extract<uint32>(header + 1, 4));
+		const uint32 storedSize(extract<uint32>(header + 5, 4));
+		vector<uint8> stored(storedSize);
+		if (storedSize)
+			file.read((char*)&stored[0], storedSize);
+		if (!file.good())
+			return false;
+
+		if (codec == CODEC_STORED)
+		{
+			if (storedSize != rawSize)
+				return false;
+			block.swap(stored);
+		}
+		else if (codec == CODEC_ZLIB)
+		{
+			#ifdef HAVE_ZLIB
+			block.resize(rawSize);
+			uLongf size(rawSize);
+			if (uncompress(&block[0], &size, &stored[0], storedSize) != Z_OK || size != rawSize)
+				return false;
+			#else // HAVE_ZLIB
+			cerr << "Recording is compressed but zlib support is not available" << endl;
+			return false;
+			#endif // HAVE_ZLIB
+		}
+		else
+			return false;
+
+		blockPos = 0;
+		blockMessagesLeft = extract<uint32>(header + 17, 4);
+		lastTimeStamp = extract<uint64>(header + 9, 8);
+		nextBlock = blockIndex + 1;
+		return true;
+	}
+
+	//! Read the next message, return false at the end of the recording or on error
+	bool RecordingReader::read(RecordedMessage& message)
+	{
+		while (blockMessagesLeft == 0)
+		{
+			if (nextBlock >= index.size())
+				return false;
+			if (!loadBlock(nextBlock))
+			{
+				cerr << "Recording is corrupted in block " << nextBlock << endl;
+				return false;
+			}
+		}
+
+		uint64 delta;
+		if (!extractVarInt(block, blockPos, delta) || blockPos + 6 > block.size())
+			return false;
+		const uint16 length(extract<uint16>(&block[blockPos]));
+		message.timeStamp = lastTimeStamp + delta;
+		message.source = extract<uint16>(&block[blockPos + 2]);
+		message.type = extract<uint16>(&block[blockPos + 4]);
+		blockPos += 6;
+		if (blockPos + length > block.size())
+			return false;
+		message.payload.assign(block.begin() + blockPos, block.begin() + blockPos + length);
+		blockPos += length;
+		lastTimeStamp = message.timeStamp;
+		--blockMessagesLeft;
+		return true;
+	}
+
+	//! Position the reader so that the next read message is the first one at or after timeStamp, return false on error
+	bool RecordingReader::seek(UnifiedTime::Value timeStamp)
+	{
+		// find the last block starting at or before timeStamp
+		size_t first(0), last(index.size());
+		while (last - first > 1)
+		{
+			const size_t middle((first + last) / 2);
+			if (index[middle].timeStamp <= timeStamp)
+				first = middle;
+			else
+				last = middle;
+		}
+		blockMessagesLeft = 0;
+		nextBlock = first;
+		if (index.empty() || !loadBlock(first))
+			return index.empty();
+
+		// then skip earlier messages in this block
+		while (blockMessagesLeft)
+		{
+			const size_t pos(blockPos);
+			uint64 delta;
+			if (!extractVarInt(block, blockPos, delta) || blockPos + 6 > block.size())
+				return false;
+			if (lastTimeStamp + delta >= timeStamp)
+			{
+				blockPos = pos;
+				break;
+			}
+			lastTimeStamp += delta;
+			blockPos += 6 + extract<uint16>(&block[blockPos]);
+			--blockMessagesLeft;
+		}
+		return true;
+	}
+
+	/*@}*/
+} // namespace Aseba
@@ -0,0 +1,133 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_RECORDING_H
+#define ASEBA_RECORDING_H
+
+#include "../../common/types.h"
+#include "../../common/utils/utils.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Dashel
+{
+	class Stream;
+}
+
+namespace Aseba
+{
+	/**
+	\defgroup recording Binary recording of network traffic
+
+	A recording file starts with the magic "AREC" and a 16-bit version.
+	Messages follow in blocks, each with a header holding the codec (stored
+	or zlib), the raw and stored sizes, the time stamp of its first message
+	and its number of messages. Inside a block, each message is its
+	time stamp delta to the previous message in ms as a variable-length
+	integer, followed by the packet exactly as on the wire (length, source,
+	type, payload). The file ends with an index of the blocks (first time
+	stamp and offset), then its entry count and the magic "AIDX". If the
+	index is missing, for instance because the recorder was killed, it is
+	rebuilt by walking the block headers. All integers are little endian.
+	*/
+	/*@{*/
+
+	//! A message of a recording, kept as raw bytes so that any type can be recorded and replayed
+	struct RecordedMessage
+	{
+		UnifiedTime::Value timeStamp; //!< reception time in ms since epoch
+		uint16 source; //!< node that sent the message
+		uint16 type; //!< message type
+		std::vector<uint8> payload; //!< content of the message, as serialized on the wire
+
+		RecordedMessage() : timeStamp(0), source(0), type(0) {}
+
+		//! Return whether this message was sent by a script, and thus can be stored in the text format
+		bool isUserMessage() const { return type < 0x8000; }
+		//! Write the message to stream as a network packet, does not flush
+		void serialize(Dashel::Stream* stream) const;
+	};
+
+	//! Location of a block in a recording file
+	struct RecordingIndexEntry
+	{
+		UnifiedTime::Value timeStamp; //!< time stamp of the first message of the block
+		uint64 offset; //!< position of the block header in the file
+
+		RecordingIndexEntry(UnifiedTime::Value timeStamp = 0, uint64 offset = 0) : timeStamp(timeStamp), offset(offset) {}
+	};
+	typedef std::vector<RecordingIndexEntry> RecordingIndex;
+
+	//! Write messages to a binary recording file
+	class RecordingWriter
+	{
+	public:
+		RecordingWriter();
+		~RecordingWriter();
+
+		bool open(const std::string& fileName);
+		void write(const RecordedMessage& message);
+		void flush();
+		void close();
+		//! Return the time stamp of the oldest message not yet written to the file, 0 if none
+		UnifiedTime::Value pendingSince() const { return blockMessageCount ? blockTimeStamp : 0; }
+
+	protected:
+		std::ofstream file;
+		std::vector<uint8> block; //!< raw content of the block being filled
+		unsigned blockMessageCount; //!< number of messages in block
+		UnifiedTime::Value blockTimeStamp; //!< time stamp of the first message in block
+		UnifiedTime::Value lastTimeStamp; //!< time stamp of the last message in block
+		RecordingIndex index; //!< blocks written so far
+	};
+
+	//! Read messages from a binary recording file, with seeking
+	class RecordingReader
+	{
+	public:
+		RecordingReader();
+
+		static bool isRecording(const std::string& fileName);
+		bool open(const std::string& fileName);
+		bool read(RecordedMessage& message);
+		bool seek(UnifiedTime::Value timeStamp);
+		//! Return the time stamp of the first message of the recording, 0 if empty
+		UnifiedTime::Value startTime() const { return index.empty() ? 0 : index.front().timeStamp; }
+
+	protected:
+		bool readIndex();
+		bool rebuildIndex();
+		bool loadBlock(size_t blockIndex);
+
+	protected:
+		std::ifstream file;
+		RecordingIndex index; //!< all blocks of the file
+		size_t nextBlock; //!< block to load once the current one is consumed
+		std::vector<uint8> block; //!< raw content of the current block
+		size_t blockPos; //!< read position in block
+		unsigned blockMessagesLeft; //!< number of messages not yet read in block
+		UnifiedTime::Value lastTimeStamp; //!< time stamp of the last read message
+	};
+
+	/*@}*/
+} // namespace Aseba
+
+#endif // ASEBA_RECORDING_H
@@ -249,9 +249,18 @@ namespace Aseba
 	}
 	
 	
+	//! Number of messages each ring buffer between the Dashel thread and the gui thread can hold
+	static const int messagesBufferCapacity = 4096;
+	//! Minimum duration between two processings of incoming messages by the gui, in ms; about once per frame
+	static const int incomingMessagesPeriod = 16;
+	
 	DashelInterface::DashelInterface(QVector<QTranslator*> translators, const QString& commandLineTarget) :
 		isRunning(true),
-		stream(0)
+		stream(0),
+		incomingMessages(messagesBufferCapacity),
+		outgoingMessages(messagesBufferCapacity),
+		incomingNotified(0),
+		outgoingNotified(0)
 	{
 		// first use local name
 		const QString& systemLocale(QLocale::system().name());
@@ -344,17 +353,104 @@ namespace Aseba
 		Dashel::Hub::stop();
 	}
 	
-	// In QThread main function, we just make our Dashel hub switch listen for incoming data
+	//! Queue message for sending by the Dashel thread, which takes ownership of it; only call from the gui thread
+	void DashelInterface::sendMessage(Message *message)
+	{
+		// if the Dashel thread does not keep up, wait for it
+		while (!outgoingMessages.push(message))
+			QThread::yieldCurrentThread();
+		
+		// the hub is probably waiting for incoming data, wake it up
+		if (outgoingNotified.testAndSetOrdered(0, 1))
+			Dashel::Hub::stop();
+	}
+	
+	//! Return the oldest message received from the network, or 0 if there is none; only call from the gui thread
+	Message* DashelInterface::takeIncomingMessage()
+	{
+		Message* message;
+		if (incomingMessages.pop(message))
+			return message;
+		return 0;
+	}
+	
+	//! Tell that the gui is about to take incoming messages, so that messagesAvailable() is emitted for the next ones
+	void DashelInterface::incomingMessagesTaken()
+	{
+		incomingNotified.fetchAndStoreOrdered(0);
+	}
+	
+	//! Write the messages queued by the gui to the stream, in the Dashel thread
+	void DashelInterface::sendOutgoingMessages()
+	{
+		outgoingNotified.fetchAndStoreOrdered(0);
+		
+		lock();
+		writeOutgoingMessages();
+		unlock();
+	}
+	
+	//! Write the messages queued by the gui to the stream, in the Dashel thread with the hub locked
+	void DashelInterface::writeOutgoingMessages()
+	{
+		Message* message;
+		bool sent(false);
+		while (outgoingMessages.pop(message))
+		{
+			try
+			{
+				if (stream)
+				{
+					message->serialize(stream);
+					sent = true;
+				}
+			}
+			catch (DashelException e)
+			{
+				emit dashelError(e.source, QString::fromLocal8Bit(e.what()));
+			}
+			delete message;
+		}
+		try
+		{
+			if (sent && stream)
+				stream->flush();
+		}
+		catch (DashelException e)
+		{
+			emit dashelError(e.source, QString::fromLocal8Bit(e.what()));
+		}
+	}
+	
+	// In QThread main function, we just make our Dashel hub switch listen for incoming data, and send queued messages when woken up
 	void DashelInterface::run()
 	{
 		while (isRunning)
+		{
 			Dashel::Hub::run();
+			sendOutgoingMessages();
+		}
 	}
 	
 	void DashelInterface::incomingData(Stream *stream)
 	{
 		Message *message = Message::receive(stream);
-		emit messageAvailable(message);
+		
+		// if the gui does not keep up, wait for it, which slows the stream down;
+		// meanwhile keep sending its messages, as it might be waiting for room to queue one
+		while (!incomingMessages.push(message))
+		{
+			if (!isRunning)
+			{
+				delete message;
+				return;
+			}
+			writeOutgoingMessages();
+			msleep(1);
+		}
+		
+		if (incomingNotified.testAndSetOrdered(0, 1))
+			emit messagesAvailable();
 	}
 	
 	void DashelInterface::connectionClosed(Stream* stream, bool abnormal)
@@ -410,10 +506,13 @@ namespace Aseba
 	{
 		userEventsTimer.setSingleShot(true);
 		connect(&userEventsTimer, SIGNAL(timeout()), SLOT(updateUserEvents()));
+		incomingMessagesTimer.setSingleShot(true);
+		connect(&incomingMessagesTimer, SIGNAL(timeout()), SLOT(processMessagesFromDashel()));
 		
 		// we connect the events from the stream listening thread to slots living in our gui thread
-		connect(&dashelInterface, SIGNAL(messageAvailable(Message *)), SLOT(messageFromDashel(Message *)), Qt::QueuedConnection);
+		connect(&dashelInterface, SIGNAL(messagesAvailable()), SLOT(messagesFromDashel()), Qt::QueuedConnection);
 		connect(&dashelInterface, SIGNAL(dashelDisconnection()), SLOT(disconnectionFromDashel()), Qt::QueuedConnection);
+		connect(&dashelInterface, SIGNAL(dashelError(int, const QString&)), SLOT(errorFromDashel(int, const QString&)), Qt::QueuedConnection);
 		
 		// we also connect to the description manager to know when we have a new node available
 		connect(&descriptionManager, SIGNAL(nodeDescriptionReceivedSignal(unsigned)), SLOT(nodeDescriptionReceived(unsigned)));
@@ -433,38 +532,29 @@ namespace Aseba
 	
 	DashelTarget::~DashelTarget()
 	{
+		// the Dashel thread sends queued messages before terminating
+		DashelTarget::disconnect();
 		dashelInterface.stop();
 		dashelInterface.wait();
-		DashelTarget::disconnect();
+		
+		// delete messages that were not processed
+		while (Message* message = dashelInterface.takeIncomingMessage())
+			delete message;
+		while (!userEventsQueue.isEmpty())
+			delete userEventsQueue.dequeue();
 	}
 	
 	void DashelTarget::disconnect()
 	{
 		assert(writeBlocked == false);
 		
-		dashelInterface.lock();
-		if (dashelInterface.stream)
+		// detach all nodes
+		for (NodesMap::const_iterator node = nodes.begin(); node != nodes.end(); ++node)
 		{
-			try
-			{
-				// detach all nodes
-				for (NodesMap::const_iterator node = nodes.begin(); node != nodes.end(); ++node)
-				{
-					//DetachDebugger(node->first).serialize(dashelInterface.stream);
-					BreakpointClearAll(node->first).serialize(dashelInterface.stream);
-					Run(node->first).serialize(dashelInterface.stream);
-				}
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			//dashelInterface.sendMessage(new DetachDebugger(node->first));
+			dashelInterface.sendMessage(new BreakpointClearAll(node->first));
+			dashelInterface.sendMessage(new Run(node->first));
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	QList<unsigned> DashelTarget::getNodesList() const
@@ -482,29 +572,13 @@ namespace Aseba
 	
 	void DashelTarget::broadcastGetDescription()
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				GetDescription().serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new GetDescription());
 	}
 	
 	void DashelTarget::uploadBytecode(unsigned node, const BytecodeVector &bytecode)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
 			NodesMap::iterator nodeIt = nodes.find(node);
 			assert(nodeIt != nodes.end());
@@ -514,252 +588,98 @@ namespace Aseba
 			nodeIt->second.eventAddressToId = bytecode.getEventAddressesToIds();
 			
 			// send bytecode
-			try
-			{
-				sendBytecode(dashelInterface.stream, node, std::vector<uint16>(bytecode.begin(), bytecode.end()));
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			std::vector<Message*> messages;
+			sendBytecode(messages, node, std::vector<uint16>(bytecode.begin(), bytecode.end()));
+			for (size_t i = 0; i < messages.size(); ++i)
+				dashelInterface.sendMessage(messages[i]);
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::writeBytecode(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				WriteBytecode(node).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new WriteBytecode(node));
 	}
 	
 	void DashelTarget::reboot(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				Reboot(node).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new Reboot(node));
 	}
 	
 	void DashelTarget::sendEvent(unsigned id, const VariablesDataVector &data)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				UserMessage(id, data).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new UserMessage(id, data));
 	}
 	
 	void DashelTarget::setVariables(unsigned node, unsigned start, const VariablesDataVector &data)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				SetVariables(node, start, data).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new SetVariables(node, start, data));
 	}
 	
 	void DashelTarget::getVariables(unsigned node, unsigned start, unsigned length)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
 			const unsigned variablesPayloadSize = ASEBA_MAX_EVENT_ARG_COUNT-1;
-
-			try
-			{
-				while (length > variablesPayloadSize)
-				{
-					GetVariables(node, start, variablesPayloadSize).serialize(dashelInterface.stream);
-					start += variablesPayloadSize;
-					length -= variablesPayloadSize;
-				}
-
-				GetVariables(node, start, length).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
+			
+			while (length > variablesPayloadSize)
 			{
-				dashelInterface.unlock();
-				handleDashelException(e);
+				dashelInterface.sendMessage(new GetVariables(node, start, variablesPayloadSize));
+				start += variablesPayloadSize;
+				length -= variablesPayloadSize;
 			}
+			
+			dashelInterface.sendMessage(new GetVariables(node, start, length));
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::reset(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				Reset(node).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new Reset(node));
 	}
 	
 	void DashelTarget::run(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
 			NodesMap::iterator nodeIt = nodes.find(node);
 			assert(nodeIt != nodes.end());
 			
-			try
-			{
-				if (nodeIt->second.executionMode == EXECUTION_STEP_BY_STEP)
-					Step(node).serialize(dashelInterface.stream);
-				Run(node).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			if (nodeIt->second.executionMode == EXECUTION_STEP_BY_STEP)
+				dashelInterface.sendMessage(new Step(node));
+			dashelInterface.sendMessage(new Run(node));
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::pause(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				Pause(node).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new Pause(node));
 	}
 	
 	void DashelTarget::next(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
 			NodesMap::iterator nodeIt = nodes.find(node);
 			assert(nodeIt != nodes.end());
 			
 			nodeIt->second.steppingInNext = WAITING_INITAL_PC;
 			
-			GetExecutionState getExecutionStateMessage;
-			getExecutionStateMessage.dest = node;
-			
-			try
-			{
-				getExecutionStateMessage.serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			GetExecutionState* getExecutionStateMessage(new GetExecutionState);
+			getExecutionStateMessage->dest = node;
+			dashelInterface.sendMessage(getExecutionStateMessage);
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::stop(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
-		{
-			try
-			{
-				Stop(node).serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
-		}
-		else
-			dashelInterface.unlock();
+		if (!writeBlocked)
+			dashelInterface.sendMessage(new Stop(node));
 	}
 	
 	void DashelTarget::setBreakpoint(unsigned node, unsigned line)
@@ -768,27 +688,13 @@ namespace Aseba
 		if (pc < 0)
 			return;
 		
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
-			BreakpointSet breakpointSetMessage;
-			breakpointSetMessage.pc = pc;
-			breakpointSetMessage.dest = node;
-			
-			try
-			{
-				breakpointSetMessage.serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			BreakpointSet* breakpointSetMessage(new BreakpointSet);
+			breakpointSetMessage->pc = pc;
+			breakpointSetMessage->dest = node;
+			dashelInterface.sendMessage(breakpointSetMessage);
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::clearBreakpoint(unsigned node, unsigned line)
@@ -797,51 +703,23 @@ namespace Aseba
 		if (pc < 0)
 			return;
 		
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
-			BreakpointClear breakpointClearMessage;
-			breakpointClearMessage.pc = pc;
-			breakpointClearMessage.dest = node;
-			
-			try
-			{
-				breakpointClearMessage.serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			BreakpointClear* breakpointClearMessage(new BreakpointClear);
+			breakpointClearMessage->pc = pc;
+			breakpointClearMessage->dest = node;
+			dashelInterface.sendMessage(breakpointClearMessage);
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::clearBreakpoints(unsigned node)
 	{
-		dashelInterface.lock();
-		if (dashelInterface.stream && !writeBlocked)
+		if (!writeBlocked)
 		{
-			BreakpointClearAll breakpointClearAllMessage;
-			breakpointClearAllMessage.dest = node;
-			
-			try
-			{
-				breakpointClearAllMessage.serialize(dashelInterface.stream);
-				dashelInterface.stream->flush();
-				dashelInterface.unlock();
-			}
-			catch(Dashel::DashelException e)
-			{
-				dashelInterface.unlock();
-				handleDashelException(e);
-			}
+			BreakpointClearAll* breakpointClearAllMessage(new BreakpointClearAll);
+			breakpointClearAllMessage->dest = node;
+			dashelInterface.sendMessage(breakpointClearAllMessage);
 		}
-		else
-			dashelInterface.unlock();
 	}
 	
 	void DashelTarget::blockWrite()
@@ -873,6 +751,33 @@ namespace Aseba
 		}
 	}
 	
+	void DashelTarget::messagesFromDashel()
+	{
+		// at high message rates, only process messages about once per frame, in batches, to keep the gui responsive
+		if (incomingMessagesTimer.isActive())
+			return;
+		const int elapsed(lastIncomingMessagesProcessing.isNull() ? incomingMessagesPeriod : lastIncomingMessagesProcessing.elapsed());
+		if ((elapsed >= 0) && (elapsed < incomingMessagesPeriod))
+			incomingMessagesTimer.start(incomingMessagesPeriod - elapsed);
+		else
+			processMessagesFromDashel();
+	}
+	
+	void DashelTarget::processMessagesFromDashel()
+	{
+		lastIncomingMessagesProcessing.start();
+		dashelInterface.incomingMessagesTaken();
+		
+		// do not process more than a buffer full, the remaining messages will come in the next batch
+		for (int i = 0; i < messagesBufferCapacity; ++i)
+		{
+			Message *message(dashelInterface.takeIncomingMessage());
+			if (!message)
+				break;
+			messageFromDashel(message);
+		}
+	}
+	
 	void DashelTarget::messageFromDashel(Message *message)
 	{
 		bool deleteMessage = true;
@@ -945,6 +850,10 @@ namespace Aseba
 	
 	void DashelTarget::disconnectionFromDashel()
 	{
+		// messages received before the disconnection must be processed first
+		incomingMessagesTimer.stop();
+		processMessagesFromDashel();
+		
 		emit networkDisconnected();
 		nodes.clear();
 		descriptionManager.reset();
@@ -1048,23 +957,7 @@ namespace Aseba
 						node.lineInNext = line;
 						node.steppingInNext = WAITING_LINE_CHANGE;
 						
-						dashelInterface.lock();
-						if (dashelInterface.stream)
-						{
-							try
-							{
-								Step(ess->source).serialize(dashelInterface.stream);
-								dashelInterface.stream->flush();
-								dashelInterface.unlock();
-							}
-							catch(Dashel::DashelException e)
-							{
-								dashelInterface.unlock();
-								handleDashelException(e);
-							}
-						}
-						else
-							dashelInterface.unlock();
+						dashelInterface.sendMessage(new Step(ess->source));
 					}
 					else if (node.steppingInNext == WAITING_LINE_CHANGE)
 					{
@@ -1080,23 +973,7 @@ namespace Aseba
 						}
 						else
 						{
-							dashelInterface.lock();
-							if (dashelInterface.stream)
-							{
-								try
-								{
-									Step(ess->source).serialize(dashelInterface.stream);
-									dashelInterface.stream->flush();
-									dashelInterface.unlock();
-								}
-								catch(Dashel::DashelException e)
-								{
-									dashelInterface.unlock();
-									handleDashelException(e);
-								}
-							}
-							else
-								dashelInterface.unlock();
+							dashelInterface.sendMessage(new Step(ess->source));
 						}
 					}
 					else
@@ -1176,6 +1053,11 @@ namespace Aseba
 		return -1;
 	}
 
+	void DashelTarget::errorFromDashel(int source, const QString& reason)
+	{
+		handleDashelException(Dashel::DashelException(Dashel::DashelException::Source(source), 0, reason.toLocal8Bit().constData()));
+	}
+	
 	void DashelTarget::handleDashelException(Dashel::DashelException e)
 	{
 		switch(e.source)
@@ -22,12 +22,14 @@
 #define TCPTARGET_H
 
 #include "Target.h"
+#include "LockFreeRingBuffer.h"
 #include "../../common/consts.h"
 #include "../../common/msg/descriptions-manager.h"
 #include <QString>
 #include <QDialog>
 #include <QQueue>
 #include <QTimer>
+#include <QTime>
 #include <QThread>
 #include <map>
 #include <dashel/dashel.h>
@@ -85,6 +87,7 @@ namespace Aseba
 	class Message;
 	class UserMessage;
 	
+	//! Thread running the Dashel hub; messages are exchanged with the gui thread through lock-free ring buffers, one per direction
 	class DashelInterface: public QThread, public Dashel::Hub
 	{
 		Q_OBJECT
@@ -100,20 +103,36 @@ namespace Aseba
 		DashelInterface(QVector<QTranslator*> translators, const QString& commandLineTarget);
 		bool attemptToReconnect();
 		
+		// called from the gui thread
+		void sendMessage(Message *message);
+		Message* takeIncomingMessage();
+		void incomingMessagesTaken();
+		
 		// from Dashel::Hub
 		virtual void stop();
 		
 	signals:
-		void messageAvailable(Message *message);
+		//! Messages are waiting in the incoming buffer; not emitted again until incomingMessagesTaken() is called
+		void messagesAvailable();
 		void dashelDisconnection();
+		void dashelError(int source, const QString& reason);
 	
 	protected:
+		void sendOutgoingMessages();
+		void writeOutgoingMessages();
+		
 		// from QThread
 		virtual void run();
 		
 		// from Dashel::Hub
 		virtual void incomingData(Dashel::Stream *stream);
 		virtual void connectionClosed(Dashel::Stream *stream, bool abnormal);
+		
+	protected:
+		LockFreeRingBuffer<Message*> incomingMessages; //!< messages from the network, produced by this thread and consumed by the gui thread
+		LockFreeRingBuffer<Message*> outgoingMessages; //!< messages to the network, produced by the gui thread and consumed by this thread
+		QAtomicInt incomingNotified; //!< 1 if messagesAvailable() was emitted and the gui has not taken messages since
+		QAtomicInt outgoingNotified; //!< 1 if the hub was woken up to send messages and did not send them yet
 	};
 	
 	//! Provides a signal/slot interface for the description manager
@@ -157,6 +176,8 @@ namespace Aseba
 		SignalingDescriptionsManager descriptionManager;
 		NodesMap nodes;
 		QTimer userEventsTimer;
+		QTimer incomingMessagesTimer; //!< delays the processing of incoming messages to process them in batches
+		QTime lastIncomingMessagesProcessing; //!< when incoming messages were processed last
 		bool writeBlocked; //!< true if write is being blocked by invasive plugins, false if write is allowed
 		
 	public:
@@ -198,11 +219,14 @@ namespace Aseba
 	
 	protected slots:
 		void updateUserEvents();
-		void messageFromDashel(Message *message);
+		void messagesFromDashel();
+		void processMessagesFromDashel();
 		void disconnectionFromDashel();
+		void errorFromDashel(int source, const QString& reason);
 		void nodeDescriptionReceived(unsigned node);
 	
 	protected:
+		void messageFromDashel(Message *message);
 		void receivedDescription(Message *message);
 		void receivedLocalEventDescription(Message *message);
 		void receivedNativeFunctionDescription(Message *message);
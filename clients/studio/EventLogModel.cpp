@@ -0,0 +1,253 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EventLogModel.h"
+#include <QIcon>
+#include <QPoint>
+#include <QStringList>
+#include <algorithm>
+
+namespace Aseba
+{
+	/** \addtogroup studio */
+	/*@{*/
+	
+	//! Number of entries kept in the log
+	static const int logCapacity = 500;
+	//! Interval between two updates of the view, in ms; about once per frame
+	static const int updatePeriod = 40;
+	//! Number of events of a type logged individually per second, above this only their rate is logged
+	static const unsigned maxEventsPerSecond = 10;
+	
+	EventLogModel::EventLogModel(const CommonDefinitions *commonDefinitions, QObject *parent) :
+		QAbstractListModel(parent),
+		commonDefinitions(commonDefinitions),
+		entries(logCapacity),
+		firstEntry(0),
+		entriesCount(0)
+	{
+		rateClock.start();
+		connect(&updateTimer, SIGNAL(timeout()), SLOT(update()));
+	}
+	
+	int EventLogModel::rowCount(const QModelIndex &parent) const
+	{
+		if (parent.isValid())
+			return 0;
+		return entriesCount;
+	}
+	
+	QVariant EventLogModel::data(const QModelIndex &index, int role) const
+	{
+		if (!index.isValid() || index.row() >= entriesCount)
+			return QVariant();
+		
+		const Entry& entry(entryAt(index.row()));
+		switch (role)
+		{
+			case Qt::DisplayRole:
+				return entryText(entry);
+			case Qt::DecorationRole:
+				return QIcon(entry.type == Entry::EXECUTION_ERROR ? ":/images/warning.png" : ":/images/info.png");
+			case Qt::UserRole:
+				// position in source code
+				if (entry.type == Entry::EXECUTION_ERROR)
+					return QPoint(entry.id, entry.count);
+				return QVariant();
+			default:
+				return QVariant();
+		}
+	}
+	
+	//! Log a user event
+	void EventLogModel::addUserEvent(unsigned id, const VariablesDataVector &data)
+	{
+		// count events of this type in the current second
+		EventRate& rate(eventRates[id]);
+		const int now(rateClock.elapsed());
+		if ((now - rate.periodStart >= 1000) || (now < rate.periodStart))
+		{
+			if (rate.suppressedCount)
+				appendRate(id, rate);
+			rate.periodStart = now;
+			rate.count = 0;
+			rate.suppressedCount = 0;
+		}
+		++rate.count;
+		
+		if (rate.count <= maxEventsPerSecond)
+		{
+			Entry& entry(appendEntry(Entry::USER_EVENT));
+			entry.id = id;
+			entry.data = data;
+		}
+		else
+		{
+			++rate.suppressedCount;
+			rate.lastData = data;
+		}
+	}
+	
+	//! Log that some user events have been dropped, i.e. not sent to the gui
+	void EventLogModel::addUserEventsDropped(unsigned amount)
+	{
+		Entry& entry(appendEntry(Entry::USER_EVENTS_DROPPED));
+		entry.count = amount;
+	}
+	
+	//! Log an execution error of node at line
+	void EventLogModel::addError(unsigned node, unsigned line, const QString& text)
+	{
+		Entry& entry(appendEntry(Entry::EXECUTION_ERROR));
+		entry.id = node;
+		entry.count = line;
+		entry.text = text;
+	}
+	
+	void EventLogModel::clear()
+	{
+		if (entriesCount)
+		{
+			beginRemoveRows(QModelIndex(), 0, entriesCount - 1);
+			firstEntry = 0;
+			entriesCount = 0;
+			endRemoveRows();
+		}
+		pendingEntries.clear();
+		eventRates.clear();
+	}
+	
+	//! Summarize the rates of the periods that are over, and show pending entries in the view
+	void EventLogModel::update()
+	{
+		const int now(rateClock.elapsed());
+		for (EventRates::iterator it(eventRates.begin()); it != eventRates.end(); ++it)
+		{
+			EventRate& rate(it.value());
+			if (rate.suppressedCount && ((now - rate.periodStart >= 1000) || (now < rate.periodStart)))
+			{
+				appendRate(it.key(), rate);
+				rate.periodStart = now;
+				rate.count = 0;
+				rate.suppressedCount = 0;
+			}
+		}
+		
+		if (pendingEntries.empty())
+		{
+			// keep running while rates still have to be summarized
+			bool suppressed(false);
+			for (EventRates::const_iterator it(eventRates.begin()); it != eventRates.end(); ++it)
+				suppressed = suppressed || it.value().suppressedCount;
+			if (!suppressed)
+				updateTimer.stop();
+			return;
+		}
+		
+		// remove the oldest entries to make room
+		const int addedCount(pendingEntries.size());
+		const int removedCount(std::max(0, entriesCount + addedCount - logCapacity));
+		if (removedCount)
+		{
+			beginRemoveRows(QModelIndex(), 0, removedCount - 1);
+			firstEntry = (firstEntry + removedCount) % logCapacity;
+			entriesCount -= removedCount;
+			endRemoveRows();
+		}
+		
+		// move pending entries to the ring buffer, reusing the memory of old ones
+		beginInsertRows(QModelIndex(), entriesCount, entriesCount + addedCount - 1);
+		for (int i = 0; i < addedCount; ++i)
+		{
+			Entry& entry(entries[(firstEntry + entriesCount) % logCapacity]);
+			Entry& pendingEntry(pendingEntries[i]);
+			entry.type = pendingEntry.type;
+			entry.time = pendingEntry.time;
+			entry.id = pendingEntry.id;
+			entry.count = pendingEntry.count;
+			entry.data.swap(pendingEntry.data);
+			entry.text = pendingEntry.text;
+			++entriesCount;
+		}
+		endInsertRows();
+		pendingEntries.clear();
+		
+		emit entriesAdded();
+	}
+	
+	//! Create a new pending entry, it will be shown at the next update
+	EventLogModel::Entry& EventLogModel::appendEntry(Entry::Type type)
+	{
+		// entries older than the capacity would be removed right away anyway
+		if (int(pendingEntries.size()) >= logCapacity)
+			pendingEntries.pop_front();
+		
+		pendingEntries.push_back(Entry());
+		Entry& entry(pendingEntries.back());
+		entry.type = type;
+		entry.time = QTime::currentTime();
+		entry.id = 0;
+		entry.count = 0;
+		
+		if (!updateTimer.isActive())
+			updateTimer.start(updatePeriod);
+		return entry;
+	}
+	
+	//! Log a summary of the events of type id received in the last period
+	void EventLogModel::appendRate(unsigned id, const EventRate& rate)
+	{
+		Entry& entry(appendEntry(Entry::USER_EVENT_RATE));
+		entry.id = id;
+		entry.count = rate.count;
+		entry.data = rate.lastData;
+	}
+	
+	const EventLogModel::Entry& EventLogModel::entryAt(int row) const
+	{
+		return entries[(firstEntry + row) % logCapacity];
+	}
+	
+	QString EventLogModel::entryText(const Entry& entry) const
+	{
+		QString text(entry.time.toString("hh:mm:ss.zzz"));
+		text += '\n';
+		
+		if (entry.type == Entry::USER_EVENTS_DROPPED)
+			return text + tr("%0 user events not shown").arg(entry.count);
+		if (entry.type == Entry::EXECUTION_ERROR)
+			return text + entry.text;
+		
+		if (entry.id < commonDefinitions->events.size())
+			text += QString::fromStdWString(commonDefinitions->events[entry.id].name);
+		else
+			text += tr("event %0").arg(entry.id);
+		if (entry.type == Entry::USER_EVENT_RATE)
+			text += tr(" : %0 events in the last second, last one").arg(entry.count);
+		text += " : ";
+		
+		QStringList values;
+		for (size_t i = 0; i < entry.data.size(); i++)
+			values.append(QString::number(entry.data[i]));
+		return text + values.join(" ");
+	}
+	
+	/*@}*/
+} // namespace Aseba
@@ -0,0 +1,112 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVENT_LOG_MODEL_H
+#define EVENT_LOG_MODEL_H
+
+#include <QAbstractListModel>
+#include <QTime>
+#include <QTimer>
+#include <QVector>
+#include <QMap>
+#include <deque>
+#include "../../compiler/compiler.h"
+
+namespace Aseba
+{
+	/** \addtogroup studio */
+	/*@{*/
+	
+	//! The last entries of the log of events and errors, kept in a fixed-capacity ring buffer.
+	//! New entries are shown in batches once per frame, their text is only formatted when displayed,
+	//! and event types that are received too often are summarized by their rate.
+	class EventLogModel: public QAbstractListModel
+	{
+		Q_OBJECT
+		
+	public:
+		EventLogModel(const CommonDefinitions *commonDefinitions, QObject *parent = 0);
+		
+		int rowCount(const QModelIndex &parent = QModelIndex()) const;
+		QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+		
+		void addUserEvent(unsigned id, const VariablesDataVector &data);
+		void addUserEventsDropped(unsigned amount);
+		void addError(unsigned node, unsigned line, const QString& text);
+		
+	public slots:
+		void clear();
+		
+	signals:
+		//! New entries have been appended at the end of the log
+		void entriesAdded();
+		
+	protected slots:
+		void update();
+		
+	protected:
+		struct Entry
+		{
+			enum Type
+			{
+				USER_EVENT, //!< a single user event, id and data are valid
+				USER_EVENT_RATE, //!< a summary of a frequent user event, id, count and data of the last one are valid
+				USER_EVENTS_DROPPED, //!< events not sent to the gui, count is valid
+				EXECUTION_ERROR //!< an execution error, node, line and text are valid
+			} type;
+			QTime time; //!< when the entry was created
+			unsigned id; //!< event identifier, or node for errors
+			unsigned count; //!< number of events, or line for errors
+			VariablesDataVector data; //!< event data
+			QString text; //!< message for errors
+		};
+		
+		//! Number of occurrences of an event type in the current second
+		struct EventRate
+		{
+			int periodStart; //!< start of the current second, in ms of rateClock
+			unsigned count; //!< events received in the current second
+			unsigned suppressedCount; //!< events received in the current second that are not logged individually
+			VariablesDataVector lastData; //!< data of the last suppressed event
+			
+			EventRate() : periodStart(0), count(0), suppressedCount(0) {}
+		};
+		typedef QMap<unsigned, EventRate> EventRates;
+		
+		Entry& appendEntry(Entry::Type type);
+		void appendRate(unsigned id, const EventRate& rate);
+		const Entry& entryAt(int row) const;
+		QString entryText(const Entry& entry) const;
+		
+	protected:
+		const CommonDefinitions *commonDefinitions; //!< to get the names of events
+		QVector<Entry> entries; //!< ring buffer of entries shown in the view
+		int firstEntry; //!< index of the oldest entry in entries
+		int entriesCount; //!< number of valid entries in entries
+		std::deque<Entry> pendingEntries; //!< entries not yet shown in the view
+		EventRates eventRates; //!< occurrences of each event type in the current second
+		QTime rateClock; //!< reference for rate periods
+		QTimer updateTimer; //!< shows pending entries and summarizes rates once per frame
+	};
+	
+	/*@}*/
+} // namespace Aseba
+
+#endif // EVENT_LOG_MODEL_H
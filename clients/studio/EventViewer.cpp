@@ -30,8 +30,10 @@
 #include <QFileDialog>
 #include <QSettings>
 #include <QtDebug>
+#include <algorithm>
 
 #include <qwt_plot.h>
+#include <qwt_plot_canvas.h>
 #include <qwt_plot_curve.h>
 #include <qwt_legend.h>
 
@@ -46,38 +48,46 @@ namespace Aseba
 	/** \addtogroup studio */
 	/*@{*/
 	
+	//! Maximum number of times per second a plot is redrawn
+	static const int maxReplotRate = 60;
+	
+	// Each bucket of decimated data is shown as two points, its minimum and its maximum
 	#if QWT_VERSION >= 0x060000
 	class EventDataWrapper : public QwtSeriesData<QPointF>
 	{
 	private:
 		std::deque<double>& _x;
-		std::deque<sint16>& _y;
+		std::deque<sint16>& _yMin;
+		std::deque<sint16>& _yMax;
 		
 	public:
-		EventDataWrapper(std::deque<double>& _x, std::deque<sint16>& _y) :
+		EventDataWrapper(std::deque<double>& _x, std::deque<sint16>& _yMin, std::deque<sint16>& _yMax) :
 			_x(_x),
-			_y(_y)
+			_yMin(_yMin),
+			_yMax(_yMax)
 		{ }
 		virtual QRectF boundingRect () const { return qwtBoundingRect(*this); }
-		virtual QPointF sample (size_t i) const { return QPointF(_x[i], double(_y[i])); }
-		virtual size_t size () const { return _x.size(); }
+		virtual QPointF sample (size_t i) const { return QPointF(_x[i/2], double((i % 2) ? _yMax[i/2] : _yMin[i/2])); }
+		virtual size_t size () const { return _x.size() * 2; }
 	};
 	#else
 	class EventDataWrapper : public QwtData
 	{
 	private:
 		std::deque<double>& _x;
-		std::deque<sint16>& _y;
+		std::deque<sint16>& _yMin;
+		std::deque<sint16>& _yMax;
 		
 	public:
-		EventDataWrapper(std::deque<double>& _x, std::deque<sint16>& _y) :
+		EventDataWrapper(std::deque<double>& _x, std::deque<sint16>& _yMin, std::deque<sint16>& _yMax) :
 			_x(_x),
-			_y(_y)
+			_yMin(_yMin),
+			_yMax(_yMax)
 		{ }
 		virtual QwtData *   copy () const { return new EventDataWrapper(*this); }
-		virtual size_t   size () const { return _x.size(); }
-		virtual double x (size_t i) const { return _x[i]; }
-		virtual double y (size_t i) const { return (double)_y[i]; }
+		virtual size_t   size () const { return _x.size() * 2; }
+		virtual double x (size_t i) const { return _x[i/2]; }
+		virtual double y (size_t i) const { return (double)((i % 2) ? _yMax[i/2] : _yMin[i/2]); }
 	};
 	#endif
 	
@@ -85,7 +95,10 @@ namespace Aseba
 		eventId(eventId),
 		eventsViewers(eventsViewers),
 		values(eventVariablesCount),
-		startingTime(QTime::currentTime())
+		startingTime(QTime::currentTime()),
+		displayMinValues(eventVariablesCount),
+		displayMaxValues(eventVariablesCount),
+		displayBucketDuration(0)
 	{
 		QSettings settings;
 		
@@ -103,14 +116,17 @@ namespace Aseba
 		{
 			QwtPlotCurve *curve = new QwtPlotCurve(QString("%0").arg(i));
 			#if QWT_VERSION >= 0x060000
-			curve->setData(new EventDataWrapper(timeStamps, values[i]));
+			curve->setData(new EventDataWrapper(displayTimeStamps, displayMinValues[i], displayMaxValues[i]));
 			#else
-			curve->setData(EventDataWrapper(timeStamps, values[i]));
+			curve->setData(EventDataWrapper(displayTimeStamps, displayMinValues[i], displayMaxValues[i]));
 			#endif
 			curve->attach(plot);
 			curve->setPen(QPen(QColor::fromHsv((i * 360) / values.size(), 255, 100), 2));
 		}
 		
+		replotTimer.setSingleShot(true);
+		connect(&replotTimer, SIGNAL(timeout()), plot, SLOT(replot()));
+		
 		QVBoxLayout *layout = new QVBoxLayout(this);
 		layout->addWidget(plot);
 		
@@ -176,6 +192,18 @@ namespace Aseba
 				for (size_t i = 0; i < values.size(); i++)
 					values[i].pop_front();
 			}
+			while (
+				(!displayTimeStamps.empty()) &&
+				(elapsedTime - displayTimeStamps[0] > timeWindowLength->value())
+			)
+			{
+				displayTimeStamps.pop_front();
+				for (size_t i = 0; i < values.size(); i++)
+				{
+					displayMinValues[i].pop_front();
+					displayMaxValues[i].pop_front();
+				}
+			}
 		}
 			
 			
@@ -191,7 +219,86 @@ namespace Aseba
 				values[i].push_back(0);
 			}
 		}
-		plot->replot();
+		addDisplayData(elapsedTime, data);
+		
+		// replot later, so that many events lead to a single replot
+		if (!replotTimer.isActive())
+			replotTimer.start(1000 / maxReplotRate);
+	}
+	
+	//! Add values to the last bucket of displayed data, or to a new one if it is full, and halve the resolution if there are more buckets than pixels
+	void EventViewer::addDisplayData(double timeStamp, const VariablesDataVector& data)
+	{
+		if (displayTimeStamps.empty() || (timeStamp - displayTimeStamps.back() >= displayBucketDuration))
+		{
+			displayTimeStamps.push_back(timeStamp);
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				const sint16 value(i < data.size() ? data[i] : 0);
+				displayMinValues[i].push_back(value);
+				displayMaxValues[i].push_back(value);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				const sint16 value(i < data.size() ? data[i] : 0);
+				displayMinValues[i].back() = std::min(displayMinValues[i].back(), value);
+				displayMaxValues[i].back() = std::max(displayMaxValues[i].back(), value);
+			}
+		}
+		
+		// two buckets per pixel are enough for min/max to look exact
+		const size_t maxBucketsCount(std::max(2 * plot->canvas()->width(), 512));
+		if (displayTimeStamps.size() > maxBucketsCount)
+			halveDisplayResolution();
+	}
+	
+	//! Merge buckets of displayed data two by two
+	void EventViewer::halveDisplayResolution()
+	{
+		const size_t count(displayTimeStamps.size());
+		const size_t mergedCount((count + 1) / 2);
+		for (size_t j = 0; j < count / 2; ++j)
+		{
+			displayTimeStamps[j] = displayTimeStamps[2*j];
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				displayMinValues[i][j] = std::min(displayMinValues[i][2*j], displayMinValues[i][2*j+1]);
+				displayMaxValues[i][j] = std::max(displayMaxValues[i][2*j], displayMaxValues[i][2*j+1]);
+			}
+		}
+		if (count % 2)
+		{
+			displayTimeStamps[mergedCount-1] = displayTimeStamps[count-1];
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				displayMinValues[i][mergedCount-1] = displayMinValues[i][count-1];
+				displayMaxValues[i][mergedCount-1] = displayMaxValues[i][count-1];
+			}
+		}
+		displayTimeStamps.resize(mergedCount);
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			displayMinValues[i].resize(mergedCount);
+			displayMaxValues[i].resize(mergedCount);
+		}
+		
+		// initially buckets hold a single value, so derive their duration from the data
+		const double span(displayTimeStamps.back() - displayTimeStamps.front());
+		displayBucketDuration = std::max(2 * displayBucketDuration, span / mergedCount);
+	}
+	
+	void EventViewer::clearDisplay()
+	{
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			displayMinValues[i].clear();
+			displayMaxValues[i].clear();
+		}
+		displayTimeStamps.clear();
+		displayBucketDuration = 0;
 	}
 	
 	void EventViewer::pauseRunCapture()
@@ -221,7 +328,9 @@ namespace Aseba
 		for (size_t i = 0; i < values.size(); i++)
 			values[i].clear();
 		timeStamps.clear();
+		clearDisplay();
 		startingTime = QTime::currentTime();
+		replotTimer.stop();
 		plot->replot();
 	}
 	
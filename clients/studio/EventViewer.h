@@ -29,6 +29,7 @@
 
 #include <deque>
 #include <QTime>
+#include <QTimer>
 
 #include "MainWindow.h"
 #include "../../common/types.h"
@@ -58,9 +59,17 @@ namespace Aseba
 		QCheckBox *timeWindowCheckBox;
 		QDoubleSpinBox *timeWindowLength;
 		
+		// captured data, complete so that it can be saved
 		std::vector<std::deque<sint16> > values;
 		std::deque<double> timeStamps;
 		QTime startingTime;
+		
+		// displayed data, decimated to the resolution of the screen so that it uses a bounded amount of memory
+		std::vector<std::deque<sint16> > displayMinValues; //!< for every channel, minimum of values in each bucket
+		std::vector<std::deque<sint16> > displayMaxValues; //!< for every channel, maximum of values in each bucket
+		std::deque<double> displayTimeStamps; //!< time of the first value in each bucket
+		double displayBucketDuration; //!< a bucket holds values received within this duration after its first one
+		QTimer replotTimer; //!< limits replots to the refresh rate of the display
 	
 	public:
 		EventViewer(unsigned eventId, const QString& eventName, unsigned eventVariablesCount, MainWindow::EventViewers* eventsViewers);
@@ -69,6 +78,11 @@ namespace Aseba
 		void detachFromMain() { eventsViewers=0; }
 		void addData(const VariablesDataVector& data);
 		
+	protected:
+		void addDisplayData(double timeStamp, const VariablesDataVector& data);
+		void halveDisplayResolution();
+		void clearDisplay();
+		
 	protected slots:
 		void pauseRunCapture();
 		void clearPlot();
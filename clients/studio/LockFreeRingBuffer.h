@@ -0,0 +1,80 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOCK_FREE_RING_BUFFER_H
+#define LOCK_FREE_RING_BUFFER_H
+
+#include <QAtomicInt>
+#include <vector>
+
+namespace Aseba
+{
+	/** \addtogroup studio */
+	/*@{*/
+
+	//! A fixed-capacity queue to pass values from one thread to another without locking.
+	//! Exactly one thread may call push() and exactly one thread may call pop().
+	template<typename T>
+	class LockFreeRingBuffer
+	{
+	public:
+		//! Create a ring buffer able to hold capacity values
+		LockFreeRingBuffer(int capacity):
+			values(capacity + 1),
+			readIndex(0),
+			writeIndex(0)
+		{}
+
+		//! Append value, return false if the buffer is full; only call from the producer thread
+		bool push(const T& value)
+		{
+			const int index(writeIndex);
+			const int nextIndex((index + 1) % int(values.size()));
+			if (nextIndex == readIndex.fetchAndAddAcquire(0))
+				return false;
+			values[index] = value;
+			writeIndex.fetchAndStoreRelease(nextIndex);
+			return true;
+		}
+
+		//! Remove the oldest value and copy it to value, return false if the buffer is empty; only call from the consumer thread
+		bool pop(T& value)
+		{
+			const int index(readIndex);
+			if (index == writeIndex.fetchAndAddAcquire(0))
+				return false;
+			value = values[index];
+			readIndex.fetchAndStoreRelease((index + 1) % int(values.size()));
+			return true;
+		}
+
+		//! Return the maximum number of values the buffer can hold
+		int capacity() const { return int(values.size()) - 1; }
+
+	protected:
+		std::vector<T> values; //!< storage, one slot is always kept empty to distinguish full from empty
+		QAtomicInt readIndex; //!< next slot to read, written by the consumer only
+		QAtomicInt writeIndex; //!< next slot to write, written by the producer only
+	};
+
+	/*@}*/
+} // namespace Aseba
+
+#endif // LOCK_FREE_RING_BUFFER_H
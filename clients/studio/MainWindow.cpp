@@ -334,6 +334,9 @@ namespace Aseba
 		target(target),
 		commonDefinitions(commonDefinitions),
 		mainWindow(mainWindow),
+		refreshTimer(0),
+		lastRefreshChangesCount(0),
+		idleRefreshTicks(0),
 		currentPC(0),
 		previousMode(Target::EXECUTION_UNKNOWN),
 		showHidden(mainWindow->showHiddenAct->isChecked()),
@@ -639,50 +642,47 @@ namespace Aseba
 	
 	void NodeTab::timerEvent ( QTimerEvent * event )
 	{
-		if (mainWindow->nodes->currentWidget() != this)
+		if ((mainWindow->nodes->currentWidget() != this) || !vmMemoryView->isVisible())
 			return;
-			
-		// only fetch what is visible
-		const QList<TargetVariablesModel::Variable> variables(variablesModel->getVariables());
+		
+		// only fetch the values shown in the rows of the viewport
+		const QList<TargetVariablesModel::Variable>& variables(variablesModel->getVariables());
 		assert(variables.size() == variablesModel->rowCount());
 		
-		unsigned currentReqCount(0);
-		unsigned currentReqPos(0);
-		for (int i = 0; i < variables.size(); ++i)
-		{
-			const TargetVariablesModel::Variable& var(variables[i]);
-			if  (((var.value.size() == 1) ||
-				 (vmMemoryView->isExpanded(variablesModel->index(i, 0)))
-				 ) &&
-				 (!vmMemoryView->isRowHidden(i, QModelIndex()))
-				)
-			{
-				if (currentReqCount == 0)
-				{
-					// new request
-					currentReqPos = var.pos;
-					currentReqCount = var.value.size();
-				}
-				else if (currentReqPos + currentReqCount == var.pos)
-				{
-					// continuous, append
-					currentReqCount += var.value.size();
-				}
-				else
-				{
-					// flush and reset
-					target->getVariables(id, currentReqPos, currentReqCount);
-					// new request
-					currentReqPos = var.pos;
-					currentReqCount = var.value.size();
-				}
-			}
-		}
-		if (currentReqCount != 0)
+		VariablesRequests requests;
+		const int viewportHeight(vmMemoryView->viewport()->height());
+		for (QModelIndex index(vmMemoryView->indexAt(QPoint(0, 0))); index.isValid(); index = vmMemoryView->indexBelow(index))
 		{
-			// flush request
-			target->getVariables(id, currentReqPos, currentReqCount);
+			if (vmMemoryView->visualRect(index).top() >= viewportHeight)
+				break;
+			
+			unsigned pos;
+			if (index.parent().isValid())
+				pos = variables[index.parent().row()].pos + index.row();
+			else if (variables[index.row()].value.size() == 1)
+				pos = variables[index.row()].pos;
+			else
+				continue; // the row of an array only shows its size
+			
+			if (!requests.empty() && (requests.back().first + requests.back().second == pos))
+				// continuous, append
+				++requests.back().second;
+			else
+				// new request
+				requests.push_back(qMakePair(pos, 1u));
 		}
+		
+		// poll at full rate while values or visible rows change, and slow down otherwise
+		const unsigned changesCount(vmMemoryModel->getChangesCount());
+		if ((requests != lastRefreshRequests) || (changesCount != lastRefreshChangesCount))
+			idleRefreshTicks = 0;
+		else if (++idleRefreshTicks % idleRefreshDivider != 0)
+			return;
+		lastRefreshRequests = requests;
+		lastRefreshChangesCount = changesCount;
+		
+		for (int i = 0; i < requests.size(); ++i)
+			target->getVariables(id, requests[i].first, requests[i].second);
 	}
 	
 	void NodeTab::variableValueUpdated(const QString& name, const VariablesDataVector& values)
@@ -2386,12 +2386,12 @@ namespace Aseba
 		#endif // HAVE_QWT
 	}
 	
-	void MainWindow::logEntryDoubleClicked(QListWidgetItem * item)
+	void MainWindow::logEntryDoubleClicked(const QModelIndex & index)
 	{
-		if (item->data(Qt::UserRole).type() == QVariant::Point)
+		if (index.data(Qt::UserRole).type() == QVariant::Point)
 		{
-			int node = item->data(Qt::UserRole).toPoint().x();
-			int line = item->data(Qt::UserRole).toPoint().y();
+			int node = index.data(Qt::UserRole).toPoint().x();
+			int line = index.data(Qt::UserRole).toPoint().y();
 			
 			NodeTab* tab = getTabFromId(node);
 			Q_ASSERT(tab);
@@ -2749,23 +2749,7 @@ namespace Aseba
 	void MainWindow::userEvent(unsigned id, const VariablesDataVector &data)
 	{	
 		if (eventsDescriptionsModel->isVisible(id)) 
-		{	
-			QString text = QTime::currentTime().toString("hh:mm:ss.zzz");
-
-			if (id < commonDefinitions.events.size())
-					text += QString("\n%0 : ").arg(QString::fromStdWString(commonDefinitions.events[id].name));
-			else
-				text += tr("\nevent %0 : ").arg(id);
-
-			for (size_t i = 0; i < data.size(); i++)
-				text += QString("%0 ").arg(data[i]);
-			
-			if (logger->count() > 50)
-				delete logger->takeItem(0);
-			QListWidgetItem * item = new QListWidgetItem(QIcon(":/images/info.png"), text, logger);
-			logger->scrollToBottom();
-			Q_UNUSED(item);
-		}
+			eventLogModel->addUserEvent(id, data);
 		
 		#ifdef HAVE_QWT
 		
@@ -2780,14 +2764,7 @@ namespace Aseba
 	//! Some user events have been dropped, i.e. not sent to the gui
 	void MainWindow::userEventsDropped(unsigned amount)
 	{
-		QString text = QTime::currentTime().toString("hh:mm:ss.zzz");
-		text += QString("\n%0 user events not shown").arg(amount);
-		
-		if (logger->count() > 50)
-			delete logger->takeItem(0);
-		QListWidgetItem * item = new QListWidgetItem(QIcon(":/images/info.png"), text, logger);
-		logger->scrollToBottom();
-		Q_UNUSED(item);
+		eventLogModel->addUserEventsDropped(amount);
 		logger->setStyleSheet(" QListView::item { background: rgb(255,128,128); }");
 	}
 	
@@ -2827,14 +2804,7 @@ namespace Aseba
 			tab->highlighter->rehighlight();
 		}
 		
-		QString text = QTime::currentTime().toString("hh:mm:ss.zzz");
-		text += "\n" + tr("%0:%1: %2").arg(target->getName(node)).arg(line + 1).arg(message);
-		
-		if (logger->count() > 50)
-			delete logger->takeItem(0);
-		QListWidgetItem *item = new QListWidgetItem(QIcon(":/images/warning.png"), text, logger);
-		item->setData(Qt::UserRole, QPoint(node, line));
-		logger->scrollToBottom();
+		eventLogModel->addError(node, line, tr("%0:%1: %2").arg(target->getName(node)).arg(line + 1).arg(message));
 	}
 	
 	
@@ -3139,9 +3109,12 @@ namespace Aseba
 		clearLogger = new QPushButton(tr("Clear"));
 		eventsDockLayout->addWidget(clearLogger);*/
 		
-		logger = new QListWidget;
+		eventLogModel = new EventLogModel(&commonDefinitions, this);
+		logger = new QListView;
+		logger->setModel(eventLogModel);
 		logger->setMinimumSize(80,100);
 		logger->setSelectionMode(QAbstractItemView::NoSelection);
+		logger->setUniformItemSizes(true);
 		clearLogger = new QPushButton(tr("Clear"));
 		statusText = new QLabel("");
 		statusText->hide();
@@ -3189,7 +3162,7 @@ namespace Aseba
 	{
 		// general connections
 		connect(nodes, SIGNAL(currentChanged(int)), SLOT(tabChanged(int)));
-		connect(logger, SIGNAL(itemDoubleClicked(QListWidgetItem *)), SLOT(logEntryDoubleClicked(QListWidgetItem *)));
+		connect(logger, SIGNAL(doubleClicked(const QModelIndex &)), SLOT(logEntryDoubleClicked(const QModelIndex &)));
 		connect(ConfigDialog::getInstance(), SIGNAL(settingsChanged()), SLOT(applySettings()));
 		
 		// global actions
@@ -3214,7 +3187,8 @@ namespace Aseba
 		connect(eventsDescriptionsView, SIGNAL(customContextMenuRequested ( const QPoint & )), SLOT(eventContextMenuRequested(const QPoint & )));
 
 		// logger
-		connect(clearLogger, SIGNAL(clicked()), logger, SLOT(clear()));
+		connect(clearLogger, SIGNAL(clicked()), eventLogModel, SLOT(clear()));
+		connect(eventLogModel, SIGNAL(entriesAdded()), logger, SLOT(scrollToBottom()));
 		connect(clearLogger, SIGNAL(clicked()), SLOT(clearAllExecutionError()));
 		
 		// constants
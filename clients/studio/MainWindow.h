@@ -51,6 +51,7 @@
 #include <string>
 #include "Target.h"
 #include "TargetModels.h"
+#include "EventLogModel.h"
 #include "Plugin.h"
 #include "PluginRegistry.h"
 #include "HelpViewer.h"
@@ -62,6 +63,7 @@ class QGroupBox;
 class QPushButton;
 class QListWidget;
 class QListWidgetItem;
+class QListView;
 class QTreeView;
 class QTranslator;
 //class QTextBrowser;
@@ -352,6 +354,11 @@ namespace Aseba
 		NodeToolInterfaces tools;
 		
 		int refreshTimer; //!< id of timer for auto refresh of variables, if active
+		typedef QList<QPair<unsigned, unsigned> > VariablesRequests; //!< start and length of ranges of variables
+		VariablesRequests lastRefreshRequests; //!< ranges of variables requested by the last auto refresh
+		unsigned lastRefreshChangesCount; //!< changes count of vmMemoryModel at the last auto refresh
+		unsigned idleRefreshTicks; //!< number of auto refresh ticks since something changed
+		static const unsigned idleRefreshDivider = 5; //!< when nothing changes, auto refresh only on one tick out of this number
 		
 		QString lastCompiledSource; //!< content of last source considered for compilation following a textChanged signal
 		int errorPos; //!< position of last error, -1 if compilation was success
@@ -441,7 +448,7 @@ namespace Aseba
 		void plotEvent();
 		void eventContextMenuRequested(const QPoint & pos);
 		void plotEvent(const unsigned eventId);
-		void logEntryDoubleClicked(QListWidgetItem *);
+		void logEntryDoubleClicked(const QModelIndex &);
 		void showCompilationMessages(bool doShown);
 		void compilationMessagesWasHidden();
 		void showMemoryUsage(bool show);
@@ -542,7 +549,8 @@ namespace Aseba
 		#ifdef HAVE_QWT
 		QPushButton* plotEventButton;
 		#endif // HAVE_QWT
-		QListWidget* logger;
+		QListView* logger;
+		EventLogModel* eventLogModel;
 		QPushButton* clearLogger;
 		QLabel* statusText; // Jiwon
 		FixedWidthTableView* eventsDescriptionsView;
@@ -82,7 +82,8 @@ namespace Aseba
 	}
 	
 	TargetVariablesModel::TargetVariablesModel(QObject *parent) :
-		QAbstractItemModel(parent)
+		QAbstractItemModel(parent),
+		changesCount(0)
 	{
 		setSupportedDragActions(Qt::CopyAction);
 	}
@@ -271,35 +272,44 @@ namespace Aseba
 	
 	unsigned TargetVariablesModel::getVariablePos(const QString& name) const
 	{
-		for (int i = 0; i < variables.size(); ++i)
-		{
-			const Variable& variable(variables[i]);
-			if (variable.name == name)
-				return variable.pos;
-		}
+		const QHash<QString, int>::const_iterator it(variablesRows.find(name));
+		if (it != variablesRows.end())
+			return variables[it.value()].pos;
 		return 0;
 	}
 	
 	unsigned TargetVariablesModel::getVariableSize(const QString& name) const
 	{
-		for (int i = 0; i < variables.size(); ++i)
-		{
-			const Variable& variable(variables[i]);
-			if (variable.name == name)
-				return variable.value.size();
-		}
+		const QHash<QString, int>::const_iterator it(variablesRows.find(name));
+		if (it != variablesRows.end())
+			return variables[it.value()].value.size();
 		return 0;
 	}
 	
 	VariablesDataVector TargetVariablesModel::getVariableValue(const QString& name) const
 	{
-		for (int i = 0; i < variables.size(); ++i)
+		const QHash<QString, int>::const_iterator it(variablesRows.find(name));
+		if (it != variablesRows.end())
+			return variables[it.value()].value;
+		return VariablesDataVector();
+	}
+	
+	//! Return the row of the first variable whose last word is at or after address, or the number of rows if none
+	int TargetVariablesModel::firstVariableEndingAfter(unsigned address) const
+	{
+		// variables are sorted by address and do not overlap, so their ends are sorted as well
+		int first(0);
+		int last(variables.size());
+		while (first < last)
 		{
-			const Variable& variable(variables[i]);
-			if (variable.name == name)
-				return variable.value;
+			const int middle((first + last) / 2);
+			const Variable& var(variables[middle]);
+			if (var.pos + var.value.size() <= address)
+				first = middle + 1;
+			else
+				last = middle;
 		}
-		return VariablesDataVector();
+		return first;
 	}
 	
 	void TargetVariablesModel::updateVariablesStructure(const VariablesMap *variablesMap)
@@ -355,6 +365,11 @@ namespace Aseba
 				variables.append(newVariables[j]);
 			endInsertRows();
 		}
+		
+		// update the index of rows by name
+		variablesRows.clear();
+		for (int j = 0; j < variables.size(); ++j)
+			variablesRows[variables[j].name] = j;
 
 		/*variables.clear();
 		for (Compiler::VariablesMap::const_iterator it = variablesMap->begin(); it != variablesMap->end(); ++it)
@@ -380,39 +395,45 @@ namespace Aseba
 	
 	void TargetVariablesModel::setVariablesData(unsigned start, const VariablesDataVector &data)
 	{
-		size_t dataLength = data.size();
-		for (int i = 0; i < variables.size(); ++i)
+		const unsigned end(start + data.size());
+		for (int i = firstVariableEndingAfter(start); i < variables.size() && variables[i].pos < end; ++i)
 		{
 			Variable &var = variables[i];
-			int varLen = (int)var.value.size();
-			int varStart = (int)start - (int)var.pos;
-			int copyLen = (int)dataLength;
-			int copyStart = 0;
-			// crop data before us
-			if (varStart < 0)
-			{
-				copyLen += varStart;
-				copyStart -= varStart;
-				varStart = 0;
-			}
+			const unsigned copyStart(std::max(start, var.pos));
+			const unsigned copyEnd(std::min(end, var.pos + (unsigned)var.value.size()));
 			// if nothing to copy, continue
-			if (copyLen <= 0)
+			if (copyStart >= copyEnd)
 				continue;
-			// crop data after us
-			if (varStart + copyLen > varLen)
+			
+			// copy, and find which values have changed
+			int firstChanged(-1);
+			int lastChanged(-1);
+			for (unsigned address = copyStart; address < copyEnd; ++address)
 			{
-				copyLen = varLen - varStart;
+				short int& value(var.value[address - var.pos]);
+				if (value != data[address - start])
+				{
+					value = data[address - start];
+					if (firstChanged < 0)
+						firstChanged = address - var.pos;
+					lastChanged = address - var.pos;
+				}
 			}
-			// if nothing to copy, continue
-			if (copyLen <= 0)
-				continue;
-			
-			// copy
-			copy(data.begin() + copyStart, data.begin() + copyStart + copyLen, var.value.begin() + varStart);
 			
-			// notify gui
-			QModelIndex parentIndex = index(i, 0);
-			emit dataChanged(index(varStart, 0, parentIndex), index(varStart + copyLen, 0, parentIndex));
+			// notify gui, only for the values that have changed
+			if (firstChanged >= 0)
+			{
+				++changesCount;
+				if (var.value.size() == 1)
+				{
+					emit dataChanged(index(i, 1), index(i, 1));
+				}
+				else
+				{
+					QModelIndex parentIndex = index(i, 0);
+					emit dataChanged(index(firstChanged, 0, parentIndex), index(lastChanged, 1, parentIndex));
+				}
+			}
 			
 			// and notify view plugins
 			for (VariableListenersNameMap::iterator it = variableListenersMap.begin(); it != variableListenersMap.end(); ++it)
@@ -429,15 +450,11 @@ namespace Aseba
 	
 	bool TargetVariablesModel::setVariableValues(const QString& name, const VariablesDataVector& values)
 	{
-		for (int i = 0; i < variables.size(); ++i)
+		const QHash<QString, int>::const_iterator it(variablesRows.find(name));
+		if (it != variablesRows.end())
 		{
-			Variable& variable(variables[i]);
-			if (variable.name == name)
-			{
-// 				setVariablesData(variable.pos, values);
-				emit variableValuesChanged(variable.pos, values);
-				return true;
-			}
+			emit variableValuesChanged(variables[it.value()].pos, values);
+			return true;
 		}
 		return false;
 	}
@@ -451,10 +468,7 @@ namespace Aseba
 	{
 		QStringList &list = variableListenersMap[listener];
 		list.push_back(name);
-		for (int i = 0; i < variables.size(); i++)
-			if (variables[i].name == name)
-				return true;
-		return false;
+		return variablesRows.contains(name);
 	}
 	
 	void TargetVariablesModel::unsubscribeToVariableOfInterest(VariableListener* listener, const QString& name)
@@ -26,6 +26,7 @@
 #include <QStringListModel>
 #include <QVector>
 #include <QList>
+#include <QHash>
 #include <QString>
 #include <QStringList>
 #include <QRegExp>
@@ -64,8 +65,6 @@ namespace Aseba
 	class TargetVariablesModel: public QAbstractItemModel
 	{
 		Q_OBJECT
-		
-		// FIXME: uses map for fast variable access
 	
 	public:
 		// variables
@@ -98,6 +97,8 @@ namespace Aseba
 		unsigned getVariablePos(const QString& name) const;
 		unsigned getVariableSize(const QString& name) const;
 		VariablesDataVector getVariableValue(const QString& name) const;
+		//! Return how many times received data changed the value of a variable, to detect activity
+		unsigned getChangesCount() const { return changesCount; }
 		
 	public slots:
 		void updateVariablesStructure(const VariablesMap *variablesMap);
@@ -121,8 +122,12 @@ namespace Aseba
 		//! Unsubscribe to all variables of interest for a given plugin
 		void unsubscribeToVariablesOfInterest(VariableListener* plugin);
 		
+		int firstVariableEndingAfter(unsigned address) const;
+		
 	private:
-		QList<Variable> variables;
+		QList<Variable> variables; //!< variables, sorted by address
+		QHash<QString, int> variablesRows; //!< row of each variable, by name
+		unsigned changesCount; //!< number of times received data changed the value of a variable
 		
 		// VariablesViewPlugin API 
 		typedef QMap<VariableListener*, QStringList> VariableListenersNameMap;
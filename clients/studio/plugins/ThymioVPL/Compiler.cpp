@@ -109,7 +109,7 @@ namespace Aseba { namespace ThymioVPL
 			definedEventMap[hash] = errorLine;
 			
 			// dispatch to code generator
-			codeGenerator.visit(eventActionsSet, scene->debugLog());
+			codeGenerator.visit(eventActionsSet, hash, errorLine, scene->debugLog());
 		}
 		
 		codeGenerator.addInitialisationCode();
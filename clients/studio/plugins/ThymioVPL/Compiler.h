@@ -29,6 +29,7 @@
 #include <utility>
 #include <QMap>
 #include <QPair>
+#include <QString>
 
 namespace Aseba { namespace ThymioVPL
 {
@@ -75,10 +76,21 @@ namespace Aseba { namespace ThymioVPL
 			
 			void reset(bool advanced);
 			void addInitialisationCode();
-			void visit(const EventActionsSet& eventActionsSet, bool debugLog);
+			void visit(const EventActionsSet& eventActionsSet, const QString& eventAndStateFilterHash, unsigned row, bool debugLog);
+			
+		protected:
+			//! Code generated for a set, kept across compilations to only regenerate modified sets
+			struct SetCode
+			{
+				QString key; //!< event and state filter hash, actions content and debug log row the code was generated from
+				std::wstring code; //!< generated code
+				bool useSound; //!< whether the code needs the sound initialisation
+			};
 			
 		protected:
 			void initEventToCodePosMap();
+			static QString setCodeKey(const EventActionsSet& eventActionsSet, const QString& eventAndStateFilterHash, bool debugLog);
+			void generateSetCode(const EventActionsSet& eventActionsSet, unsigned currentBlock, bool debugLog);
 			std::wstring indentText() const;
 			
 			void visitEndOfLine(unsigned currentBlock);
@@ -107,6 +119,8 @@ namespace Aseba { namespace ThymioVPL
 		protected:
 			typedef QMap<QString, QPair<int, int> > EventToCodePosMap;
 			EventToCodePosMap eventToCodePosMap;
+			//! Code of each set, by row, from previous compilations
+			std::vector<SetCode> setCodeCache;
 			
 			bool advancedMode;
 			bool useSound;
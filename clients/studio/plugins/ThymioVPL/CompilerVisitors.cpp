@@ -172,8 +172,27 @@ namespace Aseba { namespace ThymioVPL
 		return text;
 	}
 	
-	//! Generate code for an event-actions set
-	void Compiler::CodeGenerator::visit(const EventActionsSet& eventActionsSet, bool debugLog)
+	//! Return a string identifying everything the code of a set depends on
+	QString Compiler::CodeGenerator::setCodeKey(const EventActionsSet& eventActionsSet, const QString& eventAndStateFilterHash, bool debugLog)
+	{
+		QString key(eventAndStateFilterHash);
+		for (int i=0; i<eventActionsSet.actionBlocksCount(); ++i)
+		{
+			const Block* block(eventActionsSet.getActionBlock(i));
+			if (!block)
+				continue;
+			key += QString("|%0:").arg(block->getName());
+			for (unsigned j=0; j<block->valuesCount(); ++j)
+				key += QString::number(block->getValue(j)) + ",";
+		}
+		// the debug log contains the row of the set
+		if (debugLog)
+			key += QString("|log:%0").arg(eventActionsSet.getRow());
+		return key;
+	}
+	
+	//! Generate code for an event-actions set at row
+	void Compiler::CodeGenerator::visit(const EventActionsSet& eventActionsSet, const QString& eventAndStateFilterHash, unsigned row, bool debugLog)
 	{
 		// action and event name
 		const QString& eventName(eventActionsSet.getEventBlock()->getName());
@@ -285,6 +304,29 @@ namespace Aseba { namespace ThymioVPL
 		generatedCode.insert(generatedCode.begin() + currentBlock, L"");
 		setToCodeIdMap.push_back(currentBlock);
 		
+		// reuse the code of this row if the set did not change since last compilation
+		if (row >= setCodeCache.size())
+			setCodeCache.resize(row + 1);
+		SetCode& setCode(setCodeCache[row]);
+		const QString key(setCodeKey(eventActionsSet, eventAndStateFilterHash, debugLog));
+		if (key != setCode.key)
+		{
+			const bool previousUseSound(useSound);
+			useSound = false;
+			generateSetCode(eventActionsSet, currentBlock, debugLog);
+			setCode.key = key;
+			setCode.code = generatedCode[currentBlock];
+			setCode.useSound = useSound;
+			useSound = previousUseSound;
+		}
+		else
+			generatedCode[currentBlock] = setCode.code;
+		useSound = useSound || setCode.useSound;
+	}
+	
+	//! Generate the code of the event, state filter and actions of a set into generatedCode[currentBlock]
+	void Compiler::CodeGenerator::generateSetCode(const EventActionsSet& eventActionsSet, unsigned currentBlock, bool debugLog)
+	{
 		// add event and actions details
 		visitEventAndStateFilter(eventActionsSet.getEventBlock(), eventActionsSet.getStateFilterBlock(), currentBlock);
 		for (int i=0; i<eventActionsSet.actionBlocksCount(); ++i)
@@ -43,6 +43,7 @@ namespace Aseba { namespace ThymioVPL
 		errorGraphicsItem(new QGraphicsSvgItem(":/images/vpl/error.svgz")),
 		referredGraphicsItem(new QGraphicsSvgItem(":/images/vpl/error.svgz")),
 		referredLineItem(addLine(0, 0, 0, 0, QPen(Qt::red, 8, Qt::DashLine))),
+		changesCount(0),
 		sceneModified(false),
 		advancedMode(false),
 		zoomLevel(1)
@@ -55,6 +56,10 @@ namespace Aseba { namespace ThymioVPL
 		referredGraphicsItem->setVisible(false);
 		referredLineItem->setVisible(false);
 		
+		recompileTimer.setSingleShot(true);
+		recompileTimer.setInterval(recompileDelay);
+		connect(&recompileTimer, SIGNAL(timeout()), SLOT(recompileWithoutSetModified()));
+		
 		// create initial set
 		EventActionsSet *p(createNewEventActionsSet());
 		buttonSetHeight = p->boundingRect().height();
@@ -220,6 +225,7 @@ namespace Aseba { namespace ThymioVPL
 	//! Remove everything from the scene, leaving it with no object (hence not usable directly), and set advanced mode or not
 	void Scene::clear(bool advanced)
 	{
+		++changesCount;
 		disconnect(this, SIGNAL(selectionChanged()), this, SIGNAL(highlightChanged()));
 		for(int i=0; i<eventActionsSets.size(); i++)
 		{
@@ -497,14 +503,26 @@ namespace Aseba { namespace ThymioVPL
 		return eventActionsSets.at(row);
 	}
 	
+	//! Mark the scene as modified and schedule a recompilation, unless one is already pending
 	void Scene::recompile()
 	{
 		setModified(true);
-		recompileWithoutSetModified();
+		++changesCount;
+		if (!recompileTimer.isActive())
+			recompileTimer.start();
+	}
+	
+	//! Immediately run a recompilation scheduled by recompile(), if any
+	void Scene::recompileIfPending()
+	{
+		if (recompileTimer.isActive())
+			recompileWithoutSetModified();
 	}
 	
 	void Scene::recompileWithoutSetModified()
 	{
+		recompileTimer.stop();
+		++changesCount;
 		//qDebug() << "recompiling";
 		lastCompilationResult = compiler.compile(this);
 		
@@ -23,6 +23,7 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsSvgItem>
+#include <QTimer>
 #include "EventActionsSet.h"
 
 namespace Aseba { namespace ThymioVPL
@@ -47,6 +48,7 @@ namespace Aseba { namespace ThymioVPL
 		void reset();
 		void clear(bool advanced);
 		bool isModified() const { return sceneModified; }
+		unsigned getChangesCount() const { return changesCount; }
 		void setModified(bool mod);
 		void setScale(qreal scale);
 		void setAdvanced(bool advanced);
@@ -93,6 +95,7 @@ namespace Aseba { namespace ThymioVPL
 	public slots:
 		void recompile();
 		void recompileWithoutSetModified();
+		void recompileIfPending();
 		
 	protected:
 		/*void dragEnterEvent(QGraphicsSceneDragDropEvent *event);
@@ -115,6 +118,11 @@ namespace Aseba { namespace ThymioVPL
 		QList<EventActionsSet *> eventActionsSets;
 		Compiler compiler;
 		Compiler::CompilationResult lastCompilationResult;
+		//! Delays recompilation so that a burst of changes, such as a slider drag, only triggers one every recompileDelay ms
+		QTimer recompileTimer;
+		static const int recompileDelay = 100;
+		//! Incremented whenever the content of the scene may have changed
+		unsigned changesCount;
 		
 		// TODO: set this always through a function and emit a signal when it is changed, to update windows title (see issue 154)
 		bool sceneModified;
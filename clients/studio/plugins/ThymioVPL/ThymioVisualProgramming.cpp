@@ -490,12 +490,14 @@ namespace Aseba { namespace ThymioVPL
 	bool ThymioVisualProgramming::save()
 	{
 		USAGE_LOG(logSave());
+		scene->recompileIfPending();
 		return de->saveFile(false);
 	}
 	
 	bool ThymioVisualProgramming::saveAs()
 	{
 		USAGE_LOG(logSaveAs());
+		scene->recompileIfPending();
 		return de->saveFile(true);
 	}
 
@@ -547,6 +549,8 @@ namespace Aseba { namespace ThymioVPL
 	void ThymioVisualProgramming::run()
 	{
 		USAGE_LOG(logRun());
+		// make sure we run the latest version of the program
+		scene->recompileIfPending();
 		if(runButton->isEnabled())
 		{
 			de->loadAndRun();
@@ -658,6 +662,7 @@ namespace Aseba { namespace ThymioVPL
 	
 	void ThymioVisualProgramming::clearHighlighting(bool keepCode)
 	{
+		scene->recompileIfPending();
 		if (keepCode && scene->compilationResult().isSuccessful())
 			de->displayCode(scene->getCode(), -1);
 		else
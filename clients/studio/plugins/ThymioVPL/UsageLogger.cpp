@@ -38,8 +38,90 @@ using namespace std;
 namespace Aseba{ namespace ThymioVPL
 {
 	
+//! Open fileName for appending and start the writer thread
+UsageLogWriter::UsageLogWriter(const QString& fileName):
+	file(fileName),
+	stopping(false),
+	droppedCount(0)
+{
+	if (!file.open(QFile::WriteOnly | QFile::Append))
+		qDebug() << "Cannot open usage log file" << fileName;
+	start(QThread::LowPriority);
+}
+
+//! Write all pending records and stop the writer thread
+UsageLogWriter::~UsageLogWriter()
+{
+	mutex.lock();
+	stopping = true;
+	queueNotEmpty.wakeOne();
+	mutex.unlock();
+	wait();
+	if (droppedCount)
+		qDebug() << "Usage log queue was full," << droppedCount << "actions were not logged";
+}
+
+//! Queue a serialized action for writing, return false if the queue is full and the action was dropped
+bool UsageLogWriter::enqueue(const std::string& record)
+{
+	QMutexLocker locker(&mutex);
+	if (queue.size() >= maxQueueSize)
+	{
+		++droppedCount;
+		return false;
+	}
+	queue.append(QByteArray(record.data(), record.size()));
+	queueNotEmpty.wakeOne();
+	return true;
+}
+
+void UsageLogWriter::run()
+{
+	lastWrite.start();
+	mutex.lock();
+	while (true)
+	{
+		if (queue.isEmpty() && !stopping)
+			queueNotEmpty.wait(&mutex, flushPeriod);
+		const QList<QByteArray> records(queue);
+		queue.clear();
+		const bool stop(stopping);
+		mutex.unlock();
+		
+		for (int i = 0; i < records.size(); ++i)
+		{
+			const int size(records[i].size());
+			block.append((const char*)&size, 4);
+			block.append(records[i]);
+		}
+		if (!block.isEmpty() && (stop || block.size() >= blockSize || lastWrite.elapsed() >= flushPeriod))
+			writeBlock();
+		
+		mutex.lock();
+		if (stop && queue.isEmpty())
+			break;
+	}
+	mutex.unlock();
+}
+
+//! Compress and write the gathered records
+void UsageLogWriter::writeBlock()
+{
+	const QByteArray compressed(qCompress(block));
+	const int size(compressed.size());
+	file.write((const char*)&size, 4);
+	file.write(compressed);
+	file.flush();
+	block.clear();
+	lastWrite.restart();
+}
+
 bool UsageLogger::loggingEnabled = false;
-UsageLogger::UsageLogger()
+UsageLogger::UsageLogger():
+	writer(0),
+	scene(0),
+	stateChangesCount(0),
+	actionsSinceState(statePeriod)
 {
 	if(loggingEnabled){
 		askForGroupName();
@@ -47,8 +129,7 @@ UsageLogger::UsageLogger()
 		QString homePath = QDir::homePath();
 		QString filePath = homePath + "/" + groupName + "_" + getTimeStampString() + ".log";
 		
-		fileOut = new ofstream(filePath.toUtf8().constData(), ios::app | ios::binary);
-		scene = 0;
+		writer = new UsageLogWriter(filePath);
 		
 		connect(&signalMapper, SIGNAL(mapped(unsigned int, QObject *, QObject *)),this, SLOT(logGUIEvents(unsigned int, QObject*, QObject *)));
 	}
@@ -58,10 +139,7 @@ UsageLogger::UsageLogger()
 UsageLogger::~UsageLogger()
 {
 	delete action;
-	if(fileOut != 0){
-		fileOut->close();
-		delete fileOut;
-	}
+	delete writer;
 }
 
 void UsageLogger::setLoggingState(bool enabled){
@@ -96,6 +174,8 @@ int UsageLogger::getRow(Block * b){
 void UsageLogger::setScene(Scene * scene)
 {
 	this->scene = scene;
+	// log the state of the new scene with the next action
+	actionsSinceState = statePeriod;
 }
 
 UsageLogger& UsageLogger::getLogger()
@@ -373,19 +453,27 @@ void UsageLogger::logTabletData(const VariablesDataVector& data){
 }
 
 void UsageLogger::storeAction(Action * a){
-	if(loggingEnabled){
-		int size = a->ByteSize();
-		fileOut->write((char*)&size,4);
-		fileOut->flush();
-		a->SerializeToOstream(fileOut);
+	if(loggingEnabled && writer){
+		std::string record;
+		a->SerializeToString(&record);
+		writer->enqueue(record);
 	}
 }
 
 Action * UsageLogger::getActionWithCurrentState()
 {
 	action->Clear();
+	// only serialize the program state if it changed since last logged, or periodically
 	if(scene != 0){
-		action->set_programstateasxml(scene->toString().toUtf8().constData());
+		const unsigned changesCount(scene->getChangesCount());
+		if(changesCount != stateChangesCount || actionsSinceState >= statePeriod){
+			action->set_programstateasxml(scene->toString().toUtf8().constData());
+			stateChangesCount = changesCount;
+			actionsSinceState = 0;
+		}
+		else{
+			++actionsSinceState;
+		}
 	}
 	
 	TimeStamp *t = new TimeStamp();
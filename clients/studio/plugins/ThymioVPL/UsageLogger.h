@@ -36,6 +36,13 @@
 #include <QDropEvent>
 #include <QGraphicsSceneDragDropEvent>
 #include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QTime>
+#include <QList>
+#include <QByteArray>
 
 
 #include "Scene.h"
@@ -47,6 +54,35 @@
 
 namespace Aseba { namespace ThymioVPL
 {
+
+//! Write serialized actions to a log file from a background thread.
+//! Records (a 4-byte size followed by the action) are gathered in blocks,
+//! and each block is written compressed with qCompress, preceded by its 4-byte size.
+class UsageLogWriter : public QThread
+{
+public:
+	UsageLogWriter(const QString& fileName);
+	virtual ~UsageLogWriter();
+	
+	bool enqueue(const std::string& record);
+	
+protected:
+	virtual void run();
+	void writeBlock();
+	
+	static const int maxQueueSize = 4096; //!< records beyond that are dropped, to never block the GUI
+	static const int blockSize = 65536; //!< bytes of records gathered before compressing and writing a block
+	static const int flushPeriod = 2000; //!< maximum delay in ms before pending records are written
+	
+	QFile file;
+	QMutex mutex; //!< protects queue, stopping and droppedCount
+	QWaitCondition queueNotEmpty;
+	QList<QByteArray> queue;
+	bool stopping;
+	unsigned droppedCount;
+	QByteArray block; //!< records not yet written, only used by the writer thread
+	QTime lastWrite; //!< time of last block write, only used by the writer thread
+};
 	
 class UsageLogger : public QObject
 {
@@ -112,8 +148,14 @@ protected:
 	void askForGroupName();
 	unsigned int getMilliseconds();
 	
-	std::ofstream * fileOut;
+	UsageLogWriter * writer;
 	Scene * scene;
+	//! Value of scene->getChangesCount() when the program state was last logged
+	unsigned stateChangesCount;
+	//! Number of actions logged without the program state since it was last logged
+	unsigned actionsSinceState;
+	//! Log the program state at least every statePeriod actions, even if unchanged, so that logs can be read from any full state
+	static const unsigned statePeriod = 100;
 };
 
 }}
@@ -29,32 +29,27 @@ namespace Aseba
 	
 	typedef std::map<int, std::pair<std::string, std::string> > PortsMap;
 	
-	QtBootloaderInterface::QtBootloaderInterface(Stream* stream, int dest):
-		BootloaderInterface(stream, dest),
-		pagesCount(0),
-		pagesDoneCount(0)
-	{}
-	
-	void QtBootloaderInterface::writeHexGotDescription(unsigned pagesCount)
-	{
-		this->pagesCount = pagesCount;
-		this->pagesDoneCount = 0;
-	}
-	
-	void QtBootloaderInterface::writePageStart(unsigned pageNumber, const uint8* data, bool simple)
+	void QtMultiBootloaderInterface::devicePageWritten(unsigned device, unsigned pageNumber)
 	{
-		pagesDoneCount += 1;
+		// all robots get the same firmware, so progress is the total over started ones
+		unsigned pagesDoneCount(0);
+		unsigned pagesCount(0);
+		for (unsigned i = 0; i < getDevicesCount(); ++i)
+		{
+			pagesDoneCount += getDevice(i).pagesWritten;
+			pagesCount += getDevice(i).pagesTotal;
+		}
 		emit flashProgress((100*pagesDoneCount)/pagesCount);
 	}
 	
-	void QtBootloaderInterface::errorWritePageNonFatal(unsigned pageNumber)
+	void QtMultiBootloaderInterface::devicePageRetry(unsigned device, unsigned pageNumber, unsigned attempt)
 	{
-		qDebug() << "Warning, error while writing page" << pageNumber << "continuing ...";
+		qDebug() << "Warning, error while writing page" << pageNumber << "of" << getDevice(device).target.c_str() << ", retrying ...";
 	}
 
 	
-	ThymioUpgraderDialog::ThymioUpgraderDialog(const std::string& target):
-		target(target)
+	ThymioUpgraderDialog::ThymioUpgraderDialog(const std::vector<std::string>& targets):
+		targets(targets)
 	{
 		// Create the gui ...
 		setWindowTitle(tr("Thymio Firmware Upgrader"));
@@ -139,39 +134,42 @@ namespace Aseba
 		// start flash thread
 		Q_ASSERT(!flashFuture.isRunning());
 		const string hexFileName(lineEdit->text().toLocal8Bit().constData());
-		flashFuture = QtConcurrent::run(this, &ThymioUpgraderDialog::flashThread, target, hexFileName);
+		flashFuture = QtConcurrent::run(this, &ThymioUpgraderDialog::flashThread, targets, hexFileName);
 		flashFutureWatcher.setFuture(flashFuture);
 	}
 	
-	ThymioUpgraderDialog::FlashResult ThymioUpgraderDialog::flashThread(const std::string& _target, const std::string& hexFileName) const
+	ThymioUpgraderDialog::FlashResult ThymioUpgraderDialog::flashThread(const std::vector<std::string>& _targets, const std::string& hexFileName) const
 	{
-		// open stream
-		Dashel::Hub hub;
-		Dashel::Stream* stream(0);
-		try
+		// open streams, robots are flashed directly, so they all have id 1
+		QtMultiBootloaderInterface bootloaderInterface;
+		bootloaderInterface.setSimple(true);
+		for (size_t i = 0; i < _targets.size(); ++i)
 		{
-			stream = hub.connect(_target);
-		}
-		catch (Dashel::DashelException& e)
-		{
-			return FlashResult(FlashResult::WARNING, tr("Cannot connect to Thymio II"), tr("Cannot connect to Thymio II: %1.<p>Most probably another program is currently connected to the Thymio II. Make sure that there are no Studio or other Upgrader running and try again.</p>").arg(e.what()));
+			const unsigned device(bootloaderInterface.addDevice(_targets[i], 1));
+			if (bootloaderInterface.getDevice(device).state == MultiBootloaderInterface::Device::FAILED)
+				return FlashResult(FlashResult::WARNING, tr("Cannot connect to Thymio II"), tr("Cannot connect to Thymio II: %1.<p>Most probably another program is currently connected to the Thymio II. Make sure that there are no Studio or other Upgrader running and try again.</p>").arg(bootloaderInterface.getDevice(device).error.c_str()));
 		}
 		
 		// do flash
 		try
 		{
-			QtBootloaderInterface bootloaderInterface(stream, 1);
 			connect(&bootloaderInterface, SIGNAL(flashProgress(int)), this, SLOT(flashProgress(int)), Qt::QueuedConnection);
-			bootloaderInterface.writeHex(hexFileName, true, true);
+			if (!bootloaderInterface.writeHex(hexFileName, true))
+			{
+				QString errors;
+				for (unsigned i = 0; i < bootloaderInterface.getDevicesCount(); ++i)
+				{
+					const MultiBootloaderInterface::Device& device(bootloaderInterface.getDevice(i));
+					if (device.state != MultiBootloaderInterface::Device::DONE)
+						errors += QString("<p>%1: %2</p>").arg(device.target.c_str()).arg(device.error.c_str());
+				}
+				return FlashResult(FlashResult::FAILURE, tr("Upgrade Error"), tr("A bootloader error happened during the upgrade process: %1").arg(errors));
+			}
 		}
 		catch (HexFile::Error& e)
 		{
 			return FlashResult(FlashResult::WARNING, tr("Upgrade Error"), tr("Unable to read Hex file: %1").arg(e.toString().c_str()));
 		}
-		catch (BootloaderInterface::Error& e)
-		{
-			return FlashResult(FlashResult::FAILURE, tr("Upgrade Error"), tr("A bootloader error happened during the upgrade process: %1").arg(e.what()));
-		}
 		catch (Dashel::DashelException& e)
 		{
 			return FlashResult(FlashResult::FAILURE, tr("Upgrade Error"), tr("A communication error happened during the upgrade process: %1").arg(e.what()));
@@ -221,32 +219,22 @@ int main(int argc, char *argv[])
 	translator.load(QString(":/thymioupgrader_") + QLocale::system().name());
 	
 	const Aseba::PortsMap ports = Dashel::SerialPortEnumerator::getPorts();
-	std::string target("ser:device=");
-	bool thymioFound(false);
-	bool thymiosFound(false);
+	std::vector<std::string> targets;
 	for (Aseba::PortsMap::const_iterator it = ports.begin(); it != ports.end(); ++it)
 	{
 		if (it->second.second.compare(0,9,"Thymio-II") == 0)
 		{
-			if (thymioFound)
-				thymiosFound = true;
-			thymioFound = true;
-			target += it->second.first;
-			//std::cout << target << std::endl;
+			targets.push_back(std::string("ser:device=") + it->second.first);
+			//std::cout << targets.back() << std::endl;
 		}
 	}
-	if (!thymioFound)
+	if (targets.empty())
 	{
 		QMessageBox::critical(0, QApplication::tr("Thymio II not found"), QApplication::tr("<p><b>Cannot find Thymio II!</b></p><p>Plug Thymio II or use the command-line firmware upgrader (asebacmd).</p>"));
 		return 1;
 	}
-	if (thymiosFound)
-	{
-		QMessageBox::critical(0, QApplication::tr("Multiple Thymio II found"), QApplication::tr("<p><b>More than one Thymio II found!</b></p><p>Plug a single Thymio II or use the command-line firmware upgrader (asebacmd).</p>"));
-		return 2;
-	}
 	
-	Aseba::ThymioUpgraderDialog upgrader(target);
+	Aseba::ThymioUpgraderDialog upgrader(targets);
 	
 	return app.exec();
 }
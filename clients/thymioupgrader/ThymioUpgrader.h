@@ -5,7 +5,7 @@
 #include <QFuture>
 #include <QFutureWatcher>
 #include <dashel/dashel.h>
-#include "../../common/utils/BootloaderInterface.h"
+#include "../../common/utils/MultiBootloaderInterface.h"
 
 class QVBoxLayout;
 class QHBoxLayout;
@@ -20,21 +20,13 @@ namespace Aseba
 	/** \addtogroup thymioupdater */
 	/*@{*/
 	
-	class QtBootloaderInterface:public QObject, public BootloaderInterface
+	class QtMultiBootloaderInterface:public QObject, public MultiBootloaderInterface
 	{
 		Q_OBJECT
 		
-	public:
-		QtBootloaderInterface(Dashel::Stream* stream, int dest);
-		
-	protected:
-		virtual void writeHexGotDescription(unsigned pagesCount);
-		virtual void writePageStart(unsigned pageNumber, const uint8* data, bool simple);
-		virtual void errorWritePageNonFatal(unsigned pageNumber);
-	
 	protected:
-		unsigned pagesCount;
-		unsigned pagesDoneCount;
+		virtual void devicePageWritten(unsigned device, unsigned pageNumber);
+		virtual void devicePageRetry(unsigned device, unsigned pageNumber, unsigned attempt);
 		
 	signals:
 		void flashProgress(int percentage);
@@ -61,7 +53,7 @@ namespace Aseba
 		};
 		
 	private:
-		std::string target;
+		std::vector<std::string> targets;
 		QVBoxLayout* mainLayout;
 		QHBoxLayout* fileLayout;
 		QHBoxLayout* flashLayout;
@@ -74,11 +66,11 @@ namespace Aseba
 		QFutureWatcher<FlashResult> flashFutureWatcher;
 
 	public:
-		ThymioUpgraderDialog(const std::string& target);
+		ThymioUpgraderDialog(const std::vector<std::string>& targets);
 		~ThymioUpgraderDialog();
 		
 	private:
-		FlashResult flashThread(const std::string& _target, const std::string& hexFileName) const;
+		FlashResult flashThread(const std::vector<std::string>& _targets, const std::string& hexFileName) const;
 	
 	private slots:
 		void setupFlashButtonState();
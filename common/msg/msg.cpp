@@ -179,20 +179,41 @@ namespace Aseba
 		message->rawData.resize(len);
 		if (len)
 			stream->read(&message->rawData[0], len);
-		message->readPos = 0;
 		
 		// deserialize it
-		message->deserializeSpecific();
+		message->deserializeRawData();
 		
-		if (message->readPos != message->rawData.size())
+		return message;
+	}
+	
+	Message *Message::create(uint16 source, uint16 type, const std::vector<uint8>& rawData)
+	{
+		// create message
+		Message *message = messageTypesInitializer.createMessage(type);
+		
+		// preapare message
+		message->source = source;
+		message->type = type;
+		message->rawData = rawData;
+		
+		// deserialize it
+		message->deserializeRawData();
+		
+		return message;
+	}
+	
+	void Message::deserializeRawData()
+	{
+		readPos = 0;
+		deserializeSpecific();
+		
+		if (readPos != rawData.size())
 		{
-			cerr << "Message::receive() : fatal error: message not fully read.\n";
-			cerr << "type: " << type << ", readPos: " << message->readPos << ", rawData size: " << message->rawData.size() << endl;
-			message->dumpBuffer(wcerr);
+			cerr << "Message::deserializeRawData() : fatal error: message not fully read.\n";
+			cerr << "type: " << type << ", readPos: " << readPos << ", rawData size: " << rawData.size() << endl;
+			dumpBuffer(wcerr);
 			abort();
 		}
-		
-		return message;
 	}
 	
 	void Message::dump(wostream &stream) const
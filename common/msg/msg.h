@@ -55,10 +55,12 @@ namespace Aseba
 		
 		void serialize(Dashel::Stream* stream);
 		static Message *receive(Dashel::Stream* stream);
+		static Message *create(uint16 source, uint16 type, const std::vector<uint8>& rawData);
 		void dump(std::wostream &stream) const;
 		void dumpBuffer(std::wostream &stream) const;
 		
 	protected:
+		void deserializeRawData();
 		virtual void serializeSpecific() = 0;
 		virtual void deserializeSpecific() = 0;
 		virtual void dumpSpecific(std::wostream &stream) const = 0;
@@ -0,0 +1,115 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AboFile.h"
+#include "utils.h"
+#include "FormatableString.h"
+#include <fstream>
+#include <iterator>
+
+namespace Aseba
+{
+	AboFile::AboFile():
+		formatVersion(0),
+		protocolVersion(0),
+		productId(0),
+		firmwareVersion(0),
+		nodeId(0),
+		nameCrc(0),
+		descriptionCrc(0)
+	{}
+	
+	//! Read fileName, return false and fill errorMessage if the file is invalid
+	bool AboFile::read(const std::string& fileName, std::string& errorMessage)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+		if (!file.good())
+		{
+			errorMessage = FormatableString("Cannot open file %0").arg(fileName);
+			return false;
+		}
+		
+		// header: magic, then format and protocol versions, product, firmware, node id, name and description checksums
+		char magic[4];
+		if (!file.read(magic, 4) || magic[0] != 'A' || magic[1] != 'B' || magic[2] != 'O' || magic[3] != 0)
+		{
+			errorMessage = FormatableString("File %0 is not an Aseba Binary Object").arg(fileName);
+			return false;
+		}
+		const std::vector<uint8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		const size_t headerSize(7 * 2);
+		if (data.size() < headerSize + 2)
+		{
+			errorMessage = FormatableString("File %0 is truncated").arg(fileName);
+			return false;
+		}
+		uint16 header[7];
+		for (size_t i = 0; i < 7; ++i)
+			header[i] = data[2 * i] | (data[2 * i + 1] << 8);
+		formatVersion = header[0];
+		protocolVersion = header[1];
+		productId = header[2];
+		firmwareVersion = header[3];
+		nodeId = header[4];
+		nameCrc = header[5];
+		descriptionCrc = header[6];
+		
+		// bytecode, followed by its checksum
+		const size_t size(data[headerSize] | (data[headerSize + 1] << 8));
+		if (data.size() < headerSize + 2 + 2 * size + 2)
+		{
+			errorMessage = FormatableString("File %0 is truncated").arg(fileName);
+			return false;
+		}
+		bytecode.resize(size);
+		uint16 crc(0);
+		for (size_t i = 0; i < size; ++i)
+		{
+			const size_t pos(headerSize + 2 + 2 * i);
+			bytecode[i] = data[pos] | (data[pos + 1] << 8);
+			crc = crcXModem(crc, bytecode[i]);
+		}
+		const size_t pos(headerSize + 2 + 2 * size);
+		if ((data[pos] | (data[pos + 1] << 8)) != crc)
+		{
+			errorMessage = FormatableString("File %0 has an invalid checksum").arg(fileName);
+			return false;
+		}
+		return true;
+	}
+	
+	//! Read fileName and check that it was compiled for a node of product expectedProductId whose description has the checksum expectedDescriptionCrc, return false and fill errorMessage otherwise
+	bool AboFile::read(const std::string& fileName, uint16 expectedProductId, uint16 expectedDescriptionCrc, std::string& errorMessage)
+	{
+		if (!read(fileName, errorMessage))
+			return false;
+		if (productId != expectedProductId)
+		{
+			errorMessage = FormatableString("File %0 is for product %1, but the node is product %2").arg(fileName).arg(productId).arg(expectedProductId);
+			return false;
+		}
+		if (descriptionCrc != expectedDescriptionCrc)
+		{
+			errorMessage = FormatableString("File %0 was compiled for a node with a different description").arg(fileName);
+			return false;
+		}
+		return true;
+	}
+}
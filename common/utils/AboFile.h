@@ -0,0 +1,49 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_ABO_FILE_H
+#define ASEBA_ABO_FILE_H
+
+#include "../types.h"
+#include <vector>
+#include <string>
+
+namespace Aseba
+{
+	//! An Aseba Binary Object, the bytecode of a node saved with the node it was compiled for, see AS001 at https://aseba.wikidot.com/asebaspecifications
+	struct AboFile
+	{
+		uint16 formatVersion; //!< version of the file format
+		uint16 protocolVersion; //!< version of the protocol of the node
+		uint16 productId; //!< product identifier of the node
+		uint16 firmwareVersion; //!< firmware version of the node
+		uint16 nodeId; //!< identifier of the node
+		uint16 nameCrc; //!< XModem CRC of the name of the node
+		uint16 descriptionCrc; //!< XModem CRC of the description of the node
+		std::vector<uint16> bytecode;
+		
+		AboFile();
+		
+		bool read(const std::string& fileName, std::string& errorMessage);
+		bool read(const std::string& fileName, uint16 expectedProductId, uint16 expectedDescriptionCrc, std::string& errorMessage);
+	};
+}
+
+#endif
@@ -38,7 +38,9 @@ namespace Aseba
 		dest(dest),
 		pageSize(0),
 		pagesStart(0),
-		pagesCount(0)
+		pagesCount(0),
+		pipelined(false),
+		differential(false)
 	{
 		
 	}
@@ -87,7 +89,6 @@ namespace Aseba
 				copy(dataMessage->data, dataMessage->data + sizeof(dataMessage->data), data);
 				data += sizeof(dataMessage->data);
 				dataRead += sizeof(dataMessage->data);
-				cout << "Page read so far (" << dataRead << "/" << pageSize << ") bytes.\n";
 			}
 		}
 		
@@ -204,6 +205,83 @@ namespace Aseba
 		return true;
 	}
 	
+	//! Wait for the next acknowledgement from dest and return its error code
+	uint16 BootloaderInterface::waitAck()
+	{
+		while (true)
+		{
+			auto_ptr<Message> message(Message::receive(stream));
+			BootloaderAck *ackMessage = dynamic_cast<BootloaderAck *>(message.get());
+			if (ackMessage && (ackMessage->source == dest))
+				return ackMessage->errorCode;
+		}
+	}
+	
+	//! Write pages with the complete protocol, sending the command of a page before the data of the previous one is acknowledged.
+	//! The bootloader does not listen while erasing, so the data of a page is only sent once its command is acknowledged;
+	//! acknowledgements do not carry page numbers, but come in order: the data of the previous page, then the command of this one.
+	void BootloaderInterface::writePagesPipelined(const PageImage& pageImage)
+	{
+		bool dataInFlight(false);
+		unsigned inFlightPage(0);
+		for (size_t index = 0; index < pageImage.size(); ++index)
+		{
+			const unsigned pageIndex(pageImage.getPageNumber(index));
+			const uint8* data(pageImage.getPageData(index));
+			if (!pageImage.isDirty(index) || (pageIndex < pagesStart) || (pageIndex >= pagesStart + pagesCount))
+				continue;
+			
+			writePageStart(pageIndex, data, false);
+			BootloaderWritePage writePage;
+			writePage.dest = dest;
+			writePage.pageNumber = pageIndex;
+			writePage.serialize(stream);
+			stream->flush();
+			
+			// the data of the previous page is acknowledged while this one is erased
+			writePageWaitAck();
+			if (dataInFlight)
+			{
+				if (waitAck() != BootloaderAck::SUCCESS)
+				{
+					writePageFailure();
+					throw Error(FormatableString("Error while writing page %0").arg(inFlightPage));
+				}
+				writePageSuccess();
+				dataInFlight = false;
+			}
+			if (waitAck() != BootloaderAck::SUCCESS)
+			{
+				writePageFailure();
+				throw Error(FormatableString("Error while erasing page %0").arg(pageIndex));
+			}
+			
+			for (unsigned dataWritten = 0; dataWritten < pageSize;)
+			{
+				BootloaderPageDataWrite pageData;
+				pageData.dest = dest;
+				copy(data + dataWritten, data + dataWritten + sizeof(pageData.data), pageData.data);
+				pageData.serialize(stream);
+				dataWritten += sizeof(pageData.data);
+			}
+			stream->flush();
+			dataInFlight = true;
+			inFlightPage = pageIndex;
+		}
+		
+		// the data of the last page
+		if (dataInFlight)
+		{
+			writePageWaitAck();
+			if (waitAck() != BootloaderAck::SUCCESS)
+			{
+				writePageFailure();
+				throw Error(FormatableString("Error while writing page %0").arg(inFlightPage));
+			}
+			writePageSuccess();
+		}
+	}
+	
 	void BootloaderInterface::writeHex(const string &fileName, bool reset, bool simple)
 	{
 		// Load hex file
@@ -256,71 +334,54 @@ namespace Aseba
 			}
 		}
 		
-		// Build a map of pages out of the map of addresses
-		typedef map<uint32, vector<uint8> > PageMap;
-		PageMap pageMap;
-		for (HexFile::ChunkMap::iterator it = hexFile.data.begin(); it != hexFile.data.end(); it ++)
+		PageImage pageImage(hexFile, pageSize);
+		
+		// Skip pages whose content is already in flash
+		if (differential && !simple)
 		{
-			// get page number
-			unsigned chunkAddress = it->first;
-			// index inside data chunk
-			unsigned chunkDataIndex = 0;
-			// size of chunk in bytes
-			unsigned chunkSize = it->second.size();
-			
-			// copy data from chunk to page
-			do
+			vector<uint8> buffer(pageSize);
+			for (size_t index = 0; index < pageImage.size(); ++index)
 			{
-				// get page number
-				unsigned pageIndex = (chunkAddress + chunkDataIndex) / pageSize;
-				// get address inside page
-				unsigned byteIndex = (chunkAddress + chunkDataIndex) % pageSize;
-			
-				// if page does not exists, create it
-				if (pageMap.find(pageIndex) == pageMap.end())
+				const unsigned pageIndex(pageImage.getPageNumber(index));
+				if ((pageIndex >= pagesStart) && (pageIndex < pagesStart + pagesCount) &&
+					readPage(pageIndex, &buffer[0]) && equal(buffer.begin(), buffer.end(), pageImage.getPageData(index)))
 				{
-				//	std::cout << "New page N° " << pageIndex << " for address 0x" << std::hex << chunkAddress << endl;
-					pageMap[pageIndex] = vector<uint8>(pageSize, (uint8)0);
+					writePageSkipped(pageIndex);
+					pageImage.clearDirty(index);
 				}
-				// copy data
-				unsigned amountToCopy = min(pageSize - byteIndex, chunkSize - chunkDataIndex);
-				copy(it->second.begin() + chunkDataIndex, it->second.begin() + chunkDataIndex + amountToCopy, pageMap[pageIndex].begin() + byteIndex);
-				
-				// increment chunk data pointer
-				chunkDataIndex += amountToCopy;
 			}
-			while (chunkDataIndex < chunkSize);
 		}
 		
-		writeHexGotDescription(pageMap.size());
+		writeHexGotDescription(pageImage.getDirtyCount());
 		
 		if (simple)
 		{
 			// Write pages
-			for (PageMap::iterator it = pageMap.begin(); it != pageMap.end(); it ++)
+			for (size_t index = 0; index < pageImage.size(); ++index)
 			{
-				unsigned pageIndex = it->first;
+				unsigned pageIndex = pageImage.getPageNumber(index);
 				if (pageIndex != 0)
-					if (!writePage(pageIndex, &it->second[0], true))
+					if (!writePage(pageIndex, pageImage.getPageData(index), true))
 						errorWritePageNonFatal(pageIndex);
 			}
 			// Now look for the index 0 page
-			for (PageMap::iterator it = pageMap.begin(); it != pageMap.end(); it ++)
-			{
-				unsigned pageIndex = it->first;
-				if (pageIndex == 0)
-					if (!writePage(pageIndex, &it->second[0], true))
-						errorWritePageNonFatal(pageIndex);
-			}
+			const size_t index(pageImage.find(0));
+			if (index != pageImage.size())
+				if (!writePage(0, pageImage.getPageData(index), true))
+					errorWritePageNonFatal(0);
+		}
+		else if (pipelined)
+		{
+			writePagesPipelined(pageImage);
 		}
 		else
 		{
 			// Write pages
-			for (PageMap::iterator it = pageMap.begin(); it != pageMap.end(); it ++)
+			for (size_t index = 0; index < pageImage.size(); ++index)
 			{
-				unsigned pageIndex = it->first;
-				if ((pageIndex >= pagesStart) && (pageIndex < pagesStart + pagesCount))
-					if (!writePage(pageIndex, &it->second[0], false))
+				unsigned pageIndex = pageImage.getPageNumber(index);
+				if (pageImage.isDirty(index) && (pageIndex >= pagesStart) && (pageIndex < pagesStart + pagesCount))
+					if (!writePage(pageIndex, pageImage.getPageData(index), false))
 						throw Error(FormatableString("Error while writing page %0").arg(pageIndex));
 			}
 		}
@@ -43,6 +43,8 @@ namespace Aseba
 		The simple version requires direct access to the device to be flashed,
 		because it breaks the Aseba message protocol for page transmission.
 	*/
+	class PageImage;
+	
 	class BootloaderInterface
 	{
 	public:
@@ -61,6 +63,12 @@ namespace Aseba
 		//! Return the size of a page
 		int getPageSize() const { return pageSize; }
 		
+		//! If pipelined is true, send the command of a page while the previous one is programmed, with the complete protocol; otherwise wait for each page
+		void setPipelined(bool pipelined) { this->pipelined = pipelined; }
+		
+		//! If differential is true, read back each page before writing it and skip it if identical, with the complete protocol
+		void setDifferential(bool differential) { this->differential = differential; }
+		
 		//! Read a page
 		bool readPage(unsigned pageNumber, uint8* data);
 		
@@ -76,6 +84,10 @@ namespace Aseba
 		//! Read an hex file and write it to fileName
 		void readHex(const std::string &fileName);
 		
+	protected:
+		uint16 waitAck();
+		void writePagesPipelined(const PageImage& pageImage);
+		
 	protected:
 		// reporting function
 		
@@ -84,6 +96,7 @@ namespace Aseba
 		virtual void writePageWaitAck() {}
 		virtual void writePageSuccess() {}
 		virtual void writePageFailure() {}
+		virtual void writePageSkipped(unsigned pageNumber) {}
 		
 		virtual void writeHexStart(const std::string &fileName, bool reset, bool simple) {}
 		virtual void writeHexEnteringBootloader() {}
@@ -103,6 +116,8 @@ namespace Aseba
 		unsigned pageSize;
 		unsigned pagesStart;
 		unsigned pagesCount;
+		bool pipelined;
+		bool differential;
 	};
 } // namespace Aseba
 
@@ -19,6 +19,7 @@
 */
 
 #include "HexFile.h"
+#include "utils.h"
 #include <istream>
 #include <ostream>
 #include <fstream>
@@ -27,6 +28,7 @@
 #include <cassert>
 #include <algorithm>
 #include <valarray>
+#include <cctype>
 
 namespace Aseba
 {
@@ -55,169 +57,112 @@ namespace Aseba
 		return FormatableString("Can't open file %0").arg(fileName);
 	}
 	
-	unsigned HexFile::getUint4(std::istream &stream)
+	//! Value of hexadecimal digits by character, 0x10 for others
+	struct HexDigits
 	{
-		int c = stream.get();
-		if (c <= '9')
-			return c - '0';
-		else if (c <= 'F')
-			return c - 'A' + 10;
-		else
-			return c - 'a' + 10;
-	}
-	
-	unsigned HexFile::getUint8(std::istream &stream)
-	{
-		return (getUint4(stream) << 4) | getUint4(stream);
-	}
-	
-	unsigned HexFile::getUint16(std::istream &stream)
-	{
-		return (getUint8(stream) << 8) | getUint8(stream);
-	}
+		uint8 values[256];
+		
+		HexDigits()
+		{
+			std::fill(values, values + 256, 0x10);
+			for (unsigned i = 0; i < 10; ++i)
+				values['0' + i] = i;
+			for (unsigned i = 0; i < 6; ++i)
+			{
+				values['A' + i] = 10 + i;
+				values['a' + i] = 10 + i;
+			}
+		}
+	};
+	static const HexDigits hexDigits;
 	
 	void HexFile::read(const std::string &fileName)
 	{
-		std::ifstream ifs(fileName.c_str());
-		
-		if (ifs.bad())
+		// load the whole file at once
+		std::ifstream ifs(fileName.c_str(), std::ios::in | std::ios::binary);
+		if (!ifs.good())
 			throw FileOpeningError(fileName);
+		ifs.seekg(0, std::ios::end);
+		const std::streamoff fileSize(ifs.tellg());
+		ifs.seekg(0, std::ios::beg);
+		std::vector<char> text(fileSize > 0 ? size_t(fileSize) : 0);
+		if (!text.empty())
+			ifs.read(&text[0], text.size());
+		ifs.close();
 		
+		const unsigned char* pos(reinterpret_cast<const unsigned char*>(text.empty() ? 0 : &text[0]));
+		const unsigned char* const end(pos + text.size());
+		// length, address (2), type, up to 255 data, checksum
+		uint8 record[260];
 		int lineCounter = 0;
 		uint32 baseAddress = 0;
+		ChunkMap::iterator lastChunk(data.end());
 		
-		while (ifs.good())
+		while (true)
 		{
-			// leading ":" character
-			char c;
-			ifs >> c;
-			if (c != ':')
+			// skip line ends and other white spaces before the leading ":" character
+			while (pos != end && isspace(*pos))
+				++pos;
+			if (pos == end)
+				break;
+			if (*pos != ':')
 				throw InvalidRecord(lineCounter);
+			++pos;
 			
-			uint8 computedCheckSum = 0;
-			
-			// record data length
-			uint8 dataLength = getUint8(ifs);
-			computedCheckSum += dataLength;
-			
-			// short address
-			uint16 lowAddress = getUint16(ifs);
-			computedCheckSum += lowAddress;
-			computedCheckSum += lowAddress >> 8;
-			
-			// record type
-			uint8 recordType = getUint8(ifs);
-			computedCheckSum += recordType;
+			// decode the record at once, accumulating errors and the checksum without branching
+			if (end - pos < 2)
+				break;
+			const unsigned dataLength((hexDigits.values[pos[0]] << 4) | hexDigits.values[pos[1]]);
+			if (dataLength > 0xff)
+				throw InvalidRecord(lineCounter);
+			const unsigned recordLength(dataLength + 5);
+			if (unsigned(end - pos) < 2 * recordLength)
+				break;
+			unsigned invalid(0);
+			uint8 checkSum(0);
+			for (unsigned i = 0; i < recordLength; ++i)
+			{
+				const unsigned high(hexDigits.values[pos[2*i]]);
+				const unsigned low(hexDigits.values[pos[2*i+1]]);
+				invalid |= high | low;
+				record[i] = uint8((high << 4) | low);
+				checkSum += record[i];
+			}
+			pos += 2 * recordLength;
+			if (invalid & 0x10)
+				throw InvalidRecord(lineCounter);
+			if (checkSum != 0)
+			{
+				const uint8 recordCheckSum(record[recordLength - 1]);
+				throw WrongCheckSum(lineCounter, recordCheckSum, uint8(recordCheckSum - checkSum));
+			}
 			
+			const uint16 lowAddress((record[1] << 8) | record[2]);
+			const uint8 recordType(record[3]);
 			switch (recordType)
 			{
 				case 0:
 				// data record
-				{
-					// read data
-					std::vector<uint8> recordData;
-					for (int i = 0; i != dataLength; i++)
-					{
-						uint8 d = getUint8(ifs);
-						computedCheckSum += d;
-						recordData.push_back(d);
-						//std::cout << "data " << std::hex << (unsigned)d << "\n";
-					}
-					
-					// verify checksum
-					uint8 checkSum = getUint8(ifs);
-					computedCheckSum = 1 + ~computedCheckSum;
-					if (checkSum != computedCheckSum)
-						throw WrongCheckSum(lineCounter, checkSum, computedCheckSum);
-					
-					// compute address
-					uint32 address = lowAddress;
-					address += baseAddress;
-					//std::cout << "data record at address 0x" << std::hex << address << "\n";
-					
-					// is some place to add
-					bool found = false;
-					for (ChunkMap::iterator it = data.begin(); it != data.end(); ++it)
-					{
-						size_t chunkSize = it->second.size();
-						if (address == it->first + chunkSize)
-						{
-							// copy new
-							std::copy(recordData.begin(), recordData.end(), std::back_inserter(it->second));
-							found = true;
-							//std::cout << "tail fusable chunk found\n";
-							break;
-						}
-						else if (address + recordData.size() == it->first)
-						{
-							// resize
-							it->second.resize(chunkSize + recordData.size());
-							// move
-							std::copy_backward(it->second.begin(), it->second.begin() + chunkSize, it->second.end());
-							// copy new
-							std::copy(recordData.begin(), recordData.end(), it->second.begin());
-							found = true;
-							//std::cout << "head fusable chunk found\n";
-							break;
-						}
-					}
-					if (!found)
-						data[address] = recordData;
-				}
+				if (dataLength)
+					lastChunk = addData(lastChunk, baseAddress + lowAddress, record + 4, dataLength);
 				break;
 				
 				case 1:
 				// end of file record
-				for (ChunkMap::iterator it = data.begin(); it != data.end(); ++it)
-				{
-					//std::cout << "End of file found. Address " << it->first << " size " << it->second.size() << "\n";
-				}
-				ifs.close();
 				return;
-				break;
 				
 				case 2:
 				// extended segment address record
-				{
-					if (dataLength != 2)
-						throw InvalidRecord(lineCounter);
-					
-					// read data
-					uint16 highAddress = getUint16(ifs);
-					computedCheckSum += highAddress;
-					computedCheckSum += highAddress >> 8;
-					baseAddress = highAddress;
-					baseAddress <<= 4;
-					//std::cout << "Extended segment address record (?!): 0x" << std::hex << baseAddress << "\n";
-					
-					// verify checksum
-					uint8 checkSum = getUint8(ifs);
-					computedCheckSum = 1 + ~computedCheckSum;
-					if (checkSum != computedCheckSum)
-						throw WrongCheckSum(lineCounter, checkSum, computedCheckSum);
-				}
+				if (dataLength != 2)
+					throw InvalidRecord(lineCounter);
+				baseAddress = ((record[4] << 8) | record[5]) << 4;
 				break;
 				
 				case 4:
 				// extended linear address record
-				{
-					if (dataLength != 2)
-						throw InvalidRecord(lineCounter);
-					
-					// read data
-					uint16 highAddress = getUint16(ifs);
-					computedCheckSum += highAddress;
-					computedCheckSum += highAddress >> 8;
-					baseAddress = highAddress;
-					baseAddress <<= 16;
-					//std::cout << "Linear address record: 0x" << std::hex << baseAddress << "\n";
-					
-					// verify checksum
-					uint8 checkSum = getUint8(ifs);
-					computedCheckSum = 1 + ~computedCheckSum;
-					if (checkSum != computedCheckSum)
-						throw WrongCheckSum(lineCounter, checkSum, computedCheckSum);
-				}
+				if (dataLength != 2)
+					throw InvalidRecord(lineCounter);
+				baseAddress = ((record[4] << 8) | record[5]) << 16;
 				break;
 				
 				default:
@@ -231,6 +176,52 @@ namespace Aseba
 		throw EarlyEOF(lineCounter);
 	}
 	
+	//! Add bytes at address, merging them with adjacent or overlapped chunks, later data overwriting earlier one; lastChunk is tried first, return the chunk containing the bytes
+	HexFile::ChunkMap::iterator HexFile::addData(ChunkMap::iterator lastChunk, uint32 address, const uint8* bytes, unsigned size)
+	{
+		// records usually follow each other, otherwise look for the chunk starting before address
+		ChunkMap::iterator chunk(lastChunk);
+		if (chunk == data.end() || address < chunk->first || chunk->first + chunk->second.size() < address)
+		{
+			chunk = data.upper_bound(address);
+			if (chunk != data.begin())
+			{
+				--chunk;
+				if (chunk->first + chunk->second.size() < address)
+					chunk = data.end();
+			}
+			else
+				chunk = data.end();
+		}
+		
+		// extend or overwrite the tail fusable chunk, or create a new one
+		if (chunk != data.end())
+		{
+			const size_t offset(address - chunk->first);
+			if (chunk->second.size() < offset + size)
+				chunk->second.resize(offset + size);
+			std::copy(bytes, bytes + size, chunk->second.begin() + offset);
+		}
+		else
+		{
+			chunk = data.insert(std::make_pair(address, std::vector<uint8>())).first;
+			chunk->second.assign(bytes, bytes + size);
+		}
+		
+		// head fusable or overlapped chunks, their bytes covered by the new ones are discarded
+		const uint32 end(chunk->first + chunk->second.size());
+		ChunkMap::iterator next(chunk);
+		++next;
+		while (next != data.end() && next->first <= end)
+		{
+			const uint32 nextEnd(next->first + next->second.size());
+			if (nextEnd > end)
+				chunk->second.insert(chunk->second.end(), next->second.end() - (nextEnd - end), next->second.end());
+			data.erase(next++);
+		}
+		return chunk;
+	}
+	
 	void HexFile::writeExtendedLinearAddressRecord(std::ofstream &stream, unsigned addr16) const
 	{
 		assert(addr16 <= 65535);
@@ -298,59 +289,25 @@ namespace Aseba
 
 	void HexFile::strip(unsigned pageSize)
 	{
-		// Build a page map.
-		typedef std::map<uint32, std::vector<uint8> > PageMap;
-		PageMap pageMap;
-		for (ChunkMap::iterator it = data.begin(); it != data.end(); it ++)
-		{
-			// get page number
-			unsigned chunkAddress = it->first;
-			// index inside data chunk
-			unsigned chunkDataIndex = 0;
-			// size of chunk in bytes
-			unsigned chunkSize = it->second.size();
-
-			// copy data from chunk to page
-			do
-			{
-				// get page number
-				unsigned pageIndex = (chunkAddress + chunkDataIndex) / pageSize;
-				// get address inside page
-				unsigned byteIndex = (chunkAddress + chunkDataIndex) % pageSize;
-
-				// if page does not exists, create it
-				if (pageMap.find(pageIndex) == pageMap.end())
-				{
-				//      std::cout << "New page N° " << pageIndex << " for address 0x" << std::hex << chunkAddress << endl;
-					pageMap[pageIndex] = std::vector<uint8>(pageSize, (uint8)0xFF); // New page is created uninitialized
-				}
-				// copy data
-				unsigned amountToCopy = std::min(pageSize - byteIndex, chunkSize - chunkDataIndex);
-				copy(it->second.begin() + chunkDataIndex, it->second.begin() + chunkDataIndex + amountToCopy, pageMap[pageIndex].begin() + byteIndex);
-
-				// increment chunk data pointer
-				chunkDataIndex += amountToCopy;
-			}
-			while (chunkDataIndex < chunkSize);
-		}
+		// New pages are created uninitialized
+		const PageImage pageImage(*this, pageSize, 0xFF);
 		
 		// Now, for each page, drop it if empty
 		data.clear();
 		
-		for(PageMap::iterator it = pageMap.begin(); it != pageMap.end(); it++)
+		for (size_t index = 0; index < pageImage.size(); ++index)
 		{
+			const uint8* page(pageImage.getPageData(index));
 			int isempty = 1;
 			unsigned int i;
 			for(i = 0; i < pageSize; i+=4)
-				if(it->second[i] != 0xff || it->second[i+1] != 0xff || it->second[i+2] != 0xff) {
+				if(page[i] != 0xff || page[i+1] != 0xff || page[i+2] != 0xff) {
 					isempty = 0;
 					break;
 				}
 			if(!isempty)
-				data[it->first * pageSize] = it->second;
+				data[pageImage.getPageNumber(index) * pageSize] = std::vector<uint8>(page, page + pageSize);
 		}
-
-
 	}
 	
 	void HexFile::write(const std::string &fileName) const
@@ -397,5 +354,63 @@ namespace Aseba
 		// write EOF
 		ofs << ":00000001FF";
 	}
+	
+	PageImage::PageImage():
+		pageSize(0)
+	{}
+	
+	PageImage::PageImage(const HexFile& hexFile, unsigned pageSize, uint8 fill):
+		pageSize(pageSize)
+	{
+		// chunks are sorted and do not overlap, so pages come in order
+		for (HexFile::ChunkMap::const_iterator it = hexFile.data.begin(); it != hexFile.data.end(); ++it)
+		{
+			if (it->second.empty())
+				continue;
+			const unsigned firstPage(it->first / pageSize);
+			const unsigned lastPage((it->first + it->second.size() - 1) / pageSize);
+			for (unsigned page = firstPage; page <= lastPage; ++page)
+				if (pageNumbers.empty() || pageNumbers.back() < page)
+					pageNumbers.push_back(page);
+		}
+		content.resize(pageNumbers.size() * pageSize, fill);
+		dirty.resize(pageNumbers.size(), true);
+		
+		// copy every chunk in one go per page it spans
+		std::vector<unsigned>::iterator pageIt(pageNumbers.begin());
+		for (HexFile::ChunkMap::const_iterator it = hexFile.data.begin(); it != hexFile.data.end(); ++it)
+		{
+			const uint32 chunkAddress(it->first);
+			const unsigned chunkSize(it->second.size());
+			for (unsigned chunkDataIndex = 0; chunkDataIndex < chunkSize;)
+			{
+				const unsigned page((chunkAddress + chunkDataIndex) / pageSize);
+				const unsigned byteIndex((chunkAddress + chunkDataIndex) % pageSize);
+				pageIt = std::lower_bound(pageIt, pageNumbers.end(), page);
+				assert(pageIt != pageNumbers.end() && *pageIt == page);
+				const size_t index(pageIt - pageNumbers.begin());
+				const unsigned amountToCopy(std::min(pageSize - byteIndex, chunkSize - chunkDataIndex));
+				std::copy(it->second.begin() + chunkDataIndex, it->second.begin() + chunkDataIndex + amountToCopy, content.begin() + index * pageSize + byteIndex);
+				chunkDataIndex += amountToCopy;
+			}
+		}
+	}
+	
+	uint16 PageImage::getPageCrc(size_t index) const
+	{
+		return crcXModem(0, getPageData(index), pageSize);
+	}
+	
+	size_t PageImage::find(unsigned pageNumber) const
+	{
+		const std::vector<unsigned>::const_iterator it(std::lower_bound(pageNumbers.begin(), pageNumbers.end(), pageNumber));
+		if (it == pageNumbers.end() || *it != pageNumber)
+			return size();
+		return it - pageNumbers.begin();
+	}
+	
+	size_t PageImage::getDirtyCount() const
+	{
+		return std::count(dirty.begin(), dirty.end(), true);
+	}
 }
-
@@ -95,12 +95,51 @@ namespace Aseba
 		void strip(unsigned pageSize);
 	
 	protected:
-		unsigned getUint4(std::istream &stream);
-		unsigned getUint8(std::istream &stream);
-		unsigned getUint16(std::istream &stream);
+		ChunkMap::iterator addData(ChunkMap::iterator lastChunk, uint32 address, const uint8* bytes, unsigned size);
 		void writeExtendedLinearAddressRecord(std::ofstream &stream, unsigned addr16) const;
 		void writeData(std::ofstream &stream, unsigned addr16, unsigned count8, uint8 *data) const;
 	};
+	
+	//! The pages of an hex file that contain data, stored contiguously in increasing order
+	/**
+		Only pages with data are stored, as hex files can have a few words
+		far from the rest, such as configuration bits. Every page starts
+		dirty, meaning it must be written; writers can clear pages that are
+		known to be in flash already.
+	*/
+	class PageImage
+	{
+	public:
+		PageImage();
+		//! Lay out the content of hexFile in pages of pageSize bytes, filling the holes with fill
+		PageImage(const HexFile& hexFile, unsigned pageSize, uint8 fill = 0);
+		
+		//! Return the size of a page
+		unsigned getPageSize() const { return pageSize; }
+		//! Return the number of pages with data
+		size_t size() const { return pageNumbers.size(); }
+		//! Return the number of the index-th page
+		unsigned getPageNumber(size_t index) const { return pageNumbers[index]; }
+		//! Return the content of the index-th page
+		const uint8* getPageData(size_t index) const { return &content[index * pageSize]; }
+		//! Return the XModem CRC of the content of the index-th page
+		uint16 getPageCrc(size_t index) const;
+		//! Return the index of page pageNumber, or size() if it has no data
+		size_t find(unsigned pageNumber) const;
+		
+		//! Return whether the index-th page must be written
+		bool isDirty(size_t index) const { return dirty[index]; }
+		//! Mark the index-th page as already in flash
+		void clearDirty(size_t index) { dirty[index] = false; }
+		//! Return the number of pages that must be written
+		size_t getDirtyCount() const;
+		
+	protected:
+		unsigned pageSize;
+		std::vector<unsigned> pageNumbers; //!< sorted numbers of the pages with data
+		std::vector<uint8> content; //!< content of the pages, in the order of pageNumbers
+		std::vector<bool> dirty; //!< bitmap of pages that must be written
+	};
 }
 
 #endif
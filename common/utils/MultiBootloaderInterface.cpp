@@ -0,0 +1,426 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MultiBootloaderInterface.h"
+#include "../msg/msg.h"
+#include "FormatableString.h"
+#include <memory>
+#include <iomanip>
+
+namespace Aseba
+{
+	using namespace Dashel;
+	using namespace std;
+
+	//! Time given to a device to reset when using the simple protocol, in ms
+	static const unsigned simpleResetDelay = 10;
+	//! Time without messages from a device after which its pipeline is considered empty, in ms
+	static const unsigned resyncDelay = 200;
+
+	MultiBootloaderInterface::Device::Device(const string& target, int dest, Stream* stream):
+		target(target),
+		dest(dest),
+		stream(stream),
+		state(IDLE),
+		pageSize(0),
+		pagesStart(0),
+		pagesCount(0),
+		pages(0),
+		commandPending(false),
+		commandPage(0),
+		pagesTotal(0),
+		pagesWritten(0),
+		retriesCount(0)
+	{}
+
+	MultiBootloaderInterface::MultiBootloaderInterface():
+		reset(false),
+		pipelined(false),
+		maxRetries(3),
+		timeout(5000),
+		simple(false)
+	{}
+
+	unsigned MultiBootloaderInterface::addDevice(const string& target, int dest)
+	{
+		Stream* stream(0);
+		string error;
+		map<string, Stream*>::const_iterator it(streams.find(target));
+		if (it != streams.end())
+		{
+			stream = it->second;
+		}
+		else
+		{
+			try
+			{
+				stream = connect(target);
+				streams[target] = stream;
+			}
+			catch (DashelException& e)
+			{
+				error = e.what();
+			}
+		}
+
+		devices.push_back(Device(target, dest, stream));
+		if (!stream)
+		{
+			devices.back().state = Device::FAILED;
+			devices.back().error = FormatableString("Cannot connect: %0").arg(error);
+		}
+		return devices.size() - 1;
+	}
+
+	bool MultiBootloaderInterface::writeHex(const string &fileName, bool reset)
+	{
+		hexFile = HexFile();
+		hexFile.read(fileName);
+		pageImages.clear();
+		this->reset = reset;
+
+		// enter bootloaders
+		const UnifiedTime now;
+		for (unsigned i = 0; i < devices.size(); ++i)
+		{
+			Device& device(devices[i]);
+			if (device.state == Device::FAILED)
+				continue;
+			device.state = Device::STARTING;
+			device.startTime = now;
+			device.deadline = now + UnifiedTime(simple ? simpleResetDelay : timeout);
+			if (reset)
+			{
+				Reboot message(device.dest);
+				message.serialize(device.stream);
+				device.stream->flush();
+			}
+		}
+
+		// let all devices progress together
+		while (true)
+		{
+			bool finished(true);
+			for (unsigned i = 0; i < devices.size(); ++i)
+				finished = finished && devices[i].isFinished();
+			if (finished)
+				break;
+			if (!step(10))
+				break;
+			checkDeadlines();
+		}
+
+		bool success(true);
+		for (unsigned i = 0; i < devices.size(); ++i)
+			success = success && devices[i].state == Device::DONE;
+		return success;
+	}
+
+	void MultiBootloaderInterface::dumpSummary(ostream& stream) const
+	{
+		unsigned succeeded(0);
+		UnifiedTime::Value longest(0);
+		for (unsigned i = 0; i < devices.size(); ++i)
+		{
+			const Device& device(devices[i]);
+			stream << device.target << " node " << device.dest << ": ";
+			if (device.state == Device::DONE)
+			{
+				const UnifiedTime::Value duration((device.endTime - device.startTime).value);
+				stream << "done, " << device.pagesWritten << " pages in " << duration << " ms";
+				if (duration)
+					stream << " (" << setprecision(3) << double(device.pagesWritten) * device.pageSize / duration << " kB/s)";
+				++succeeded;
+				longest = max(longest, duration);
+			}
+			else if (device.state == Device::FAILED)
+				stream << "failed after " << device.pagesWritten << " pages, " << device.error;
+			else
+				stream << "interrupted after " << device.pagesWritten << " pages";
+			if (device.retriesCount)
+				stream << ", " << device.retriesCount << " retries";
+			stream << "\n";
+		}
+		stream << succeeded << " of " << devices.size() << " devices upgraded";
+		if (succeeded)
+			stream << ", slowest in " << longest << " ms";
+		stream << endl;
+	}
+
+	void MultiBootloaderInterface::incomingData(Stream *stream)
+	{
+		auto_ptr<Message> message(Message::receive(stream));
+		for (unsigned i = 0; i < devices.size(); ++i)
+			if (devices[i].stream == stream && devices[i].dest == message->source)
+				processMessage(i, message.get());
+	}
+
+	void MultiBootloaderInterface::connectionClosed(Stream *stream, bool abnormal)
+	{
+		for (unsigned i = 0; i < devices.size(); ++i)
+		{
+			if (devices[i].stream != stream)
+				continue;
+			devices[i].stream = 0;
+			if (devices[i].state != Device::IDLE && !devices[i].isFinished())
+				finishDevice(i, "Connection closed");
+		}
+		for (map<string, Stream*>::iterator it = streams.begin(); it != streams.end(); ++it)
+		{
+			if (it->second == stream)
+			{
+				streams.erase(it);
+				break;
+			}
+		}
+	}
+
+	void MultiBootloaderInterface::processMessage(unsigned index, const Message* message)
+	{
+		Device& device(devices[index]);
+		switch (device.state)
+		{
+			case Device::STARTING:
+			{
+				const BootloaderDescription *description(dynamic_cast<const BootloaderDescription *>(message));
+				if (description && !simple)
+				{
+					if (description->pageSize == 0 || description->pageSize % 4 != 0)
+					{
+						finishDevice(index, FormatableString("Invalid page size %0").arg(description->pageSize));
+						return;
+					}
+					device.pageSize = description->pageSize;
+					device.pagesStart = description->pagesStart;
+					device.pagesCount = description->pagesCount;
+					startWriting(index);
+				}
+			}
+			break;
+
+			case Device::WRITING:
+			{
+				const BootloaderAck *ack(dynamic_cast<const BootloaderAck *>(message));
+				if (!ack || (device.inFlight.empty() && !device.commandPending))
+					return;
+				if (ack->errorCode != BootloaderAck::SUCCESS)
+				{
+					pageFailed(index);
+					return;
+				}
+				device.deadline = UnifiedTime() + UnifiedTime(timeout);
+				// acknowledgements come in order: the data of the pages in flight, then the pending command
+				if (!device.inFlight.empty())
+				{
+					const unsigned pageNumber(device.pages->getPageNumber(device.inFlight.front()));
+					device.inFlight.pop_front();
+					++device.pagesWritten;
+					devicePageWritten(index, pageNumber);
+				}
+				else
+				{
+					// the page is erased, the bootloader listens again
+					device.commandPending = false;
+					sendPageData(index, device.commandPage);
+				}
+				sendPages(index);
+			}
+			break;
+
+			case Device::RESYNCING:
+			// the pipeline is not empty yet
+			device.deadline = UnifiedTime() + UnifiedTime(resyncDelay);
+			break;
+
+			default:
+			break;
+		}
+	}
+
+	void MultiBootloaderInterface::checkDeadlines()
+	{
+		const UnifiedTime now;
+		for (unsigned i = 0; i < devices.size(); ++i)
+		{
+			Device& device(devices[i]);
+			if (now < device.deadline)
+				continue;
+			switch (device.state)
+			{
+				case Device::STARTING:
+				if (simple)
+				{
+					device.pageSize = 2048;
+					startWriting(i);
+				}
+				else
+					finishDevice(i, "No answer from bootloader");
+				break;
+
+				case Device::WRITING:
+				pageFailed(i);
+				break;
+
+				case Device::RESYNCING:
+				// write again the pages that were in flight, in order
+				if (device.commandPending)
+					device.toWrite.push_front(device.commandPage);
+				device.toWrite.insert(device.toWrite.begin(), device.inFlight.begin(), device.inFlight.end());
+				device.inFlight.clear();
+				device.commandPending = false;
+				device.state = Device::WRITING;
+				sendPages(i);
+				break;
+
+				default:
+				break;
+			}
+		}
+	}
+
+	void MultiBootloaderInterface::startWriting(unsigned index)
+	{
+		Device& device(devices[index]);
+		device.pages = getPages(device.pageSize);
+		device.toWrite.clear();
+		for (size_t i = 0; i < device.pages->size(); ++i)
+		{
+			const unsigned pageIndex(device.pages->getPageNumber(i));
+			if (simple)
+			{
+				// page 0 contains the reset vector, so write it last
+				if (pageIndex != 0)
+					device.toWrite.push_back(i);
+			}
+			else if ((pageIndex >= device.pagesStart) && (pageIndex < device.pagesStart + device.pagesCount))
+				device.toWrite.push_back(i);
+		}
+		if (simple && device.pages->find(0) != device.pages->size())
+			device.toWrite.push_back(device.pages->find(0));
+
+		device.pagesTotal = device.toWrite.size();
+		device.state = Device::WRITING;
+		deviceStarted(index, device.pagesTotal);
+		sendPages(index);
+	}
+
+	//! Send the command of the next page if the pipeline allows, and finish the device if all pages are acknowledged
+	/*!	With the complete protocol, the data of a page is sent once its command is acknowledged,
+		as the bootloader does not listen while erasing; so at most the data of a page and the command
+		of the next one are in flight. The simple protocol sends commands and data together.
+	*/
+	void MultiBootloaderInterface::sendPages(unsigned index)
+	{
+		Device& device(devices[index]);
+		if (device.toWrite.empty() && device.inFlight.empty() && !device.commandPending)
+		{
+			finishDevice(index, "");
+			return;
+		}
+		// a third page in flight would have its command sent while two pages are still programming
+		const size_t maxInFlight((pipelined && !simple) ? 2 : 1);
+		if (device.toWrite.empty() || device.commandPending || device.inFlight.size() >= maxInFlight)
+			return;
+
+		const size_t pageIndex(device.toWrite.front());
+		device.toWrite.pop_front();
+		BootloaderWritePage writePage;
+		writePage.dest = device.dest;
+		writePage.pageNumber = device.pages->getPageNumber(pageIndex);
+		writePage.serialize(device.stream);
+		if (simple)
+		{
+			sendPageData(index, pageIndex);
+		}
+		else
+		{
+			device.commandPending = true;
+			device.commandPage = pageIndex;
+			device.stream->flush();
+		}
+		device.deadline = UnifiedTime() + UnifiedTime(timeout);
+	}
+
+	//! Send the data of a page whose command was sent, and wait for its acknowledgement
+	void MultiBootloaderInterface::sendPageData(unsigned index, size_t pageIndex)
+	{
+		Device& device(devices[index]);
+		const uint8* data(device.pages->getPageData(pageIndex));
+		if (simple)
+		{
+			device.stream->write(data, device.pageSize);
+		}
+		else
+		{
+			for (unsigned dataWritten = 0; dataWritten < device.pageSize;)
+			{
+				BootloaderPageDataWrite pageData;
+				pageData.dest = device.dest;
+				copy(data + dataWritten, data + dataWritten + sizeof(pageData.data), pageData.data);
+				pageData.serialize(device.stream);
+				dataWritten += sizeof(pageData.data);
+			}
+		}
+		device.stream->flush();
+		device.inFlight.push_back(pageIndex);
+	}
+
+	//! The first page not acknowledged failed, retry it after the pipeline has drained, or give up on the device
+	void MultiBootloaderInterface::pageFailed(unsigned index)
+	{
+		Device& device(devices[index]);
+		const size_t pageIndex(device.inFlight.empty() ? device.commandPage : device.inFlight.front());
+		const unsigned pageNumber(device.pages->getPageNumber(pageIndex));
+		const unsigned attempt(++device.failures[pageIndex]);
+		if (attempt > maxRetries)
+		{
+			finishDevice(index, FormatableString("Error while writing page %0").arg(pageNumber));
+			return;
+		}
+		++device.retriesCount;
+		devicePageRetry(index, pageNumber, attempt);
+		device.state = Device::RESYNCING;
+		device.deadline = UnifiedTime() + UnifiedTime(resyncDelay);
+	}
+
+	//! Mark a device as done if error is empty, as failed otherwise
+	void MultiBootloaderInterface::finishDevice(unsigned index, const string& error)
+	{
+		Device& device(devices[index]);
+		device.endTime = UnifiedTime();
+		device.error = error;
+		device.state = error.empty() ? Device::DONE : Device::FAILED;
+		if (device.state == Device::DONE && reset)
+		{
+			BootloaderReset message(device.dest);
+			message.serialize(device.stream);
+			device.stream->flush();
+		}
+		deviceFinished(index);
+	}
+
+	const PageImage* MultiBootloaderInterface::getPages(unsigned pageSize)
+	{
+		map<unsigned, PageImage>::iterator it(pageImages.find(pageSize));
+		if (it == pageImages.end())
+			it = pageImages.insert(make_pair(pageSize, PageImage(hexFile, pageSize))).first;
+		return &it->second;
+	}
+} // namespace Aseba
@@ -0,0 +1,152 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASEBA_MULTI_BOOTLOADER_INTERFACE_H
+#define ASEBA_MULTI_BOOTLOADER_INTERFACE_H
+
+#include <dashel/dashel.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <ostream>
+#include "../types.h"
+#include "utils.h"
+#include "HexFile.h"
+
+namespace Aseba
+{
+	class Message;
+
+	//! Write an hex file to several aseba-compatible bootloaders at once
+	/**
+		Devices are reached either over separate streams, or over a shared
+		one such as a switch, in which case they are told apart by node id.
+		Unlike BootloaderInterface, no call blocks on a single device: all
+		devices progress together from the events of the hub, and a page
+		that fails or times out is written again up to a number of retries.
+		The simple protocol is supported, but only with one device per stream.
+	*/
+	class MultiBootloaderInterface: public Dashel::Hub
+	{
+	public:
+		//! A device to be flashed and its progress
+		struct Device
+		{
+			enum State
+			{
+				IDLE = 0,
+				STARTING, //!< waiting for the bootloader description
+				WRITING,
+				RESYNCING, //!< waiting for in-flight messages to drain after a failure
+				DONE,
+				FAILED
+			};
+
+			std::string target;
+			int dest;
+			Dashel::Stream* stream;
+
+			State state;
+			std::string error; //!< reason of failure, if state is FAILED
+
+			unsigned pageSize;
+			unsigned pagesStart;
+			unsigned pagesCount;
+
+			const PageImage* pages; //!< pages to write, shared between devices of same page size
+			std::deque<size_t> toWrite; //!< indices in pages of the pages not sent yet, in order
+			std::deque<size_t> inFlight; //!< indices in pages of the pages whose data is sent but not acknowledged yet, in order
+			bool commandPending; //!< whether the command of commandPage is sent and its acknowledgement, once erased, awaited before sending its data
+			size_t commandPage; //!< index in pages of the page whose command is pending
+			std::map<size_t, unsigned> failures; //!< number of failures, by index in pages
+
+			unsigned pagesTotal;
+			unsigned pagesWritten;
+			unsigned retriesCount;
+			UnifiedTime startTime;
+			UnifiedTime endTime;
+			UnifiedTime deadline; //!< time at which the current state times out
+
+			Device(const std::string& target, int dest, Dashel::Stream* stream);
+			//! Return whether this device will not progress any more
+			bool isFinished() const { return state == DONE || state == FAILED; }
+		};
+
+	public:
+		MultiBootloaderInterface();
+
+		//! Add a device with node id dest reachable through target, return its index; streams are shared between devices of same target
+		unsigned addDevice(const std::string& target, int dest);
+
+		//! If pipelined is true, send the command of a page while the previous one is programmed, with the complete protocol; otherwise wait for each page
+		void setPipelined(bool pipelined) { this->pipelined = pipelined; }
+		//! Set how many times a page is written again after a failure before giving up on its device
+		void setRetries(unsigned retries) { maxRetries = retries; }
+		//! Set how long to wait for the bootloader before considering a page as failed, in ms
+		void setTimeout(unsigned timeout) { this->timeout = timeout; }
+		//! If simple is true, use the simplified protocol that requires direct access to devices
+		void setSimple(bool simple) { this->simple = simple; }
+
+		//! Write an hex file to all devices, return whether all succeeded
+		bool writeHex(const std::string &fileName, bool reset);
+
+		//! Return the number of devices
+		unsigned getDevicesCount() const { return devices.size(); }
+		//! Return a device and its progress
+		const Device& getDevice(unsigned index) const { return devices[index]; }
+		//! Write the outcome, time and throughput of every device
+		void dumpSummary(std::ostream& stream) const;
+
+	protected:
+		// reporting function
+
+		virtual void deviceStarted(unsigned device, unsigned pagesCount) {}
+		virtual void devicePageWritten(unsigned device, unsigned pageNumber) {}
+		virtual void devicePageRetry(unsigned device, unsigned pageNumber, unsigned attempt) {}
+		virtual void deviceFinished(unsigned device) {}
+
+	protected:
+		virtual void incomingData(Dashel::Stream *stream);
+		virtual void connectionClosed(Dashel::Stream *stream, bool abnormal);
+
+		void processMessage(unsigned index, const Message* message);
+		void checkDeadlines();
+		void startWriting(unsigned index);
+		void sendPages(unsigned index);
+		void sendPageData(unsigned index, size_t pageIndex);
+		void pageFailed(unsigned index);
+		void finishDevice(unsigned index, const std::string& error);
+		const PageImage* getPages(unsigned pageSize);
+
+	protected:
+		std::vector<Device> devices;
+		std::map<std::string, Dashel::Stream*> streams; //!< streams by target
+		std::map<unsigned, PageImage> pageImages; //!< pages of hexFile, by page size
+		HexFile hexFile;
+		bool reset;
+		bool pipelined;
+		unsigned maxRetries;
+		unsigned timeout;
+		bool simple;
+	};
+} // namespace Aseba
+
+#endif // ASEBA_MULTI_BOOTLOADER_INTERFACE_H
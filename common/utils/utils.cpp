@@ -125,6 +125,26 @@ namespace Aseba
 		stream << " ";
 	}
 	
+	long long unsigned monotonicMicroseconds()
+	{
+		#if defined(WIN32)
+		LARGE_INTEGER frequency, counter;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&counter);
+		const long long unsigned seconds(counter.QuadPart / frequency.QuadPart);
+		const long long unsigned rest(counter.QuadPart % frequency.QuadPart);
+		return seconds * 1000000 + (rest * 1000000) / frequency.QuadPart;
+		#elif defined(__APPLE__)
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return (long long unsigned)(tv.tv_sec) * 1000000 + tv.tv_usec;
+		#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (long long unsigned)(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+		#endif
+	}
+	
 	std::string WStringToUTF8(const std::wstring& s)
 	{
 		std::string os;
@@ -264,6 +284,11 @@ namespace Aseba
 		return crc_xmodem_update(oldCrc, reinterpret_cast<const uint8*>(&v), 2);
 	}
 	
+	uint16 crcXModem(const uint16 oldCrc, const uint8* data, size_t size)
+	{
+		return crc_xmodem_update(oldCrc, data, size);
+	}
+	
 	template<typename T>
 	std::vector<T> split(const T& s, const T& delim)
 	{
@@ -110,6 +110,9 @@ namespace Aseba
 	//! Dump the current time to a stream
 	void dumpTime(std::ostream &stream, bool raw = false);
 	
+	//! Return a monotonic time in microseconds, to measure short durations; the origin is unspecified
+	long long unsigned monotonicMicroseconds();
+	
 	//! Transform a wstring into an UTF8 string, this function is thread-safe
 	std::string WStringToUTF8(const std::wstring& s);
 	
@@ -122,6 +125,9 @@ namespace Aseba
 	//! Update the XModem CRC (x^16 + x^12 + x^5 + 1 (0x1021)) with a uint16 value
 	uint16 crcXModem(const uint16 oldCrc, const uint16 v);
 	
+	//! Update the XModem CRC (x^16 + x^12 + x^5 + 1 (0x1021)) with size bytes
+	uint16 crcXModem(const uint16 oldCrc, const uint8* data, size_t size);
+	
 	//! Split a string using given delimiters
 	template<typename T>
 	std::vector<T> split(const T& s, const T& delim);
@@ -91,6 +91,41 @@ namespace Aseba
 		return functionsMap;
 	}
 	
+	//! Reset all durations and counters
+	void CompilationStatistics::clear()
+	{
+		for (unsigned i = 0; i < PHASE_COUNT; ++i)
+			phaseDuration[i] = 0;
+		compilationCount = 0;
+		bytecodeSize = 0;
+		allocatedVariablesCount = 0;
+	}
+	
+	//! Return the sum of the durations of all phases, in microseconds
+	long long unsigned CompilationStatistics::totalDuration() const
+	{
+		long long unsigned total(0);
+		for (unsigned i = 0; i < PHASE_COUNT; ++i)
+			total += phaseDuration[i];
+		return total;
+	}
+	
+	//! Return the name of a phase, suitable for machine-readable output
+	const char* CompilationStatistics::phaseName(Phase phase)
+	{
+		switch (phase)
+		{
+			case PHASE_TOKENIZE: return "tokenize";
+			case PHASE_PARSE: return "parse";
+			case PHASE_EXPAND: return "expand";
+			case PHASE_TYPECHECK: return "typecheck";
+			case PHASE_OPTIMIZE: return "optimize";
+			case PHASE_EMIT: return "emit";
+			case PHASE_LINK: return "link";
+			default: return "unknown";
+		}
+	}
+	
 	//! Return the number of words this element takes in memory
 	unsigned BytecodeElement::getWordSize() const
 	{
@@ -115,6 +150,10 @@ namespace Aseba
 	{
 		targetDescription = 0;
 		commonDefinitions = 0;
+		statistics = 0;
+		targetMapsValid = false;
+		commonMapsValid = false;
+		targetFreeVariableIndex = 0;
 		freeVariableIndex = 0;
 		endVariableIndex = 0;
 		TranslatableError::setTranslateCB(ErrorMessages::defaultCallback);
@@ -132,6 +171,22 @@ namespace Aseba
 		commonDefinitions = definitions;
 	}
 	
+	//! Set where to accumulate the timings of compilations, 0 to disable measurements
+	void Compiler::setStatistics(CompilationStatistics *statistics)
+	{
+		this->statistics = statistics;
+	}
+	
+	//! If statistics are enabled, add the time since phaseStart to phase, and restart the measurement
+	void Compiler::recordPhase(CompilationStatistics::Phase phase, long long unsigned& phaseStart)
+	{
+		if (!statistics)
+			return;
+		const long long unsigned now(monotonicMicroseconds());
+		statistics->phaseDuration[phase] += now - phaseStart;
+		phaseStart = now;
+	}
+	
 	//! Compile a new condition
 	//! \param source stream to read the source code from
 	//! \param bytecode destination array for bytecode
@@ -145,8 +200,9 @@ namespace Aseba
 		assert(commonDefinitions);
 		
 		unsigned indent = 0;
+		long long unsigned phaseStart(statistics ? monotonicMicroseconds() : 0);
 		
-		// we need to build maps at each compilation in case previous ones produced errors and messed maps up
+		// we need to reset maps at each compilation in case previous ones produced errors and messed maps up
 		buildMaps();
 		if (freeVariableIndex > targetDescription->variablesSize)
 		{
@@ -164,6 +220,7 @@ namespace Aseba
 			errorDescription = error.toError();
 			return false;
 		}
+		recordPhase(CompilationStatistics::PHASE_TOKENIZE, phaseStart);
 		
 		if (dump)
 		{
@@ -183,6 +240,7 @@ namespace Aseba
 			errorDescription = error.toError();
 			return false;
 		}
+		recordPhase(CompilationStatistics::PHASE_PARSE, phaseStart);
 		
 		if (dump)
 		{
@@ -243,6 +301,7 @@ namespace Aseba
 			errorDescription = error.toError();
 			return false;
 		}
+		recordPhase(CompilationStatistics::PHASE_EXPAND, phaseStart);
 
 		if (dump)
 		{
@@ -262,6 +321,7 @@ namespace Aseba
 			errorDescription = error.toError();
 			return false;
 		}
+		recordPhase(CompilationStatistics::PHASE_TYPECHECK, phaseStart);
 		
 		if (dump)
 		{
@@ -282,6 +342,7 @@ namespace Aseba
 			errorDescription = error.toError();
 			return false;
 		}
+		recordPhase(CompilationStatistics::PHASE_OPTIMIZE, phaseStart);
 		
 		if (dump)
 		{
@@ -307,6 +368,7 @@ namespace Aseba
 		
 		// fix-up (add of missing STOP and RET bytecodes at code generation)
 		preLinkBytecode.fixup(subroutineTable);
+		recordPhase(CompilationStatistics::PHASE_EMIT, phaseStart);
 		
 		// stack check
 		if (!verifyStackCalls(preLinkBytecode))
@@ -321,6 +383,14 @@ namespace Aseba
 			errorDescription = TranslatableError(SourcePos(), ERROR_SCRIPT_TOO_BIG).toError();
 			return false;
 		}
+		recordPhase(CompilationStatistics::PHASE_LINK, phaseStart);
+		
+		if (statistics)
+		{
+			++statistics->compilationCount;
+			statistics->bytecodeSize = bytecode.size();
+			statistics->allocatedVariablesCount = allocatedVariablesCount;
+		}
 		
 		if (dump)
 		{
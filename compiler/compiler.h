@@ -216,6 +216,8 @@ namespace Aseba
 	{
 		//! Create a filled pair
 		NamedValue(const std::wstring& name, int value) : name(name), value(value) {}
+		//! Return whether both name and value are equal
+		bool operator==(const NamedValue& that) const { return name == that.name && value == that.value; }
 		
 		std::wstring name; //!< name part of the pair
 		int value; //!< value part of the pair
@@ -254,6 +256,33 @@ namespace Aseba
 	//! Vector of data of variables
 	typedef std::vector<short int> VariablesDataVector;
 	
+	//! Time spent in each phase of a compilation, and size of its result, for benchmarking
+	struct CompilationStatistics
+	{
+		//! Phases of a compilation, in execution order
+		enum Phase
+		{
+			PHASE_TOKENIZE = 0,
+			PHASE_PARSE,
+			PHASE_EXPAND,
+			PHASE_TYPECHECK,
+			PHASE_OPTIMIZE,
+			PHASE_EMIT,
+			PHASE_LINK,
+			PHASE_COUNT
+		};
+		
+		long long unsigned phaseDuration[PHASE_COUNT]; //!< time spent in each phase, in microseconds, accumulated over compilations
+		unsigned compilationCount; //!< number of compilations accounted
+		unsigned bytecodeSize; //!< size of the last generated bytecode, in words
+		unsigned allocatedVariablesCount; //!< number of variables allocated by the last compilation, in words
+		
+		CompilationStatistics() { clear(); }
+		void clear();
+		long long unsigned totalDuration() const;
+		static const char* phaseName(Phase phase);
+	};
+	
 	//! Aseba Event Scripting Language compiler
 	class Compiler
 	{
@@ -372,6 +401,7 @@ namespace Aseba
 		const VariablesMap *getVariablesMap() const { return &variablesMap; }
 		const SubroutineTable *getSubroutineTable() const { return &subroutineTable; }
 		void setCommonDefinitions(const CommonDefinitions *definitions);
+		void setStatistics(CompilationStatistics *statistics);
 		bool compile(std::wistream& source, BytecodeVector& bytecode, unsigned& allocatedVariablesCount, Error &errorDescription, std::wostream* dump = 0);
 		void setTranslateCallback(ErrorMessages::ErrorCallback newCB) { TranslatableError::setTranslateCB(newCB); }
 		static std::wstring translate(ErrorCode error) { return TranslatableError::translateCB(error); }
@@ -416,6 +446,7 @@ namespace Aseba
 		bool verifyStackCalls(PreLinkBytecode& preLinkBytecode);
 		bool link(const PreLinkBytecode& preLinkBytecode, BytecodeVector& bytecode);
 		void disassemble(BytecodeVector& bytecode, const PreLinkBytecode& preLinkBytecode, std::wostream& dump) const;
+		void recordPhase(CompilationStatistics::Phase phase, long long unsigned& phaseStart);
 		
 	protected:
 		Node* parseProgram();
@@ -474,6 +505,16 @@ namespace Aseba
 		unsigned endVariableIndex; //!< (endMemory - endVariableIndex) is pointing to the first free variable at the end
 		const TargetDescription *targetDescription; //!< description of the target VM
 		const CommonDefinitions *commonDefinitions; //!< common definitions, such as events or some constants
+		CompilationStatistics *statistics; //!< if not 0, receives the timings of each compilation
+		
+		// the symbols coming from the target description and the common definitions are kept across compilations, and rebuilt only when these change
+		bool targetMapsValid; //!< whether targetVariablesMap and functionsMap are up-to-date with targetDescription
+		bool commonMapsValid; //!< whether commonConstantsMap and globalEventsMap are up-to-date with commonDefinitions
+		TargetDescription mapsTargetDescription; //!< copy of the target description the cached maps were built from
+		CommonDefinitions mapsCommonDefinitions; //!< copy of the common definitions the cached maps were built from
+		VariablesMap targetVariablesMap; //!< variables of the target, before the program adds its own
+		unsigned targetFreeVariableIndex; //!< first free variable after the ones of the target
+		ConstantsMap commonConstantsMap; //!< constants of the common definitions, before the program adds its own
 
 		ErrorMessages translator;
 	}; // Compiler
@@ -30,9 +30,8 @@
 #include <iomanip>
 #include <memory>
 #include <limits>
-#ifndef __APPLE__
-	#include <malloc.h>
-#endif
+#include <vector>
+#include <algorithm>
 
 namespace Aseba
 {
@@ -71,37 +70,44 @@ namespace Aseba
 		return false;
 	}
 	
-	//! Compute the edit distance between two vector-style containers, inspired from http://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C.2B.2B
+	//! Compute the edit distance between two vector-style containers, return maxDist if it is at least maxDist.
+	//! Only the band of cells within maxDist of the diagonal is computed, using two rows, inspired from http://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C.2B.2B
 	template <class T> unsigned int editDistance(const T& s1, const T& s2, const unsigned maxDist)
 	{
-		const size_t len1 = s1.size() + 1, len2 = s2.size() + 1;
-		const size_t matSize(len1*len2);
-		unsigned *d(reinterpret_cast<unsigned*>(alloca(matSize*sizeof(unsigned))));
-
-		d[0] = 0;
-		for(unsigned i = 1; i < len1; ++i)
-			d[i*len2+0] = i;
-		for(unsigned i = 1; i < len2; ++i)
-			d[i] = i;
-
-		for(unsigned i = 1; i < len1; ++i)
+		const size_t len1 = s1.size(), len2 = s2.size();
+		if ((len1 > len2 ? len1 - len2 : len2 - len1) >= maxDist)
+			return maxDist;
+		
+		// cells outside the band are never smaller than maxDist, so they are seen as maxDist
+		std::vector<unsigned> previous(len2 + 1), current(len2 + 1);
+		for (size_t j = 0; j <= len2; ++j)
+			previous[j] = std::min<size_t>(j, maxDist);
+		
+		for (size_t i = 1; i <= len1; ++i)
 		{
-			bool wasBelowMax(false);
-			for(unsigned j = 1; j < len2; ++j)
+			const size_t first(i > maxDist ? i - maxDist : 1);
+			const size_t last(std::min(len2, i + maxDist));
+			current[first - 1] = (first == 1) ? std::min<size_t>(i, maxDist) : maxDist;
+			bool wasBelowMax(current[first - 1] < maxDist);
+			for (size_t j = first; j <= last; ++j)
 			{
-				const unsigned cost = std::min(std::min(
-					d[(i - 1)*len2+j] + 1,
-					d[i*len2+(j - 1)] + 1),
-					d[(i - 1)*len2+(j - 1)] + (s1[i - 1] == s2[j - 1] ? 0 : 1)
+				const unsigned cost = std::min(std::min(std::min(
+					previous[j] + 1,
+					current[j - 1] + 1),
+					previous[j - 1] + (s1[i - 1] == s2[j - 1] ? 0 : 1)),
+					maxDist
 				);
 				if (cost < maxDist)
 					wasBelowMax = true;
-				d[i*len2+j] = cost;
+				current[j] = cost;
 			}
+			if (last < len2)
+				current[last + 1] = maxDist;
 			if (!wasBelowMax)
 				return maxDist;
+			previous.swap(current);
 		}
-		return d[matSize-1];
+		return previous[len2];
 	}
 	
 	//! Helper function to find for something in one of the map, using edit-distance to check for candidates if not found
@@ -111,21 +117,21 @@ namespace Aseba
 		typename MapType::const_iterator it(map.find(name));
 		if (it == map.end())
 		{
+			// only look for candidates closer than the best one found so far
 			const unsigned maxDist(3);
-			std::wstring bestName;
-			unsigned bestDist(std::numeric_limits<unsigned>::max());
-			for (typename MapType::const_iterator jt(map.begin()); jt != map.end(); ++jt)
+			typename MapType::const_iterator bestIt(map.end());
+			unsigned bestDist(maxDist);
+			for (typename MapType::const_iterator jt(map.begin()); jt != map.end() && bestDist > 1; ++jt)
 			{
-				const std::wstring thatName(jt->first);
-				const unsigned d(editDistance<std::wstring>(name, thatName, maxDist));
-				if (d < bestDist && d < maxDist)
+				const unsigned d(editDistance<std::wstring>(name, jt->first, bestDist));
+				if (d < bestDist)
 				{
 					bestDist = d;
-					bestName = thatName;
+					bestIt = jt;
 				}
 			}
-			if (bestDist < maxDist)
-				throw TranslatableError(pos, misspelledError).arg(name).arg(bestName);
+			if (bestIt != map.end())
+				throw TranslatableError(pos, misspelledError).arg(name).arg(bestIt->first);
 			else
 				throw TranslatableError(pos, notFoundError).arg(name);
 		}
@@ -183,43 +189,77 @@ namespace Aseba
 		return findInTable<SubroutineReverseTable>(subroutineReverseTable, name, pos, ERROR_SUBROUTINE_NOT_DEFINED, ERROR_SUBROUTINE_NOT_DEFINED_GUESS);
 	}
 	
-	//! Build variables and functions maps
+	//! Return whether two target descriptions have the same named variables, local events and native functions, and thus lead to the same maps
+	static bool haveSameSymbols(const TargetDescription& a, const TargetDescription& b)
+	{
+		if (a.namedVariables.size() != b.namedVariables.size() ||
+			a.localEvents.size() != b.localEvents.size() ||
+			a.nativeFunctions.size() != b.nativeFunctions.size())
+			return false;
+		for (size_t i = 0; i < a.namedVariables.size(); ++i)
+			if (a.namedVariables[i].size != b.namedVariables[i].size || a.namedVariables[i].name != b.namedVariables[i].name)
+				return false;
+		for (size_t i = 0; i < a.localEvents.size(); ++i)
+			if (a.localEvents[i].name != b.localEvents[i].name)
+				return false;
+		for (size_t i = 0; i < a.nativeFunctions.size(); ++i)
+			if (a.nativeFunctions[i].name != b.nativeFunctions[i].name)
+				return false;
+		return true;
+	}
+	
+	//! Build variables and functions maps; the ones coming from the target description and the common definitions are only rebuilt if these have changed since the last call
 	void Compiler::buildMaps()
 	{
 		assert(targetDescription);
+		assert(commonDefinitions);
 		
 		// erase tables
 		implementedEvents.clear();
 		subroutineTable.clear();
 		subroutineReverseTable.clear();
 		
-		// fill variables map
-		variablesMap = targetDescription->getVariablesMap(freeVariableIndex);
-		
-		// fill functions map
-		functionsMap = targetDescription->getFunctionsMap();
-		
-		// fill contants maps
-		constantsMap.clear();
-		for (unsigned i = 0; i < commonDefinitions->constants.size(); i++)
+		// the caller might have changed the content of the descriptions in place, so compare it
+		if (!targetMapsValid || !haveSameSymbols(*targetDescription, mapsTargetDescription))
 		{
-			const NamedValue &constant(commonDefinitions->constants[i]);
-			constantsMap[constant.name] = constant.value;
+			mapsTargetDescription = *targetDescription;
+			targetVariablesMap = targetDescription->getVariablesMap(targetFreeVariableIndex);
+			functionsMap = targetDescription->getFunctionsMap();
+			targetMapsValid = true;
+			commonMapsValid = false;
 		}
-		
-		// fill global events map
-		globalEventsMap.clear();
-		for (unsigned i = 0; i < commonDefinitions->events.size(); i++)
+		if (!commonMapsValid || commonDefinitions->events != mapsCommonDefinitions.events || commonDefinitions->constants != mapsCommonDefinitions.constants)
 		{
-			globalEventsMap[commonDefinitions->events[i].name] = i;
+			mapsCommonDefinitions = *commonDefinitions;
+			
+			// fill constants map
+			commonConstantsMap.clear();
+			for (unsigned i = 0; i < commonDefinitions->constants.size(); i++)
+			{
+				const NamedValue &constant(commonDefinitions->constants[i]);
+				commonConstantsMap[constant.name] = constant.value;
+			}
+			
+			// fill global events map
+			globalEventsMap.clear();
+			for (unsigned i = 0; i < commonDefinitions->events.size(); i++)
+			{
+				globalEventsMap[commonDefinitions->events[i].name] = i;
+			}
+			
+			// fill all events map
+			allEventsMap = globalEventsMap;
+			for (unsigned i = 0; i < targetDescription->localEvents.size(); ++i)
+			{
+				allEventsMap[targetDescription->localEvents[i].name] = ASEBA_EVENT_LOCAL_EVENTS_START - i;
+			}
+			commonMapsValid = true;
 		}
 		
-		// fill all events map
-		allEventsMap = globalEventsMap;
-		for (unsigned i = 0; i < targetDescription->localEvents.size(); ++i)
-		{
-			allEventsMap[targetDescription->localEvents[i].name] = ASEBA_EVENT_LOCAL_EVENTS_START - i;
-		}
+		// the program adds its own variables and constants, so start from fresh copies
+		variablesMap = targetVariablesMap;
+		freeVariableIndex = targetFreeVariableIndex;
+		constantsMap = commonConstantsMap;
 	}
 	
 	/*@}*/
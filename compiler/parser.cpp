@@ -398,7 +398,7 @@ namespace Aseba
 			throw TranslatableError(varPos, ERROR_VAR_ALREADY_DEFINED).arg(varName);
 
 		// check if variable conflicts with a constant
-		if(commonDefinitions->constants.contains(varName))
+		if (commonConstantsMap.find(varName) != commonConstantsMap.end())
 			throw TranslatableError(varPos, ERROR_VAR_CONST_COLLISION).arg(varName);
 		
 		// optional assignation
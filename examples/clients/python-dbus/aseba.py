@@ -148,6 +148,12 @@ class Aseba(object):
         else:
             return [int(dbus_array[x]) for x in range(0,size)]
 
+    def get_many(self, node, variables):
+        # read several variables in a single D-Bus call
+        if self.dummy: return [[0] * 10 for var in variables]
+        dbus_arrays = self.network.GetVariables(node, variables)
+        return [[int(value) for value in dbus_array] for dbus_array in dbus_arrays]
+
     def send_event(self, event_id, event_args):
 
         if isinstance(event_id, basestring):
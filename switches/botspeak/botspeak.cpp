@@ -77,7 +77,24 @@ namespace Aseba
 	} operationMap;
 	
 	
-	BotSpeakBridge::Value::Value(BotSpeakBridge* bridge, const std::string& arg)
+	//! Maximum number of commands executed as a single batch
+	static const size_t maxBatchSize = 64;
+	//! Maximum number of words of a single GetVariables, the answer may come in several messages
+	static const unsigned maxReadLength = 128;
+	//! Maximum number of unneeded words to read to merge two ranges of variables in a single GetVariables
+	static const unsigned maxReadGap = 8;
+	
+	BotSpeakBridge::Operand::Operand():
+		kind(CONSTANT),
+		value(0),
+		address(-1),
+		indexAddress(-1)
+	{}
+	
+	BotSpeakBridge::Operand::Operand(BotSpeakBridge* bridge, const std::string& arg):
+		value(0),
+		address(-1),
+		indexAddress(-1)
 	{
 		const StringVector parts(split<string>(arg, "[] "));
 		assert(parts.size() >= 1);
@@ -95,93 +112,36 @@ namespace Aseba
 					index = varSize-1;
 				}
 				address = bridge->getVarAddress(parts[0]) + index;
-				GetVariables(bridge->nodeId, address, 1).serialize(bridge->asebaStream);
-				bridge->asebaStream->flush();
-				state = PENDING_DIRECT_VALUE;
+				kind = DIRECT;
 			}
 			else
 			{
 				address = bridge->getVarAddress(parts[0]);
-				indirectAddress = bridge->getVarAddress(parts[1]);
-				GetVariables(bridge->nodeId, indirectAddress, 1).serialize(bridge->asebaStream);
-				bridge->asebaStream->flush();
-				state = PENDING_INDIRECT_VALUE;
+				indexAddress = bridge->getVarAddress(parts[1]);
+				kind = INDIRECT;
 			}
 		}
 		else
 		{
-			indirectAddress = -1;
 			if (isNumber(parts[0]))
 			{
-				address = -1;
 				value = atoi(parts[0].c_str());
-				state = RESOLVED;
+				kind = CONSTANT;
 			}
 			else
 			{
 				address = bridge->getVarAddress(parts[0]);
-				GetVariables(bridge->nodeId, address, 1).serialize(bridge->asebaStream);
-				bridge->asebaStream->flush();
-				state = PENDING_DIRECT_VALUE;
+				kind = DIRECT;
 			}
 		}
 	}
 	
-	bool BotSpeakBridge::Value::update(BotSpeakBridge* bridge, unsigned addr, int val)
-	{
-		if (state == PENDING_INDIRECT_VALUE && addr == indirectAddress)
-		{
-			address += val;
-			GetVariables(bridge->nodeId, address, 1).serialize(bridge->asebaStream);
-			bridge->asebaStream->flush();
-			state = PENDING_DIRECT_VALUE;
-			return true;
-		}
-		else if (state == PENDING_DIRECT_VALUE && addr == address)
-		{
-			value = val;
-			state = RESOLVED;
-			return true;
-		}
-		return false;
-	}
-	
-	BotSpeakBridge::Operation::Operation(BotSpeakBridge* bridge, const std::string& op, const std::string& lhs, const std::string& rhs):
+	BotSpeakBridge::Command::Command(BotSpeakBridge* bridge, const std::string& op, const std::string& lhs, const std::string& rhs):
 		op(op),
-		lhs(bridge, lhs),
-		rhs(bridge, rhs)
-	{}
-	
-	//! Update operation, exec if ready, return whether was executed
-	bool BotSpeakBridge::Operation::update(BotSpeakBridge* bridge, unsigned addr, int val)
-	{
-		if (!lhs.update(bridge, addr, val))
-			rhs.update(bridge, addr, val);
-		if (isReady())
-		{
-			exec(bridge);
-			return true;
-		}
-		return false;
-	}
-	
-	bool BotSpeakBridge::Operation::isReady()
+		lhs(bridge, lhs)
 	{
-		return (lhs.state == Value::RESOLVED) && (rhs.state == Value::RESOLVED);
-	}
-	
-	void BotSpeakBridge::Operation::exec(BotSpeakBridge* bridge)
-	{
-		assert(isReady());
-		const int result(operationMap.exec(op, lhs.value, rhs.value));
-		// output result
-		bridge->outputBotspeak(result);
-		// write back result
-		SetVariables(bridge->nodeId, lhs.address, SetVariables::VariablesVector(1, result)).serialize(bridge->asebaStream);
-		// update outputs
-		UserMessage(bridge->eventId(L"update_outputs")).serialize(bridge->asebaStream);
-		bridge->asebaStream->flush();
-		if (bridge->verbose) cout << "Set address " << lhs.address << " to value " << result << endl;
+		if (op != "GET")
+			this->rhs = Operand(bridge, rhs);
 	}
 	
 	
@@ -294,29 +254,21 @@ namespace Aseba
 		
 		// if variables, check for pending requests
 		const Variables *variables(dynamic_cast<Variables *>(message));
-		if (variables)
+		if (variables && !batch.empty())
 		{
-			if (getValue.get() && (variables->variables.size() == 1))
-			{
-				if (verbose) cout << "Received variable value, updating pending get" << endl;
-				getValue->update(this, variables->start, variables->variables[0]);
-				if (getValue->state == Value::RESOLVED)
-				{
-					outputBotspeak(getValue->value);
-					if (verbose) cout << "Received result of get: " << getValue->value << endl;
-					getValue.reset();
-					startNextOperationIfPossible();
-				}
-			}
-			else if ((currentOperation.get()) && (variables->variables.size() == 1))
+			// a long read may be answered in several chunks, each one moving the read past its values
+			map<unsigned, unsigned>::iterator readIt(pendingReads.find(variables->start));
+			if (readIt != pendingReads.end() && !variables->variables.empty() && variables->variables.size() <= readIt->second)
 			{
-				if (verbose) cout << "Received variable value, updating pending operation" << endl;
-				if (currentOperation->update(this, variables->start, variables->variables[0]))
-				{
-					if (verbose) cout << "Operation completed" << endl;
-					currentOperation.reset();
-					startNextOperationIfPossible();
-				}
+				if (verbose) cout << "Received " << variables->variables.size() << " variables values from address " << variables->start << endl;
+				for (size_t i = 0; i < variables->variables.size(); ++i)
+					fetchedValues[variables->start + i] = variables->variables[i];
+				const unsigned remaining(readIt->second - variables->variables.size());
+				pendingReads.erase(readIt);
+				if (remaining)
+					pendingReads[variables->start + variables->variables.size()] = remaining;
+				else if (pendingReads.empty())
+					continueBatch();
 			}
 		}
 		
@@ -666,7 +618,7 @@ namespace Aseba
 		nextOperationsOp.push(op);
 		nextOperationsArg0.push(arg0);
 		nextOperationsArg1.push(arg1);
-		startNextOperationIfPossible();
+		startNextBatchIfPossible();
 	}
 	
 	void BotSpeakBridge::scheduleGet(const string& arg)
@@ -675,31 +627,168 @@ namespace Aseba
 		nextOperationsOp.push("GET");
 		nextOperationsArg0.push(arg);
 		nextOperationsArg1.push("");
-		startNextOperationIfPossible();
+		startNextBatchIfPossible();
 	}
 	
-	void BotSpeakBridge::startNextOperationIfPossible()
+	//! If no batch is running, take all pending commands as a new batch, update inputs and start executing them
+	void BotSpeakBridge::startNextBatchIfPossible()
 	{
-		if (!currentOperation.get() && !getValue.get() && !nextOperationsOp.empty())
+		if (!batch.empty() || nextOperationsOp.empty())
+			return;
+		
+		// inputs are updated once for the whole batch
+		UserMessage(eventId(L"update_inputs")).serialize(asebaStream);
+		while (!nextOperationsOp.empty() && batch.size() < maxBatchSize)
 		{
-			// pending one, update inputs and schedule next
-			UserMessage(eventId(L"update_inputs")).serialize(asebaStream);
-			asebaStream->flush();
-			// depending whether it is a get or a binary operation
-			if (nextOperationsOp.front() == "GET")
+			batch.push_back(Command(this, nextOperationsOp.front(), nextOperationsArg0.front(), nextOperationsArg1.front()));
+			nextOperationsOp.pop();
+			nextOperationsArg0.pop();
+			nextOperationsArg1.pop();
+		}
+		if (verbose) cout << "Next batch of " << batch.size() << " commands started" << endl;
+		fetchedValues.clear();
+		continueBatch();
+	}
+	
+	//! Execute the batch if all its inputs are known, otherwise request the missing ones from the target
+	void BotSpeakBridge::continueBatch()
+	{
+		set<unsigned> missing;
+		if (evaluateBatch(missing, false))
+		{
+			evaluateBatch(missing, true);
+			if (verbose) cout << "Batch completed" << endl;
+			batch.clear();
+			startNextBatchIfPossible();
+		}
+		else
+		{
+			assert(!missing.empty());
+			requestValues(missing);
+		}
+	}
+	
+	//! Run the commands of the batch in order, on values fetched from the target and written by previous commands.
+	//! Return whether all values were known; if not, fill missing with the addresses to read from the target.
+	//! If commit is true, all values must be known; output results to BotSpeak and write the final values to the target.
+	bool BotSpeakBridge::evaluateBatch(set<unsigned>& missing, bool commit)
+	{
+		PartialValuesMap written;
+		for (Commands::const_iterator it(batch.begin()); it != batch.end(); ++it)
+		{
+			const Command& command(*it);
+			
+			// where to write, if unknown later commands might depend on it, so stop here
+			unsigned lhsAddress(-1);
+			if (command.lhs.kind != Operand::CONSTANT && !resolveAddress(command.lhs, written, missing, lhsAddress))
+				return false;
+			
+			// read inputs
+			bool known(true);
+			int lhsValue(command.lhs.value);
+			int rhsValue(0);
+			if (command.op != "SET" && command.lhs.kind != Operand::CONSTANT)
+				known = readValue(lhsAddress, written, missing, lhsValue);
+			if (command.op != "GET")
+				known = readOperand(command.rhs, written, missing, rhsValue) && known;
+			
+			// compute result, wrapped to 16 bits as the target would store it
+			const int result(sint16(command.op == "GET" ? lhsValue : operationMap.exec(command.op, lhsValue, rhsValue)));
+			if (command.op != "GET" && command.lhs.kind != Operand::CONSTANT)
+				written[lhsAddress] = make_pair(known, result);
+			if (commit)
 			{
-				getValue.reset(new Value(this, nextOperationsArg0.front()));
-				if (verbose) cout << "Next get started" << endl;
+				assert(known);
+				outputBotspeak(result);
+				if (verbose) cout << command.op << " at address " << lhsAddress << " gives " << result << endl;
 			}
-			else
+		}
+		
+		if (!missing.empty())
+			return false;
+		
+		if (commit)
+		{
+			// write back results, one message per contiguous range of addresses
+			PartialValuesMap::const_iterator it(written.begin());
+			while (it != written.end())
 			{
-				currentOperation.reset(new Operation(this, nextOperationsOp.front(), nextOperationsArg0.front(), nextOperationsArg1.front()));
-				if (verbose) cout << "Next operation started" << endl;
+				const unsigned start(it->first);
+				SetVariables::VariablesVector values;
+				for (; it != written.end() && it->first == start + values.size(); ++it)
+					values.push_back(it->second.second);
+				SetVariables(nodeId, start, values).serialize(asebaStream);
 			}
-			nextOperationsOp.pop();
-			nextOperationsArg0.pop();
-			nextOperationsArg1.pop();
+			// update outputs
+			UserMessage(eventId(L"update_outputs")).serialize(asebaStream);
+			asebaStream->flush();
+		}
+		return true;
+	}
+	
+	//! Read the value at address, return false and add address to missing if it must be fetched from the target
+	bool BotSpeakBridge::readValue(unsigned address, const PartialValuesMap& written, set<unsigned>& missing, int& value) const
+	{
+		PartialValuesMap::const_iterator writtenIt(written.find(address));
+		if (writtenIt != written.end())
+		{
+			value = writtenIt->second.second;
+			return writtenIt->second.first;
+		}
+		ValuesMap::const_iterator fetchedIt(fetchedValues.find(address));
+		if (fetchedIt != fetchedValues.end())
+		{
+			value = fetchedIt->second;
+			return true;
+		}
+		missing.insert(address);
+		return false;
+	}
+	
+	//! Compute the address of a variable operand, return false if it depends on an unknown index
+	bool BotSpeakBridge::resolveAddress(const Operand& operand, const PartialValuesMap& written, set<unsigned>& missing, unsigned& address) const
+	{
+		assert(operand.kind != Operand::CONSTANT);
+		if (operand.kind == Operand::DIRECT)
+		{
+			address = operand.address;
+			return true;
+		}
+		int index;
+		if (!readValue(operand.indexAddress, written, missing, index))
+			return false;
+		address = operand.address + index;
+		return true;
+	}
+	
+	//! Get the value of an operand, return false if it is not known yet
+	bool BotSpeakBridge::readOperand(const Operand& operand, const PartialValuesMap& written, set<unsigned>& missing, int& value) const
+	{
+		if (operand.kind == Operand::CONSTANT)
+		{
+			value = operand.value;
+			return true;
+		}
+		unsigned address;
+		if (!resolveAddress(operand, written, missing, address))
+			return false;
+		return readValue(address, written, missing, value);
+	}
+	
+	//! Request the values at addresses from the target, merging close addresses in single messages
+	void BotSpeakBridge::requestValues(const set<unsigned>& addresses)
+	{
+		set<unsigned>::const_iterator it(addresses.begin());
+		while (it != addresses.end())
+		{
+			const unsigned start(*it);
+			unsigned end(start + 1);
+			for (++it; it != addresses.end() && *it <= end + maxReadGap && *it < start + maxReadLength; ++it)
+				end = *it + 1;
+			GetVariables(nodeId, start, end - start).serialize(asebaStream);
+			pendingReads[start] = end - start;
 		}
+		asebaStream->flush();
 	}
 	
 	std::wstring BotSpeakBridge::asebaCodeHeader() const
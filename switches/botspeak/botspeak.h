@@ -23,6 +23,8 @@
 
 #include <stdint.h>
 #include <queue>
+#include <map>
+#include <set>
 #include <dashel/dashel.h>
 #include "../../common/msg/descriptions-manager.h"
 
@@ -39,36 +41,38 @@ namespace Aseba
 		typedef std::vector<std::string> StringVector;
 		typedef TargetDescription::NamedVariable NamedVariable;
 		
-		struct Value
+		//! An argument of a command: a constant, a variable, or an element of an array indexed by a variable
+		struct Operand
 		{
 			enum
 			{
-				RESOLVED,
-				PENDING_DIRECT_VALUE,
-				PENDING_INDIRECT_VALUE
-			} state;
-			int value; //! resolved value
-			unsigned address; //! address to which the value belong
-			unsigned indirectAddress; //! address to which the index belongs
+				CONSTANT,
+				DIRECT,
+				INDIRECT
+			} kind;
+			int value; //! value, if constant
+			unsigned address; //! address of the variable, or of the first element of the array if indirect
+			unsigned indexAddress; //! address of the index, if indirect
 			
-			Value(BotSpeakBridge* bridge, const std::string& arg);
-		
-			bool update(BotSpeakBridge* bridge, unsigned addr, int val);
+			Operand();
+			Operand(BotSpeakBridge* bridge, const std::string& arg);
 		};
 		
-		struct Operation
+		//! A GET, or an operation (SET, ADD, ...) writing its result to lhs
+		struct Command
 		{
 			std::string op;
-			Value lhs;
-			Value rhs;
+			Operand lhs;
+			Operand rhs;
 			
-			Operation(BotSpeakBridge* bridge, const std::string& op, const std::string& lhs, const std::string& rhs);
-			bool update(BotSpeakBridge* bridge, unsigned addr, int val);
-		
-		protected:
-			bool isReady();
-			void exec(BotSpeakBridge* bridge);
+			Command(BotSpeakBridge* bridge, const std::string& op, const std::string& lhs, const std::string& rhs);
 		};
+		typedef std::vector<Command> Commands;
+		
+		//! Values of variables by address
+		typedef std::map<unsigned, int> ValuesMap;
+		//! Values of variables by address, for each one whether it is known yet
+		typedef std::map<unsigned, std::pair<bool, int> > PartialValuesMap;
 		
 	protected:
 		// streams
@@ -91,11 +95,11 @@ namespace Aseba
 		// is in run&wait mode?
 		bool runAndWait;
 		
-		// current operation
-		bool getInProgress;
-		std::auto_ptr<Value> getValue;
-		std::auto_ptr<Operation> currentOperation;
-		// and pending ones
+		// commands executed together, with a single round trip to read their inputs when possible
+		Commands batch;
+		ValuesMap fetchedValues; // values read from target for the current batch
+		std::map<unsigned, unsigned> pendingReads; // start and length of variables still expected from target for the current batch
+		// and pending commands
 		std::queue<std::string> nextOperationsOp;
 		std::queue<std::string> nextOperationsArg0;
 		std::queue<std::string> nextOperationsArg1;
@@ -125,7 +129,13 @@ namespace Aseba
 		// helper functions
 		void scheduleGet(const std::string& arg);
 		void scheduleOperation(const std::string& op, const std::string& arg0, const std::string& arg1);
-		void startNextOperationIfPossible();
+		void startNextBatchIfPossible();
+		void continueBatch();
+		bool evaluateBatch(std::set<unsigned>& missing, bool commit);
+		bool readValue(unsigned address, const PartialValuesMap& written, std::set<unsigned>& missing, int& value) const;
+		bool resolveAddress(const Operand& operand, const PartialValuesMap& written, std::set<unsigned>& missing, unsigned& address) const;
+		bool readOperand(const Operand& operand, const PartialValuesMap& written, std::set<unsigned>& missing, int& value) const;
+		void requestValues(const std::set<unsigned>& addresses);
 		std::wstring asebaCodeHeader() const;
 		std::wstring asebaCodeFooter() const;
 		void defineVar(const std::wstring& varName, unsigned varSize);
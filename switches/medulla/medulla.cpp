@@ -27,6 +27,7 @@
 #include <valarray>
 #include <vector>
 #include <iterator>
+#include <algorithm>
 #include "medulla.h"
 #include "../../common/consts.h"
 #include "../../common/types.h"
@@ -66,6 +67,26 @@ namespace Aseba
 		return data;
 	}
 	
+	//! A stream collecting written data in memory, to serialize messages outside the hub thread
+	class SerializationBuffer: public Stream
+	{
+	public:
+		SerializationBuffer(): Stream("buffer") {}
+		
+		virtual void write(const void *data, const size_t size)
+		{
+			const uint8* bytes(reinterpret_cast<const uint8*>(data));
+			this->data.insert(this->data.end(), bytes, bytes + size);
+		}
+		virtual void flush() {}
+		virtual void read(void *data, size_t size)
+		{
+			throw DashelException(DashelException::IOError, 0, "Cannot read from a serialization buffer", this);
+		}
+		
+		std::vector<uint8> data; //!< everything written so far
+	};
+	
 	void EventFilterInterface::emitEvent(const quint16 id, const QString& name, const Values& data)
 	{
 		emit Event(id, name, data);
@@ -108,10 +129,15 @@ namespace Aseba
 	AsebaNetworkInterface::AsebaNetworkInterface(Hub* hub, bool systemBus) :
 		QDBusAbstractAdaptor(hub),
 		hub(hub),
+		subscribedEvents(65536),
 		systemBus(systemBus),
 		eventsFiltersCounter(0)
 	{
 		qDBusRegisterMetaType<Values>();
+		qDBusRegisterMetaType<ValuesList>();
+		
+		connect(&pendingReadsTimer, SIGNAL(timeout()), SLOT(timeoutPendingReads()));
+		pendingReadsTimer.setInterval(readTimeout / 4);
 		
 		//FIXME: here no error handling is done, with system bus these calls can fail	
 		DBusConnectionBus().registerObject("/", hub);
@@ -128,7 +154,7 @@ namespace Aseba
 		
 		// if user message, send to D-Bus as well
 		UserMessage *userMessage = dynamic_cast<UserMessage *>(message);
-		if (userMessage)
+		if (userMessage && subscribedEvents.testBit(userMessage->type))
 		{
 			sendEventOnDBus(userMessage->type, fromAsebaVector(userMessage->data));
 		}
@@ -136,55 +162,40 @@ namespace Aseba
 		// if variables, check for pending answers
 		Variables *variables = dynamic_cast<Variables *>(message);
 		if (variables)
-		{
-			const unsigned nodeId(variables->source);
-			const unsigned pos(variables->start);
-			for (RequestsList::iterator it = pendingReads.begin(); it != pendingReads.end(); ++it)
-			{
-				RequestData* request(*it);
-				if (request->nodeId == nodeId && request->pos == pos)
-				{
-					QDBusMessage &reply(request->reply);
-					Values values(fromAsebaVector(variables->variables));
-					reply << QVariant::fromValue(values);
-					DBusConnectionBus().send(reply);
-					delete request;
-					pendingReads.erase(it);
-					break;
-				}
-			}
-		}
+			variablesReceived(variables->source, variables->start, variables->variables);
 		
 		delete message;
 	}
 	
 	void AsebaNetworkInterface::sendEventOnDBus(const quint16 event, const Values& data)
 	{
-		QList<EventFilterInterface*> filters = eventsFilters.values(event);
-		QString name;
-		if (event < commonDefinitions.events.size())
-			name = QString::fromStdWString(commonDefinitions.events[event].name);
-		else
-			name = "?";
-		for (int i = 0; i < filters.size(); ++i)
-			filters.at(i)->emitEvent(event, name, data);
+		if (!subscribedEvents.testBit(event))
+			return;
+		const QString name(event < eventsNames.size() ? eventsNames[event] : QString("?"));
+		for (EventsFiltersMap::const_iterator it(eventsFilters.constFind(event)); it != eventsFilters.constEnd() && it.key() == event; ++it)
+			it.value()->emitEvent(event, name, data);
 	}
 	
 	void AsebaNetworkInterface::listenEvent(EventFilterInterface* filter, quint16 event)
 	{
 		eventsFilters.insert(event, filter);
+		subscribedEvents.setBit(event);
 	}
 	
 	void AsebaNetworkInterface::ignoreEvent(EventFilterInterface* filter, quint16 event)
 	{
 		eventsFilters.remove(event, filter);
+		subscribedEvents.setBit(event, eventsFilters.contains(event));
 	}
 	
 	void AsebaNetworkInterface::filterDestroyed(EventFilterInterface* filter)
 	{
 		QList<quint16> events = eventsFilters.keys(filter);
 		for (int i = 0; i < events.size(); ++i)
+		{
 			eventsFilters.remove(events.at(i), filter);
+			subscribedEvents.setBit(events.at(i), eventsFilters.contains(events.at(i)));
+		}
 	}
 	
 	void AsebaNetworkInterface::LoadScripts(const QString& fileName, const QDBusMessage &message)
@@ -292,6 +303,7 @@ namespace Aseba
 			commonDefinitions.constants.clear();
 			userDefinedVariablesMap.clear();
 		}
+		updateEventsNames();
 		
 		// check if there was some matching problem
 		if (noNodeCount)
@@ -398,59 +410,48 @@ namespace Aseba
 	
 	Values AsebaNetworkInterface::GetVariable(const QString& node, const QString& variable, const QDBusMessage &message)
 	{
-		// make sure the node exists
-		NodesNamesMap::const_iterator nodeIt(nodesNames.find(node));
-		if (nodeIt == nodesNames.end())
-		{
-			DBusConnectionBus().send(message.createErrorReply(QDBusError::InvalidArgs, QString("node %0 does not exists").arg(node)));
+		unsigned nodeId, pos, length;
+		if (!findVariable(node, variable, nodeId, pos, length, message))
 			return Values();
-		}
-		const unsigned nodeId(nodeIt.value());
-		
-		unsigned pos(unsigned(-1));
-		unsigned length(unsigned(-1));
-		
-		// check whether variable is user-defined
-		const UserDefinedVariablesMap::const_iterator userVarMapIt(userDefinedVariablesMap.find(node));
-		if (userVarMapIt != userDefinedVariablesMap.end())
-		{
-			const VariablesMap& userVarMap(userVarMapIt.value());
-			const VariablesMap::const_iterator userVarIt(userVarMap.find(variable.toStdWString()));
-			if (userVarIt != userVarMap.end())
-			{
-				pos = userVarIt->second.first;
-				length = userVarIt->second.second;
-			}
-		}
 		
-		// if variable is not user-defined, check whether it is provided by this node
-		if (pos == unsigned(-1))
-		{
-			bool ok1, ok2;
-			pos = getVariablePos(nodeId, variable.toStdWString(), &ok1);
-			length = getVariableSize(nodeId, variable.toStdWString(), &ok2);
-			if (!(ok1 && ok2))
-			{
-				DBusConnectionBus().send(message.createErrorReply(QDBusError::InvalidArgs, QString("variable %0 does not exists in node %1").arg(variable).arg(node)));
-				return Values();
-			}
-		}
+		// the reply will be sent when the values arrive
+		message.setDelayedReply(true);
+		ReadWaiter waiter;
+		waiter.reply = message.createReply();
+		waiter.bulk = 0;
+		waiter.index = 0;
+		requestRead(nodeId, pos, length, waiter);
+		return Values();
+	}
+	
+	ValuesList AsebaNetworkInterface::GetVariables(const QString& node, const QStringList& variables, const QDBusMessage &message)
+	{
+		// resolve all variables first, so that no read is issued if one is invalid
+		QVector<unsigned> positions(variables.size());
+		QVector<unsigned> lengths(variables.size());
+		unsigned nodeId(0);
+		for (int i = 0; i < variables.size(); ++i)
+			if (!findVariable(node, variables[i], nodeId, positions[i], lengths[i], message))
+				return ValuesList();
+		if (variables.isEmpty())
+			return ValuesList();
 		
-		// send request to aseba network
+		// the reply will be sent when the values of all variables arrive
+		message.setDelayedReply(true);
+		BulkRead* bulk(new BulkRead);
+		bulk->reply = message.createReply();
+		for (int i = 0; i < variables.size(); ++i)
+			bulk->values.append(Values());
+		bulk->remaining = variables.size();
+		bulk->failed = false;
+		for (int i = 0; i < variables.size(); ++i)
 		{
-			GetVariables msg(nodeId, pos, length);
-			hub->sendMessage(msg);
+			ReadWaiter waiter;
+			waiter.bulk = bulk;
+			waiter.index = i;
+			requestRead(nodeId, positions[i], lengths[i], waiter);
 		}
-		
-		// build bookkeeping for async reply
-		RequestData *request = new RequestData;
-		request->nodeId = nodeId;
-		request->pos = pos;
-		message.setDelayedReply(true);
-		request->reply = message.createReply();
-		
-		pendingReads.push_back(request);
-		return Values();
+		return ValuesList();
 	}
 	
 	void AsebaNetworkInterface::SendEvent(const quint16 event, const Values& data)
@@ -492,6 +493,190 @@ namespace Aseba
 			return QDBusConnection::sessionBus();
 	}
 	
+	//! Find the node identifier, position and length of a variable, either user-defined or provided by the node; if not found, reply an error to message and return false
+	bool AsebaNetworkInterface::findVariable(const QString& node, const QString& variable, unsigned& nodeId, unsigned& pos, unsigned& length, const QDBusMessage &message) const
+	{
+		// make sure the node exists
+		NodesNamesMap::const_iterator nodeIt(nodesNames.find(node));
+		if (nodeIt == nodesNames.end())
+		{
+			DBusConnectionBus().send(message.createErrorReply(QDBusError::InvalidArgs, QString("node %0 does not exists").arg(node)));
+			return false;
+		}
+		nodeId = nodeIt.value();
+		
+		// check whether variable is user-defined
+		const UserDefinedVariablesMap::const_iterator userVarMapIt(userDefinedVariablesMap.find(node));
+		if (userVarMapIt != userDefinedVariablesMap.end())
+		{
+			const VariablesMap& userVarMap(userVarMapIt.value());
+			const VariablesMap::const_iterator userVarIt(userVarMap.find(variable.toStdWString()));
+			if (userVarIt != userVarMap.end())
+			{
+				pos = userVarIt->second.first;
+				length = userVarIt->second.second;
+				return true;
+			}
+		}
+		
+		// if variable is not user-defined, check whether it is provided by this node
+		bool ok1, ok2;
+		pos = getVariablePos(nodeId, variable.toStdWString(), &ok1);
+		length = getVariableSize(nodeId, variable.toStdWString(), &ok2);
+		if (!(ok1 && ok2))
+		{
+			DBusConnectionBus().send(message.createErrorReply(QDBusError::InvalidArgs, QString("variable %0 does not exists in node %1").arg(variable).arg(node)));
+			return false;
+		}
+		return true;
+	}
+	
+	//! Register waiter for the values of a range of variables of a node, and send a request on the Aseba network unless one covering it is already in flight
+	void AsebaNetworkInterface::requestRead(unsigned nodeId, unsigned pos, unsigned length, const ReadWaiter& waiter)
+	{
+		const quint64 key(readKey(nodeId, pos));
+		PendingReadsMap::iterator it(pendingReads.find(key));
+		const bool isNew(it == pendingReads.end());
+		if (isNew)
+		{
+			it = pendingReads.insert(key, PendingRead());
+			it->received = 0;
+		}
+		if (isNew || it->values.size() < length)
+		{
+			Aseba::GetVariables msg(nodeId, pos, length);
+			hub->sendMessage(msg);
+			
+			it->values.resize(length, 0);
+			it->sendTime.start();
+			if (!pendingReadsTimer.isActive())
+				pendingReadsTimer.start();
+		}
+		it->waiters.append(waiter);
+		it->waiters.back().length = length;
+	}
+	
+	//! Fill the reads in flight with a chunk of values of node nodeId at start, answering the callers having all their values
+	void AsebaNetworkInterface::variablesReceived(unsigned nodeId, unsigned start, const std::vector<sint16>& values)
+	{
+		// the reads of this node starting at or before the chunk
+		QList<ReadWaiter> answeredWaiters;
+		QList<Values> answeredValues;
+		PendingReadsMap::iterator it(pendingReads.lowerBound(readKey(nodeId, 0)));
+		while (it != pendingReads.end() && it.key() <= readKey(nodeId, start))
+		{
+			PendingRead& read(it.value());
+			const unsigned offset(start - (it.key() & 0xffff));
+			if (offset > read.received)
+			{
+				// chunk beyond a missing one, wait for a repeated read or the timeout
+				++it;
+				continue;
+			}
+			for (size_t i = 0; i < values.size() && offset + i < read.values.size(); ++i)
+				read.values[offset + i] = values[i];
+			read.received = std::max<unsigned>(read.received, std::min<size_t>(offset + values.size(), read.values.size()));
+			
+			for (int i = 0; i < read.waiters.size();)
+			{
+				if (read.waiters[i].length <= read.received)
+				{
+					answeredWaiters.append(read.waiters[i]);
+					answeredValues.append(fromAsebaVector(std::vector<sint16>(read.values.begin(), read.values.begin() + read.waiters[i].length)));
+					read.waiters.removeAt(i);
+				}
+				else
+					++i;
+			}
+			if (read.waiters.isEmpty())
+				it = pendingReads.erase(it);
+			else
+				++it;
+		}
+		if (pendingReads.isEmpty())
+			pendingReadsTimer.stop();
+		
+		for (int i = 0; i < answeredWaiters.size(); ++i)
+			answerWaiter(answeredWaiters[i], answeredValues[i]);
+	}
+	
+	//! Give values to a waiting caller, replying on D-Bus if it has everything it asked for
+	void AsebaNetworkInterface::answerWaiter(const ReadWaiter& waiter, const Values& values)
+	{
+		if (!waiter.bulk)
+		{
+			QDBusMessage reply(waiter.reply);
+			reply << QVariant::fromValue(values);
+			DBusConnectionBus().send(reply);
+			return;
+		}
+		
+		BulkRead* bulk(waiter.bulk);
+		bulk->values[waiter.index] = values;
+		if (--bulk->remaining == 0)
+		{
+			if (!bulk->failed)
+			{
+				bulk->reply << QVariant::fromValue(bulk->values);
+				DBusConnectionBus().send(bulk->reply);
+			}
+			delete bulk;
+		}
+	}
+	
+	//! Reply an error to a waiting caller, only once for a bulk call
+	void AsebaNetworkInterface::failWaiter(const ReadWaiter& waiter, const QString& errorMessage)
+	{
+		if (!waiter.bulk)
+		{
+			DBusConnectionBus().send(waiter.reply.createErrorReply(QDBusError::Timeout, errorMessage));
+			return;
+		}
+		
+		BulkRead* bulk(waiter.bulk);
+		if (!bulk->failed)
+		{
+			DBusConnectionBus().send(bulk->reply.createErrorReply(QDBusError::Timeout, errorMessage));
+			bulk->failed = true;
+		}
+		if (--bulk->remaining == 0)
+			delete bulk;
+	}
+	
+	//! Fail the reads that were not answered within readTimeout, for instance because the node was disconnected
+	void AsebaNetworkInterface::timeoutPendingReads()
+	{
+		QList<ReadWaiter> expiredWaiters;
+		for (PendingReadsMap::iterator it = pendingReads.begin(); it != pendingReads.end();)
+		{
+			if (it->sendTime.elapsed() >= readTimeout)
+			{
+				expiredWaiters += it->waiters;
+				it = pendingReads.erase(it);
+			}
+			else
+				++it;
+		}
+		if (pendingReads.isEmpty())
+			pendingReadsTimer.stop();
+		for (int i = 0; i < expiredWaiters.size(); ++i)
+			failWaiter(expiredWaiters[i], QString("no answer from the network within %0 ms").arg(readTimeout));
+	}
+	
+	//! Rebuild the cache of events names, to call whenever commonDefinitions.events changes
+	void AsebaNetworkInterface::updateEventsNames()
+	{
+		eventsNames.clear();
+		for (size_t i = 0; i < commonDefinitions.events.size(); ++i)
+			eventsNames.append(QString::fromStdWString(commonDefinitions.events[i].name));
+	}
+	
+	//! Return a key identifying a read at pos of node nodeId, both being 16-bit values on the Aseba network; the keys of a node are contiguous and sorted by position
+	quint64 AsebaNetworkInterface::readKey(unsigned nodeId, unsigned pos)
+	{
+		return (quint64(nodeId & 0xffff) << 16) | quint64(pos & 0xffff);
+	}
+	
 	// the following methods run in the main thread (event loop)
 	
 	Hub::Hub(unsigned port, bool verbose, bool dump, bool forward, bool rawTime, bool systemBus) :
@@ -522,30 +707,19 @@ namespace Aseba
 			cout << std::endl;
 		}
 		
-		// Called from the dbus thread, not the Hub thread, need to lock	
-		lock();
-
-		// write on all connected streams
-		for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
-		{
-			Stream* destStream(*it);
-			
-			if ((forward) && (destStream == sourceStream))
-				continue;
-			
-			try
-			{
-				message->serialize(destStream);
-				destStream->flush();
-			}
-			catch (DashelException e)
-			{
-				// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
-				std::cerr << "error while writing message" << std::endl;
-			}
-		}
-
-		unlock();
+		// serialize in the calling thread, and queue for the hub thread
+		SerializationBuffer buffer;
+		message->serialize(&buffer);
+		OutgoingMessage outgoingMessage;
+		outgoingMessage.data.swap(buffer.data);
+		outgoingMessage.sourceStream = sourceStream;
+		outgoingMessagesMutex.lock();
+		outgoingMessages.append(outgoingMessage);
+		outgoingMessagesMutex.unlock();
+		
+		// the hub is probably waiting for incoming data, wake it up
+		if (outgoingNotified.testAndSetOrdered(0, 1))
+			Dashel::Hub::stop();
 	}
 	
 	void Hub::sendMessage(Message& message, Dashel::Stream* sourceStream)
@@ -565,10 +739,66 @@ namespace Aseba
 	
 	// the following methods run in the blocking reception thread
 	
-	// In QThread main function, we just make our Dashel hub switch listen for incoming data
+	// In QThread main function, we make our Dashel hub switch listen for incoming data, and write queued messages when woken up
 	void Hub::run()
 	{
-		Dashel::Hub::run();
+		while (true)
+		{
+			Dashel::Hub::run();
+			sendOutgoingMessages();
+		}
+	}
+	
+	//! Write all queued messages, with a single write and flush per stream
+	void Hub::sendOutgoingMessages()
+	{
+		outgoingNotified.fetchAndStoreOrdered(0);
+		
+		outgoingMessagesMutex.lock();
+		const QList<OutgoingMessage> messages(outgoingMessages);
+		outgoingMessages.clear();
+		outgoingMessagesMutex.unlock();
+		if (messages.isEmpty())
+			return;
+		
+		// concatenate all messages, and note their sources to exclude them when forwarding
+		std::vector<uint8> allData;
+		std::set<Stream*> sourceStreams;
+		for (int i = 0; i < messages.size(); ++i)
+		{
+			allData.insert(allData.end(), messages[i].data.begin(), messages[i].data.end());
+			if (messages[i].sourceStream)
+				sourceStreams.insert(messages[i].sourceStream);
+		}
+		
+		// write on all connected streams; as streams are only created and closed in this thread, no lock is needed
+		for (StreamsSet::iterator it = dataStreams.begin(); it != dataStreams.end();++it)
+		{
+			Stream* destStream(*it);
+			
+			try
+			{
+				if (forward && sourceStreams.find(destStream) != sourceStreams.end())
+				{
+					// do not send back messages to the stream they came from
+					std::vector<uint8> data;
+					for (int i = 0; i < messages.size(); ++i)
+						if (messages[i].sourceStream != destStream)
+							data.insert(data.end(), messages[i].data.begin(), messages[i].data.end());
+					if (data.empty())
+						continue;
+					destStream->write(&data[0], data.size());
+				}
+				else
+					destStream->write(&allData[0], allData.size());
+				destStream->flush();
+			}
+			catch (DashelException e)
+			{
+				// if this stream has a problem, ignore it for now, and let Hub call connectionClosed later.
+				std::cerr << "error while writing message" << std::endl;
+			}
+		}
 	}
 	
 	// the following method run in the blocking reception thread
@@ -30,10 +30,17 @@
 #include <QDBusMessage>
 #include <QMetaType>
 #include <QList>
+#include <QMap>
+#include <QBitArray>
+#include <QTime>
+#include <QTimer>
+#include <QMutex>
+#include <QAtomicInt>
 #include "../../common/msg/msg.h"
 #include "../../common/msg/descriptions-manager.h"
 
 typedef QList<qint16> Values;
+typedef QList<Values> ValuesList;
 
 namespace Aseba
 {
@@ -82,11 +89,32 @@ namespace Aseba
 		Q_CLASSINFO("D-Bus Interface", "ch.epfl.mobots.AsebaNetwork")
 		
 		protected:
-			struct RequestData
+			//! A call to GetVariables, answered once all its variables have been read
+			struct BulkRead
 			{
-				unsigned nodeId;
-				unsigned pos;
-				QDBusMessage reply;
+				QDBusMessage reply; //!< reply to send with the values
+				ValuesList values; //!< values read so far, in the order of the call
+				int remaining; //!< number of reads still referring to this call
+				bool failed; //!< an error was already replied, values must be discarded
+			};
+			
+			//! A caller waiting for a read, either a call to GetVariable or an element of a call to GetVariables
+			struct ReadWaiter
+			{
+				QDBusMessage reply; //!< reply to send with the values, if bulk is 0
+				BulkRead* bulk; //!< bulk call this read is part of, or 0
+				int index; //!< index of the values in bulk
+				unsigned length; //!< number of values the caller asked for
+			};
+			
+			//! A read in flight on the Aseba network, answering all callers asking for variables at the same position meanwhile
+			/*! Replies longer than a message are split in chunks, which are accumulated until each caller has its values */
+			struct PendingRead
+			{
+				QList<ReadWaiter> waiters; //!< callers waiting for the values
+				std::vector<sint16> values; //!< values of the longest read requested, filled as chunks arrive
+				unsigned received; //!< number of values received contiguously from the start
+				QTime sendTime; //!< when the request was sent on the network
 			};
 			
 		public:
@@ -100,6 +128,7 @@ namespace Aseba
 			void listenEvent(EventFilterInterface* filter, quint16 event);
 			void ignoreEvent(EventFilterInterface* filter, quint16 event);
 			void filterDestroyed(EventFilterInterface* filter);
+			void timeoutPendingReads();
 		
 		public slots:
 			Q_NOREPLY void LoadScripts(const QString& fileName, const QDBusMessage &message);
@@ -108,6 +137,7 @@ namespace Aseba
 			QStringList GetVariablesList(const QString& node) const;
 			Q_NOREPLY void SetVariable(const QString& node, const QString& variable, const Values& data, const QDBusMessage &message) const;
 			Values GetVariable(const QString& node, const QString& variable, const QDBusMessage &message);
+			ValuesList GetVariables(const QString& node, const QStringList& variables, const QDBusMessage &message);
 			Q_NOREPLY void SendEvent(const quint16 event, const Values& data);
 			Q_NOREPLY void SendEventName(const QString& name, const Values& data, const QDBusMessage &message);
 			QDBusObjectPath CreateEventFilter();
@@ -115,6 +145,13 @@ namespace Aseba
 		protected:
 			virtual void nodeDescriptionReceived(unsigned nodeId);
 			QDBusConnection DBusConnectionBus() const;
+			bool findVariable(const QString& node, const QString& variable, unsigned& nodeId, unsigned& pos, unsigned& length, const QDBusMessage &message) const;
+			void requestRead(unsigned nodeId, unsigned pos, unsigned length, const ReadWaiter& waiter);
+			void variablesReceived(unsigned nodeId, unsigned start, const std::vector<sint16>& values);
+			void answerWaiter(const ReadWaiter& waiter, const Values& values);
+			void failWaiter(const ReadWaiter& waiter, const QString& errorMessage);
+			static quint64 readKey(unsigned nodeId, unsigned pos);
+			void updateEventsNames();
 			
 		protected:
 			Hub* hub;
@@ -123,10 +160,14 @@ namespace Aseba
 			NodesNamesMap nodesNames;
 			typedef QMap<QString, VariablesMap> UserDefinedVariablesMap;
 			UserDefinedVariablesMap userDefinedVariablesMap;
-			typedef QList<RequestData*> RequestsList;
-			RequestsList pendingReads;
+			typedef QMap<quint64, PendingRead> PendingReadsMap;
+			PendingReadsMap pendingReads; //!< reads in flight, by node and position, sorted so that reads covering a chunk are found together
+			QTimer pendingReadsTimer; //!< checks for lost replies while reads are in flight
+			static const int readTimeout = 2000; //!< ms after which an unanswered read fails
 			typedef QMultiMap<quint16, EventFilterInterface*> EventsFiltersMap;
 			EventsFiltersMap eventsFilters;
+			QBitArray subscribedEvents; //!< by event identifier, whether any filter listens to it
+			QStringList eventsNames; //!< names of events from commonDefinitions, ready to be sent on D-Bus
 			bool systemBus;
 			unsigned eventsFiltersCounter;
 	};
@@ -134,8 +175,8 @@ namespace Aseba
 	/*!
 		Route Aseba messages on the TCP part of the network.
 		
-		This thread only *receives* messages.
-		All dispatch, including forwarding, is done in the main thread called by
+		This thread receives messages and writes the messages queued by sendMessage().
+		All dispatch, including forwarding, is decided in the main thread called by
 		the AsebaNetworkInterface class.
 	*/
 	class Hub: public QThread, public Dashel::Hub
@@ -153,7 +194,8 @@ namespace Aseba
 			Hub(unsigned port, bool verbose, bool dump, bool forward, bool rawTime, bool systemBus);
 			
 			/*! Sends a message to Dashel peers.
-				Does not delete the message, should be called by the main thread.
+				Does not delete the message, can be called from any thread.
+				The message is serialized and queued, and written by the hub thread.
 				@param message aseba message to send
 				@param sourceStream originate of the message, if from Dashel.
 			*/
@@ -174,6 +216,7 @@ namespace Aseba
 			void requestDescription();
 			
 		private:
+			void sendOutgoingMessages();
 			virtual void run();
 			virtual void connectionCreated(Dashel::Stream *stream);
 			virtual void incomingData(Dashel::Stream *stream);
@@ -184,11 +227,22 @@ namespace Aseba
 			bool dump; //!< should we dump content of CAN messages
 			bool forward; //!< should we only forward messages instead of transmit them back to the sender
 			bool rawTime; //!< should displayed timestamps be of the form sec:usec since 1970
+			
+			//! A serialized message waiting to be written by the hub thread
+			struct OutgoingMessage
+			{
+				std::vector<uint8> data; //!< serialized message
+				Dashel::Stream* sourceStream; //!< stream the message came from, if any
+			};
+			QMutex outgoingMessagesMutex; //!< only protects outgoingMessages, never held during I/O
+			QList<OutgoingMessage> outgoingMessages; //!< messages queued by sendMessage()
+			QAtomicInt outgoingNotified; //!< whether the hub thread was already woken up for the queued messages
 	};
 	
 	/*@}*/
 };
 
 Q_DECLARE_METATYPE(Values);
+Q_DECLARE_METATYPE(ValuesList);
 
 #endif
@@ -0,0 +1,335 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../common/consts.h"
+#include "../../common/msg/msg.h"
+#include "../../common/utils/utils.h"
+#include "../../transport/dashel_plugins/dashel-plugins.h"
+#include <dashel/dashel.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+
+//! A node that behaves like an Aseba bootloader, to test and benchmark flashing without hardware
+class DummyBootloader: public Dashel::Hub
+{
+private:
+	unsigned nodeId;
+	unsigned pageSize;
+	unsigned pagesStart;
+	unsigned pagesCount;
+	unsigned eraseTime; //!< simulated time to erase a page, in ms
+	unsigned writeTime; //!< simulated time to program a page, in ms
+	std::string flashFileName; //!< if not empty, where flash content is kept between runs
+	std::vector<uint8> flash; //!< content of all pages, starting at page 0
+
+	int programmingPage; //!< page being written, -1 if none
+	std::vector<uint8> pageBuffer; //!< data received so far for programmingPage
+	bool erasing; //!< whether programmingPage is being erased, its command not being acknowledged yet
+	Aseba::UnifiedTime eraseEnd; //!< when the erase completes
+	unsigned pagesWritten;
+	unsigned pagesRead;
+	unsigned messagesLost; //!< messages received while erasing
+
+	Dashel::Stream* stream;
+
+public:
+	DummyBootloader(unsigned pageSize, unsigned pagesStart, unsigned pagesCount, unsigned eraseTime, unsigned writeTime, const std::string& flashFileName):
+		nodeId(1),
+		pageSize(pageSize),
+		pagesStart(pagesStart),
+		pagesCount(pagesCount),
+		eraseTime(eraseTime),
+		writeTime(writeTime),
+		flashFileName(flashFileName),
+		flash((pagesStart + pagesCount) * pageSize, 0xff),
+		programmingPage(-1),
+		erasing(false),
+		pagesWritten(0),
+		pagesRead(0),
+		messagesLost(0),
+		stream(0)
+	{
+		if (!flashFileName.empty())
+		{
+			std::ifstream file(flashFileName.c_str(), std::ios::in | std::ios::binary);
+			file.read(reinterpret_cast<char*>(&flash[0]), flash.size());
+		}
+	}
+
+	void listen(int basePort, int deltaPort)
+	{
+		const int port(basePort + deltaPort);
+		nodeId = 1 + deltaPort;
+		try
+		{
+			std::ostringstream oss;
+			oss << "tcpin:port=" << port;
+			Dashel::Hub::connect(oss.str());
+		}
+		catch (Dashel::DashelException e)
+		{
+			std::cerr << "Cannot create listening port " << port << ": " << e.what() << std::endl;
+			abort();
+		}
+	}
+
+	//! Process messages, completing erases when they are due
+	void run()
+	{
+		while (true)
+		{
+			int timeout(-1);
+			if (erasing)
+			{
+				const Aseba::UnifiedTime now;
+				timeout = (now < eraseEnd) ? int((eraseEnd - now).value) : 0;
+			}
+			if (!step(timeout))
+				break;
+			if (erasing && !(Aseba::UnifiedTime() < eraseEnd))
+			{
+				erasing = false;
+				sendAck(Aseba::BootloaderAck::SUCCESS);
+			}
+		}
+	}
+
+	void saveFlash()
+	{
+		if (flashFileName.empty())
+			return;
+		std::ofstream file(flashFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&flash[0]), flash.size());
+	}
+
+protected:
+	virtual void connectionCreated(Dashel::Stream *stream)
+	{
+		std::string targetName = stream->getTargetName();
+		if (targetName.substr(0, targetName.find_first_of(':')) == "tcp")
+		{
+			this->stream = stream;
+			std::cerr << this << " : New client connected." << std::endl;
+			// as if we just started
+			sendDescription();
+		}
+	}
+
+	virtual void connectionClosed(Dashel::Stream *stream, bool abnormal)
+	{
+		if (stream != this->stream)
+			return;
+		this->stream = 0;
+		programmingPage = -1;
+		erasing = false;
+		std::cerr << this << " : Client has disconnected, " << pagesWritten << " pages written, " << pagesRead << " pages read, " << messagesLost << " messages lost while erasing." << std::endl;
+	}
+
+	virtual void incomingData(Dashel::Stream *stream)
+	{
+		std::auto_ptr<Aseba::Message> message(Aseba::Message::receive(stream));
+		if (stream != this->stream)
+			return;
+
+		// like a real flash, the bootloader does not listen while erasing, so whatever is sent meanwhile is lost
+		if (erasing)
+		{
+			++messagesLost;
+			return;
+		}
+
+		Aseba::CmdMessage* cmdMessage(dynamic_cast<Aseba::CmdMessage*>(message.get()));
+		if (!cmdMessage || cmdMessage->dest != nodeId)
+			return;
+
+		if (dynamic_cast<Aseba::Reboot*>(message.get()))
+		{
+			// entering bootloader again
+			programmingPage = -1;
+			sendDescription();
+		}
+		else if (dynamic_cast<Aseba::BootloaderReset*>(message.get()))
+		{
+			saveFlash();
+			sendAck(Aseba::BootloaderAck::SUCCESS);
+			std::cerr << this << " : Leaving bootloader, " << pagesWritten << " pages written, " << pagesRead << " pages read." << std::endl;
+		}
+		else if (Aseba::BootloaderReadPage* readPage = dynamic_cast<Aseba::BootloaderReadPage*>(message.get()))
+		{
+			if (!isValidPage(readPage->pageNumber))
+			{
+				sendAck(Aseba::BootloaderAck::ERROR_INVALID_FRAME_SIZE);
+				return;
+			}
+			for (unsigned i = 0; i < pageSize; i += 4)
+			{
+				Aseba::BootloaderDataRead data;
+				data.source = nodeId;
+				std::copy(&flash[readPage->pageNumber * pageSize + i], &flash[readPage->pageNumber * pageSize + i] + 4, data.data);
+				data.serialize(stream);
+			}
+			++pagesRead;
+			sendAck(Aseba::BootloaderAck::SUCCESS);
+		}
+		else if (Aseba::BootloaderWritePage* writePage = dynamic_cast<Aseba::BootloaderWritePage*>(message.get()))
+		{
+			if (!isValidPage(writePage->pageNumber))
+			{
+				sendAck(Aseba::BootloaderAck::ERROR_PROGRAMMING_FAILED);
+				return;
+			}
+			// the command is acknowledged once the page is erased
+			programmingPage = writePage->pageNumber;
+			pageBuffer.clear();
+			erasing = true;
+			eraseEnd = Aseba::UnifiedTime() + Aseba::UnifiedTime(eraseTime);
+		}
+		else if (Aseba::BootloaderPageDataWrite* pageData = dynamic_cast<Aseba::BootloaderPageDataWrite*>(message.get()))
+		{
+			if (programmingPage < 0)
+			{
+				sendAck(Aseba::BootloaderAck::ERROR_NOT_PROGRAMMING);
+				return;
+			}
+			pageBuffer.insert(pageBuffer.end(), pageData->data, pageData->data + sizeof(pageData->data));
+			if (pageBuffer.size() >= pageSize)
+			{
+				// like a real flash, we do not process messages while programming
+				Aseba::UnifiedTime(writeTime).sleep();
+				std::copy(pageBuffer.begin(), pageBuffer.begin() + pageSize, flash.begin() + programmingPage * pageSize);
+				programmingPage = -1;
+				++pagesWritten;
+				sendAck(Aseba::BootloaderAck::SUCCESS);
+			}
+		}
+	}
+
+	bool isValidPage(unsigned pageNumber) const
+	{
+		return (pageNumber >= pagesStart) && (pageNumber < pagesStart + pagesCount);
+	}
+
+	void sendDescription()
+	{
+		if (!stream)
+			return;
+		Aseba::BootloaderDescription description;
+		description.source = nodeId;
+		description.pageSize = pageSize;
+		description.pagesStart = pagesStart;
+		description.pagesCount = pagesCount;
+		description.serialize(stream);
+		stream->flush();
+	}
+
+	void sendAck(uint16 errorCode)
+	{
+		Aseba::BootloaderAck ack;
+		ack.source = nodeId;
+		ack.errorCode = errorCode;
+		ack.serialize(stream);
+		stream->flush();
+	}
+};
+
+//! Show usage
+void dumpHelp(std::ostream &stream, const char *programName)
+{
+	stream << "Aseba dummy bootloader, simulate the bootloader of a node, usage:\n";
+	stream << programName << " [options] [port delta]\n";
+	stream << "Listen on port " << ASEBA_DEFAULT_PORT << " + delta with node id 1 + delta.\n";
+	stream << "Options:\n";
+	stream << "--page-size N   : size of a page in bytes (default: 2048)\n";
+	stream << "--pages-start N : first writable page (default: 16)\n";
+	stream << "--pages-count N : number of writable pages (default: 48)\n";
+	stream << "--erase-time MS : simulated time to erase a page, messages received meanwhile are lost (default: 20)\n";
+	stream << "--write-time MS : simulated time to program a page (default: 20)\n";
+	stream << "--flash FILE    : load flash content from FILE and save it there when leaving bootloader\n";
+	stream << "-h, --help      : shows this help\n";
+	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	Dashel::initPlugins();
+
+	unsigned pageSize(2048);
+	unsigned pagesStart(16);
+	unsigned pagesCount(48);
+	unsigned eraseTime(20);
+	unsigned writeTime(20);
+	std::string flashFileName;
+	int deltaPort(0);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg(argv[i]);
+		if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
+		{
+			dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if (arg[0] == '-')
+		{
+			if (i + 1 >= argc)
+			{
+				dumpHelp(std::cerr, argv[0]);
+				return 1;
+			}
+			const char* value(argv[++i]);
+			if (strcmp(arg, "--page-size") == 0)
+				pageSize = atoi(value);
+			else if (strcmp(arg, "--pages-start") == 0)
+				pagesStart = atoi(value);
+			else if (strcmp(arg, "--pages-count") == 0)
+				pagesCount = atoi(value);
+			else if (strcmp(arg, "--erase-time") == 0)
+				eraseTime = atoi(value);
+			else if (strcmp(arg, "--write-time") == 0)
+				writeTime = atoi(value);
+			else if (strcmp(arg, "--flash") == 0)
+				flashFileName = value;
+			else
+			{
+				dumpHelp(std::cerr, argv[0]);
+				return 1;
+			}
+		}
+		else
+			deltaPort = atoi(arg);
+	}
+	if ((pageSize == 0) || (pageSize % 4 != 0))
+	{
+		std::cerr << "Page size must be a non-zero multiple of 4" << std::endl;
+		return 1;
+	}
+
+	DummyBootloader bootloader(pageSize, pagesStart, pagesCount, eraseTime, writeTime, flashFileName);
+	bootloader.listen(ASEBA_DEFAULT_PORT, deltaPort);
+	bootloader.run();
+	bootloader.saveFlash();
+
+	return 0;
+}
@@ -26,20 +26,35 @@
 #include "../../vm/natives.h"
 #include "../../common/productids.h"
 #include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include "../../common/utils/AboFile.h"
+#include "../../compiler/compiler.h"
 #include "../../transport/buffer/vm-buffer.h"
 #include <dashel/dashel.h>
 #include <iostream>
 #include <sstream>
 #include <valarray>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <cstdlib>
+#ifdef WIN32
+#include <winsock2.h>
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
 
 extern AsebaVMDescription nodeDescription;
 
-class AsebaNode: public Dashel::Hub
+//! A virtual node: a VM with its memory, reachable through its own listening port
+class AsebaNode
 {
 private:
-	AsebaVMState vm;
 	std::valarray<unsigned short> bytecode;
 	std::valarray<signed short> stack;
 	struct Variables
@@ -50,23 +65,38 @@ private:
 		sint16 productId;
 		sint16 user[1024];
 	} variables;
-	char mutableName[12];
 	
 public:
+	AsebaVMState vm;
+	std::string name;
+	int port;
 	// public because accessed from a glue function
 	uint16 lastMessageSource;
 	std::valarray<uint8> lastMessageData;
 	// this must be public because of bindings to C functions
 	Dashel::Stream* stream;
-	// all streams that must be disconnected at next step
-	std::vector<Dashel::Stream*> toDisconnect;
+	//! time at which the next timer event is due
+	Aseba::UnifiedTime nextTimer;
+	//! time of the first timer event since the last resynchronisation
+	Aseba::UnifiedTime timerOrigin;
+	//! number of timer events since timerOrigin
+	unsigned timerCount;
+	//! whether the VM is waiting in the list of VMs to run
+	bool scheduled;
 	
 public:
-	
-	AsebaNode()
+	AsebaNode(int deltaPort):
+		name("dummynode-"),
+		port(ASEBA_DEFAULT_PORT + deltaPort),
+		stream(0),
+		timerCount(0),
+		scheduled(false)
 	{
 		// setup variables
-		vm.nodeId = 1;
+		vm.nodeId = 1 + deltaPort;
+		std::ostringstream oss;
+		oss << deltaPort;
+		name += oss.str();
 		
 		bytecode.resize(512);
 		vm.bytecode = &bytecode[0];
@@ -78,65 +108,243 @@ public:
 		
 		vm.variables = reinterpret_cast<sint16 *>(&variables);
 		vm.variablesSize = sizeof(variables) / sizeof(sint16);
+		
+		// init VM
+		AsebaVMInit(&vm);
 	}
 	
-	void listen(int basePort, int deltaPort)
+	//! Copy bytecode into vm and start running it, as a set bytecode followed by a reset and a run would do
+	bool setBytecode(const std::vector<uint16>& code)
 	{
-		const int port(basePort + deltaPort);
-		vm.nodeId = 1 + deltaPort;
-		strncpy(mutableName, "dummynode-0", 12);
-		mutableName[10] = '0' + deltaPort;
-		nodeDescription.name = mutableName;
+		if (code.size() > bytecode.size())
+			return false;
+		std::copy(code.begin(), code.end(), vm.bytecode);
+		vm.flags = 0;
+		AsebaVMSetupEvent(&vm, ASEBA_EVENT_INIT);
+		return true;
+	}
+	
+	//! Return whether an event is being executed and the VM is not in step by step
+	bool isRunning() const
+	{
+		return AsebaMaskIsSet(vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK) && AsebaMaskIsClear(vm.flags, ASEBA_VM_STEP_BY_STEP_MASK);
+	}
+};
+
+//! The nodes of this process, all served by a single event loop
+class AsebaNodesHub: public Dashel::Hub
+{
+public:
+	std::vector<AsebaNode*> nodes;
+	//! frequency of the timer event, in Hz, 0 if disabled
+	double timerRate;
+	//! nodes by time of their next timer event
+	std::multimap<Aseba::UnifiedTime::Value, AsebaNode*> timers;
+	//! nodes whose VM has an event to execute
+	std::deque<AsebaNode*> toRun;
+	// all streams that must be disconnected at next step
+	std::vector<Dashel::Stream*> toDisconnect;
+	std::map<int, AsebaNode*> nodeByPort;
+	std::map<Dashel::Stream*, AsebaNode*> nodeByStream;
+	std::map<AsebaVMState*, AsebaNode*> vmStateToNode;
+	
+	// statistics since last report
+	unsigned timerEvents;
+	unsigned lateTimerEvents;
+	unsigned messagesReceived;
+	unsigned messagesSent;
+	unsigned vmRuns;
+	
+public:
+	AsebaNodesHub():
+		timerRate(50),
+		timerEvents(0),
+		lateTimerEvents(0),
+		messagesReceived(0),
+		messagesSent(0),
+		vmRuns(0)
+	{}
+	
+	~AsebaNodesHub()
+	{
+		for (size_t i = 0; i < nodes.size(); ++i)
+			delete nodes[i];
+	}
+	
+	void addNode(int deltaPort)
+	{
+		AsebaNode* node(new AsebaNode(deltaPort));
+		nodes.push_back(node);
+		nodeByPort[node->port] = node;
+		vmStateToNode[&node->vm] = node;
 		
 		// connect network
 		try
 		{
 			std::ostringstream oss;
-			oss << "tcpin:port=" << port;
+			oss << "tcpin:port=" << node->port;
 			Dashel::Hub::connect(oss.str());
 		}
 		catch (Dashel::DashelException e)
 		{
-			std::cerr << "Cannot create listening port " << port << ": " << e.what() << std::endl;
+			std::cerr << "Cannot create listening port " << node->port << ": " << e.what() << std::endl;
 			abort();
 		}
+	}
+	
+	//! Run the nodes until the hub is stopped, reporting statistics every statsPeriod ms if not 0
+	void run(unsigned statsPeriod)
+	{
+		// spread the timer events of the nodes over a period
+		const Aseba::UnifiedTime start;
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			if (timerRate > 0)
+			{
+				nodes[i]->timerOrigin = start + Aseba::UnifiedTime(Aseba::UnifiedTime::Value(1000. * i / nodes.size() / timerRate));
+				nodes[i]->timerCount = 0;
+				nodes[i]->nextTimer = nodes[i]->timerOrigin;
+				timers.insert(std::make_pair(nodes[i]->nextTimer.value, nodes[i]));
+			}
+			// run preloaded bytecode
+			scheduleRun(nodes[i]);
+		}
 		
-		// init VM
-		AsebaVMInit(&vm);
+		Aseba::UnifiedTime lastStats(start);
+		while (true)
+		{
+			// wait for data until the next timer event, unless some VM is busy
+			int timeout(-1);
+			Aseba::UnifiedTime now;
+			if (!toRun.empty())
+				timeout = 0;
+			else if (!timers.empty())
+				timeout = (timers.begin()->first < now.value) ? 0 : int(timers.begin()->first - now.value);
+			if (statsPeriod)
+			{
+				const Aseba::UnifiedTime nextStats(lastStats + Aseba::UnifiedTime(statsPeriod));
+				const int statsTimeout((nextStats < now) ? 0 : int((nextStats - now).value));
+				if (timeout < 0 || statsTimeout < timeout)
+					timeout = statsTimeout;
+			}
+			if (!step(timeout))
+				break;
+			
+			// disconnect old streams
+			for (size_t i = 0; i < toDisconnect.size(); ++i)
+			{
+				nodeByStream.erase(toDisconnect[i]);
+				closeStream(toDisconnect[i]);
+				std::cerr << toDisconnect[i] << " : Old client disconnected by new client." << std::endl;
+			}
+			toDisconnect.clear();
+			
+			// run VMs before firing timers, as a timer event replaces the event set up by init or incoming messages;
+			// those that exceed their steps limit will continue at next iteration
+			for (size_t count = toRun.size(); count > 0; --count)
+			{
+				AsebaNode* node(toRun.front());
+				toRun.pop_front();
+				node->scheduled = false;
+				runVM(node);
+			}
+			
+			// timer events that are due
+			now = Aseba::UnifiedTime();
+			while (!timers.empty() && !(now.value < timers.begin()->first))
+			{
+				AsebaNode* node(timers.begin()->second);
+				timers.erase(timers.begin());
+				timerEvent(node);
+				// computed from the origin so that rounding to ms does not accumulate
+				++node->timerCount;
+				node->nextTimer = node->timerOrigin + Aseba::UnifiedTime(Aseba::UnifiedTime::Value(1000. * node->timerCount / timerRate));
+				// if we are more than a period late, skip missed events rather than bursting them
+				if (node->nextTimer < now)
+				{
+					++lateTimerEvents;
+					node->timerOrigin = now;
+					node->timerCount = 1;
+					node->nextTimer = now + Aseba::UnifiedTime(Aseba::UnifiedTime::Value(1000. / timerRate));
+				}
+				timers.insert(std::make_pair(node->nextTimer.value, node));
+			}
+			
+			// report statistics
+			now = Aseba::UnifiedTime();
+			if (statsPeriod && !(now < lastStats + Aseba::UnifiedTime(statsPeriod)))
+			{
+				dumpStatistics(std::cout, (now - lastStats).value);
+				lastStats = now;
+			}
+		}
 	}
 	
+	void dumpStatistics(std::ostream& stream, Aseba::UnifiedTime::Value duration)
+	{
+		const double seconds(double(duration) / 1000.);
+		stream << nodes.size() << " nodes: ";
+		stream << timerEvents / seconds << " timer events/s";
+		if (timerRate > 0)
+			stream << " (expected " << nodes.size() * timerRate << ", " << lateTimerEvents << " late)";
+		stream << ", " << messagesReceived / seconds << " messages received/s";
+		stream << ", " << messagesSent / seconds << " messages sent/s";
+		stream << ", " << vmRuns / seconds << " VM runs/s" << std::endl;
+		timerEvents = lateTimerEvents = messagesReceived = messagesSent = vmRuns = 0;
+	}
+	
+protected:
 	virtual void connectionCreated(Dashel::Stream *stream)
 	{
 		std::string targetName = stream->getTargetName();
 		if (targetName.substr(0, targetName.find_first_of(':')) == "tcp")
 		{
+			AsebaNode* node(getNodeOfConnection(stream));
+			if (!node)
+			{
+				std::cerr << stream << " : Cannot find the node of new client, disconnecting." << std::endl;
+				toDisconnect.push_back(stream);
+				return;
+			}
+			
 			// schedule current stream for disconnection
-			if (this->stream)
-				toDisconnect.push_back(this->stream);
+			if (node->stream)
+				toDisconnect.push_back(node->stream);
 			
 			// set new stream as current stream
-			this->stream = stream;
-			std::cerr << this << " : New client connected." << std::endl;
+			node->stream = stream;
+			nodeByStream[stream] = node;
+			std::cerr << node->name << " : New client connected." << std::endl;
 		}
 	}
 	
 	virtual void connectionClosed(Dashel::Stream *stream, bool abnormal)
 	{
-		this->stream = 0;
+		std::map<Dashel::Stream*, AsebaNode*>::iterator it(nodeByStream.find(stream));
+		if (it == nodeByStream.end())
+			return;
+		AsebaNode* node(it->second);
+		nodeByStream.erase(it);
+		if (node->stream != stream)
+			return;
+		
+		node->stream = 0;
 		// clear breakpoints
-		vm.breakpointsCount = 0;
+		node->vm.breakpointsCount = 0;
 		
 		if (abnormal)
-			std::cerr << this << " : Client has disconnected unexpectedly." << std::endl;
+			std::cerr << node->name << " : Client has disconnected unexpectedly." << std::endl;
 		else
-			std::cerr << this << " : Client has disconnected properly." << std::endl;
+			std::cerr << node->name << " : Client has disconnected properly." << std::endl;
 	}
 	
 	virtual void incomingData(Dashel::Stream *stream)
 	{
-		// only process data for the current stream
-		if (stream != this->stream)
+		// only process data for the current stream of a node
+		std::map<Dashel::Stream*, AsebaNode*>::iterator it(nodeByStream.find(stream));
+		if (it == nodeByStream.end() || it->second->stream != stream)
 			return;
+		AsebaNode* node(it->second);
 		
 		uint16 temp;
 		uint16 len;
@@ -144,23 +352,67 @@ public:
 		stream->read(&temp, 2);
 		len = bswap16(temp);
 		stream->read(&temp, 2);
-		lastMessageSource = bswap16(temp);
-		lastMessageData.resize(len+2);
-		stream->read(&lastMessageData[0], lastMessageData.size());
+		node->lastMessageSource = bswap16(temp);
+		node->lastMessageData.resize(len+2);
+		stream->read(&node->lastMessageData[0], node->lastMessageData.size());
+		++messagesReceived;
 		
-		AsebaProcessIncomingEvents(&vm);
+		AsebaProcessIncomingEvents(&node->vm);
+		scheduleRun(node);
+	}
+	
+	void timerEvent(AsebaNode* node)
+	{
+		// schedule a periodic event if we are not in step by step
+		if (AsebaMaskIsClear(node->vm.flags, ASEBA_VM_STEP_BY_STEP_MASK) || AsebaMaskIsClear(node->vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK))
+		{
+			AsebaVMSetupEvent(&node->vm, ASEBA_EVENT_LOCAL_EVENTS_START-0);
+			++timerEvents;
+			scheduleRun(node);
+		}
+	}
+	
+	void runVM(AsebaNode* node)
+	{
+		if (AsebaVMRun(&node->vm, 65535))
+			++vmRuns;
+		// the steps limit was reached
+		scheduleRun(node);
 	}
 	
-	virtual void applicationStep()
+	void scheduleRun(AsebaNode* node)
 	{
-		// run VM
-		AsebaVMRun(&vm, 65535);
+		if (node->isRunning() && !node->scheduled)
+		{
+			node->scheduled = true;
+			toRun.push_back(node);
+		}
+	}
+	
+	//! Return the node listening on the local port of an incoming connection
+	AsebaNode* getNodeOfConnection(Dashel::Stream *stream)
+	{
+		if (nodes.size() == 1)
+			return nodes[0];
 		
-		// reschedule a periodic event if we are not in step by step
-		if (AsebaMaskIsClear(vm.flags, ASEBA_VM_STEP_BY_STEP_MASK) || AsebaMaskIsClear(vm.flags, ASEBA_VM_EVENT_ACTIVE_MASK))
-			AsebaVMSetupEvent(&vm, ASEBA_EVENT_LOCAL_EVENTS_START-0);
+		// incoming connections carry their socket, ask it which port it was accepted on
+		const std::string sock(stream->getTargetParameter("sock"));
+		if (sock.empty())
+			return 0;
+		struct sockaddr_in addr;
+		socklen_t addrLen(sizeof(addr));
+		if (getsockname(atoi(sock.c_str()), reinterpret_cast<struct sockaddr*>(&addr), &addrLen) != 0)
+			return 0;
+		std::map<int, AsebaNode*>::const_iterator it(nodeByPort.find(ntohs(addr.sin_port)));
+		return it != nodeByPort.end() ? it->second : 0;
 	}
-} node;
+} hub;
+
+//! Glue functions only get the VM, find its node
+static AsebaNode* getNode(AsebaVMState *vm)
+{
+	return hub.vmStateToNode[vm];
+}
 
 // Implementation of aseba glue code
 
@@ -171,7 +423,7 @@ extern "C" void AsebaPutVmToSleep(AsebaVMState *vm)
 
 extern "C" void AsebaSendBuffer(AsebaVMState *vm, const uint8* data, uint16 length)
 {
-	Dashel::Stream* stream = node.stream;
+	Dashel::Stream* stream = getNode(vm)->stream;
 	if (stream)
 	{
 		try
@@ -183,6 +435,7 @@ extern "C" void AsebaSendBuffer(AsebaVMState *vm, const uint8* data, uint16 leng
 			stream->write(&temp, 2);
 			stream->write(data, length);
 			stream->flush();
+			++hub.messagesSent;
 		}
 		catch (Dashel::DashelException e)
 		{
@@ -193,18 +446,21 @@ extern "C" void AsebaSendBuffer(AsebaVMState *vm, const uint8* data, uint16 leng
 
 extern "C" uint16 AsebaGetBuffer(AsebaVMState *vm, uint8* data, uint16 maxLength, uint16* source)
 {
-	if (node.lastMessageData.size())
+	const AsebaNode* node(getNode(vm));
+	if (node->lastMessageData.size())
 	{
-		*source = node.lastMessageSource;
-		memcpy(data, &node.lastMessageData[0], node.lastMessageData.size());
+		*source = node->lastMessageSource;
+		memcpy(data, &node->lastMessageData[0], node->lastMessageData.size());
 	}
-	return node.lastMessageData.size();
+	return node->lastMessageData.size();
 }
 
 extern AsebaVMDescription nodeDescription;
 
 extern "C" const AsebaVMDescription* AsebaGetVMDescription(AsebaVMState *vm)
 {
+	// all nodes share the description but their names
+	nodeDescription.name = getNode(vm)->name.c_str();
 	return &nodeDescription;
 }
 
@@ -230,7 +486,10 @@ extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16 id)
 }
 
 
-static const AsebaLocalEventDescription localEvents[] = {
+//! description of the timer event, following its rate
+static std::string timerDescription;
+
+static AsebaLocalEventDescription localEvents[] = {
 	{ "timer", "periodic timer at 50 Hz" },
 	{ NULL, NULL }
 };
@@ -273,31 +532,128 @@ extern "C" void AsebaAssert(AsebaVMState *vm, AsebaAssertReason reason)
 }
 
 
+//! Return the checksum of the description the nodes send, which compiled bytecode records
+static uint16 descriptionCrc(const AsebaVMState* vm)
+{
+	Aseba::TargetDescription description;
+	description.protocolVersion = ASEBA_PROTOCOL_VERSION;
+	description.bytecodeSize = vm->bytecodeSize;
+	description.variablesSize = vm->variablesSize;
+	description.stackSize = vm->stackSize;
+	for (const AsebaVariableDescription* variable(nodeDescription.variables); variable->size; ++variable)
+		description.namedVariables.push_back(Aseba::TargetDescription::NamedVariable(Aseba::UTF8ToWString(variable->name), variable->size));
+	for (const AsebaLocalEventDescription* event(localEvents); event->name; ++event)
+	{
+		Aseba::TargetDescription::LocalEvent localEvent;
+		localEvent.name = Aseba::UTF8ToWString(event->name);
+		description.localEvents.push_back(localEvent);
+	}
+	for (const AsebaNativeFunctionDescription* const* native(nativeFunctionsDescriptions); *native; ++native)
+	{
+		Aseba::TargetDescription::NativeFunction function(Aseba::UTF8ToWString((*native)->name), Aseba::UTF8ToWString((*native)->doc));
+		for (const AsebaNativeFunctionArgumentDescription* argument((*native)->arguments); argument->size; ++argument)
+			function.parameters.push_back(Aseba::TargetDescription::NativeFunctionParameter(Aseba::UTF8ToWString(argument->name), argument->size));
+		description.nativeFunctions.push_back(function);
+	}
+	return description.crc();
+}
+
+//! Show usage
+static void dumpHelp(std::ostream &stream, const char *programName)
+{
+	stream << "Aseba dummy node, simulate one or several nodes, usage:\n";
+	stream << programName << " [options] [delta port]\n";
+	stream << "Node i listens on port " << ASEBA_DEFAULT_PORT << " + delta + i with node id 1 + delta + i.\n";
+	stream << "Options:\n";
+	stream << "-n, --nodes N       : number of nodes to simulate (default: 1)\n";
+	stream << "-r, --rate HZ       : frequency of the timer event, 0 to disable it (default: 50)\n";
+	stream << "-b, --bytecode FILE : load an .abo file in the next node (can be repeated),\n";
+	stream << "                      nodes without one of their own run the last one\n";
+	stream << "-s, --stats S       : print statistics every S seconds\n";
+	stream << "-h, --help          : shows this help\n";
+	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+}
+
 int main(int argc, char* argv[])
 {
-	const int basePort = ASEBA_DEFAULT_PORT;
-	int deltaPort = 0;
-	if (argc > 1)
+	int deltaPort(0);
+	unsigned nodesCount(1);
+	double timerRate(50);
+	unsigned statsPeriod(0);
+	std::vector<std::string> bytecodeFileNames;
+	
+	for (int i = 1; i < argc; ++i)
 	{
-		deltaPort = atoi(argv[1]);
-		if (deltaPort < 0 || deltaPort >= 9)
+		const std::string arg(argv[i]);
+		if ((arg == "-h") || (arg == "--help"))
 		{
-			std::cerr << "Usage: " << argv[0] << " [delta port, from 0 to 9]" << std::endl;
-			return 1;
+			dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if (arg[0] == '-')
+		{
+			if (i + 1 >= argc)
+			{
+				dumpHelp(std::cerr, argv[0]);
+				return 1;
+			}
+			const char* value(argv[++i]);
+			if ((arg == "-n") || (arg == "--nodes"))
+				nodesCount = atoi(value);
+			else if ((arg == "-r") || (arg == "--rate"))
+				timerRate = atof(value);
+			else if ((arg == "-b") || (arg == "--bytecode"))
+				bytecodeFileNames.push_back(value);
+			else if ((arg == "-s") || (arg == "--stats"))
+				statsPeriod = unsigned(atof(value) * 1000);
+			else
+			{
+				dumpHelp(std::cerr, argv[0]);
+				return 1;
+			}
 		}
+		else
+			deltaPort = atoi(arg.c_str());
+	}
+	if (deltaPort < 0 || nodesCount == 0 || deltaPort + ASEBA_DEFAULT_PORT + nodesCount > 65536 || timerRate < 0)
+	{
+		dumpHelp(std::cerr, argv[0]);
+		return 1;
 	}
-	node.listen(basePort, deltaPort);
-	while (node.step(10))
+	
+	std::ostringstream oss;
+	if (timerRate > 0)
+		oss << "periodic timer at " << timerRate << " Hz";
+	else
+		oss << "periodic timer, disabled";
+	timerDescription = oss.str();
+	localEvents[0].doc = timerDescription.c_str();
+	
+	hub.timerRate = timerRate;
+	for (unsigned i = 0; i < nodesCount; ++i)
+		hub.addNode(deltaPort + i);
+	
+	// preload bytecode compiled for a dummy node, each file is read once
+	std::map<std::string, Aseba::AboFile> abos;
+	for (unsigned i = 0; i < nodesCount && !bytecodeFileNames.empty(); ++i)
 	{
-		// disconnect old streams
-		for (size_t i = 0; i < node.toDisconnect.size(); ++i)
+		const std::string& fileName(bytecodeFileNames[std::min<size_t>(i, bytecodeFileNames.size() - 1)]);
+		if (abos.find(fileName) == abos.end())
 		{
-			node.closeStream(node.toDisconnect[i]);
-			std::cerr << &node << " : Old client disconnected by new client." << std::endl;
+			std::string errorMessage;
+			if (!abos[fileName].read(fileName, ASEBA_PID_UNDEFINED, descriptionCrc(&hub.nodes[i]->vm), errorMessage))
+			{
+				std::cerr << errorMessage << std::endl;
+				return 1;
+			}
+		}
+		if (!hub.nodes[i]->setBytecode(abos[fileName].bytecode))
+		{
+			std::cerr << "Bytecode of file " << fileName << " is too large for node " << hub.nodes[i]->name << std::endl;
+			return 1;
 		}
-		node.toDisconnect.clear();
-		
-		// run VM
-		node.applicationStep();
 	}
+	
+	hub.run(statsPeriod);
+	return 0;
 }
@@ -26,33 +26,60 @@
 #include <QMessageBox>
 #include <QApplication>
 #include <string>
+#include <iostream>
 #include <typeinfo>
 #include <algorithm>
 #include <cassert>
 #include "AsebaGlue.h"
-#include "PlaygroundViewer.h"
+#include "SimulationEnvironment.h"
 #include "../../transport/buffer/vm-buffer.h"
 #include "../../common/utils/FormatableString.h"
+#include "../../common/utils/utils.h"
 // #include "../../vm/vm.h"
 
 
 namespace Aseba
 {
-	// Mapping so that Aseba C callbacks can dispatch to the right objects
-	VMStateToEnvironment vmStateToEnvironment;
+	// Mapping so that Aseba C callbacks can dispatch to the right objects, one per simulation so that simulations can run concurrently
+	VMStateToEnvironment& vmStateToEnvironment()
+	{
+		return Enki::SimulationEnvironment::getInstance()->vmStateToEnvironment;
+	}
+	
+	void nativeRand(AsebaVMState *vm)
+	{
+		// same arguments as AsebaNative_rand
+		uint16 destIndex = AsebaNativePopArg(vm);
+		uint16 length = AsebaNativePopArg(vm);
+		
+		Enki::SimulationEnvironment* environment(Enki::SimulationEnvironment::getInstance());
+		for (uint16 i = 0; i < length; i++)
+			vm->variables[destIndex++] = (sint16)environment->getRandom();
+	}
 
 	// SimpleDashelConnection
 
 	SimpleDashelConnection::SimpleDashelConnection(unsigned port):
-		stream(0)
+		stream(0),
+		listening(port != 0),
+		index(Enki::SimulationEnvironment::getInstance()->connectionsCount++),
+		tick(0),
+		diverged(false)
 	{
+		if (!listening)
+			return;
 		try
 		{
 			Dashel::Hub::connect(QString("tcpin:port=%1").arg(port).toStdString());
 		}
 		catch (Dashel::DashelException e)
 		{
-			QMessageBox::critical(0, QApplication::tr("Aseba Playground"), QApplication::tr("Cannot create listening port %0: %1").arg(port).arg(e.what()));
+			const QString message(QApplication::tr("Cannot create listening port %0: %1").arg(port).arg(e.what()));
+			// there is no application object when running headless
+			if (qApp)
+				QMessageBox::critical(0, QApplication::tr("Aseba Playground"), message);
+			else
+				std::cerr << message.toStdString() << std::endl;
 			abort();
 		}
 	}
@@ -122,13 +149,14 @@ namespace Aseba
 			lastMessageSource = bswap16(temp);
 			lastMessageData.resize(len+2);
 			stream->read(&lastMessageData[0], lastMessageData.size());
-		
-			// execute event on all VM that are linked to this connection
-			for (VMStateToEnvironment::iterator it(Aseba::vmStateToEnvironment.begin()); it != vmStateToEnvironment.end(); ++it)
-			{
-				if (it.value().second == this)
-					AsebaProcessIncomingEvents(it.key());
-			}
+			
+			NetworkLogEntry entry;
+			entry.type = NetworkLogEntry::MESSAGE;
+			entry.source = lastMessageSource;
+			entry.data.assign(&lastMessageData[0], &lastMessageData[0] + lastMessageData.size());
+			record(entry);
+			
+			processLastMessage();
 		}
 		catch (Dashel::DashelException e)
 		{
@@ -141,12 +169,12 @@ namespace Aseba
 		if (stream == this->stream)
 		{
 			this->stream = 0;
-			// clear breakpoints on all VM that are linked to this connection
-			for (VMStateToEnvironment::iterator it(Aseba::vmStateToEnvironment.begin()); it != vmStateToEnvironment.end(); ++it)
-			{
-				if (it.value().second == this)
-					it.key()->breakpointsCount = 0;
-			}
+			
+			NetworkLogEntry entry;
+			entry.type = NetworkLogEntry::DISCONNECTION;
+			record(entry);
+			
+			clearBreakpoints();
 		}
 		LOG_INFO(QString("Client disconnected properly from ") + stream->getTargetName().c_str());
 	}
@@ -161,6 +189,119 @@ namespace Aseba
 		}
 		toDisconnect.clear();
 	}
+	
+	//! Deliver the inputs of this tick: from the clients when listening, or from the network log when replaying
+	void SimpleDashelConnection::networkStep()
+	{
+		Enki::SimulationEnvironment* environment(Enki::SimulationEnvironment::getInstance());
+		
+		if (environment->recorder)
+		{
+			NetworkLogEntry entry;
+			entry.type = NetworkLogEntry::STATE;
+			entry.crc = stateChecksum();
+			record(entry);
+		}
+		
+		if (listening)
+		{
+			// do a network step
+			Hub::step();
+			
+			// disconnect old streams
+			closeOldStreams();
+		}
+		else if (environment->player)
+			replayStep(environment->player);
+		
+		++tick;
+	}
+	
+	void SimpleDashelConnection::processLastMessage()
+	{
+		// execute event on all VM that are linked to this connection
+		VMStateToEnvironment& mapping(vmStateToEnvironment());
+		for (VMStateToEnvironment::iterator it(mapping.begin()); it != mapping.end(); ++it)
+		{
+			if (it.value().second == this)
+				AsebaProcessIncomingEvents(it.key());
+		}
+	}
+	
+	void SimpleDashelConnection::clearBreakpoints()
+	{
+		// clear breakpoints on all VM that are linked to this connection
+		VMStateToEnvironment& mapping(vmStateToEnvironment());
+		for (VMStateToEnvironment::iterator it(mapping.begin()); it != mapping.end(); ++it)
+		{
+			if (it.value().second == this)
+				it.key()->breakpointsCount = 0;
+		}
+	}
+	
+	//! Return a checksum of the execution state and variables of all VM that are linked to this connection
+	uint16 SimpleDashelConnection::stateChecksum() const
+	{
+		uint16 crc(0);
+		const VMStateToEnvironment& mapping(vmStateToEnvironment());
+		for (VMStateToEnvironment::const_iterator it(mapping.begin()); it != mapping.end(); ++it)
+		{
+			if (it.value().second != this)
+				continue;
+			const AsebaVMState* vm(it.key());
+			crc = crcXModem(crc, vm->flags);
+			crc = crcXModem(crc, vm->pc);
+			for (uint16 i = 0; i < vm->variablesSize; ++i)
+				crc = crcXModem(crc, uint16(vm->variables[i]));
+		}
+		return crc;
+	}
+	
+	//! Stamp entry with this connection and the current tick and write it to the network log, if recording
+	void SimpleDashelConnection::record(const NetworkLogEntry& entry)
+	{
+		NetworkRecorder* recorder(Enki::SimulationEnvironment::getInstance()->recorder);
+		if (!recorder)
+			return;
+		NetworkLogEntry stamped(entry);
+		stamped.tick = tick;
+		stamped.connection = index;
+		recorder->record(stamped);
+	}
+	
+	//! Apply the recorded inputs of the current tick, checking that the state matches the recording
+	void SimpleDashelConnection::replayStep(NetworkPlayer* player)
+	{
+		NetworkLogEntry entry;
+		while (player->next(index, tick, entry))
+		{
+			switch (entry.type)
+			{
+				case NetworkLogEntry::MESSAGE:
+					lastMessageSource = entry.source;
+					lastMessageData.resize(entry.data.size());
+					std::copy(entry.data.begin(), entry.data.end(), &lastMessageData[0]);
+					processLastMessage();
+					break;
+				
+				case NetworkLogEntry::DISCONNECTION:
+					clearBreakpoints();
+					break;
+				
+				case NetworkLogEntry::STATE:
+					if (!diverged && entry.crc != stateChecksum())
+					{
+						diverged = true;
+						++Enki::SimulationEnvironment::getInstance()->replayDivergences;
+						LOG_ERR(QString("Replay of connection %0 diverged from recording at tick %1").arg(index).arg(tick));
+					}
+					break;
+				
+				default:
+					break;
+			}
+		}
+	}
 
 } // Aseba
 
@@ -173,15 +314,16 @@ extern "C" void AsebaPutVmToSleep(AsebaVMState *vm)
 
 extern "C" void AsebaSendBuffer(AsebaVMState *vm, const uint8* data, uint16 length)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	Aseba::AbstractNodeConnection* connection(environment.second);
 	assert(connection);
 	connection->sendBuffer(vm->nodeId, data, length);
+	Enki::SimulationEnvironment::getInstance()->nodeSentBuffer(vm->nodeId, data, length);
 }
 
 extern "C" uint16 AsebaGetBuffer(AsebaVMState *vm, uint8* data, uint16 maxLength, uint16* source)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	Aseba::AbstractNodeConnection* connection(environment.second);
 	assert(connection);
 	return connection->getBuffer(data, maxLength, source);
@@ -189,7 +331,7 @@ extern "C" uint16 AsebaGetBuffer(AsebaVMState *vm, uint8* data, uint16 maxLength
 
 extern "C" const AsebaVMDescription* AsebaGetVMDescription(AsebaVMState *vm)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	const Aseba::AbstractNodeGlue* glue(environment.first);
 	assert(glue);
 	return glue->getDescription();
@@ -197,7 +339,7 @@ extern "C" const AsebaVMDescription* AsebaGetVMDescription(AsebaVMState *vm)
 
 extern "C" const AsebaLocalEventDescription * AsebaGetLocalEventsDescriptions(AsebaVMState *vm)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	const Aseba::AbstractNodeGlue* glue(environment.first);
 	assert(glue);
 	return glue->getLocalEventsDescriptions();
@@ -205,7 +347,7 @@ extern "C" const AsebaLocalEventDescription * AsebaGetLocalEventsDescriptions(As
 
 extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunctionsDescriptions(AsebaVMState *vm)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	const Aseba::AbstractNodeGlue* glue(environment.first);
 	assert(glue);
 	return glue->getNativeFunctionsDescriptions();
@@ -213,7 +355,7 @@ extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunction
 
 extern "C" void AsebaNativeFunction(AsebaVMState *vm, uint16 id)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	Aseba::AbstractNodeGlue* glue(environment.first);
 	assert(glue);
 	glue->callNativeFunction(id);
@@ -231,7 +373,7 @@ extern "C" void AsebaResetIntoBootloader(AsebaVMState *vm)
 
 extern "C" void AsebaAssert(AsebaVMState *vm, AsebaAssertReason reason)
 {
-	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment.value(vm));
+	const Aseba::NodeEnvironment& environment(Aseba::vmStateToEnvironment().value(vm));
 	const Aseba::AbstractNodeGlue* glue(environment.first);
 	assert(glue);
 	qDebug() << QString::fromStdString(Aseba::FormatableString("\nFatal error: glue %0 with node id %1 of type %2 at has produced exception: ").arg(glue).arg(vm->nodeId).arg(typeid(glue).name()));
@@ -24,6 +24,7 @@
 #include "../../common/types.h"
 #include "../../common/consts.h"
 #include "../../vm/natives.h"
+#include "NetworkLog.h"
 #include <dashel/dashel.h>
 #include <valarray>
 #include <vector>
@@ -53,7 +54,11 @@ namespace Aseba
 	typedef QPair<AbstractNodeGlue*, AbstractNodeConnection*> NodeEnvironment;
 	typedef QMap<AsebaVMState*, NodeEnvironment> VMStateToEnvironment;
 
-	extern VMStateToEnvironment vmStateToEnvironment;
+	//! Return the mapping of the simulation running in the current thread
+	VMStateToEnvironment& vmStateToEnvironment();
+	
+	//! Replacement of AsebaNative_rand drawing from the generator of the simulation running in the current thread
+	void nativeRand(AsebaVMState *vm);
 	
 	// Implementation of the connection using Dashel
 
@@ -63,8 +68,13 @@ namespace Aseba
 		std::vector<Dashel::Stream*> toDisconnect; // all streams that must be disconnected at next step
 		uint16 lastMessageSource;
 		std::valarray<uint8> lastMessageData;
+		bool listening;
+		uint16 index; // order of creation in the simulation, identifies the connection in network logs
+		uint32 tick; // number of network steps done, inputs are recorded and replayed at the tick they are applied
+		bool diverged; // whether replay has already diverged from the recording
 
 	public:
+		//! Listen for clients on port, or do not listen at all if port is 0 (headless simulation)
 		SimpleDashelConnection(unsigned port);
 		
 		virtual void sendBuffer(uint16 nodeId, const uint8* data, uint16 length);
@@ -75,6 +85,14 @@ namespace Aseba
 		virtual void connectionClosed(Dashel::Stream *stream, bool abnormal);
 		
 		void closeOldStreams();
+		void networkStep();
+		
+	protected:
+		void processLastMessage();
+		void clearBreakpoints();
+		uint16 stateChecksum() const;
+		void record(const NetworkLogEntry& entry);
+		void replayStep(NetworkPlayer* player);
 	};
 	
 } // Aseba
@@ -20,7 +20,7 @@
 
 #include "EPuck.h"
 #include "Parameters.h"
-#include "PlaygroundViewer.h"
+#include "SimulationEnvironment.h"
 #include "../../common/productids.h"
 #include "../../common/utils/utils.h"
 
@@ -35,8 +35,8 @@ extern "C" void PlaygroundEPuckNative_energysend(AsebaVMState *vm)
 	int index = AsebaNativePopArg(vm);
 	
 	// find related VM
-	PlaygroundViewer* playgroundViewer(PlaygroundViewer::getInstance());
-	World* world(playgroundViewer->getWorld());
+	SimulationEnvironment* environment(SimulationEnvironment::getInstance());
+	World* world(environment->getWorld());
 	for (World::ObjectsIterator objectIt = world->objects.begin(); objectIt != world->objects.end(); ++objectIt)
 	{
 		AsebaFeedableEPuck *epuck = dynamic_cast<AsebaFeedableEPuck*>(*objectIt);
@@ -45,7 +45,7 @@ extern "C" void PlaygroundEPuckNative_energysend(AsebaVMState *vm)
 			uint16 amount = vm->variables[index];
 			
 			unsigned toSend = std::min((unsigned)amount, (unsigned)epuck->energy);
-			playgroundViewer->energyPool += toSend;
+			environment->energyPool += toSend;
 			epuck->energy -= toSend;
 		}
 	}
@@ -59,8 +59,8 @@ extern "C" void PlaygroundEPuckNative_energyreceive(AsebaVMState *vm)
 	int index = AsebaNativePopArg(vm);
 	
 	// find related VM
-	PlaygroundViewer* playgroundViewer(PlaygroundViewer::getInstance());
-	World* world(playgroundViewer->getWorld());
+	SimulationEnvironment* environment(SimulationEnvironment::getInstance());
+	World* world(environment->getWorld());
 	for (World::ObjectsIterator objectIt = world->objects.begin(); objectIt != world->objects.end(); ++objectIt)
 	{
 		AsebaFeedableEPuck *epuck = dynamic_cast<AsebaFeedableEPuck*>(*objectIt);
@@ -68,8 +68,8 @@ extern "C" void PlaygroundEPuckNative_energyreceive(AsebaVMState *vm)
 		{
 			uint16 amount = vm->variables[index];
 			
-			unsigned toReceive = std::min((unsigned)amount, (unsigned)playgroundViewer->energyPool);
-			playgroundViewer->energyPool -= toReceive;
+			unsigned toReceive = std::min((unsigned)amount, (unsigned)environment->energyPool);
+			environment->energyPool -= toReceive;
 			epuck->energy += toReceive;
 		}
 	}
@@ -82,8 +82,8 @@ extern "C" void PlaygroundEPuckNative_energyamount(AsebaVMState *vm)
 {
 	int index = AsebaNativePopArg(vm);
 	
-	PlaygroundViewer* playgroundViewer(PlaygroundViewer::getInstance());
-	vm->variables[index] = playgroundViewer->energyPool;
+	SimulationEnvironment* environment(SimulationEnvironment::getInstance());
+	vm->variables[index] = environment->energyPool;
 }
 
 extern "C" AsebaNativeFunctionDescription PlaygroundEPuckNativeDescription_energyamount;
@@ -195,21 +195,20 @@ namespace Enki
 		variables.id = id;
 		variables.productId = ASEBA_PID_PLAYGROUND_EPUCK;
 		
-		vmStateToEnvironment[&vm] = qMakePair((Aseba::AbstractNodeGlue*)this, (Aseba::AbstractNodeConnection *)this);
+		vmStateToEnvironment()[&vm] = qMakePair((Aseba::AbstractNodeGlue*)this, (Aseba::AbstractNodeConnection *)this);
 	}
 	
 	AsebaFeedableEPuck::~AsebaFeedableEPuck()
 	{
-		vmStateToEnvironment.remove(&vm);
+		// the environment may already be gone if it was destroyed before the world
+		if (SimulationEnvironment::getInstance())
+			vmStateToEnvironment().remove(&vm);
 	}
 	
 	void AsebaFeedableEPuck::controlStep(double dt)
 	{
-		// do a network step
-		Hub::step();
-		
-		// disconnect old streams
-		closeOldStreams();
+		// do a network step, if connected
+		networkStep();
 		
 		// get physical variables
 		variables.prox[0] = static_cast<sint16>(infraredSensor0.getValue());
@@ -313,7 +312,11 @@ namespace Enki
 	
 	void AsebaFeedableEPuck::callNativeFunction(uint16 id)
 	{
-		nativeFunctions[id](&vm);
+		// math.rand uses the generator of the simulation, so that concurrent simulations are independent
+		if (nativeFunctions[id] == AsebaNative_rand)
+			nativeRand(&vm);
+		else
+			nativeFunctions[id](&vm);
 	}
 	
 } // Enki
@@ -0,0 +1,192 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HeadlessSimulation.h"
+#include "AsebaGlue.h"
+#include "../../compiler/compiler.h"
+#include "../../common/consts.h"
+#include "../../common/productids.h"
+#include "../../common/utils/AboFile.h"
+#include "../../common/utils/utils.h"
+#include <enki/PhysicalEngine.h>
+#include <algorithm>
+#include <iostream>
+
+namespace Enki
+{
+	using namespace Aseba;
+	
+	HeadlessSimulation::HeadlessSimulation(World* world):
+		world(world),
+		time(0)
+	{
+	}
+	
+	World* HeadlessSimulation::getWorld() const
+	{
+		return world;
+	}
+	
+	void HeadlessSimulation::log(const QString& entry, const QColor& color)
+	{
+		std::cerr << time << ": " << entry.toStdString() << std::endl;
+	}
+	
+	void HeadlessSimulation::nodeSentBuffer(uint16 nodeId, const uint8* data, uint16 length)
+	{
+		if (length < 2)
+			return;
+		
+		// only keep user events, whose types are below the ones of system messages
+		const uint16 type(data[0] | (data[1] << 8));
+		if (type >= 0x8000)
+			return;
+		
+		EmittedEvent event;
+		event.time = time;
+		event.source = nodeId;
+		event.type = type;
+		for (uint16 i = 2; i + 1 < length; i += 2)
+			event.args.push_back(sint16(data[i] | (data[i+1] << 8)));
+		events.push_back(event);
+	}
+	
+	//! Advance the world by steps of dt seconds
+	void HeadlessSimulation::run(unsigned steps, double dt)
+	{
+		for (unsigned i = 0; i < steps; ++i)
+		{
+			world->step(dt, 3);
+			time += dt;
+		}
+	}
+	
+	//! Write the variables of vms and the emitted events to stream, in a text format easy to compare between runs
+	void HeadlessSimulation::dump(std::ostream& stream, const QList<AsebaVMState*>& vms) const
+	{
+		stream << "time " << time << "\n";
+		for (int i = 0; i < vms.size(); ++i)
+		{
+			const AsebaVMState* vm(vms[i]);
+			const AbstractNodeGlue* glue(vmStateToEnvironment().value(const_cast<AsebaVMState*>(vm)).first);
+			stream << "node " << vm->nodeId << "\n";
+			
+			// named variables first
+			unsigned pos(0);
+			const AsebaVariableDescription* variable(glue->getDescription()->variables);
+			for (; variable->size; ++variable)
+			{
+				stream << "\t" << variable->name << ":";
+				for (unsigned j = 0; j < variable->size; ++j)
+					stream << " " << vm->variables[pos + j];
+				stream << "\n";
+				pos += variable->size;
+			}
+			
+			// then the memory used by the program, ignoring trailing zeros
+			unsigned end(vm->variablesSize);
+			while (end > pos && vm->variables[end - 1] == 0)
+				--end;
+			if (end > pos)
+			{
+				stream << "\t@" << pos << ":";
+				for (unsigned j = pos; j < end; ++j)
+					stream << " " << vm->variables[j];
+				stream << "\n";
+			}
+		}
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			const EmittedEvent& event(events[i]);
+			stream << "event " << event.time << " " << event.source << " " << event.type << ":";
+			for (size_t j = 0; j < event.args.size(); ++j)
+				stream << " " << event.args[j];
+			stream << "\n";
+		}
+		stream.flush();
+	}
+	
+	//! Build the description of a simulated node from its glue, as the node would send it
+	TargetDescription HeadlessSimulation::describeNode(const AsebaVMState* vm)
+	{
+		const AbstractNodeGlue* glue(vmStateToEnvironment().value(const_cast<AsebaVMState*>(vm)).first);
+		TargetDescription description;
+		description.protocolVersion = ASEBA_PROTOCOL_VERSION;
+		description.bytecodeSize = vm->bytecodeSize;
+		description.variablesSize = vm->variablesSize;
+		description.stackSize = vm->stackSize;
+		
+		for (const AsebaVariableDescription* variable(glue->getDescription()->variables); variable->size; ++variable)
+			description.namedVariables.push_back(TargetDescription::NamedVariable(UTF8ToWString(variable->name), variable->size));
+		
+		for (const AsebaLocalEventDescription* event(glue->getLocalEventsDescriptions()); event->name; ++event)
+		{
+			TargetDescription::LocalEvent localEvent;
+			localEvent.name = UTF8ToWString(event->name);
+			localEvent.description = UTF8ToWString(event->doc);
+			description.localEvents.push_back(localEvent);
+		}
+		
+		for (const AsebaNativeFunctionDescription* const* native(glue->getNativeFunctionsDescriptions()); *native; ++native)
+		{
+			TargetDescription::NativeFunction function(UTF8ToWString((*native)->name), UTF8ToWString((*native)->doc));
+			for (const AsebaNativeFunctionArgumentDescription* argument((*native)->arguments); argument->size; ++argument)
+				function.parameters.push_back(TargetDescription::NativeFunctionParameter(UTF8ToWString(argument->name), argument->size));
+			description.nativeFunctions.push_back(function);
+		}
+		
+		return description;
+	}
+	
+	//! Load an Aseba Binary Object into vm and start running it, return false and fill errorMessage if the file is invalid or for another kind of node
+	bool HeadlessSimulation::loadBytecode(AsebaVMState* vm, const QString& fileName, QString& errorMessage)
+	{
+		// the bytecode must have been compiled for this kind of node
+		const TargetDescription description(describeNode(vm));
+		unsigned freeVariableIndex;
+		const VariablesMap variablesMap(description.getVariablesMap(freeVariableIndex));
+		const VariablesMap::const_iterator productIdIt(variablesMap.find(UTF8ToWString(ASEBA_PID_VAR_NAME)));
+		const uint16 productId(productIdIt != variablesMap.end() ? uint16(vm->variables[productIdIt->second.first]) : uint16(ASEBA_PID_UNDEFINED));
+		
+		AboFile abo;
+		std::string error;
+		if (!abo.read(fileName.toLocal8Bit().constData(), productId, description.crc(), error))
+		{
+			errorMessage = QString::fromStdString(error);
+			return false;
+		}
+		if (abo.bytecode.size() > vm->bytecodeSize)
+		{
+			errorMessage = QString("Bytecode of file %0 is too large for the node: %1 words, maximum %2").arg(fileName).arg(unsigned(abo.bytecode.size())).arg(vm->bytecodeSize);
+			return false;
+		}
+		
+		setBytecode(vm, abo.bytecode);
+		return true;
+	}
+	
+	//! Copy bytecode into vm and start running it, as a set bytecode followed by a reset and a run would do
+	void HeadlessSimulation::setBytecode(AsebaVMState* vm, const std::vector<uint16>& bytecode)
+	{
+		std::copy(bytecode.begin(), bytecode.end(), vm->bytecode);
+		vm->flags = 0;
+		AsebaVMSetupEvent(vm, ASEBA_EVENT_INIT);
+	}
+} // Enki
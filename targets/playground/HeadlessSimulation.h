@@ -0,0 +1,73 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PLAYGROUND_HEADLESS_SIMULATION_H
+#define __PLAYGROUND_HEADLESS_SIMULATION_H
+
+#include "SimulationEnvironment.h"
+#include "../../vm/vm.h"
+#include <QList>
+#include <vector>
+#include <ostream>
+
+namespace Aseba
+{
+	struct TargetDescription;
+}
+
+namespace Enki
+{
+	//! Run a world without viewer nor event loop, as fast as possible with a fixed time step, recording the events emitted by the nodes
+	class HeadlessSimulation : public SimulationEnvironment
+	{
+	public:
+		//! A user event emitted by a node
+		struct EmittedEvent
+		{
+			double time; //!< simulation time at which the event was emitted, in s
+			uint16 source; //!< node identifier of the emitter
+			uint16 type; //!< event identifier
+			std::vector<sint16> args; //!< event payload
+		};
+		
+	public:
+		World* world;
+		double time;
+		std::vector<EmittedEvent> events;
+		
+	public:
+		HeadlessSimulation(World* world);
+		
+		// from SimulationEnvironment
+		
+		virtual World* getWorld() const;
+		virtual void log(const QString& entry, const QColor& color);
+		virtual void nodeSentBuffer(uint16 nodeId, const uint8* data, uint16 length);
+		
+		void run(unsigned steps, double dt);
+		void dump(std::ostream& stream, const QList<AsebaVMState*>& vms) const;
+		
+		static Aseba::TargetDescription describeNode(const AsebaVMState* vm);
+		static bool loadBytecode(AsebaVMState* vm, const QString& fileName, QString& errorMessage);
+		static void setBytecode(AsebaVMState* vm, const std::vector<uint16>& bytecode);
+	};
+}
+
+#endif // __PLAYGROUND_HEADLESS_SIMULATION_H
@@ -0,0 +1,158 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NetworkLog.h"
+#include <algorithm>
+
+namespace Aseba
+{
+	static const char logMagic[4] = { 'A', 'P', 'N', 'L' };
+	static const uint16 logVersion = 0;
+	
+	static void append16(std::vector<uint8>& buffer, uint16 v)
+	{
+		buffer.push_back(v & 0xff);
+		buffer.push_back(v >> 8);
+	}
+	
+	static void append32(std::vector<uint8>& buffer, uint32 v)
+	{
+		append16(buffer, v & 0xffff);
+		append16(buffer, v >> 16);
+	}
+	
+	// NetworkRecorder
+	
+	//! Create the log file and write its header, return false if it cannot be written
+	bool NetworkRecorder::open(const QString& fileName)
+	{
+		file.setFileName(fileName);
+		if (!file.open(QFile::WriteOnly | QFile::Truncate))
+			return false;
+		std::vector<uint8> header(logMagic, logMagic + 4);
+		append16(header, logVersion);
+		return file.write(reinterpret_cast<const char*>(&header[0]), header.size()) == qint64(header.size());
+	}
+	
+	void NetworkRecorder::record(const NetworkLogEntry& entry)
+	{
+		std::vector<uint8> buffer;
+		buffer.reserve(11 + entry.data.size());
+		buffer.push_back(entry.type);
+		append32(buffer, entry.tick);
+		append16(buffer, entry.connection);
+		if (entry.type == NetworkLogEntry::MESSAGE)
+		{
+			append16(buffer, entry.source);
+			append16(buffer, entry.data.size());
+			buffer.insert(buffer.end(), entry.data.begin(), entry.data.end());
+		}
+		else if (entry.type == NetworkLogEntry::STATE)
+			append16(buffer, entry.crc);
+		// the file is buffered by Qt and flushed when closed
+		file.write(reinterpret_cast<const char*>(&buffer[0]), buffer.size());
+	}
+	
+	// NetworkPlayer
+	
+	NetworkPlayer::NetworkPlayer():
+		ticksCount(0)
+	{
+	}
+	
+	//! Read the whole log in memory, return false and fill errorMessage if it is invalid
+	bool NetworkPlayer::load(const QString& fileName, QString& errorMessage)
+	{
+		QFile file(fileName);
+		if (!file.open(QFile::ReadOnly))
+		{
+			errorMessage = QString("Cannot open file %0").arg(fileName);
+			return false;
+		}
+		const QByteArray content(file.readAll());
+		const uint8* data(reinterpret_cast<const uint8*>(content.constData()));
+		const size_t size(content.size());
+		
+		if (size < 6 || !std::equal(logMagic, logMagic + 4, content.constData()) || (data[4] | (data[5] << 8)) != logVersion)
+		{
+			errorMessage = QString("File %0 is not a playground network log").arg(fileName);
+			return false;
+		}
+		
+		entries.clear();
+		ticksCount = 0;
+		size_t pos(6);
+		while (pos < size)
+		{
+			NetworkLogEntry entry;
+			if (pos + 7 > size)
+				break;
+			entry.type = data[pos];
+			entry.tick = data[pos+1] | (data[pos+2] << 8) | (data[pos+3] << 16) | (uint32(data[pos+4]) << 24);
+			entry.connection = data[pos+5] | (data[pos+6] << 8);
+			pos += 7;
+			if (entry.type == NetworkLogEntry::MESSAGE)
+			{
+				if (pos + 4 > size)
+					break;
+				entry.source = data[pos] | (data[pos+1] << 8);
+				const uint16 length(data[pos+2] | (data[pos+3] << 8));
+				pos += 4;
+				if (pos + length > size)
+					break;
+				entry.data.assign(data + pos, data + pos + length);
+				pos += length;
+			}
+			else if (entry.type == NetworkLogEntry::STATE)
+			{
+				if (pos + 2 > size)
+					break;
+				entry.crc = data[pos] | (data[pos+1] << 8);
+				pos += 2;
+			}
+			else if (entry.type != NetworkLogEntry::DISCONNECTION)
+			{
+				errorMessage = QString("File %0 has an unknown entry of type %1").arg(fileName).arg(entry.type);
+				return false;
+			}
+			
+			if (entry.connection >= entries.size())
+				entries.resize(entry.connection + 1);
+			ticksCount = std::max(ticksCount, entry.tick + 1);
+			entries[entry.connection].push_back(entry);
+		}
+		if (pos != size)
+		{
+			errorMessage = QString("File %0 is truncated").arg(fileName);
+			return false;
+		}
+		return true;
+	}
+	
+	//! If the next entry of connection is at tick, remove it from the log, copy it to entry and return true
+	bool NetworkPlayer::next(uint16 connection, uint32 tick, NetworkLogEntry& entry)
+	{
+		if (connection >= entries.size() || entries[connection].empty() || entries[connection].front().tick != tick)
+			return false;
+		entry = entries[connection].front();
+		entries[connection].pop_front();
+		return true;
+	}
+}
@@ -0,0 +1,83 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PLAYGROUND_NETWORK_LOG_H
+#define __PLAYGROUND_NETWORK_LOG_H
+
+#include "../../common/types.h"
+#include <QFile>
+#include <QString>
+#include <deque>
+#include <vector>
+
+namespace Aseba
+{
+	//! What reaches the simulated nodes of a connection during one simulation tick, as recorded in a network log.
+	//! A log starts with "APNL" and a 16-bit version, followed by entries made of a 8-bit type, a 32-bit tick and
+	//! a 16-bit connection index; then, for messages, a 16-bit source, a 16-bit length and the data, and for states
+	//! a 16-bit checksum. All values are little endian.
+	struct NetworkLogEntry
+	{
+		enum Type
+		{
+			MESSAGE = 0, //!< a message from a client
+			DISCONNECTION, //!< the client disconnected
+			STATE //!< checksum of the nodes' state at the beginning of the tick, to detect divergence when replaying
+		};
+		
+		uint8 type;
+		uint32 tick;
+		uint16 connection;
+		uint16 source;
+		std::vector<uint8> data;
+		uint16 crc;
+		
+		NetworkLogEntry() : type(MESSAGE), tick(0), connection(0), source(0), crc(0) {}
+	};
+	
+	//! Write the inputs of the connections of a simulation to a file, so that it can be replayed
+	class NetworkRecorder
+	{
+	public:
+		bool open(const QString& fileName);
+		void record(const NetworkLogEntry& entry);
+		
+	protected:
+		QFile file;
+	};
+	
+	//! Read a recorded network log and deliver its entries connection by connection, tick by tick
+	class NetworkPlayer
+	{
+	public:
+		NetworkPlayer();
+		
+		bool load(const QString& fileName, QString& errorMessage);
+		bool next(uint16 connection, uint32 tick, NetworkLogEntry& entry);
+		//! Return the number of ticks covered by the log
+		uint32 getTicksCount() const { return ticksCount; }
+		
+	protected:
+		std::vector<std::deque<NetworkLogEntry> > entries; //!< entries by connection, in recording order
+		uint32 ticksCount;
+	};
+}
+
+#endif // __PLAYGROUND_NETWORK_LOG_H
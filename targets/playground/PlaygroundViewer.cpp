@@ -41,18 +41,12 @@ namespace Enki
 {
 	using namespace Aseba;
 	
-	static PlaygroundViewer* playgroundViewer = 0;
-
 	PlaygroundViewer::PlaygroundViewer(World* world) : 
 		ViewerWidget(world),
 		font("Courier", 10),
-		logPos(0),
-		energyPool(INITIAL_POOL_ENERGY)
+		logPos(0)
 	{
 		//font.setPixelSize(14);
-		if (playgroundViewer)
-			abort();
-		playgroundViewer = this;
 	}
 	
 	PlaygroundViewer::~PlaygroundViewer()
@@ -65,11 +59,6 @@ namespace Enki
 		return world;
 	}
 	
-	PlaygroundViewer* PlaygroundViewer::getInstance()
-	{
-		return playgroundViewer;
-	}
-	
 	void PlaygroundViewer::log(const QString& entry, const QColor& color)
 	{
 		logText[logPos] = entry;
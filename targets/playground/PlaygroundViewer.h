@@ -28,22 +28,18 @@
 #ifndef __PLAYGROUND_VIEWER_H
 #define __PLAYGROUND_VIEWER_H
 
+#include "SimulationEnvironment.h"
 #include "../../common/utils/utils.h"
 #include <viewer/Viewer.h>
 #include <QProcess>
 
-#define LOG_COLOR(t,c) Enki::PlaygroundViewer::getInstance()->log(t,c)
-#define LOG_INFO(t) Enki::PlaygroundViewer::getInstance()->log(t,Qt::white)
-#define LOG_WARN(t) Enki::PlaygroundViewer::getInstance()->log(t,Qt::yellow)
-#define LOG_ERR(t) Enki::PlaygroundViewer::getInstance()->log(t,Qt::red)
-
 #define LOG_HISTORY_COUNT 20
 
 namespace Enki
 {
 	class World;
 	
-	class PlaygroundViewer : public ViewerWidget
+	class PlaygroundViewer : public ViewerWidget, public SimulationEnvironment
 	{
 		Q_OBJECT
 		
@@ -53,16 +49,15 @@ namespace Enki
 		QColor logColor[LOG_HISTORY_COUNT];
 		Aseba::UnifiedTime logTime[LOG_HISTORY_COUNT];
 		unsigned logPos;
-		unsigned energyPool;
 		
 	public:
 		PlaygroundViewer(World* world);
 		virtual ~PlaygroundViewer();
 		
-		World* getWorld() const;
-		static PlaygroundViewer* getInstance();
+		// from SimulationEnvironment
 		
-		void log(const QString& entry, const QColor& color);
+		virtual World* getWorld() const;
+		virtual void log(const QString& entry, const QColor& color);
 		
 	public slots:
 		void processStarted();
@@ -0,0 +1,269 @@
+/*
+	Playground - An active arena to learn multi-robots programming
+	Copyright (C) 1999--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+	3D models
+	Copyright (C) 2008:
+		Basilio Noris
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Scenario.h"
+#include "Door.h"
+#include "EPuck.h"
+#include "Thymio2.h"
+#include "SimulationEnvironment.h"
+#include <QFile>
+#include <iostream>
+
+namespace Enki
+{
+	//! Parse the scenario file fileName into domDocument, return false and fill errorMessage on failure
+	bool readScenario(const QString& fileName, QDomDocument& domDocument, QString& errorMessage)
+	{
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			errorMessage = QString("Cannot open file %1").arg(fileName);
+			return false;
+		}
+		QString errorStr;
+		int errorLine, errorColumn;
+		if (!domDocument.setContent(&file, false, &errorStr, &errorLine, &errorColumn))
+		{
+			errorMessage = QString("Parse error at file %1, line %2, column %3:\n%4").arg(fileName).arg(errorLine).arg(errorColumn).arg(errorStr);
+			return false;
+		}
+		return true;
+	}
+	
+	typedef QMap<QString, Color> ColorsMap;
+	
+	//! Read the colors defined in the scenario
+	static ColorsMap readColors(const QDomDocument& domDocument)
+	{
+		// Scan for colors
+		ColorsMap colorsMap;
+		QDomElement colorE = domDocument.documentElement().firstChildElement("color");
+		while (!colorE.isNull())
+		{
+			colorsMap[colorE.attribute("name")] = Color(
+				colorE.attribute("r").toDouble(),
+				colorE.attribute("g").toDouble(),
+				colorE.attribute("b").toDouble()
+			);
+			
+			colorE = colorE.nextSiblingElement ("color");
+		}
+		
+		return colorsMap;
+	}
+	
+	//! Create the world of the scenario, without any object
+	World* createWorld(const QDomDocument& domDocument)
+	{
+		const ColorsMap colorsMap(readColors(domDocument));
+		
+		// Create the world
+		QDomElement worldE = domDocument.documentElement().firstChildElement("world");
+		Color worldColor(Color::gray);
+		if (!colorsMap.contains(worldE.attribute("color")))
+			std::cerr << "Warning, world walls color " << worldE.attribute("color").toStdString() << " undefined\n";
+		else
+			worldColor = colorsMap[worldE.attribute("color")];
+		return new World(
+			worldE.attribute("w").toDouble(),
+			worldE.attribute("h").toDouble(),
+			worldColor
+		);
+	}
+	
+	//! Add the objects and robots of the scenario to world, robots listen for clients only if listen is true; return the states of the robots' VMs, in creation order
+	QList<AsebaVMState*> populateWorld(const QDomDocument& domDocument, World* world, bool listen)
+	{
+		const ColorsMap colorsMap(readColors(domDocument));
+		
+		// Scan for areas
+		typedef QMap<QString, Polygone> AreasMap;
+		AreasMap areasMap;
+		QDomElement areaE = domDocument.documentElement().firstChildElement("area");
+		while (!areaE.isNull())
+		{
+			Polygone p;
+			QDomElement pointE = areaE.firstChildElement("point");
+			while (!pointE.isNull())
+			{
+				p.push_back(Point(
+					pointE.attribute("x").toDouble(),
+					pointE.attribute("y").toDouble()
+				));
+				pointE = pointE.nextSiblingElement ("point");
+			}
+			areasMap[areaE.attribute("name")] = p;
+			areaE = areaE.nextSiblingElement ("area");
+		}
+		
+		// Scan for walls
+		QDomElement wallE = domDocument.documentElement().firstChildElement("wall");
+		while (!wallE.isNull())
+		{
+			PhysicalObject* wall = new PhysicalObject();
+			if (!colorsMap.contains(wallE.attribute("color")))
+				std::cerr << "Warning, color " << wallE.attribute("color").toStdString() << " undefined\n";
+			else
+				wall->setColor(colorsMap[wallE.attribute("color")]);
+			wall->pos.x = wallE.attribute("x").toDouble();
+			wall->pos.y = wallE.attribute("y").toDouble();
+			wall->setRectangular(
+				wallE.attribute("l1").toDouble(),
+				wallE.attribute("l2").toDouble(),
+				wallE.attribute("h").toDouble(),
+				-1
+			);
+			world->addObject(wall);
+			
+			wallE  = wallE.nextSiblingElement ("wall");
+		}
+		
+		// Scan for feeders
+		QDomElement feederE = domDocument.documentElement().firstChildElement("feeder");
+		while (!feederE.isNull())
+		{
+			EPuckFeeder* feeder = new EPuckFeeder;
+			feeder->pos.x = feederE.attribute("x").toDouble();
+			feeder->pos.y = feederE.attribute("y").toDouble();
+			world->addObject(feeder);
+		
+			feederE = feederE.nextSiblingElement ("feeder");
+		}
+		// TODO: if needed, custom color to feeder
+		
+		// Scan for doors
+		typedef QMap<QString, SlidingDoor*> DoorsMap;
+		DoorsMap doorsMap;
+		QDomElement doorE = domDocument.documentElement().firstChildElement("door");
+		while (!doorE.isNull())
+		{
+			SlidingDoor *door = new SlidingDoor(
+				Point(
+					doorE.attribute("closedX").toDouble(),
+					doorE.attribute("closedY").toDouble()
+				),
+				Point(
+					doorE.attribute("openedX").toDouble(),
+					doorE.attribute("openedY").toDouble()
+				),
+				Point(
+					doorE.attribute("l1").toDouble(),
+					doorE.attribute("l2").toDouble()
+				),
+				doorE.attribute("h").toDouble(),
+				doorE.attribute("moveDuration").toDouble()
+			);
+			if (!colorsMap.contains(doorE.attribute("color")))
+				std::cerr << "Warning, door color " << doorE.attribute("color").toStdString() << " undefined\n";
+			else
+				door->setColor(colorsMap[doorE.attribute("color")]);
+			doorsMap[doorE.attribute("name")] = door;
+			world->addObject(door);
+			
+			doorE = doorE.nextSiblingElement ("door");
+		}
+		
+		// Scan for activation, and link them with areas and doors
+		QDomElement activationE = domDocument.documentElement().firstChildElement("activation");
+		while (!activationE.isNull())
+		{
+			if (areasMap.find(activationE.attribute("area")) == areasMap.end())
+			{
+				std::cerr << "Warning, area " << activationE.attribute("area").toStdString() << " undefined\n";
+				activationE = activationE.nextSiblingElement ("activation");
+				continue;
+			}
+			
+			if (doorsMap.find(activationE.attribute("door")) == doorsMap.end())
+			{
+				std::cerr << "Warning, door " << activationE.attribute("door").toStdString() << " undefined\n";
+				activationE = activationE.nextSiblingElement ("activation");
+				continue;
+			}
+			
+			const Polygone& area = *areasMap.find(activationE.attribute("area"));
+			Door* door = *doorsMap.find(activationE.attribute("door"));
+			
+			DoorButton* activation = new DoorButton(
+				Point(
+					activationE.attribute("x").toDouble(),
+					activationE.attribute("y").toDouble()
+				),
+				Point(
+					activationE.attribute("l1").toDouble(),
+					activationE.attribute("l2").toDouble()
+				),
+				area,
+				door
+			);
+			
+			world->addObject(activation);
+			
+			activationE = activationE.nextSiblingElement ("activation");
+		}
+		
+		// Scan for e-puck
+		// TODO: make sure we do not try to open twice the same ports
+		//QSet<unsigned> portUsed;
+		QDomElement ePuckE = domDocument.documentElement().firstChildElement("e-puck");
+		unsigned asebaServerCount(0);
+		QList<AsebaVMState*> vms;
+		while (!ePuckE.isNull())
+		{
+			const unsigned port(ePuckE.attribute("port", QString("%0").arg(ASEBA_DEFAULT_PORT+asebaServerCount)).toUInt());	
+			AsebaFeedableEPuck* epuck(new AsebaFeedableEPuck(listen ? port : 0, asebaServerCount + 1));
+			asebaServerCount++;
+			epuck->pos.x = ePuckE.attribute("x").toDouble();
+			epuck->pos.y = ePuckE.attribute("y").toDouble();
+			epuck->angle = ePuckE.attribute("angle").toDouble();
+			world->addObject(epuck);
+			vms.append(&epuck->vm);
+			if (listen)
+				LOG_INFO(QString("New e-puck on port %0").arg(port));
+			ePuckE = ePuckE.nextSiblingElement ("e-puck");
+		}
+		
+		// Scan for Thymio 2
+		QDomElement thymioE(domDocument.documentElement().firstChildElement("thymio2"));
+		while (!thymioE.isNull())
+		{
+			const unsigned port(thymioE.attribute("port", QString("%0").arg(ASEBA_DEFAULT_PORT+asebaServerCount)).toUInt());
+			AsebaThymio2* thymio(new AsebaThymio2(listen ? port : 0));
+			asebaServerCount++;
+			thymio->pos.x = thymioE.attribute("x").toDouble();
+			thymio->pos.y = thymioE.attribute("y").toDouble();
+			thymio->angle = thymioE.attribute("angle").toDouble();
+			world->addObject(thymio);
+			vms.append(&thymio->vm);
+			if (listen)
+				LOG_INFO(QString("New Thymio II on port %0").arg(port));
+			thymioE = thymioE.nextSiblingElement ("thymio2");
+		}
+		
+		return vms;
+	}
+} // Enki
@@ -0,0 +1,256 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ScenarioRunner.h"
+#include "Scenario.h"
+#include "HeadlessSimulation.h"
+#include "AsebaGlue.h"
+#include "../../compiler/compiler.h"
+#include "../../common/consts.h"
+#include "../../common/utils/utils.h"
+#include <enki/PhysicalEngine.h>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDomDocument>
+#include <QXmlStreamWriter>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtConcurrentMap>
+#include <memory>
+#include <sstream>
+
+namespace Enki
+{
+	using namespace Aseba;
+	
+	//! Read a list of runs, file names in it being relative to its directory; return false and fill errorMessage if it cannot be read
+	bool ScenarioRunner::readRunList(const QString& fileName, Runs& runs, QString& errorMessage)
+	{
+		QFile file(fileName);
+		if (!file.open(QFile::ReadOnly))
+		{
+			errorMessage = QString("Cannot open file %0").arg(fileName);
+			return false;
+		}
+		
+		QDomDocument document("playground-runs");
+		QString errorMsg;
+		int errorLine;
+		int errorColumn;
+		if (!document.setContent(&file, false, &errorMsg, &errorLine, &errorColumn))
+		{
+			errorMessage = QString("Error in XML file %0: %1 at line %2, column %3").arg(fileName).arg(errorMsg).arg(errorLine).arg(errorColumn);
+			return false;
+		}
+		
+		const QDir baseDir(QFileInfo(fileName).dir());
+		for (QDomElement runE(document.documentElement().firstChildElement("run")); !runE.isNull(); runE = runE.nextSiblingElement("run"))
+		{
+			Run run;
+			run.scenarioFileName = baseDir.filePath(runE.attribute("scenario"));
+			run.name = runE.attribute("name", QString("%0").arg(runs.size()));
+			run.dt = runE.attribute("dt", QString::number(run.dt)).toDouble();
+			if (run.dt <= 0)
+			{
+				errorMessage = QString("Run %0 has a non-positive time step").arg(run.name);
+				return false;
+			}
+			if (runE.hasAttribute("duration"))
+				run.steps = unsigned(runE.attribute("duration").toDouble() / run.dt + 0.5);
+			else
+				run.steps = runE.attribute("steps", QString::number(run.steps)).toUInt();
+			run.seed = runE.attribute("seed", "0").toUInt();
+			for (QDomElement robotE(runE.firstChildElement("robot")); !robotE.isNull(); robotE = robotE.nextSiblingElement("robot"))
+			{
+				Program program;
+				if (robotE.hasAttribute("aesl"))
+				{
+					program.aeslFileName = baseDir.filePath(robotE.attribute("aesl"));
+					program.nodeName = robotE.attribute("node");
+				}
+				else if (robotE.hasAttribute("bytecode"))
+					program.bytecodeFileName = baseDir.filePath(robotE.attribute("bytecode"));
+				run.programs.append(program);
+			}
+			runs.append(run);
+		}
+		return true;
+	}
+	
+	//! The compiler sets its error messages and translation callback in statics, so runs compile one at a time
+	static QMutex compilerMutex;
+	
+	//! Compile the program of a node of an aesl project for vm and start running it, return false and fill errorMessage on failure
+	static bool compileProgram(AsebaVMState* vm, const ScenarioRunner::Program& program, QString& errorMessage)
+	{
+		QFile file(program.aeslFileName);
+		if (!file.open(QFile::ReadOnly))
+		{
+			errorMessage = QString("Cannot open file %0").arg(program.aeslFileName);
+			return false;
+		}
+		QDomDocument document("aesl-source");
+		QString errorMsg;
+		int errorLine;
+		int errorColumn;
+		if (!document.setContent(&file, false, &errorMsg, &errorLine, &errorColumn))
+		{
+			errorMessage = QString("Error in XML source file %0: %1 at line %2, column %3").arg(program.aeslFileName).arg(errorMsg).arg(errorLine).arg(errorColumn);
+			return false;
+		}
+		
+		CommonDefinitions commonDefinitions;
+		QDomElement nodeE;
+		for (QDomElement element(document.documentElement().firstChildElement()); !element.isNull(); element = element.nextSiblingElement())
+		{
+			if (element.tagName() == "event")
+				commonDefinitions.events.push_back(NamedValue(element.attribute("name").toStdWString(), element.attribute("size").toUInt()));
+			else if (element.tagName() == "constant")
+				commonDefinitions.constants.push_back(NamedValue(element.attribute("name").toStdWString(), element.attribute("value").toInt()));
+			else if (element.tagName() == "node" && nodeE.isNull() && (program.nodeName.isEmpty() || element.attribute("name") == program.nodeName))
+				nodeE = element;
+		}
+		if (nodeE.isNull())
+		{
+			errorMessage = QString("No node %0 in %1").arg(program.nodeName).arg(program.aeslFileName);
+			return false;
+		}
+		
+		const TargetDescription description(HeadlessSimulation::describeNode(vm));
+		std::wistringstream is(nodeE.text().toStdWString());
+		BytecodeVector bytecode;
+		unsigned allocatedVariablesCount;
+		Error error;
+		{
+			QMutexLocker locker(&compilerMutex);
+			Compiler compiler;
+			compiler.setTargetDescription(&description);
+			compiler.setCommonDefinitions(&commonDefinitions);
+			if (!compiler.compile(is, bytecode, allocatedVariablesCount, error))
+			{
+				errorMessage = QString("%0:%1: %2").arg(program.aeslFileName).arg(nodeE.attribute("name")).arg(QString::fromStdWString(error.toWString()));
+				return false;
+			}
+		}
+		
+		HeadlessSimulation::setBytecode(vm, std::vector<uint16>(bytecode.begin(), bytecode.end()));
+		return true;
+	}
+	
+	//! Create the world of run, simulate it and collect its results; runs executed by different threads are independent
+	ScenarioRunner::Result ScenarioRunner::execute(const Run& run)
+	{
+		Result result;
+		result.run = run;
+		
+		QDomDocument domDocument("aseba-playground");
+		if (!readScenario(run.scenarioFileName, domDocument, result.error))
+			return result;
+		
+		const long long unsigned startTime(monotonicMicroseconds());
+		std::auto_ptr<World> world(createWorld(domDocument));
+		HeadlessSimulation simulation(world.get());
+		simulation.randomState = run.seed;
+		const QList<AsebaVMState*> vms(populateWorld(domDocument, world.get(), false));
+		
+		// load programs in robots, in creation order
+		if (run.programs.size() > vms.size())
+		{
+			result.error = QString("More programs than robots in scenario %0").arg(run.scenarioFileName);
+			return result;
+		}
+		for (int i = 0; i < run.programs.size(); ++i)
+		{
+			const Program& program(run.programs[i]);
+			if (!program.aeslFileName.isEmpty())
+			{
+				if (!compileProgram(vms[i], program, result.error))
+					return result;
+			}
+			else if (!program.bytecodeFileName.isEmpty())
+			{
+				if (!HeadlessSimulation::loadBytecode(vms[i], program.bytecodeFileName, result.error))
+					return result;
+			}
+		}
+		
+		simulation.run(run.steps, run.dt);
+		
+		std::ostringstream dump;
+		simulation.dump(dump, vms);
+		result.dump = dump.str();
+		result.simulatedTime = simulation.time;
+		result.eventsCount = simulation.events.size();
+		
+		// robots must be deleted while the environment they registered to exists
+		world.reset();
+		result.duration = monotonicMicroseconds() - startTime;
+		result.success = true;
+		return result;
+	}
+	
+	//! Execute all runs concurrently using threadCount threads (or as many as cores if 0), return results in the order of runs
+	ScenarioRunner::Results ScenarioRunner::executeAll(const Runs& runs, int threadCount)
+	{
+		if (threadCount > 0)
+			QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+		return QtConcurrent::blockingMapped<Results>(runs, &ScenarioRunner::execute);
+	}
+	
+	//! Write an XML report with, for each result, its metrics and the final state of its robots
+	bool ScenarioRunner::writeReport(const QString& fileName, const Results& results)
+	{
+		QFile file(fileName);
+		if (!file.open(QFile::WriteOnly | QFile::Truncate))
+			return false;
+		
+		QXmlStreamWriter xml(&file);
+		xml.setAutoFormatting(true);
+		xml.writeStartDocument();
+		xml.writeStartElement("playground-report");
+		for (int i = 0; i < results.size(); ++i)
+		{
+			const Result& result(results[i]);
+			xml.writeStartElement("run");
+			xml.writeAttribute("name", result.run.name);
+			xml.writeAttribute("scenario", result.run.scenarioFileName);
+			xml.writeAttribute("seed", QString::number(result.run.seed));
+			xml.writeAttribute("success", result.success ? "true" : "false");
+			if (result.success)
+			{
+				xml.writeAttribute("steps", QString::number(result.run.steps));
+				xml.writeAttribute("simulated-time", QString::number(result.simulatedTime));
+				xml.writeAttribute("duration-us", QString::number(result.duration));
+				xml.writeAttribute("events", QString::number(result.eventsCount));
+				xml.writeCharacters(QString::fromStdString(result.dump));
+			}
+			else
+			{
+				xml.writeAttribute("error", result.error);
+			}
+			xml.writeEndElement();
+		}
+		xml.writeEndElement();
+		xml.writeEndDocument();
+		return true;
+	}
+} // Enki
@@ -0,0 +1,81 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PLAYGROUND_SCENARIO_RUNNER_H
+#define __PLAYGROUND_SCENARIO_RUNNER_H
+
+#include "../../common/types.h"
+#include <QString>
+#include <QList>
+#include <string>
+
+namespace Enki
+{
+	//! Run many independent headless simulations concurrently, one world per thread of a pool
+	class ScenarioRunner
+	{
+	public:
+		//! The program of one robot, either an aesl project or a compiled Aseba Binary Object
+		struct Program
+		{
+			QString aeslFileName; //!< aesl project to compile, if not empty
+			QString nodeName; //!< node of the aesl project to use, the first one if empty
+			QString bytecodeFileName; //!< .abo file to load, if aeslFileName is empty
+		};
+		
+		//! A scenario along with the programs of its robots and how long to simulate it
+		struct Run
+		{
+			QString name; //!< name of the run in the report
+			QString scenarioFileName; //!< playground file describing the world
+			QList<Program> programs; //!< programs of the robots, in their creation order
+			unsigned steps; //!< number of steps to simulate
+			double dt; //!< duration of a step in s
+			uint16 seed; //!< seed of math.rand
+			
+			Run() : steps(1000), dt(0.03), seed(0) {}
+		};
+		typedef QList<Run> Runs;
+		
+		//! The outcome of a Run
+		struct Result
+		{
+			Run run; //!< the executed run
+			bool success; //!< whether the scenario and programs could be loaded
+			QString error; //!< why the run failed, if not successful
+			double simulatedTime; //!< simulated time in s
+			unsigned eventsCount; //!< number of user events emitted by the robots
+			long long unsigned duration; //!< wall-clock time of the run in microseconds
+			std::string dump; //!< final variables and emitted events, see HeadlessSimulation::dump()
+			
+			Result() : success(false), simulatedTime(0), eventsCount(0), duration(0) {}
+		};
+		typedef QList<Result> Results;
+		
+	public:
+		static bool readRunList(const QString& fileName, Runs& runs, QString& errorMessage);
+		static Result execute(const Run& run);
+		static Results executeAll(const Runs& runs, int threadCount = 0);
+		
+		static bool writeReport(const QString& fileName, const Results& results);
+	};
+}
+
+#endif // __PLAYGROUND_SCENARIO_RUNNER_H
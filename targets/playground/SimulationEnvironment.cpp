@@ -0,0 +1,70 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SimulationEnvironment.h"
+#include "Parameters.h"
+#include <QThreadStorage>
+#include <cstdlib>
+
+namespace Enki
+{
+	// QThreadStorage deletes what it holds when the thread exits, so hold the environment through a wrapper it can own
+	struct EnvironmentPointer
+	{
+		SimulationEnvironment* environment;
+		EnvironmentPointer(): environment(0) {}
+	};
+	static QThreadStorage<EnvironmentPointer*> currentEnvironment;
+	
+	SimulationEnvironment::SimulationEnvironment():
+		energyPool(INITIAL_POOL_ENERGY),
+		randomState(0),
+		connectionsCount(0),
+		recorder(0),
+		player(0),
+		replayDivergences(0)
+	{
+		if (!currentEnvironment.hasLocalData())
+			currentEnvironment.setLocalData(new EnvironmentPointer);
+		if (currentEnvironment.localData()->environment)
+			abort();
+		currentEnvironment.localData()->environment = this;
+	}
+	
+	SimulationEnvironment::~SimulationEnvironment()
+	{
+		currentEnvironment.localData()->environment = 0;
+	}
+	
+	//! Return the environment of the simulation running in the current thread
+	SimulationEnvironment* SimulationEnvironment::getInstance()
+	{
+		if (!currentEnvironment.hasLocalData())
+			return 0;
+		return currentEnvironment.localData()->environment;
+	}
+	
+	//! Return the next value of the generator of math.rand, using the same generator as the VM
+	uint16 SimulationEnvironment::getRandom()
+	{
+		randomState = 25173 * randomState + 13849;
+		return randomState;
+	}
+} // Enki
@@ -0,0 +1,66 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2013:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+	
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+	
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PLAYGROUND_SIMULATION_ENVIRONMENT_H
+#define __PLAYGROUND_SIMULATION_ENVIRONMENT_H
+
+#include "AsebaGlue.h"
+#include "../../common/types.h"
+#include <QString>
+#include <QColor>
+
+#define LOG_COLOR(t,c) Enki::SimulationEnvironment::getInstance()->log(t,c)
+#define LOG_INFO(t) Enki::SimulationEnvironment::getInstance()->log(t,Qt::white)
+#define LOG_WARN(t) Enki::SimulationEnvironment::getInstance()->log(t,Qt::yellow)
+#define LOG_ERR(t) Enki::SimulationEnvironment::getInstance()->log(t,Qt::red)
+
+namespace Enki
+{
+	class World;
+	
+	//! What the simulated robots need from the program running the simulation, either with a viewer or headless.
+	//! There is a single instance per thread, created before adding robots to the world, so that independent simulations can run concurrently.
+	class SimulationEnvironment
+	{
+	public:
+		unsigned energyPool;
+		Aseba::VMStateToEnvironment vmStateToEnvironment;
+		uint16 randomState; //!< state of the generator of math.rand, shared by all nodes as on a single microcontroller
+		unsigned connectionsCount; //!< number of node connections created, used to identify them in network logs
+		Aseba::NetworkRecorder* recorder; //!< if not 0, where to record the inputs of the connections, not owned
+		Aseba::NetworkPlayer* player; //!< if not 0, where to read the inputs of the connections from, not owned
+		unsigned replayDivergences; //!< number of connections whose state differed from the recording
+		
+	public:
+		SimulationEnvironment();
+		virtual ~SimulationEnvironment();
+		
+		static SimulationEnvironment* getInstance();
+		
+		uint16 getRandom();
+		
+		virtual World* getWorld() const = 0;
+		virtual void log(const QString& entry, const QColor& color) = 0;
+		//! Called for every message a node sends to the network, data starting with the message type
+		virtual void nodeSentBuffer(uint16 nodeId, const uint8* data, uint16 length) {}
+	};
+}
+
+#endif // __PLAYGROUND_SIMULATION_ENVIRONMENT_H
@@ -20,7 +20,7 @@
 
 #include "Thymio2.h"
 #include "Parameters.h"
-#include "PlaygroundViewer.h"
+#include "SimulationEnvironment.h"
 #include "../../common/productids.h"
 #include "../../common/utils/utils.h"
 
@@ -61,21 +61,20 @@ namespace Enki
 		variables.id = vm.nodeId;
 		variables.productId = ASEBA_PID_THYMIO2;
 		
-		vmStateToEnvironment[&vm] = qMakePair((Aseba::AbstractNodeGlue*)this, (Aseba::AbstractNodeConnection *)this);
+		vmStateToEnvironment()[&vm] = qMakePair((Aseba::AbstractNodeGlue*)this, (Aseba::AbstractNodeConnection *)this);
 	}
 	
 	AsebaThymio2::~AsebaThymio2()
 	{
-		vmStateToEnvironment.remove(&vm);
+		// the environment may already be gone if it was destroyed before the world
+		if (SimulationEnvironment::getInstance())
+			vmStateToEnvironment().remove(&vm);
 	}
 	
 	void AsebaThymio2::controlStep(double dt)
 	{
-		// do a network step
-		Hub::step();
-		
-		// disconnect old streams
-		closeOldStreams();
+		// do a network step, if connected
+		networkStep();
 		
 		// get physical variables
 		// TODO: implement
@@ -145,7 +144,11 @@ namespace Enki
 	
 	void AsebaThymio2::callNativeFunction(uint16 id)
 	{
-		nativeFunctions[id](&vm);
+		// math.rand uses the generator of the simulation, so that concurrent simulations are independent
+		if (nativeFunctions[id] == AsebaNative_rand)
+			nativeRand(&vm);
+		else
+			nativeFunctions[id](&vm);
 	}
 	
 } // Enki
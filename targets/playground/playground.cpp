@@ -26,19 +26,199 @@
 */
 
 
-#include "AsebaGlue.h"
-#include "Door.h"
-#include "EPuck.h"
-#include "Thymio2.h"
+#include "Scenario.h"
 #include "PlaygroundViewer.h"
+#include "HeadlessSimulation.h"
+#include "ScenarioRunner.h"
 #include <QtXml>
 #include <QApplication>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QProcess>
+#include <memory>
+#include <iostream>
+
+void dumpHelp(std::ostream &stream, const char *programName)
+{
+	stream << "Aseba Playground, simulate robots in an arena, usage:\n";
+	stream << programName << " [options] [scenario.playground]\n";
+	stream << "Without scenario, ask for one in a file dialog.\n";
+	stream << "Options:\n";
+	stream << "    --headless      : run without viewer nor network, as fast as possible, then dump variables and events\n";
+	stream << "    --steps n       : number of steps to simulate in headless mode (default: 1000, or the length of --replay)\n";
+	stream << "    --duration s    : simulated time in headless mode, in seconds, overrides --steps\n";
+	stream << "    --dt s          : duration of a step in headless mode, in seconds (default: 0.03)\n";
+	stream << "    --bytecode file : in headless mode, load an .abo file in the next robot (can be repeated)\n";
+	stream << "    --record file   : record the inputs of the robots from their clients to file, to replay them later\n";
+	stream << "    --replay file   : in headless mode, feed the robots with inputs recorded by --record and check their state\n";
+	stream << "    --batch file    : run all scenarios listed in file concurrently, headless, and write a report\n";
+	stream << "    --report file   : where to write the report of --batch (default: report.xml)\n";
+	stream << "    -j threads      : number of simulation threads for --batch (default: number of cores)\n";
+	stream << "    -h, --help      : shows this help\n";
+	stream << "Report bugs to: aseba-dev@gna.org" << std::endl;
+}
+
+//! Load the scenario, run it for the requested time and dump the state of the robots to stdout
+int runHeadless(const QString& fileName, const QStringList& bytecodeFileNames, const QString& replayFileName, unsigned steps, double dt)
+{
+	// create document
+	QDomDocument domDocument("aseba-playground");
+	QString errorMessage;
+	if (!Enki::readScenario(fileName, domDocument, errorMessage))
+	{
+		std::cerr << errorMessage.toStdString() << std::endl;
+		return 1;
+	}
+	
+	// load recorded inputs, the world stepping at the same rate as when recording
+	Aseba::NetworkPlayer player;
+	if (!replayFileName.isEmpty())
+	{
+		if (!player.load(replayFileName, errorMessage))
+		{
+			std::cerr << errorMessage.toStdString() << std::endl;
+			return 1;
+		}
+		if (steps == 0)
+			steps = player.getTicksCount();
+	}
+	
+	// create the world and its robots, without listening for clients
+	std::auto_ptr<Enki::World> world(Enki::createWorld(domDocument));
+	Enki::HeadlessSimulation simulation(world.get());
+	if (!replayFileName.isEmpty())
+		simulation.player = &player;
+	const QList<AsebaVMState*> vms(Enki::populateWorld(domDocument, world.get(), false));
+	
+	// load programs in robots, in creation order
+	if (bytecodeFileNames.size() > vms.size())
+	{
+		std::cerr << "More bytecode files than robots in scenario" << std::endl;
+		return 1;
+	}
+	for (int i = 0; i < bytecodeFileNames.size(); ++i)
+	{
+		if (!Enki::HeadlessSimulation::loadBytecode(vms[i], bytecodeFileNames[i], errorMessage))
+		{
+			std::cerr << errorMessage.toStdString() << std::endl;
+			return 2;
+		}
+	}
+	
+	// run and report
+	simulation.run(steps, dt);
+	simulation.dump(std::cout, vms);
+	return simulation.replayDivergences ? 1 : 0;
+}
+
+//! Run all the scenarios of a run list concurrently and write their report, return 0 if all runs succeeded
+int runBatch(const QString& runListFileName, const QString& reportFileName, int threadCount)
+{
+	Enki::ScenarioRunner::Runs runs;
+	QString errorMessage;
+	if (!Enki::ScenarioRunner::readRunList(runListFileName, runs, errorMessage))
+	{
+		std::cerr << errorMessage.toStdString() << std::endl;
+		return 3;
+	}
+	
+	const long long unsigned startTime(Aseba::monotonicMicroseconds());
+	const Enki::ScenarioRunner::Results results(Enki::ScenarioRunner::executeAll(runs, threadCount));
+	const long long unsigned duration(Aseba::monotonicMicroseconds() - startTime);
+	
+	int failureCount(0);
+	for (int i = 0; i < results.size(); ++i)
+	{
+		if (!results[i].success)
+		{
+			std::cerr << results[i].run.name.toStdString() << ": " << results[i].error.toStdString() << std::endl;
+			++failureCount;
+		}
+	}
+	if (!Enki::ScenarioRunner::writeReport(reportFileName, results))
+	{
+		std::cerr << "Cannot write report" << std::endl;
+		return 3;
+	}
+	std::cout << results.size() << " runs executed in " << duration / 1000 << " ms, " << failureCount << " failed" << std::endl;
+	return failureCount ? 1 : 0;
+}
 
 int main(int argc, char *argv[])
 {
+	// Get cmd line arguments
+	QString fileName;
+	bool headless(false);
+	unsigned steps(0);
+	double duration(0);
+	double dt(0.03);
+	QStringList bytecodeFileNames;
+	QString recordFileName;
+	QString replayFileName;
+	QString runListFileName;
+	QString reportFileName("report.xml");
+	int threadCount(0);
+	for (int i = 1; i < argc; ++i)
+	{
+		const QString arg(argv[i]);
+		const bool hasValue(i + 1 < argc);
+		if (arg == "--headless")
+			headless = true;
+		else if (arg == "--steps" && hasValue)
+			steps = QString(argv[++i]).toUInt();
+		else if (arg == "--duration" && hasValue)
+			duration = QString(argv[++i]).toDouble();
+		else if (arg == "--dt" && hasValue)
+			dt = QString(argv[++i]).toDouble();
+		else if (arg == "--bytecode" && hasValue)
+			bytecodeFileNames.append(argv[++i]);
+		else if (arg == "--record" && hasValue)
+			recordFileName = argv[++i];
+		else if (arg == "--replay" && hasValue)
+			replayFileName = argv[++i];
+		else if (arg == "--batch" && hasValue)
+			runListFileName = argv[++i];
+		else if (arg == "--report" && hasValue)
+			reportFileName = argv[++i];
+		else if (arg == "-j" && hasValue)
+			threadCount = QString(argv[++i]).toInt();
+		else if ((arg == "-h") || (arg == "--help"))
+		{
+			dumpHelp(std::cout, argv[0]);
+			return 0;
+		}
+		else if (arg.startsWith("-"))
+		{
+			std::cerr << "Error, unknown or incomplete option " << argv[i] << "\n";
+			dumpHelp(std::cerr, argv[0]);
+			return 1;
+		}
+		else
+			fileName = arg;
+	}
+	
+	// Batch and headless modes do not use Qt's application nor event loop
+	if (!runListFileName.isEmpty())
+		return runBatch(runListFileName, reportFileName, threadCount);
+	if (headless)
+	{
+		if (fileName.isEmpty())
+		{
+			std::cerr << "You must specify a scenario on the command line in headless mode\n";
+			return 1;
+		}
+		if (dt <= 0)
+		{
+			std::cerr << "Time step must be positive\n";
+			return 1;
+		}
+		if (duration > 0)
+			steps = unsigned(duration / dt + 0.5);
+		else if (steps == 0 && replayFileName.isEmpty())
+			steps = 1000;
+		return runHeadless(fileName, bytecodeFileNames, replayFileName, steps, dt);
+	}
+	
 	QApplication app(argc, argv);
 	
 	/*
@@ -55,14 +235,7 @@ int main(int argc, char *argv[])
 	// create document
 	QDomDocument domDocument("aseba-playground");
 	
-	// Get cmd line arguments
-	QString fileName;
-	bool ask = true;
-	if (argc > 1)
-	{
-		fileName = argv[1];
-		ask = false;
-	}
+	bool ask = fileName.isEmpty();
 	
 	// Try to load xml config file
 	do
@@ -103,195 +276,24 @@ int main(int argc, char *argv[])
 	}
 	while (true);
 	
-	// Scan for colors
-	typedef QMap<QString, Enki::Color> ColorsMap;
-	ColorsMap colorsMap;
-	QDomElement colorE = domDocument.documentElement().firstChildElement("color");
-	while (!colorE.isNull())
-	{
-		colorsMap[colorE.attribute("name")] = Enki::Color(
-			colorE.attribute("r").toDouble(),
-			colorE.attribute("g").toDouble(),
-			colorE.attribute("b").toDouble()
-		);
-		
-		colorE = colorE.nextSiblingElement ("color");
-	}
+	// Create the world and the viewer, that must exist before robots
+	std::auto_ptr<Enki::World> world(Enki::createWorld(domDocument));
+	Enki::PlaygroundViewer viewer(world.get());
 	
-	// Scan for areas
-	typedef QMap<QString, Enki::Polygone> AreasMap;
-	AreasMap areasMap;
-	QDomElement areaE = domDocument.documentElement().firstChildElement("area");
-	while (!areaE.isNull())
+	// Record inputs if requested, stamped with the ticks at which robots apply them
+	Aseba::NetworkRecorder recorder;
+	if (!recordFileName.isEmpty())
 	{
-		Enki::Polygone p;
-		QDomElement pointE = areaE.firstChildElement("point");
-		while (!pointE.isNull())
+		if (!recorder.open(recordFileName))
 		{
-			p.push_back(Enki::Point(
-				pointE.attribute("x").toDouble(),
-				pointE.attribute("y").toDouble()
-			));
-			pointE = pointE.nextSiblingElement ("point");
+			std::cerr << "Cannot write to " << recordFileName.toStdString() << std::endl;
+			return 1;
 		}
-		areasMap[areaE.attribute("name")] = p;
-		areaE = areaE.nextSiblingElement ("area");
-	}
-	
-	// Create the world
-	QDomElement worldE = domDocument.documentElement().firstChildElement("world");
-	Enki::Color worldColor(Enki::Color::gray);
-	if (!colorsMap.contains(worldE.attribute("color")))
-		std::cerr << "Warning, world walls color " << worldE.attribute("color").toStdString() << " undefined\n";
-	else
-		worldColor = colorsMap[worldE.attribute("color")];
-	Enki::World world(
-		worldE.attribute("w").toDouble(),
-		worldE.attribute("h").toDouble(),
-		worldColor
-	);
-	
-	// Create viewer
-	Enki::PlaygroundViewer viewer(&world);
-	
-	// Scan for walls
-	QDomElement wallE = domDocument.documentElement().firstChildElement("wall");
-	while (!wallE.isNull())
-	{
-		Enki::PhysicalObject* wall = new Enki::PhysicalObject();
-		if (!colorsMap.contains(wallE.attribute("color")))
-			std::cerr << "Warning, color " << wallE.attribute("color").toStdString() << " undefined\n";
-		else
-			wall->setColor(colorsMap[wallE.attribute("color")]);
-		wall->pos.x = wallE.attribute("x").toDouble();
-		wall->pos.y = wallE.attribute("y").toDouble();
-		wall->setRectangular(
-			wallE.attribute("l1").toDouble(),
-			wallE.attribute("l2").toDouble(),
-			wallE.attribute("h").toDouble(),
-			-1
-		);
-		world.addObject(wall);
-		
-		wallE  = wallE.nextSiblingElement ("wall");
+		viewer.recorder = &recorder;
 	}
 	
-	// Scan for feeders
-	QDomElement feederE = domDocument.documentElement().firstChildElement("feeder");
-	while (!feederE.isNull())
-	{
-		Enki::EPuckFeeder* feeder = new Enki::EPuckFeeder;
-		feeder->pos.x = feederE.attribute("x").toDouble();
-		feeder->pos.y = feederE.attribute("y").toDouble();
-		world.addObject(feeder);
-	
-		feederE = feederE.nextSiblingElement ("feeder");
-	}
-	// TODO: if needed, custom color to feeder
-	
-	// Scan for doors
-	typedef QMap<QString, Enki::SlidingDoor*> DoorsMap;
-	DoorsMap doorsMap;
-	QDomElement doorE = domDocument.documentElement().firstChildElement("door");
-	while (!doorE.isNull())
-	{
-		Enki::SlidingDoor *door = new Enki::SlidingDoor(
-			Enki::Point(
-				doorE.attribute("closedX").toDouble(),
-				doorE.attribute("closedY").toDouble()
-			),
-			Enki::Point(
-				doorE.attribute("openedX").toDouble(),
-				doorE.attribute("openedY").toDouble()
-			),
-			Enki::Point(
-				doorE.attribute("l1").toDouble(),
-				doorE.attribute("l2").toDouble()
-			),
-			doorE.attribute("h").toDouble(),
-			doorE.attribute("moveDuration").toDouble()
-		);
-		if (!colorsMap.contains(doorE.attribute("color")))
-			std::cerr << "Warning, door color " << doorE.attribute("color").toStdString() << " undefined\n";
-		else
-			door->setColor(colorsMap[doorE.attribute("color")]);
-		doorsMap[doorE.attribute("name")] = door;
-		world.addObject(door);
-		
-		doorE = doorE.nextSiblingElement ("door");
-	}
-	
-	// Scan for activation, and link them with areas and doors
-	QDomElement activationE = domDocument.documentElement().firstChildElement("activation");
-	while (!activationE.isNull())
-	{
-		if (areasMap.find(activationE.attribute("area")) == areasMap.end())
-		{
-			std::cerr << "Warning, area " << activationE.attribute("area").toStdString() << " undefined\n";
-			activationE = activationE.nextSiblingElement ("activation");
-			continue;
-		}
-		
-		if (doorsMap.find(activationE.attribute("door")) == doorsMap.end())
-		{
-			std::cerr << "Warning, door " << activationE.attribute("door").toStdString() << " undefined\n";
-			activationE = activationE.nextSiblingElement ("activation");
-			continue;
-		}
-		
-		const Enki::Polygone& area = *areasMap.find(activationE.attribute("area"));
-		Enki::Door* door = *doorsMap.find(activationE.attribute("door"));
-		
-		Enki::DoorButton* activation = new Enki::DoorButton(
-			Enki::Point(
-				activationE.attribute("x").toDouble(),
-				activationE.attribute("y").toDouble()
-			),
-			Enki::Point(
-				activationE.attribute("l1").toDouble(),
-				activationE.attribute("l2").toDouble()
-			),
-			area,
-			door
-		);
-		
-		world.addObject(activation);
-		
-		activationE = activationE.nextSiblingElement ("activation");
-	}
-	
-	// Scan for e-puck
-	// TODO: make sure we do not try to open twice the same ports
-	//QSet<unsigned> portUsed;
-	QDomElement ePuckE = domDocument.documentElement().firstChildElement("e-puck");
-	unsigned asebaServerCount(0);
-	while (!ePuckE.isNull())
-	{
-		const unsigned port(ePuckE.attribute("port", QString("%0").arg(ASEBA_DEFAULT_PORT+asebaServerCount)).toUInt());	
-		Enki::AsebaFeedableEPuck* epuck(new Enki::AsebaFeedableEPuck(port, asebaServerCount + 1));
-		asebaServerCount++;
-		epuck->pos.x = ePuckE.attribute("x").toDouble();
-		epuck->pos.y = ePuckE.attribute("y").toDouble();
-		epuck->angle = ePuckE.attribute("angle").toDouble();
-		world.addObject(epuck);
-		viewer.log(QString("New e-puck on port %0").arg(port), Qt::white);
-		ePuckE = ePuckE.nextSiblingElement ("e-puck");
-	}
-	
-	// Scan for Thymio 2
-	QDomElement thymioE(domDocument.documentElement().firstChildElement("thymio2"));
-	while (!thymioE.isNull())
-	{
-		const unsigned port(thymioE.attribute("port", QString("%0").arg(ASEBA_DEFAULT_PORT+asebaServerCount)).toUInt());
-		Enki::AsebaThymio2* thymio(new Enki::AsebaThymio2(port));
-		asebaServerCount++;
-		thymio->pos.x = thymioE.attribute("x").toDouble();
-		thymio->pos.y = thymioE.attribute("y").toDouble();
-		thymio->angle = thymioE.attribute("angle").toDouble();
-		world.addObject(thymio);
-		viewer.log(QString("New Thymio II on port %0").arg(port), Qt::white);
-		thymioE = thymioE.nextSiblingElement ("thymio2");
-	}
+	// Add objects and robots
+	Enki::populateWorld(domDocument, world.get(), true);
 	
 	// Scan for external processes
 	QList<QProcess*> processes;
@@ -0,0 +1,505 @@
+// Aseba
+#include "../compiler/compiler.h"
+#include "../vm/vm.h"
+#include "../vm/natives.h"
+#include "../common/consts.h"
+#include "../common/utils/utils.h"
+#include "../common/utils/FormatableString.h"
+using namespace Aseba;
+
+// C++
+#include <string>
+#include <iostream>
+#include <locale>
+#include <fstream>
+#include <sstream>
+#include <valarray>
+#include <vector>
+#include <algorithm>
+
+// C
+#include <getopt.h>		// getopt_long()
+#include <stdlib.h>		// exit()
+#include <dirent.h>		// opendir()
+#ifndef WIN32
+#include <sys/resource.h>	// getrusage()
+#endif // WIN32
+
+#ifdef HAVE_LIBXML2
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#endif // HAVE_LIBXML2
+
+// defines
+#define DEFAULT_ITERATIONS	20
+#define MAX_STEPS_PER_EVENT	65535
+
+extern "C" bool AsebaExecutionErrorOccurred();
+
+static const AsebaNativeFunctionDescription* nativeFunctionsDescriptions[] =
+{
+	ASEBA_NATIVES_STD_DESCRIPTIONS,
+	0
+};
+
+extern "C" const AsebaNativeFunctionDescription * const * AsebaGetNativeFunctionsDescriptions(AsebaVMState *vm)
+{
+	return nativeFunctionsDescriptions;
+}
+
+static const char short_options [] = "i:o:sh";
+static const struct option long_options[] = {
+	{ "iterations",	required_argument,	NULL,	'i'},
+	{ "output",		required_argument,	NULL,	'o'},
+	{ "synthetic",	no_argument,		NULL,	's'},
+	{ "help",		no_argument,		NULL,	'h'},
+	{ 0, 0, 0, 0 }
+};
+
+static void usage (int argc, char** argv)
+{
+	std::cerr 	<< "Usage: " << argv[0] << " [options] [source|directory]..." << std::endl << std::endl
+			<< "Compile each source many times and report, as one JSON object per line," << std::endl
+			<< "the time spent in each phase of the compiler, the size of the bytecode," << std::endl
+			<< "the number of VM steps taken by each event and the peak memory usage of" << std::endl
+			<< "the whole process so far, which includes the sources benchmarked before." << std::endl
+			<< "Directories are scanned for .txt files (and .aesl files if built with libxml2)." << std::endl << std::endl
+			<< "Options:" << std::endl
+			<< "    -i | --iterations N  Number of compilations per source (default: " << DEFAULT_ITERATIONS << ")" << std::endl
+			<< "    -o | --output file   Write results to file instead of standard output" << std::endl
+			<< "    -s | --synthetic     Add generated programs with many handlers and large vectors" << std::endl
+			<< "    -h | --help          Show this help" << std::endl;
+}
+
+//! A program to benchmark, with the definitions it is compiled against
+struct BenchSource
+{
+	std::string name;
+	std::wstring source;
+	CommonDefinitions definitions;
+
+	BenchSource(const std::string& name, const std::wstring& source) : name(name), source(source) {}
+};
+typedef std::vector<BenchSource> BenchSources;
+
+//! A VM large enough for the synthetic programs, with the standard natives
+struct BenchNode
+{
+	AsebaVMState vm;
+	std::valarray<unsigned short> bytecode;
+	std::valarray<signed short> stack;
+	std::valarray<signed short> variables;
+	TargetDescription d;
+
+	BenchNode()
+	{
+		vm.nodeId = 0;
+		bytecode.resize(32768);
+		vm.bytecode = &bytecode[0];
+		vm.bytecodeSize = bytecode.size();
+
+		stack.resize(256);
+		vm.stack = &stack[0];
+		vm.stackSize = stack.size();
+
+		// variables addresses are 12 bits
+		variables.resize(4096);
+		vm.variables = &variables[0];
+		vm.variablesSize = variables.size();
+
+		AsebaVMInit(&vm);
+
+		d.name = L"benchvm";
+		d.protocolVersion = ASEBA_PROTOCOL_VERSION;
+		d.bytecodeSize = vm.bytecodeSize;
+		d.variablesSize = vm.variablesSize;
+		d.stackSize = vm.stackSize;
+
+		const AsebaNativeFunctionDescription* const* nativeDescs(AsebaGetNativeFunctionsDescriptions(&vm));
+		while (*nativeDescs)
+		{
+			const AsebaNativeFunctionDescription* nativeDesc(*nativeDescs);
+			std::string name(nativeDesc->name);
+			std::string doc(nativeDesc->doc);
+
+			TargetDescription::NativeFunction native(
+				std::wstring(name.begin(), name.end()),
+				std::wstring(doc.begin(), doc.end())
+			);
+
+			const AsebaNativeFunctionArgumentDescription* params(nativeDesc->arguments);
+			while (params->size)
+			{
+				name = params->name;
+				native.parameters.push_back(
+					TargetDescription::NativeFunctionParameter(std::wstring(name.begin(), name.end()), params->size)
+				);
+				++params;
+			}
+
+			d.nativeFunctions.push_back(native);
+			++nativeDescs;
+		}
+	}
+
+	bool loadBytecode(const BytecodeVector& bytecode)
+	{
+		if (bytecode.size() > vm.bytecodeSize)
+			return false;
+		AsebaVMInit(&vm);
+		size_t i = 0;
+		for (BytecodeVector::const_iterator it(bytecode.begin()); it != bytecode.end(); ++it)
+			vm.bytecode[i++] = it->bytecode;
+		return true;
+	}
+
+	//! Execute event until it terminates, return the number of steps it took, or -1 if it does not terminate
+	int countSteps(unsigned event)
+	{
+		if (!AsebaVMSetupEvent(&vm, event))
+			return 0;
+		int steps(0);
+		while (vm.flags & ASEBA_VM_EVENT_ACTIVE_MASK)
+		{
+			if (steps == MAX_STEPS_PER_EVENT)
+			{
+				vm.flags = 0;
+				return -1;
+			}
+			AsebaVMRun(&vm, 1);
+			++steps;
+		}
+		return steps;
+	}
+};
+
+// read source code to a string
+static bool readFile(const std::string& filename, std::string& content)
+{
+	std::ifstream ifs(filename.c_str(), std::ifstream::binary);
+	if (!ifs.is_open())
+		return false;
+	std::ostringstream oss;
+	oss << ifs.rdbuf();
+	content = oss.str();
+	return true;
+}
+
+static bool hasSuffix(const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// name results by file name only, so that they can be compared across checkouts
+static std::string baseName(const std::string& filename)
+{
+	const size_t pos(filename.find_last_of("/\\"));
+	return pos == std::string::npos ? filename : filename.substr(pos + 1);
+}
+
+// add a plain text source, with the definitions used by asebatest
+static void addTextSource(BenchSources& sources, const std::string& filename)
+{
+	std::string utf8Source;
+	if (!readFile(filename, utf8Source))
+	{
+		std::cerr << "Error opening source file " << filename << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	BenchSource source(baseName(filename), UTF8ToWString(utf8Source));
+	source.definitions.events.push_back(NamedValue(L"event1", 0));
+	source.definitions.events.push_back(NamedValue(L"event2", 3));
+	source.definitions.constants.push_back(NamedValue(L"FOO", 2));
+	sources.push_back(source);
+}
+
+#ifdef HAVE_LIBXML2
+// add every non-empty node program of an AESL project, with the project's events and constants
+static void addAeslSource(BenchSources& sources, const std::string& filename)
+{
+	xmlDoc *doc(xmlReadFile(filename.c_str(), NULL, 0));
+	if (!doc)
+	{
+		std::cerr << "Cannot read aesl script XML from file " << filename << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	CommonDefinitions definitions;
+	std::vector<std::pair<std::string, std::wstring> > programs;
+	for (xmlNode *node = xmlDocGetRootElement(doc)->children; node; node = node->next)
+	{
+		if (node->type != XML_ELEMENT_NODE)
+			continue;
+		const std::string element((const char *)node->name);
+		xmlChar *name(xmlGetProp(node, BAD_CAST("name")));
+		if (!name)
+			continue;
+		if (element == "event")
+		{
+			xmlChar *size(xmlGetProp(node, BAD_CAST("size")));
+			definitions.events.push_back(NamedValue(UTF8ToWString((const char *)name), size ? atoi((const char *)size) : 0));
+			xmlFree(size);
+		}
+		else if (element == "constant")
+		{
+			xmlChar *value(xmlGetProp(node, BAD_CAST("value")));
+			definitions.constants.push_back(NamedValue(UTF8ToWString((const char *)name), value ? atoi((const char *)value) : 0));
+			xmlFree(value);
+		}
+		else if (element == "node")
+		{
+			xmlChar *text(xmlNodeGetContent(node));
+			if (text && *text)
+				programs.push_back(std::make_pair(std::string((const char *)name), UTF8ToWString((const char *)text)));
+			xmlFree(text);
+		}
+		xmlFree(name);
+	}
+	xmlFreeDoc(doc);
+
+	for (size_t i = 0; i < programs.size(); ++i)
+	{
+		BenchSource source(baseName(filename) + ":" + programs[i].first, programs[i].second);
+		source.definitions = definitions;
+		sources.push_back(source);
+	}
+}
+#endif // HAVE_LIBXML2
+
+static void addPath(BenchSources& sources, const std::string& path)
+{
+	DIR *dir(opendir(path.c_str()));
+	if (dir)
+	{
+		std::vector<std::string> entries;
+		while (struct dirent *entry = readdir(dir))
+			entries.push_back(entry->d_name);
+		closedir(dir);
+		std::sort(entries.begin(), entries.end());
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (hasSuffix(entries[i], ".txt"))
+				addTextSource(sources, path + "/" + entries[i]);
+			#ifdef HAVE_LIBXML2
+			else if (hasSuffix(entries[i], ".aesl"))
+				addAeslSource(sources, path + "/" + entries[i]);
+			#endif // HAVE_LIBXML2
+		}
+	}
+	#ifdef HAVE_LIBXML2
+	else if (hasSuffix(path, ".aesl"))
+		addAeslSource(sources, path);
+	#endif // HAVE_LIBXML2
+	else
+		addTextSource(sources, path);
+}
+
+// many small event handlers, as in large fleet projects
+static BenchSource generateManyHandlers(unsigned count)
+{
+	std::wostringstream oss;
+	oss << L"var counter\n";
+	oss << L"var args[4]\n";
+	BenchSource source("synthetic:handlers-" + FormatableString("%0").arg(count), L"");
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const std::wstring name(WFormatableString(L"event%0").arg(i));
+		source.definitions.events.push_back(NamedValue(name, i % 4));
+		oss << L"onevent " << name << L"\n";
+		oss << L"counter = counter + " << (i % 100) << L"\n";
+		if (i % 4)
+			oss << L"args[" << (i % 4) << L"] = counter * 2\n";
+	}
+	source.source = oss.str();
+	return source;
+}
+
+// large vectors with element-wise operations, which the compiler expands to scalar code
+static BenchSource generateLargeVectors(unsigned size)
+{
+	std::wostringstream oss;
+	oss << L"var a[" << size << L"]\n";
+	oss << L"var b[" << size << L"]\n";
+	oss << L"var c[" << size << L"]\n";
+	oss << L"var i\n";
+	oss << L"for i in 0:" << size - 1 << L" do\n";
+	oss << L"\ta[i] = i\n";
+	oss << L"\tb[i] = " << size << L" - i\n";
+	oss << L"end\n";
+	oss << L"c = a + b\n";
+	oss << L"c = c + c - a\n";
+	oss << L"call math.dot(i, a, b, 0)\n";
+	BenchSource source("synthetic:vectors-" + FormatableString("%0").arg(size), oss.str());
+	return source;
+}
+
+//! Return the peak resident memory of the whole process since it started, not of the last source alone
+static long processPeakMemoryKiB()
+{
+	#ifndef WIN32
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+	#else // __APPLE__
+	return usage.ru_maxrss;
+	#endif // __APPLE__
+	#else // WIN32
+	return 0;
+	#endif // WIN32
+}
+
+static std::string jsonEscape(const std::string& s)
+{
+	std::string escaped;
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		const char c(s[i]);
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if ((unsigned char)c < 0x20)
+			escaped += ' ';
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+static void benchmark(BenchNode& node, const BenchSource& source, unsigned iterations, std::ostream& out)
+{
+	Compiler compiler;
+	CompilationStatistics statistics;
+	compiler.setTargetDescription(&node.d);
+	compiler.setCommonDefinitions(&source.definitions);
+	compiler.setStatistics(&statistics);
+
+	BytecodeVector bytecode;
+	unsigned allocatedVariablesCount;
+	Error error;
+	bool success(true);
+	for (unsigned i = 0; i < iterations && success; ++i)
+	{
+		std::wistringstream is(source.source);
+		success = compiler.compile(is, bytecode, allocatedVariablesCount, error);
+	}
+
+	out << "{\"name\": \"" << jsonEscape(source.name) << "\"";
+	out << ", \"success\": " << (success ? "true" : "false");
+	if (!success)
+	{
+		out << ", \"error\": \"" << jsonEscape(WStringToUTF8(error.toWString())) << "\"";
+		out << "}" << std::endl;
+		return;
+	}
+	out << ", \"iterations\": " << statistics.compilationCount;
+	for (unsigned phase = 0; phase < CompilationStatistics::PHASE_COUNT; ++phase)
+		out << ", \"" << CompilationStatistics::phaseName(CompilationStatistics::Phase(phase)) << "_us\": " << double(statistics.phaseDuration[phase]) / statistics.compilationCount;
+	out << ", \"total_us\": " << double(statistics.totalDuration()) / statistics.compilationCount;
+	out << ", \"process_peak_memory_kib\": " << processPeakMemoryKiB();
+	out << ", \"bytecode_words\": " << statistics.bytecodeSize;
+	out << ", \"variables_words\": " << statistics.allocatedVariablesCount;
+
+	// execute every event once, init first as on a real node
+	out << ", \"vm_steps\": {";
+	if (node.loadBytecode(bytecode))
+	{
+		const BytecodeVector::EventAddressesToIdsMap eventAddr(bytecode.getEventAddressesToIds());
+		std::vector<unsigned> events;
+		events.push_back(ASEBA_EVENT_INIT);
+		for (BytecodeVector::EventAddressesToIdsMap::const_iterator it(eventAddr.begin()); it != eventAddr.end(); ++it)
+			if (it->second != ASEBA_EVENT_INIT)
+				events.push_back(it->second);
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			const unsigned event(events[i]);
+			std::string name;
+			if (event == ASEBA_EVENT_INIT)
+				name = "init";
+			else if (event < source.definitions.events.size())
+				name = WStringToUTF8(source.definitions.events[event].name);
+			else
+				name = FormatableString("%0").arg(event);
+			out << (i ? ", " : "") << "\"" << jsonEscape(name) << "\": " << node.countSteps(event);
+		}
+	}
+	out << "}";
+	out << "}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned iterations = DEFAULT_ITERATIONS;
+	bool synthetic = false;
+	std::string outputFileName;
+
+	std::locale::global(std::locale(""));
+
+	// parse the arguments
+	for(;;)
+	{
+		int index;
+		int c;
+
+		c = getopt_long(argc, argv, short_options, long_options, &index);
+
+		if (c==-1)
+			break;
+
+		switch(c)
+		{
+			case 0: // getopt_long() flag
+				break;
+			case 'i':
+				iterations = atoi(optarg);
+				break;
+			case 'o':
+				outputFileName = optarg;
+				break;
+			case 's':
+				synthetic = true;
+				break;
+			case 'h':
+				usage(argc, argv);
+				exit(EXIT_SUCCESS);
+			default:
+				usage(argc, argv);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if ((optind == argc && !synthetic) || iterations == 0)
+	{
+		usage(argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	// collect the corpus
+	BenchSources sources;
+	for (int i = optind; i < argc; ++i)
+		addPath(sources, argv[i]);
+	if (synthetic)
+	{
+		sources.push_back(generateManyHandlers(100));
+		sources.push_back(generateManyHandlers(2000));
+		sources.push_back(generateLargeVectors(64));
+		sources.push_back(generateLargeVectors(1000));
+	}
+
+	std::ofstream outputFile;
+	if (!outputFileName.empty())
+	{
+		outputFile.open(outputFileName.c_str());
+		if (!outputFile.is_open())
+		{
+			std::cerr << "Error opening output file " << outputFileName << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	std::ostream& out(outputFileName.empty() ? std::cout : outputFile);
+
+	BenchNode node;
+	for (size_t i = 0; i < sources.size(); ++i)
+		benchmark(node, sources[i], iterations, out);
+
+	return EXIT_SUCCESS;
+}
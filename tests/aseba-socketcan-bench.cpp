@@ -0,0 +1,158 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Throughput benchmark for the socketcan Dashel plugin
+//
+// Open two CAN streams on the same interface and send variables messages from
+// one to the other in bursts, reporting the frames per second and the CPU time
+// per packet, both ends included. Use a virtual interface, set up with:
+//   modprobe vcan && ip link add dev vcan0 type vcan && ip link set up vcan0
+//   aseba-socketcan-bench [interface] [packets] [variables per packet] [burst] [noread]
+//
+// With noread, the receiving stream is never read, so that the interface queue
+// fills up; report instead how long the longest flush took, which is bounded by
+// the plugin's timeout for a full queue.
+//
+// Return 0 if all packets were received intact, or all were sent with noread
+
+#include "../common/msg/msg.h"
+#include "../common/utils/utils.h"
+#include "../transport/dashel_plugins/dashel-plugins.h"
+#include <dashel/dashel.h>
+
+// C++
+#include <iostream>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+
+class SocketCanBench: public Dashel::Hub
+{
+public:
+	Dashel::Stream* sender;
+	Dashel::Stream* receiver;
+	unsigned received;
+	unsigned corrupted;
+	Aseba::Variables reference;
+
+	SocketCanBench(const std::string& target, const Aseba::Variables& reference):
+		received(0),
+		corrupted(0),
+		reference(reference)
+	{
+		sender = connect(target);
+		receiver = connect(target);
+	}
+
+protected:
+	virtual void incomingData(Dashel::Stream *stream)
+	{
+		std::auto_ptr<Aseba::Message> message(Aseba::Message::receive(stream));
+		const Aseba::Variables* variables(dynamic_cast<const Aseba::Variables*>(message.get()));
+		if (stream != receiver)
+			return;
+		if (!variables || variables->source != reference.source || variables->start != reference.start || variables->variables != reference.variables)
+			++corrupted;
+		++received;
+	}
+};
+
+//! Return the number of CAN frames the plugin uses for a packet with size bytes of payload
+static unsigned framesPerPacket(unsigned size)
+{
+	// the first frame carries the message type and 6 bytes of payload
+	if (size <= 6)
+		return 1;
+	unsigned frames(2);
+	for (size -= 6; size > 8; size -= 8)
+		++frames;
+	return frames;
+}
+
+int main(int argc, char* argv[])
+{
+	Dashel::initPlugins();
+
+	const std::string interface(argc > 1 ? argv[1] : "vcan0");
+	const unsigned packets(argc > 2 ? atoi(argv[2]) : 100000);
+	const unsigned variablesCount(argc > 3 ? atoi(argv[3]) : 31);
+	const unsigned burst(argc > 4 ? atoi(argv[4]) : 16);
+	const bool readBack(argc <= 5 || std::string(argv[5]) != "noread");
+
+	Aseba::Variables reference;
+	reference.source = 1;
+	reference.start = 0;
+	for (unsigned i = 0; i < variablesCount; ++i)
+		reference.variables.push_back(i * 37);
+
+	try
+	{
+		SocketCanBench bench("can:if=" + interface, reference);
+
+		const Aseba::UnifiedTime startTime;
+		const clock_t startClock(clock());
+		unsigned sent(0);
+		Aseba::UnifiedTime::Value longestFlush(0);
+		while (sent < packets)
+		{
+			for (unsigned i = 0; i < burst && sent < packets; ++i, ++sent)
+				reference.serialize(bench.sender);
+			const Aseba::UnifiedTime flushTime;
+			bench.sender->flush();
+			if (!readBack)
+			{
+				longestFlush = std::max(longestFlush, (Aseba::UnifiedTime() - flushTime).value);
+				continue;
+			}
+			// wait for this burst, giving up if frames are lost
+			const Aseba::UnifiedTime deadline(Aseba::UnifiedTime() + Aseba::UnifiedTime(1000));
+			while (bench.received < sent && Aseba::UnifiedTime() < deadline)
+				bench.step(10);
+			if (bench.received < sent)
+				break;
+		}
+		const double duration(double((Aseba::UnifiedTime() - startTime).value) / 1000.);
+		const double cpu(double(clock() - startClock) / CLOCKS_PER_SEC);
+
+		if (!readBack)
+		{
+			std::cout << sent << " packets of " << variablesCount << " variables sent without reading in " << duration << " s";
+			std::cout << ", longest flush " << longestFlush << " ms" << std::endl;
+			return 0;
+		}
+
+		// source, start and variables after the type
+		const unsigned frames(bench.received * framesPerPacket(2 + 2 * variablesCount));
+		std::cout << bench.received << " of " << sent << " packets of " << variablesCount << " variables received";
+		std::cout << " in " << duration << " s, " << bench.corrupted << " corrupted" << std::endl;
+		if (duration > 0)
+			std::cout << frames / duration << " frames/s, " << bench.received / duration << " packets/s" << std::endl;
+		if (bench.received)
+			std::cout << 1e6 * cpu / bench.received << " us of CPU per packet" << std::endl;
+
+		return (bench.received == packets && bench.corrupted == 0) ? 0 : 1;
+	}
+	catch (Dashel::DashelException e)
+	{
+		std::cerr << "Error on " << interface << ": " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,355 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Test and benchmark the reassembly of packets by the CAN transport layer,
+// by feeding it synthetic traffic from several sources whose frames are interleaved.
+//   aseba-test-can-net                    : run the tests, return 0 on success
+//   aseba-test-can-net --bench [sources]  : report the reception throughput in frames per second
+
+#include "../transport/can/can-net.h"
+#include "../common/consts.h"
+
+// C++
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+typedef std::vector<uint8> Packet;
+typedef std::vector<CanFrame> Frames;
+
+//! Frames produced by the send side of the layer
+static Frames sentFrames;
+//! Source whose packets the glue asks to drop, -1 if none
+static int droppedSource = -1;
+static unsigned receivedDroppedCount = 0;
+
+static CanFrame sendQueue[128];
+static CanFrame recvQueue[1100];
+
+extern "C" void AsebaIdle(void)
+{
+}
+
+extern "C" uint16 AsebaShouldDropPacket(uint16 source, const uint8* data)
+{
+	return int(source) == droppedSource;
+}
+
+static void sendFrame(const CanFrame *frame)
+{
+	sentFrames.push_back(*frame);
+}
+
+static int isFrameRoom()
+{
+	return 1;
+}
+
+static void receivedPacketDropped()
+{
+	++receivedDroppedCount;
+}
+
+static void sentPacketDropped()
+{
+}
+
+static void init(size_t recvQueueSize)
+{
+	AsebaCanInit(1, sendFrame, isFrameRoom, receivedPacketDropped, sentPacketDropped, sendQueue, sizeof(sendQueue) / sizeof(CanFrame), recvQueue, recvQueueSize);
+	receivedDroppedCount = 0;
+	droppedSource = -1;
+}
+
+//! Return a packet of random content, small or up to the maximum packet size
+static Packet randomPacket()
+{
+	const size_t size((rand() % 4 == 0) ? 1 + rand() % 8 : 1 + rand() % ASEBA_MAX_INNER_PACKET_SIZE);
+	Packet packet(size);
+	for (size_t i = 0; i < size; ++i)
+		packet[i] = rand() % 256;
+	return packet;
+}
+
+//! Return the frames of packets sent by several sources, interleaved as if they were sending at the same time
+static Frames interleavedTraffic(const std::vector<std::vector<Packet> >& packets)
+{
+	std::vector<Frames> framesBySource(packets.size());
+	for (size_t source = 0; source < packets.size(); ++source)
+	{
+		for (size_t i = 0; i < packets[source].size(); ++i)
+		{
+			sentFrames.clear();
+			AsebaCanSendSpecificSource(&packets[source][i][0], packets[source][i].size(), source);
+			framesBySource[source].insert(framesBySource[source].end(), sentFrames.begin(), sentFrames.end());
+		}
+	}
+
+	// pick the next frame of a random source, keeping the order of each source
+	Frames traffic;
+	std::vector<size_t> positions(packets.size(), 0);
+	std::vector<size_t> active;
+	for (size_t source = 0; source < packets.size(); ++source)
+		if (!framesBySource[source].empty())
+			active.push_back(source);
+	while (!active.empty())
+	{
+		const size_t i(rand() % active.size());
+		const size_t source(active[i]);
+		traffic.push_back(framesBySource[source][positions[source]++]);
+		if (positions[source] == framesBySource[source].size())
+		{
+			active[i] = active.back();
+			active.pop_back();
+		}
+	}
+	return traffic;
+}
+
+//! Read all complete packets from the layer, by source
+static void receiveAll(std::vector<std::vector<Packet> >& received)
+{
+	uint8 data[ASEBA_MAX_INNER_PACKET_SIZE];
+	uint16 source;
+	uint16 size;
+	while ((size = AsebaCanRecv(data, sizeof(data), &source)) != 0)
+		received[source].push_back(Packet(data, data + size));
+}
+
+//! Return whether received is made of packets of sent, in the same order
+static bool isSubsequence(const std::vector<Packet>& received, const std::vector<Packet>& sent)
+{
+	size_t j = 0;
+	for (size_t i = 0; i < received.size(); ++i)
+	{
+		while (j < sent.size() && sent[j] != received[i])
+			++j;
+		if (j == sent.size())
+			return false;
+		++j;
+	}
+	return true;
+}
+
+static std::vector<std::vector<Packet> > randomPackets(size_t sourcesCount, size_t packetsCount)
+{
+	std::vector<std::vector<Packet> > packets(sourcesCount);
+	for (size_t source = 0; source < sourcesCount; ++source)
+		for (size_t i = 0; i < packetsCount; ++i)
+			packets[source].push_back(randomPacket());
+	return packets;
+}
+
+static bool check(bool condition, const char* what)
+{
+	if (!condition)
+		std::cerr << "Failed: " << what << std::endl;
+	return condition;
+}
+
+//! Packets interleaved from several sources and read as frames arrive are all received intact
+static bool testInterleaved()
+{
+	init(sizeof(recvQueue) / sizeof(CanFrame));
+	const std::vector<std::vector<Packet> > packets(randomPackets(8, 20));
+	const Frames traffic(interleavedTraffic(packets));
+	std::vector<std::vector<Packet> > received(packets.size());
+	for (size_t i = 0; i < traffic.size(); ++i)
+	{
+		AsebaCanFrameReceived(&traffic[i]);
+		receiveAll(received);
+	}
+	bool ok(check(receivedDroppedCount == 0, "interleaved: no packet dropped"));
+	ok = check(received == packets, "interleaved: packets received intact and in order") && ok;
+	ok = check(AsebaCanRecvBufferEmpty(), "interleaved: reception queue empty") && ok;
+	return ok;
+}
+
+//! When the reception queue overflows, packets are dropped but none is corrupted, and the queue recovers
+static bool testOverflow()
+{
+	init(200);
+	const std::vector<std::vector<Packet> > packets(randomPackets(8, 20));
+	const Frames traffic(interleavedTraffic(packets));
+	std::vector<std::vector<Packet> > received(packets.size());
+	for (size_t i = 0; i < traffic.size(); ++i)
+	{
+		AsebaCanFrameReceived(&traffic[i]);
+		// read rarely, so that the queue fills up
+		if (i % 64 == 0)
+			receiveAll(received);
+	}
+	receiveAll(received);
+	bool ok(check(receivedDroppedCount != 0, "overflow: some packets dropped"));
+	for (size_t source = 0; source < packets.size(); ++source)
+		ok = check(isSubsequence(received[source], packets[source]), "overflow: received packets intact") && ok;
+	ok = check(AsebaCanRecvBufferEmpty(), "overflow: reception queue empty") && ok;
+	return ok;
+}
+
+//! Packets of a source filtered by the glue are not received, others are
+static bool testFilter()
+{
+	init(sizeof(recvQueue) / sizeof(CanFrame));
+	droppedSource = 3;
+	const std::vector<std::vector<Packet> > packets(randomPackets(6, 20));
+	const Frames traffic(interleavedTraffic(packets));
+	std::vector<std::vector<Packet> > received(packets.size());
+	for (size_t i = 0; i < traffic.size(); ++i)
+	{
+		AsebaCanFrameReceived(&traffic[i]);
+		receiveAll(received);
+	}
+	bool ok(true);
+	for (size_t source = 0; source < packets.size(); ++source)
+	{
+		if (int(source) == droppedSource)
+			ok = check(received[source].empty(), "filter: filtered source not received") && ok;
+		else
+			ok = check(received[source] == packets[source], "filter: other sources received") && ok;
+	}
+	ok = check(AsebaCanRecvBufferEmpty(), "filter: reception queue empty") && ok;
+	return ok;
+}
+
+//! Losing the start or the stop frame of a packet loses this packet only
+/*!	Sources of even id lose start frames and sources of odd id stop frames,
+	as the protocol cannot detect a packet losing its stop followed by the next one losing its start.
+*/
+static bool testLostFrames()
+{
+	init(sizeof(recvQueue) / sizeof(CanFrame));
+	const std::vector<std::vector<Packet> > packets(randomPackets(8, 40));
+	const Frames traffic(interleavedTraffic(packets));
+	std::vector<std::vector<Packet> > received(packets.size());
+	size_t lostCount(0);
+	for (size_t i = 0; i < traffic.size(); ++i)
+	{
+		const unsigned type(traffic[i].id >> 8);
+		const unsigned source(traffic[i].id & 0xff);
+		if ((type == 1 + source % 2) && rand() % 10 == 0)
+		{
+			++lostCount;
+			continue;
+		}
+		AsebaCanFrameReceived(&traffic[i]);
+		receiveAll(received);
+	}
+	size_t receivedCount(0), sentCount(0);
+	bool ok(true);
+	for (size_t source = 0; source < packets.size(); ++source)
+	{
+		ok = check(isSubsequence(received[source], packets[source]), "lost frames: received packets intact") && ok;
+		receivedCount += received[source].size();
+		sentCount += packets[source].size();
+	}
+	// a lost stop frame also loses the packet it belongs to, not more
+	ok = check(receivedCount + lostCount >= sentCount, "lost frames: other packets received") && ok;
+	return ok;
+}
+
+//! Return the frames of a packet sent by source
+static Frames packetFrames(const Packet& packet, uint16 source)
+{
+	sentFrames.clear();
+	AsebaCanSendSpecificSource(&packet[0], packet.size(), source);
+	return sentFrames;
+}
+
+//! A packet restarting after a lost stop frees the lost packet only, not the small packets received meanwhile
+static bool testRestart()
+{
+	init(sizeof(recvQueue) / sizeof(CanFrame));
+	const uint16 source(5);
+	const Packet lost(40, 1), small(4, 2), restarted(30, 3);
+	Frames traffic(packetFrames(lost, source));
+	traffic.pop_back();
+	const Frames smallFrames(packetFrames(small, source));
+	const Frames restartedFrames(packetFrames(restarted, source));
+	traffic.insert(traffic.end(), smallFrames.begin(), smallFrames.end());
+	traffic.insert(traffic.end(), restartedFrames.begin(), restartedFrames.end());
+	
+	std::vector<std::vector<Packet> > received(source + 1);
+	for (size_t i = 0; i < traffic.size(); ++i)
+		AsebaCanFrameReceived(&traffic[i]);
+	receiveAll(received);
+	std::vector<Packet> expected;
+	expected.push_back(small);
+	expected.push_back(restarted);
+	bool ok(check(received[source] == expected, "restart: small and restarted packets received"));
+	ok = check(receivedDroppedCount == 1, "restart: lost packet reported") && ok;
+	ok = check(AsebaCanRecvBufferEmpty(), "restart: reception queue empty") && ok;
+	return ok;
+}
+
+//! Feed interleaved traffic and report how many frames per second are reassembled
+static void bench(size_t sourcesCount)
+{
+	init(sizeof(recvQueue) / sizeof(CanFrame));
+	const std::vector<std::vector<Packet> > packets(randomPackets(sourcesCount, 200));
+	const Frames traffic(interleavedTraffic(packets));
+	std::vector<std::vector<Packet> > received(packets.size());
+	uint8 data[ASEBA_MAX_INNER_PACKET_SIZE];
+	uint16 source;
+	const unsigned rounds(20);
+
+	const clock_t start(clock());
+	for (unsigned round = 0; round < rounds; ++round)
+	{
+		for (size_t i = 0; i < traffic.size(); ++i)
+		{
+			// like the translator, try to read a packet after each frame
+			AsebaCanFrameReceived(&traffic[i]);
+			AsebaCanRecv(data, sizeof(data), &source);
+		}
+		while (AsebaCanRecv(data, sizeof(data), &source))
+			;
+	}
+	const double duration(double(clock() - start) / CLOCKS_PER_SEC);
+
+	const double framesCount(double(traffic.size()) * rounds);
+	std::cout << sourcesCount << " sources: " << framesCount << " frames in " << duration << " s, ";
+	std::cout << (duration > 0 ? framesCount / duration : 0) << " frames/s";
+	std::cout << ", " << receivedDroppedCount << " packets dropped" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	srand(0);
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		if (argc > 2)
+			bench(atoi(argv[2]));
+		else
+			for (size_t sourcesCount = 1; sourcesCount <= 16; sourcesCount *= 2)
+				bench(sourcesCount);
+		return 0;
+	}
+
+	bool ok(testInterleaved());
+	ok = testOverflow() && ok;
+	ok = testFilter() && ok;
+	ok = testLostFrames() && ok;
+	ok = testRestart() && ok;
+	return ok ? 0 : 1;
+}
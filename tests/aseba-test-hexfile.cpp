@@ -0,0 +1,180 @@
+/*
+	Aseba - an event-based framework for distributed robot control
+	Copyright (C) 2007--2015:
+		Stephane Magnenat <stephane at magnenat dot net>
+		(http://stephane.magnenat.net)
+		and other contributors, see authors.txt for details
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published
+	by the Free Software Foundation, version 3 of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Test the reading of hex files and their layout in pages, including records
+// that follow, bridge or overlap each other; later records overwrite earlier ones.
+//   aseba-test-hexfile [temporary file name]
+
+#include "../common/utils/HexFile.h"
+
+// C++
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+
+struct Record
+{
+	unsigned address;
+	std::vector<uint8> bytes;
+};
+typedef std::vector<Record> Records;
+
+static Record record(unsigned address, unsigned size, uint8 value)
+{
+	Record r;
+	r.address = address;
+	for (unsigned i = 0; i < size; ++i)
+		r.bytes.push_back(value + i);
+	return r;
+}
+
+static void writeRecord(std::ofstream& file, unsigned address, unsigned type, const std::vector<uint8>& bytes)
+{
+	std::vector<uint8> line;
+	line.push_back(bytes.size());
+	line.push_back((address >> 8) & 0xff);
+	line.push_back(address & 0xff);
+	line.push_back(type);
+	line.insert(line.end(), bytes.begin(), bytes.end());
+	uint8 checkSum(0);
+	for (size_t i = 0; i < line.size(); ++i)
+		checkSum += line[i];
+	line.push_back(-checkSum);
+	file << ":";
+	for (size_t i = 0; i < line.size(); ++i)
+	{
+		char digits[3];
+		sprintf(digits, "%02X", line[i]);
+		file << digits;
+	}
+	file << "\n";
+}
+
+//! Write records to an hex file, in the given order
+static void writeHex(const std::string& fileName, const Records& records)
+{
+	std::ofstream file(fileName.c_str());
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		std::vector<uint8> upper;
+		upper.push_back(records[i].address >> 24);
+		upper.push_back((records[i].address >> 16) & 0xff);
+		writeRecord(file, 0, 4, upper);
+		writeRecord(file, records[i].address & 0xffff, 0, records[i].bytes);
+	}
+	writeRecord(file, 0, 1, std::vector<uint8>());
+}
+
+//! Read records back through HexFile and PageImage and compare them with applying the records in order
+static bool check(const std::string& fileName, const Records& records, const char* what)
+{
+	const unsigned pageSize(64);
+	std::map<unsigned, uint8> expected;
+	for (size_t i = 0; i < records.size(); ++i)
+		for (size_t j = 0; j < records[i].bytes.size(); ++j)
+			expected[records[i].address + j] = records[i].bytes[j];
+
+	writeHex(fileName, records);
+	Aseba::HexFile hexFile;
+	try
+	{
+		hexFile.read(fileName);
+	}
+	catch (Aseba::HexFile::Error& e)
+	{
+		std::cerr << "Failed: " << what << ": " << e.toString() << std::endl;
+		return false;
+	}
+
+	// chunks must not overlap nor touch, and hold the latest bytes
+	bool ok(true);
+	size_t bytesCount(0);
+	unsigned previousEnd(0);
+	for (Aseba::HexFile::ChunkMap::const_iterator it = hexFile.data.begin(); it != hexFile.data.end(); ++it)
+	{
+		if (it != hexFile.data.begin() && it->first <= previousEnd)
+			ok = false;
+		previousEnd = it->first + it->second.size();
+		for (size_t j = 0; j < it->second.size(); ++j)
+			if (expected.find(it->first + j) == expected.end() || expected[it->first + j] != it->second[j])
+				ok = false;
+		bytesCount += it->second.size();
+	}
+	ok = ok && bytesCount == expected.size();
+
+	// pages hold the same bytes, holes are filled
+	const Aseba::PageImage pages(hexFile, pageSize, 0xff);
+	for (std::map<unsigned, uint8>::const_iterator it = expected.begin(); it != expected.end(); ++it)
+	{
+		const size_t index(pages.find(it->first / pageSize));
+		if (index == pages.size() || pages.getPageData(index)[it->first % pageSize] != it->second)
+			ok = false;
+	}
+
+	if (!ok)
+		std::cerr << "Failed: " << what << std::endl;
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string fileName(argc > 1 ? argv[1] : "aseba-test-hexfile.hex");
+	bool ok(true);
+
+	Records records;
+	for (unsigned i = 0; i < 16; ++i)
+		records.push_back(record(i * 16, 16, i));
+	ok = check(fileName, records, "contiguous records") && ok;
+
+	records.push_back(record(0x08, 16, 0xa0));
+	ok = check(fileName, records, "record overlapping earlier data") && ok;
+
+	records.clear();
+	records.push_back(record(0x00, 16, 0x10));
+	records.push_back(record(0x20, 16, 0x20));
+	records.push_back(record(0x08, 32, 0x30));
+	ok = check(fileName, records, "record overlapping two chunks") && ok;
+
+	records.clear();
+	records.push_back(record(0x40, 8, 0x10));
+	records.push_back(record(0x48, 8, 0x20));
+	records.push_back(record(0x30, 48, 0x30));
+	ok = check(fileName, records, "record covering a chunk") && ok;
+
+	records.clear();
+	records.push_back(record(0x1fff8, 16, 0x10));
+	records.push_back(record(0x1fff0, 12, 0x20));
+	ok = check(fileName, records, "overlap across 64 kB") && ok;
+
+	srand(0);
+	for (unsigned test = 0; test < 50; ++test)
+	{
+		records.clear();
+		for (unsigned i = 0; i < 100; ++i)
+			records.push_back(record(rand() % 1024, 1 + rand() % 32, rand() % 256));
+		ok = check(fileName, records, "random overlapping records") && ok;
+	}
+
+	remove(fileName.c_str());
+	return ok ? 0 : 1;
+}
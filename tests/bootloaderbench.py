@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+
+# Flashing benchmark for asebacmd
+#
+# Start a simulated bootloader and write a generated hex file to it with
+# asebacmd, first waiting for each page to be acknowledged, then sending the
+# command of a page while the previous one is programmed, and finally again in
+# differential mode, where all pages are already in flash and should be
+# skipped. Report the time of each run. The simulated bootloader takes
+# write_time ms to erase and again to program a page.
+#   bootloaderbench.py asebacmd asebadummybootloader [pages] [write_time]
+#
+# Return 0 if all runs succeeded and the flash content matches the hex file
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import random
+import tempfile
+import subprocess
+
+PAGE_SIZE = 2048
+PAGES_START = 16
+PORT_DELTA = 5
+TARGET = "tcp:localhost;{}".format(33333 + PORT_DELTA)
+NODE_ID = str(1 + PORT_DELTA)
+
+def hex_record(address, record_type, data):
+    record = [len(data), (address >> 8) & 0xff, address & 0xff, record_type] + list(data)
+    checksum = (-sum(record)) & 0xff
+    return ":" + "".join("{:02X}".format(b) for b in record + [checksum]) + "\n"
+
+def write_hex(file_name, image, base_address):
+    # 16 bytes per data record, with extended linear address records when crossing 64 kB
+    with open(file_name, "w") as f:
+        upper = None
+        for offset in range(0, len(image), 16):
+            address = base_address + offset
+            if address >> 16 != upper:
+                upper = address >> 16
+                f.write(hex_record(0, 4, [upper >> 8, upper & 0xff]))
+            f.write(hex_record(address & 0xffff, 0, image[offset:offset + 16]))
+        f.write(hex_record(0, 1, []))
+
+def flash(asebacmd, hex_file, options):
+    start = time.time()
+    process = subprocess.Popen([asebacmd, "-t", TARGET] + options + ["whex", NODE_ID, hex_file, "reset"], stdout=subprocess.PIPE)
+    output = process.communicate()[0].decode("ascii", "replace")
+    duration = time.time() - start
+    if process.returncode != 0 or "Failure" in output:
+        print(output)
+        return None, output
+    return duration, output
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: {} asebacmd asebadummybootloader [pages] [write_time]".format(sys.argv[0]))
+        return 1
+    pages = int(sys.argv[3]) if len(sys.argv) > 3 else 32
+    write_time = sys.argv[4] if len(sys.argv) > 4 else "5"
+
+    random.seed(0)
+    image = [random.randint(0, 255) for i in range(pages * PAGE_SIZE)]
+    hex_fd, hex_file = tempfile.mkstemp(suffix=".hex")
+    flash_fd, flash_file = tempfile.mkstemp(suffix=".bin")
+    os.close(hex_fd)
+    os.close(flash_fd)
+    write_hex(hex_file, image, PAGES_START * PAGE_SIZE)
+
+    failures = 0
+    bootloader = subprocess.Popen([sys.argv[2], "--flash", flash_file, "--erase-time", write_time, "--write-time", write_time,
+        "--pages-count", str(pages), str(PORT_DELTA)])
+    time.sleep(0.5)
+    try:
+        runs = [("stop and wait", []), ("pipelined", ["-w"]),
+            ("differential, unchanged", ["-w", "-d"])]
+        for name, options in runs:
+            duration, output = flash(sys.argv[1], hex_file, options)
+            if duration is None:
+                print("{}: failed".format(name))
+                failures += 1
+                continue
+            skipped = output.count("unchanged, skipped")
+            print("{}: {:.3f} s, {} pages skipped".format(name, duration, skipped))
+            if "-d" in options and skipped != pages:
+                print("{}: expected {} pages skipped".format(name, pages))
+                failures += 1
+    finally:
+        bootloader.terminate()
+        bootloader.wait()
+
+    with open(flash_file, "rb") as f:
+        content = bytearray(f.read())
+    if list(content[PAGES_START * PAGE_SIZE:(PAGES_START + pages) * PAGE_SIZE]) != image:
+        print("flash content does not match hex file")
+        failures += 1
+    os.remove(hex_file)
+    os.remove(flash_file)
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+
+# Latency benchmark for the BotSpeak bridge
+#
+# Start a dummy node and a BotSpeak bridge connected to it, then send bursts
+# of SET, ADD and GET commands and measure the time until all their answers
+# are received, reporting the average latency per command and per burst. The
+# sums overflow 16 bits, so answers must wrap as variables on the target do.
+#   botspeakbench.py asebadummynode asebabotspeak [bursts] [burst_size]
+#
+# Return 0 if all answers were received and correct
+
+from __future__ import print_function
+
+import sys
+import time
+import socket
+import subprocess
+
+BOTSPEAK_PORT = 9999
+
+def connect(port, timeout):
+    # the bridge needs some time to get the description of the node
+    deadline = time.time() + timeout
+    while True:
+        try:
+            return socket.create_connection(("localhost", port))
+        except socket.error:
+            if time.time() > deadline:
+                raise
+            time.sleep(0.1)
+
+def wrap16(value):
+    return (value + 0x8000) % 0x10000 - 0x8000
+
+def read_lines(sock, buf, count):
+    lines = []
+    while len(lines) < count:
+        while b"\r\n" not in buf:
+            data = sock.recv(4096)
+            if not data:
+                raise IOError("connection closed by bridge")
+            buf += data
+        line, buf = buf.split(b"\r\n", 1)
+        lines.append(line.decode("ascii").strip())
+    return lines, buf
+
+def run(sock, bursts, burst_size):
+    buf = b""
+    # declare the variables used by the benchmark
+    sock.sendall(b"SET bench_a,0\r\nSET bench_b,0\r\n")
+    _, buf = read_lines(sock, buf, 2)
+
+    failures = 0
+    durations = []
+    for burst in range(bursts):
+        commands = []
+        expected = []
+        b = 0
+        for i in range(burst_size):
+            if i % 3 == 0:
+                a = (i * 1000) % 30000
+                commands.append("SET bench_a,{}".format(a))
+                expected.append(a)
+            elif i % 3 == 1:
+                commands.append("ADD bench_b,bench_a")
+                b = wrap16(b + a)
+                expected.append(b)
+            else:
+                commands.append("GET bench_b")
+                expected.append(b)
+        payload = "".join(c + "\r\n" for c in commands).encode("ascii")
+        start = time.time()
+        sock.sendall(payload)
+        answers, buf = read_lines(sock, buf, len(commands))
+        durations.append(time.time() - start)
+        for command, answer, value in zip(commands, answers, expected):
+            if answer != str(value):
+                print("{}: expected {}, got {}".format(command, value, answer))
+                failures += 1
+        # reset b for the next burst, outside measurement
+        sock.sendall(b"SET bench_b,0\r\n")
+        _, buf = read_lines(sock, buf, 1)
+    return failures, durations
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: {} asebadummynode asebabotspeak [bursts] [burst_size]".format(sys.argv[0]))
+        return 1
+    bursts = int(sys.argv[3]) if len(sys.argv) > 3 else 20
+    burst_size = int(sys.argv[4]) if len(sys.argv) > 4 else 30
+
+    node = subprocess.Popen([sys.argv[1], "0"])
+    time.sleep(0.5)
+    bridge = subprocess.Popen([sys.argv[2], "tcp:localhost;33333", str(BOTSPEAK_PORT)], stdout=subprocess.PIPE)
+    # the bridge refuses BotSpeak connections until it has the description of the node
+    time.sleep(0.5)
+    try:
+        sock = connect(BOTSPEAK_PORT, 5)
+        failures, durations = run(sock, bursts, burst_size)
+        sock.close()
+    finally:
+        bridge.terminate()
+        node.terminate()
+        bridge.wait()
+        node.wait()
+
+    total = sum(durations)
+    print("{} bursts of {} commands".format(bursts, burst_size))
+    print("per burst: {:.3f} ms".format(1000. * total / len(durations)))
+    print("per command: {:.3f} ms".format(1000. * total / (len(durations) * burst_size)))
+    print("{} wrong answers".format(failures))
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
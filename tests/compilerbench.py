@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+
+# Regression harness for aseba-compiler-bench
+#
+# Check mode: run the benchmark once on the given inputs and compare the
+# deterministic metrics (success, bytecode size, allocated variables and VM
+# steps per event) to a baseline; any increase is a regression.
+#   compilerbench.py check bench_bin baseline.json [bench arguments]
+#
+# Compare mode: compare two result files of the benchmark, also reporting
+# timings; with a tolerance, fail if the total time grows more than that.
+#   compilerbench.py compare old.json new.json [time_tolerance]
+#
+# Return 0 when there is no regression
+
+from __future__ import print_function
+
+import sys
+import json
+import subprocess
+
+def load_results(lines):
+    results = {}
+    for line in lines:
+        line = line.strip()
+        if line:
+            result = json.loads(line)
+            results[result["name"]] = result
+    return results
+
+def compare_structure(old, new):
+    # returns a list of regressions messages
+    regressions = []
+    for name in sorted(old):
+        before = old[name]
+        if name not in new:
+            regressions.append("{}: missing from results".format(name))
+            continue
+        after = new[name]
+        if before["success"] != after["success"]:
+            regressions.append("{}: success changed from {} to {}".format(name, before["success"], after["success"]))
+            continue
+        if not before["success"]:
+            continue
+        for key in ("bytecode_words", "variables_words"):
+            if after[key] > before[key]:
+                regressions.append("{}: {} grew from {} to {}".format(name, key, before[key], after[key]))
+        for event in sorted(before["vm_steps"]):
+            steps_before = before["vm_steps"][event]
+            steps_after = after["vm_steps"].get(event)
+            if steps_after is None:
+                regressions.append("{}: event {} disappeared".format(name, event))
+            elif steps_after > steps_before or (steps_after < 0 <= steps_before):
+                regressions.append("{}: event {} takes {} steps instead of {}".format(name, event, steps_after, steps_before))
+    return regressions
+
+def compare_timings(old, new, tolerance):
+    regressions = []
+    for name in sorted(old):
+        if name not in new or not old[name]["success"] or not new[name]["success"]:
+            continue
+        before = old[name]["total_us"]
+        after = new[name]["total_us"]
+        ratio = after / before if before > 0 else 1.0
+        print("{}: {:.1f} us -> {:.1f} us ({:+.1f} %)".format(name, before, after, (ratio - 1.0) * 100.0))
+        if tolerance is not None and ratio > 1.0 + tolerance:
+            regressions.append("{}: total time grew by {:.1f} %".format(name, (ratio - 1.0) * 100.0))
+    return regressions
+
+def usage():
+    print("Usage:", file=sys.stderr)
+    print("  {} check bench_bin baseline.json [bench arguments]".format(sys.argv[0]), file=sys.stderr)
+    print("  {} compare old.json new.json [time_tolerance]".format(sys.argv[0]), file=sys.stderr)
+    exit(1)
+
+if len(sys.argv) < 4:
+    usage()
+
+if sys.argv[1] == "check":
+    bench_bin = sys.argv[2]
+    with open(sys.argv[3]) as f:
+        baseline = load_results(f)
+    output = subprocess.check_output([bench_bin, "--iterations", "1"] + sys.argv[4:])
+    regressions = compare_structure(baseline, load_results(output.decode("utf-8").splitlines()))
+elif sys.argv[1] == "compare":
+    with open(sys.argv[2]) as f:
+        old = load_results(f)
+    with open(sys.argv[3]) as f:
+        new = load_results(f)
+    tolerance = float(sys.argv[4]) if len(sys.argv) > 4 else None
+    regressions = compare_structure(old, new) + compare_timings(old, new, tolerance)
+else:
+    usage()
+
+for regression in regressions:
+    print(regression)
+if regressions:
+    exit(2)
+else:
+    exit(0)
@@ -0,0 +1,242 @@
+#!/usr/bin/env python
+
+# Check that asebadummynode runs the init code of bytecode preloaded with -b
+#
+# Ask a dummy node for its description to compute its checksum, then write
+# .abo files whose init stores a value in the first user variable and whose
+# timer counts in the second. Start nodes running them, read the variables
+# of every node back over its own port, and check the node ids and values.
+# Also check that a file compiled for another description is refused.
+#   dummynodeinit.py asebadummynode
+#
+# Return 0 if all checks pass
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import socket
+import struct
+import tempfile
+import subprocess
+
+PORT_DELTA = 40
+BASE_PORT = 33333
+# after id, source, args[32] and productId
+USER_VARIABLE = 35
+COUNTER_VARIABLE = 36
+
+ASEBA_PROTOCOL_VERSION = 4
+ASEBA_PID_UNDEFINED = 0
+ASEBA_EVENT_INIT = 0xffff
+ASEBA_EVENT_TIMER = 0xfffe
+ASEBA_MESSAGE_DESCRIPTION = 0x9000
+ASEBA_MESSAGE_NAMED_VARIABLE_DESCRIPTION = 0x9001
+ASEBA_MESSAGE_LOCAL_EVENT_DESCRIPTION = 0x9002
+ASEBA_MESSAGE_NATIVE_FUNCTION_DESCRIPTION = 0x9003
+ASEBA_MESSAGE_VARIABLES = 0x9005
+ASEBA_MESSAGE_GET_DESCRIPTION = 0xa000
+ASEBA_MESSAGE_GET_VARIABLES = 0xa00b
+
+def crc_xmodem(crc, data):
+    for byte in bytearray(data):
+        crc ^= byte << 8
+        for i in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+def crc_word(crc, value):
+    return crc_xmodem(crc, struct.pack("<H", value & 0xffff))
+
+def crc_string(crc, s):
+    # strings are checksummed as UTF-8 padded to an even length
+    if len(s) % 2:
+        s += b"\0"
+    return crc_xmodem(crc, s)
+
+def receive(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise IOError("connection closed")
+        data += chunk
+    return data
+
+def receive_message(sock):
+    length, source, message_type = struct.unpack("<3H", receive(sock, 6))
+    return source, message_type, receive(sock, length)
+
+def send_message(sock, message_type, payload):
+    sock.sendall(struct.pack("<3H", len(payload), 0, message_type) + payload)
+
+class Reader(object):
+    def __init__(self, payload):
+        self.payload = payload
+        self.pos = 0
+    def word(self):
+        value, = struct.unpack("<h", self.payload[self.pos:self.pos + 2])
+        self.pos += 2
+        return value
+    def string(self):
+        length = bytearray(self.payload[self.pos:self.pos + 1])[0]
+        value = self.payload[self.pos + 1:self.pos + 1 + length]
+        self.pos += 1 + length
+        return value
+
+def description_crc(port):
+    """Return the checksum of the description of the node on port, computed as the compiler does"""
+    sock = socket.create_connection(("localhost", port), 5)
+    try:
+        send_message(sock, ASEBA_MESSAGE_GET_DESCRIPTION, struct.pack("<H", ASEBA_PROTOCOL_VERSION))
+        while True:
+            source, message_type, payload = receive_message(sock)
+            if message_type == ASEBA_MESSAGE_DESCRIPTION:
+                break
+        reader = Reader(payload)
+        reader.string()
+        reader.word()
+        bytecode_size, stack_size, variables_size = reader.word(), reader.word(), reader.word()
+        counts = {
+            ASEBA_MESSAGE_NAMED_VARIABLE_DESCRIPTION: reader.word(),
+            ASEBA_MESSAGE_LOCAL_EVENT_DESCRIPTION: reader.word(),
+            ASEBA_MESSAGE_NATIVE_FUNCTION_DESCRIPTION: reader.word()
+        }
+        parts = dict((message_type, []) for message_type in counts)
+        while any(len(parts[t]) < counts[t] for t in counts):
+            source, message_type, payload = receive_message(sock)
+            if message_type in parts:
+                parts[message_type].append(Reader(payload))
+    finally:
+        sock.close()
+
+    crc = crc_word(0, bytecode_size)
+    crc = crc_word(crc, variables_size)
+    crc = crc_word(crc, stack_size)
+    for reader in parts[ASEBA_MESSAGE_NAMED_VARIABLE_DESCRIPTION]:
+        size = reader.word()
+        crc = crc_word(crc, size)
+        crc = crc_string(crc, reader.string())
+    for reader in parts[ASEBA_MESSAGE_LOCAL_EVENT_DESCRIPTION]:
+        crc = crc_string(crc, reader.string())
+    for reader in parts[ASEBA_MESSAGE_NATIVE_FUNCTION_DESCRIPTION]:
+        crc = crc_string(crc, reader.string())
+        reader.string()
+        for i in range(reader.word()):
+            size = reader.word()
+            crc = crc_word(crc, size)
+            crc = crc_string(crc, reader.string())
+    return crc
+
+def write_abo(bytecode, node_id, description):
+    abo_fd, file_name = tempfile.mkstemp(suffix=".abo")
+    os.close(abo_fd)
+    words = struct.pack("<{}H".format(len(bytecode)), *bytecode)
+    with open(file_name, "wb") as f:
+        f.write(b"ABO\0")
+        # format and protocol versions, product, firmware, node id, name and description checksums
+        f.write(struct.pack("<7H", 0, ASEBA_PROTOCOL_VERSION, ASEBA_PID_UNDEFINED, 0, node_id, 0, description))
+        f.write(struct.pack("<H", len(bytecode)))
+        f.write(words)
+        f.write(struct.pack("<H", crc_xmodem(0, words)))
+    return file_name
+
+def program(value):
+    """Return bytecode storing value in USER_VARIABLE at init and counting timer events in COUNTER_VARIABLE"""
+    return [
+        # event table
+        5, ASEBA_EVENT_INIT, 5, ASEBA_EVENT_TIMER, 8,
+        # init: push value, store it, stop
+        (0x1 << 12) | value, (0x4 << 12) | USER_VARIABLE, 0,
+        # timer: load counter, push 1, add, store counter, stop
+        (0x3 << 12) | COUNTER_VARIABLE, (0x1 << 12) | 1, (0x8 << 12) | 2, (0x4 << 12) | COUNTER_VARIABLE, 0
+    ]
+
+def read_variables(port, node_id, start, length):
+    """Read variables of the node on port, checking that node_id answers"""
+    sock = socket.create_connection(("localhost", port), 5)
+    try:
+        send_message(sock, ASEBA_MESSAGE_GET_VARIABLES, struct.pack("<3H", node_id, start, length))
+        while True:
+            source, message_type, payload = receive_message(sock)
+            if message_type == ASEBA_MESSAGE_VARIABLES:
+                if source != node_id:
+                    raise IOError("node {} answered on port {} instead of node {}".format(source, port, node_id))
+                values = struct.unpack("<H{}h".format(length), payload[:2 + 2 * length])
+                if values[0] == start:
+                    return list(values[1:])
+    finally:
+        sock.close()
+
+def start_nodes(node, arguments):
+    process = subprocess.Popen([node] + arguments + [str(PORT_DELTA)])
+    time.sleep(0.5)
+    return process
+
+def stop_nodes(process):
+    process.terminate()
+    process.wait()
+
+def check_nodes(node, nodes_count, values, files):
+    arguments = ["-n", str(nodes_count), "-r", "50"]
+    for file_name in files:
+        arguments += ["-b", file_name]
+    process = start_nodes(node, arguments)
+    ok = True
+    try:
+        for i in range(nodes_count):
+            node_id = 1 + PORT_DELTA + i
+            value, counter = read_variables(BASE_PORT + PORT_DELTA + i, node_id, USER_VARIABLE, 2)
+            if value != values[i]:
+                print("init did not run on node {}: variable is {}, expected {}".format(node_id, value, values[i]))
+                ok = False
+            if counter <= 0:
+                print("timer did not run on node {}".format(node_id))
+                ok = False
+    finally:
+        stop_nodes(process)
+    return ok
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: {} asebadummynode".format(sys.argv[0]))
+        return 1
+    node = sys.argv[1]
+
+    process = start_nodes(node, [])
+    try:
+        description = description_crc(BASE_PORT + PORT_DELTA)
+    finally:
+        stop_nodes(process)
+
+    first = write_abo(program(42), 1 + PORT_DELTA, description)
+    second = write_abo(program(43), 2 + PORT_DELTA, description)
+    foreign = write_abo(program(44), 1 + PORT_DELTA, description ^ 0x5555)
+    try:
+        ok = check_nodes(node, 1, [42], [first])
+        # the last file is used by the nodes without one of their own
+        ok = check_nodes(node, 3, [42, 43, 43], [first, second]) and ok
+
+        with open(os.devnull, "w") as devnull:
+            process = subprocess.Popen([node, "-b", foreign, str(PORT_DELTA)], stderr=devnull)
+            for i in range(20):
+                if process.poll() is not None:
+                    break
+                time.sleep(0.1)
+            if process.poll() is None:
+                stop_nodes(process)
+                print("bytecode for another description was accepted")
+                ok = False
+    finally:
+        for file_name in (first, second, foreign):
+            os.remove(file_name)
+
+    if not ok:
+        return 1
+    print("init ran on all nodes")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+
+# Check that asebarec closes its binary recording cleanly when interrupted
+#
+# Listen for the recorder as a TCP target, send it a few messages, interrupt
+# it with SIGINT before its periodic flush, and check that the recording holds
+# the messages and ends with its index.
+#   recinterrupt.py asebarec
+#
+# Return 0 if the recording is complete
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import signal
+import socket
+import struct
+import tempfile
+import subprocess
+
+PORT = 33333 + 41
+MESSAGES_COUNT = 5
+FILE_HEADER_SIZE = 6
+INDEX_ENTRY_SIZE = 16
+
+def check_recording(file_name):
+    with open(file_name, "rb") as f:
+        data = f.read()
+    if len(data) < FILE_HEADER_SIZE + 8 or data[:4] != b"AREC":
+        print("recording is truncated or has no header")
+        return False
+    if data[-4:] != b"AIDX":
+        print("recording has no index")
+        return False
+    count, = struct.unpack("<I", data[-8:-4])
+    if count == 0 or len(data) < FILE_HEADER_SIZE + 8 + count * INDEX_ENTRY_SIZE:
+        print("recording index is empty or invalid: {} entries".format(count))
+        return False
+    index_start = len(data) - 8 - count * INDEX_ENTRY_SIZE
+    messages = 0
+    for i in range(count):
+        time_stamp, offset = struct.unpack("<QQ", data[index_start + i * INDEX_ENTRY_SIZE:index_start + (i + 1) * INDEX_ENTRY_SIZE])
+        # block header: codec, raw and stored sizes, time stamp, then messages count
+        codec, raw_size, stored_size, block_time_stamp, block_messages = struct.unpack("<BIIQI", data[offset:offset + 21])
+        if block_time_stamp != time_stamp:
+            print("index entry {} does not match its block".format(i))
+            return False
+        messages += block_messages
+    if messages != MESSAGES_COUNT:
+        print("recording holds {} messages, expected {}".format(messages, MESSAGES_COUNT))
+        return False
+    return True
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: {} asebarec".format(sys.argv[0]))
+        return 1
+
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("localhost", PORT))
+    server.listen(1)
+    server.settimeout(5)
+
+    rec_fd, rec_file = tempfile.mkstemp(suffix=".arec")
+    os.close(rec_fd)
+    recorder = subprocess.Popen([sys.argv[1], "-o", rec_file, "tcp:localhost;{}".format(PORT)])
+    try:
+        connection, address = server.accept()
+        # user messages of type 1 from node 2, with one argument
+        for i in range(MESSAGES_COUNT):
+            connection.sendall(struct.pack("<4H", 2, 2, 1, i))
+        # less than the flush delay, so that the messages are still buffered
+        time.sleep(0.3)
+        recorder.send_signal(signal.SIGINT)
+        for i in range(50):
+            if recorder.poll() is not None:
+                break
+            time.sleep(0.1)
+        if recorder.poll() is None:
+            print("recorder did not stop on SIGINT")
+            recorder.kill()
+            recorder.wait()
+            return 1
+        connection.close()
+        return 0 if check_recording(rec_file) else 1
+    finally:
+        server.close()
+        os.remove(rec_file)
+
+if __name__ == "__main__":
+    sys.exit(main())
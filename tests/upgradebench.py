@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+
+# Throughput benchmark for concurrent firmware upgrades
+#
+# Start an increasing number of simulated bootloaders, up to max_devices, and
+# write a generated hex file to all of them at once with asebacmd mwhex,
+# reporting the total time and the aggregated throughput for each count.
+#   upgradebench.py asebacmd asebadummybootloader [max_devices] [pages]
+#
+# Return 0 if all upgrades succeeded and all flash contents match the hex file
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import random
+import shutil
+import tempfile
+import subprocess
+
+PAGE_SIZE = 2048
+PAGES_START = 16
+FIRST_DELTA = 10
+WRITE_TIME = "5"
+
+def hex_record(address, record_type, data):
+    record = [len(data), (address >> 8) & 0xff, address & 0xff, record_type] + list(data)
+    checksum = (-sum(record)) & 0xff
+    return ":" + "".join("{:02X}".format(b) for b in record + [checksum]) + "\n"
+
+def write_hex(file_name, image, base_address):
+    with open(file_name, "w") as f:
+        upper = None
+        for offset in range(0, len(image), 16):
+            address = base_address + offset
+            if address >> 16 != upper:
+                upper = address >> 16
+                f.write(hex_record(0, 4, [upper >> 8, upper & 0xff]))
+            f.write(hex_record(address & 0xffff, 0, image[offset:offset + 16]))
+        f.write(hex_record(0, 1, []))
+
+def run(asebacmd, dummy, directory, hex_file, image, pages, count):
+    flash_files = [os.path.join(directory, "flash{}.bin".format(i)) for i in range(count)]
+    for name in flash_files:
+        if os.path.exists(name):
+            os.remove(name)
+    bootloaders = [subprocess.Popen([dummy, "--flash", flash_files[i], "--erase-time", WRITE_TIME, "--write-time", WRITE_TIME,
+        "--pages-count", str(pages), str(FIRST_DELTA + i)], stderr=open(os.devnull, "w")) for i in range(count)]
+    time.sleep(0.5)
+    try:
+        devices = ["tcp:localhost;{}@{}".format(33333 + FIRST_DELTA + i, 1 + FIRST_DELTA + i) for i in range(count)]
+        start = time.time()
+        process = subprocess.Popen([asebacmd, "-w", "mwhex", hex_file, "reset"] + devices, stdout=subprocess.PIPE)
+        output = process.communicate()[0].decode("ascii", "replace")
+        duration = time.time() - start
+    finally:
+        # give some time to save the flash
+        time.sleep(0.2)
+        for bootloader in bootloaders:
+            bootloader.terminate()
+        for bootloader in bootloaders:
+            bootloader.wait()
+
+    failures = 0
+    if process.returncode != 0:
+        print(output)
+        failures += 1
+    for name in flash_files:
+        with open(name, "rb") as f:
+            content = bytearray(f.read())
+        if list(content[PAGES_START * PAGE_SIZE:(PAGES_START + pages) * PAGE_SIZE]) != image:
+            print("{}: flash content does not match hex file".format(name))
+            failures += 1
+    return failures, duration
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: {} asebacmd asebadummybootloader [max_devices] [pages]".format(sys.argv[0]))
+        return 1
+    max_devices = int(sys.argv[3]) if len(sys.argv) > 3 else 64
+    pages = int(sys.argv[4]) if len(sys.argv) > 4 else 16
+
+    random.seed(0)
+    image = [random.randint(0, 255) for i in range(pages * PAGE_SIZE)]
+    directory = tempfile.mkdtemp()
+    hex_file = os.path.join(directory, "firmware.hex")
+    write_hex(hex_file, image, PAGES_START * PAGE_SIZE)
+
+    failures = 0
+    count = 1
+    try:
+        while count <= max_devices:
+            run_failures, duration = run(sys.argv[1], sys.argv[2], directory, hex_file, image, pages, count)
+            failures += run_failures
+            kbytes = count * pages * PAGE_SIZE / 1024.
+            print("{} devices: {:.3f} s, {:.1f} kB/s".format(count, duration, kbytes / duration))
+            count *= 2
+    finally:
+        shutil.rmtree(directory)
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -24,8 +24,20 @@
 #include <string.h>
 #include <assert.h>
 
-static unsigned char buffer[ASEBA_MAX_INNER_PACKET_SIZE];
-static unsigned buffer_pos;
+/* hosts running VMs in several threads, such as the playground, define
+   ASEBA_VM_BUFFER_THREAD_LOCAL so that each thread builds messages in its own buffer */
+#ifdef ASEBA_VM_BUFFER_THREAD_LOCAL
+	#ifdef _MSC_VER
+		#define ASEBA_VM_BUFFER_STORAGE static __declspec(thread)
+	#else
+		#define ASEBA_VM_BUFFER_STORAGE static __thread
+	#endif
+#else
+	#define ASEBA_VM_BUFFER_STORAGE static
+#endif
+
+ASEBA_VM_BUFFER_STORAGE unsigned char buffer[ASEBA_MAX_INNER_PACKET_SIZE];
+ASEBA_VM_BUFFER_STORAGE unsigned buffer_pos;
 
 static void buffer_add(const uint8* data, const uint16 len)
 {
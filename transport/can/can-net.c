@@ -31,8 +31,35 @@
 #define CANID_TO_ID(canid) ((canid) & 0xff)
 #define TO_CANID(type, id) (((type) << 8) | (id))
 
+/*! Source value used to look for a free reassembly slot */
+#define ASEBA_CAN_NO_SOURCE 0xffff
+
 #define ASEBA_MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+/*! Maximum number of sources whose multi-frame packets are being received or dropped at the same time */
+#ifndef ASEBA_CAN_REASSEMBLY_SLOTS
+#define ASEBA_CAN_REASSEMBLY_SLOTS 20
+#endif
+
+/*! Maximum number of complete packets waiting in the reception queue to be read by AsebaCanRecv() */
+#ifndef ASEBA_CAN_PENDING_PACKETS
+#define ASEBA_CAN_PENDING_PACKETS 64
+#endif
+
+/*!	Reassembly state of a multi-frame packet from a given source */
+typedef struct
+{
+	uint16 source; /*!< source + 1, 0 if this slot is free */
+	uint16 firstPos; /*!< position of the start frame in the reception queue */
+	uint16 dropping; /*!< if true, frames of this packet are not stored */
+} AsebaCanReassemblySlot;
+
+/*!	A complete packet in the reception queue */
+typedef struct
+{
+	uint16 firstPos; /*!< position of the first frame of the packet */
+	uint16 lastPos; /*!< position of the last frame of the packet */
+} AsebaCanPendingPacket;
 
 /*!	This contains the state of the CAN implementation of Aseba network */
 static struct AsebaCan
@@ -57,6 +84,14 @@ static struct AsebaCan
 	size_t recvQueueSize;
 	uint16 recvQueueInsertPos;
 	uint16 recvQueueConsumePos;
+	
+	// reassembly of multi-frame packets, by source
+	AsebaCanReassemblySlot slots[ASEBA_CAN_REASSEMBLY_SLOTS];
+	
+	// complete packets, in the order they have been received
+	AsebaCanPendingPacket pending[ASEBA_CAN_PENDING_PACKETS];
+	uint16 pendingInsertPos;
+	uint16 pendingConsumePos;
 
 	uint16 volatile sendQueueLock;
 	
@@ -167,24 +202,70 @@ static void AsebaCanRecvQueueGarbageCollect()
 	}
 }
 
-/*! Free frames associated with an id in the reception queue */
-static void AsebaCanRecvQueueFreeFrames(uint16 id)
+/*! Store a frame at the end of the reception queue, do not check for overwrite, return its position */
+static uint16 AsebaCanRecvQueueInsert(const CanFrame *frame)
+{
+	uint16 pos = asebaCan.recvQueueInsertPos;
+	uint16 temp;
+	memcpy(&asebaCan.recvQueue[pos], frame, sizeof(*frame));
+	asebaCan.recvQueue[pos].used = 1;
+	temp = pos + 1;
+	if (temp >= asebaCan.recvQueueSize)
+		temp = 0;
+	asebaCan.recvQueueInsertPos = temp;
+	return pos;
+}
+
+/*! Free the frames of the packet being received from an id, starting at its first position */
+static void AsebaCanRecvQueueFreeFrames(uint16 id, uint16 firstPos)
 {
 	uint16 i;
 	
-	// for all used frames...
-	for (i = asebaCan.recvQueueConsumePos; i != asebaCan.recvQueueInsertPos;)
+	// for all frames of the packet being received...
+	for (i = firstPos; i != asebaCan.recvQueueInsertPos;)
 	{
-		// if frame is of a specific id, mark frame as unused
-		if (CANID_TO_ID(asebaCan.recvQueue[i].id) == id)
+		// if frame is of a specific id, mark frame as unused; small packets from this id
+		// received meanwhile, after a lost stop, are complete and left to the reader
+		if (CANID_TO_ID(asebaCan.recvQueue[i].id) == id && CANID_TO_TYPE(asebaCan.recvQueue[i].id) != TYPE_SMALL_PACKET)
 			asebaCan.recvQueue[i].used = 0;
 		
 		i++;
 		if (i >= asebaCan.recvQueueSize)
 			i = 0;
 	}
+	AsebaCanRecvQueueGarbageCollect();
+}
+
+/*! Return the reassembly slot of a source, or a free slot if source is ASEBA_CAN_NO_SOURCE, or 0 if none */
+static AsebaCanReassemblySlot* AsebaCanFindSlot(uint16 source)
+{
+	uint16 i;
+	for (i = 0; i < ASEBA_CAN_REASSEMBLY_SLOTS; i++)
+		if (asebaCan.slots[i].source == (uint16)(source + 1))
+			return &asebaCan.slots[i];
+	return 0;
+}
+
+/*! Return true if there is room for another complete packet */
+static uint16 AsebaCanPendingHasRoom()
+{
+	uint16 temp = asebaCan.pendingInsertPos + 1;
+	if (temp >= ASEBA_CAN_PENDING_PACKETS)
+		temp = 0;
+	return temp != asebaCan.pendingConsumePos;
 }
 
+/*! Append a complete packet, do not check for overwrite */
+static void AsebaCanPendingPush(uint16 firstPos, uint16 lastPos)
+{
+	uint16 temp;
+	asebaCan.pending[asebaCan.pendingInsertPos].firstPos = firstPos;
+	asebaCan.pending[asebaCan.pendingInsertPos].lastPos = lastPos;
+	temp = asebaCan.pendingInsertPos + 1;
+	if (temp >= ASEBA_CAN_PENDING_PACKETS)
+		temp = 0;
+	asebaCan.pendingInsertPos = temp;
+}
 
 void AsebaCanInit(uint16 id, AsebaCanSendFrameFP sendFrameFP, AsebaCanIntVoidFP isFrameRoomFP, AsebaCanVoidVoidFP receivedPacketDroppedFP, AsebaCanVoidVoidFP sentPacketDroppedFP, CanFrame* sendQueue, size_t sendQueueSize, CanFrame* recvQueue, size_t recvQueueSize)
 {
@@ -205,6 +286,10 @@ void AsebaCanInit(uint16 id, AsebaCanSendFrameFP sendFrameFP, AsebaCanIntVoidFP
 	asebaCan.recvQueueInsertPos = 0;
 	asebaCan.recvQueueConsumePos = 0;
 	
+	memset(asebaCan.slots, 0, sizeof(asebaCan.slots));
+	asebaCan.pendingInsertPos = 0;
+	asebaCan.pendingConsumePos = 0;
+	
 	asebaCan.sendQueueLock = 0;
 }
 
@@ -271,144 +356,150 @@ void AsebaCanFlushQueue(void)
 
 uint16 AsebaCanRecv(uint8 *data, size_t size, uint16 *source)
 {
-	int stopPos = -1;
-	uint16 stopId;
+	uint16 firstPos, lastPos, id, temp;
 	uint16 pos = 0;
+	uint16 found = 0;
 	uint16 i;
 	
-	// first scan for "short packets" and "stops"
-	for (i = asebaCan.recvQueueConsumePos; i != asebaCan.recvQueueInsertPos; )
+	// complete packets are listed as they are received, so there is nothing to scan for;
+	// skip entries whose frames are all gone, which should not happen but must not stop the reader
+	while (!found)
 	{
-		if(asebaCan.recvQueue[i].used) {
-			
-			if (CANID_TO_TYPE(asebaCan.recvQueue[i].id) == TYPE_SMALL_PACKET)
-			{
-				// copy data
-				uint16 len = ASEBA_MIN(size, asebaCan.recvQueue[i].len);
-				memcpy(data, asebaCan.recvQueue[i].data, len);
-				*source = CANID_TO_ID(asebaCan.recvQueue[i].id);
-				asebaCan.recvQueue[i].used = 0;
-				
-				// garbage collect
-				AsebaCanRecvQueueGarbageCollect();
-				
-				return len;
-			}
-			// stop found, we thus must have seen start before
-			else if (CANID_TO_TYPE(asebaCan.recvQueue[i].id) == TYPE_PACKET_STOP)
-			{
-				stopPos = i;
-				stopId = CANID_TO_ID(asebaCan.recvQueue[i].id);
-				break;
-			}
-		}
-		i++;
-		if (i >= asebaCan.recvQueueSize)
-			i = 0;
-	}
-	
-	// if we haven't found anything
-	if (stopPos < 0)
-		return 0;
-	
-	// collect data
-	*source = CANID_TO_ID(stopId);
-	i = asebaCan.recvQueueConsumePos;
-	while (1)
-	{
-		if(asebaCan.recvQueue[i].used) {
-
-			if (CANID_TO_ID(asebaCan.recvQueue[i].id) == stopId)
+		if (asebaCan.pendingConsumePos == asebaCan.pendingInsertPos)
+			break;
+		firstPos = asebaCan.pending[asebaCan.pendingConsumePos].firstPos;
+		lastPos = asebaCan.pending[asebaCan.pendingConsumePos].lastPos;
+		id = CANID_TO_ID(asebaCan.recvQueue[lastPos].id);
+		
+		// collect data, the frames of other sources received in between are skipped
+		*source = id;
+		i = firstPos;
+		while (1)
+		{
+			if (asebaCan.recvQueue[i].used && (CANID_TO_ID(asebaCan.recvQueue[i].id) == id))
 			{
-			if (pos < size)
-					{
+				if (pos < size)
+				{
 					uint16 amount = ASEBA_MIN(asebaCan.recvQueue[i].len, size - pos);
 					memcpy(data + pos, asebaCan.recvQueue[i].data, amount);
 					pos += amount;
 				}
 				asebaCan.recvQueue[i].used = 0;
+				found = 1;
 			}
 			
-			if (i == stopPos)
+			if (i == lastPos)
 				break;
-	
+			
+			i++;
+			if (i >= asebaCan.recvQueueSize)
+				i = 0;
 		}
-		i++;
-		if (i >= asebaCan.recvQueueSize)
-			i = 0;
+		
+		temp = asebaCan.pendingConsumePos + 1;
+		if (temp >= ASEBA_CAN_PENDING_PACKETS)
+			temp = 0;
+		asebaCan.pendingConsumePos = temp;
 	}
-
+	
 	// garbage collect
 	AsebaCanRecvQueueGarbageCollect();
 	
 	return pos;
 }
 
-#define MAX_DROPPING_SOURCE 20
-static uint16 dropping[MAX_DROPPING_SOURCE];
-
 void AsebaCanFrameReceived(const CanFrame *frame)
 {
-	
 	uint16 source = CANID_TO_ID(frame->id);
+	uint16 type = CANID_TO_TYPE(frame->id);
+	AsebaCanReassemblySlot* slot;
 	
-	// check whether this packet should be filtered or not
-	if (CANID_TO_TYPE(frame->id) == TYPE_SMALL_PACKET)
+	// small packets are complete as soon as received
+	if (type == TYPE_SMALL_PACKET)
 	{
+		uint16 pos;
+		
+		// check whether this packet should be filtered or not
 		if (AsebaShouldDropPacket(source, frame->data))
 			return;
+		
+		if (AsebaCanRecvQueueGetMinFreeFrames() <= 1 || !AsebaCanPendingHasRoom())
+		{
+			// notify user
+			asebaCan.receivedPacketDroppedFP();
+			return;
+		}
+		
+		pos = AsebaCanRecvQueueInsert(frame);
+		AsebaCanPendingPush(pos, pos);
+		return;
 	}
-	else if (CANID_TO_TYPE(frame->id) == TYPE_PACKET_START)
+	
+	slot = AsebaCanFindSlot(source);
+	if (type == TYPE_PACKET_START)
 	{
-		if (AsebaShouldDropPacket(source, frame->data))
+		if (slot)
 		{
-			uint16 i;
-			for (i = 0; i < MAX_DROPPING_SOURCE; i++)
+			// the stop of the previous packet was lost, forget it
+			if (!slot->dropping)
 			{
-				if (dropping[i] == 0)
-				{
-					dropping[i] = source + 1;
-					return;
-				}
+				AsebaCanRecvQueueFreeFrames(source, slot->firstPos);
+				asebaCan.receivedPacketDroppedFP();
 			}
 		}
-	}
-	else
-	{
-		uint16 i;
-		for (i = 0; i < MAX_DROPPING_SOURCE; i++)
+		else
 		{
-			if (dropping[i] == source + 1)
+			slot = AsebaCanFindSlot(ASEBA_CAN_NO_SOURCE);
+			if (!slot)
 			{
-				if (CANID_TO_TYPE(frame->id) == TYPE_PACKET_STOP)
-					dropping[i] = 0;
+				// too many packets at the same time, the rest of this one will be ignored
+				asebaCan.receivedPacketDroppedFP();
 				return;
 			}
+			slot->source = source + 1;
 		}
-	}
-	
-	if (AsebaCanRecvQueueGetMinFreeFrames() <= 1)
-	{
-		// if packet is stop, free associated frames, otherwise this could lead to everlasting used frames
-		if (CANID_TO_TYPE(frame->id) == TYPE_PACKET_STOP) {
-			AsebaCanRecvQueueFreeFrames(source);
-			AsebaCanRecvQueueGarbageCollect();
+		
+		// check whether this packet should be filtered or not
+		slot->dropping = AsebaShouldDropPacket(source, frame->data);
+		if (slot->dropping)
+			return;
+		
+		if (AsebaCanRecvQueueGetMinFreeFrames() <= 1)
+		{
+			slot->dropping = 1;
+			asebaCan.receivedPacketDroppedFP();
+			return;
 		}
 		
-		// notify user
-		asebaCan.receivedPacketDroppedFP();
+		slot->firstPos = AsebaCanRecvQueueInsert(frame);
+		return;
 	}
-	else
+	
+	// the start of this packet was not received or the packet is ignored
+	if (!slot)
+		return;
+	
+	if (!slot->dropping)
 	{
-		uint16 temp;
-		// store and increment pos
-		memcpy(&asebaCan.recvQueue[asebaCan.recvQueueInsertPos], frame, sizeof(*frame));
-		asebaCan.recvQueue[asebaCan.recvQueueInsertPos].used = 1;
-		temp = asebaCan.recvQueueInsertPos + 1;
-		if (temp >= asebaCan.recvQueueSize)
-			temp = 0;
-		asebaCan.recvQueueInsertPos = temp;
+		if (AsebaCanRecvQueueGetMinFreeFrames() <= 1 || (type == TYPE_PACKET_STOP && !AsebaCanPendingHasRoom()))
+		{
+			// free associated frames, otherwise this could lead to everlasting used frames
+			AsebaCanRecvQueueFreeFrames(source, slot->firstPos);
+			slot->dropping = 1;
+			
+			// notify user
+			asebaCan.receivedPacketDroppedFP();
+		}
+		else
+		{
+			uint16 pos = AsebaCanRecvQueueInsert(frame);
+			if (type == TYPE_PACKET_STOP)
+				AsebaCanPendingPush(slot->firstPos, pos);
+		}
 	}
+	
+	if (type == TYPE_PACKET_STOP)
+		slot->source = 0;
 }
 
 void AsebaCanRecvFreeQueue(void)
@@ -419,8 +510,9 @@ void AsebaCanRecvFreeQueue(void)
 	asebaCan.recvQueueInsertPos = 0;
 	asebaCan.recvQueueConsumePos = 0;
 	
-	for(i = 0; i < MAX_DROPPING_SOURCE; i++) 
-		dropping[i] = 0;
+	memset(asebaCan.slots, 0, sizeof(asebaCan.slots));
+	asebaCan.pendingInsertPos = 0;
+	asebaCan.pendingConsumePos = 0;
 }
 
 /*@}*/
@@ -41,6 +41,12 @@ extern "C" {
 	
 	This transport layer only works on little-endian systems for now,
 	as it does not perform endian correction.
+	
+	On reception, frames of multi-frame packets are tracked per source,
+	so that packets from several nodes can be interleaved on the bus.
+	Up to ASEBA_CAN_REASSEMBLY_SLOTS sources can be sending a multi-frame
+	packet at the same time, and up to ASEBA_CAN_PENDING_PACKETS complete
+	packets can wait to be read, both can be redefined when compiling.
 */
 /*@{*/
 
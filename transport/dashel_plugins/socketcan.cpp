@@ -22,6 +22,7 @@
 #include <sys/uio.h>
 #include <net/if.h>
 #include <poll.h>
+#include <time.h>
 
 #include <sys/socket.h>
 #include <linux/can.h>
@@ -64,6 +65,14 @@ using namespace std;
  *
  * The interface must already be configured & upped by your distribution script.
  *
+ * Frames are exchanged with the kernel in batches: outgoing frames are queued
+ * until flush() and sent with a single sendmmsg(), incoming frames are read with
+ * recvmmsg() directly into the reception fifo. A kernel filter only lets Aseba
+ * frames through, so that other traffic on the bus does not wake the process up.
+ *
+ * For testing, a virtual interface can be used:
+ * 	modprobe vcan && ip link add dev vcan0 type vcan && ip link set up vcan0
+ *
  * Usage example:
  * 	"can:if=can0"
  *
@@ -87,11 +96,15 @@ class CanStream: public SelectableStream
 		unsigned int rx_len;
 		unsigned int rx_p;
 
-		struct iovec iov;
-		struct msghdr msg;
 		struct sockaddr_can addr;
-		char ctrlmsg[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(__u32))];
-		struct can_frame rframe;
+
+#define TX_CAN_SIZE 256
+// How long to wait for the interface queue to drain before dropping frames, in ms
+#define TX_CAN_TIMEOUT 100
+		struct can_frame tx_frames[TX_CAN_SIZE];
+		struct iovec tx_iov[TX_CAN_SIZE];
+		struct mmsghdr tx_msgs[TX_CAN_SIZE];
+		int tx_frames_count;
 
 #define RX_CAN_SIZE 1000
 		struct {
@@ -100,6 +113,11 @@ class CanStream: public SelectableStream
 		} rx_fifo[RX_CAN_SIZE];
 		int rx_insert;
 		int rx_consume;
+
+#define RX_CAN_BATCH 64
+		struct iovec rx_iov[RX_CAN_BATCH];
+		struct mmsghdr rx_msgs[RX_CAN_BATCH];
+		char rx_ctrlmsg[RX_CAN_BATCH][CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(__u32))];
 	public:
 		CanStream(const string &targetName) :
 			Stream("can"),
@@ -137,23 +155,52 @@ class CanStream: public SelectableStream
 			if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &options, sizeof(options)))
 				perror("socketcan: cannot set monitoring for dropped packets");
 
+			// Only receive Aseba frames: standard ids of at most 10 bits, no remote frames
+			struct can_filter filter;
+			filter.can_id = 0;
+			filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | 0x400;
+			if (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)))
+				perror("socketcan: cannot set Rx filter");
+
 			addr.can_ifindex = ifr.ifr_ifindex;
 			if(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
 				throw DashelException(DashelException::ConnectionFailed, 0, "Unable to bind", this);
 
 			rx_insert = rx_consume = 0;
 			tx_len = 0;
+			tx_frames_count = 0;
 			rx_len = 0;
 			rx_p = 0;
 			memset(rx_fifo, 0, sizeof(rx_fifo));
-			iov.iov_base = &rframe;
-			msg.msg_iov = &iov;
-			msg.msg_name = &addr;
-			msg.msg_namelen = sizeof(addr);
-			msg.msg_iovlen = 1;
-			msg.msg_control = ctrlmsg;
-			msg.msg_controllen = sizeof(ctrlmsg);
-			msg.msg_flags = 0;
+
+			// each message of a batch carries one frame, the socket being bound no address is needed
+			memset(tx_msgs, 0, sizeof(tx_msgs));
+			for (int i = 0; i < TX_CAN_SIZE; i++)
+			{
+				tx_iov[i].iov_base = &tx_frames[i];
+				tx_iov[i].iov_len = sizeof(tx_frames[i]);
+				tx_msgs[i].msg_hdr.msg_iov = &tx_iov[i];
+				tx_msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			memset(rx_msgs, 0, sizeof(rx_msgs));
+			for (int i = 0; i < RX_CAN_BATCH; i++)
+			{
+				rx_iov[i].iov_len = sizeof(struct can_frame);
+				rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+				rx_msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+		}
+
+		virtual ~CanStream()
+		{
+			// Frames queued without a flush are still sent, if the interface can take them right away
+			try
+			{
+				send_frames(0);
+			}
+			catch (DashelException e)
+			{
+			}
 		}
 	private:
 		int is_packet_tx(void)
@@ -167,27 +214,60 @@ class CanStream: public SelectableStream
 			return 0;
 		}
 
-		void can_write_frame(struct can_frame * f)
+		static long long monotonic_ms(void)
 		{
-			ssize_t ret;
-
-			do {
-				ret = ::write(fd, f, sizeof(*f));
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+		}
 
-				if(ret == -1 && errno == ENOBUFS)
+		// Send all queued frames, in as few system calls as possible;
+		// if the interface queue stays full for timeout ms, for instance without any other node on the bus, drop the remaining frames
+		void send_frames(int timeout = TX_CAN_TIMEOUT)
+		{
+			int sent = 0;
+			long long deadline = -1;
+			while(sent < tx_frames_count)
+			{
+				int ret = sendmmsg(fd, &tx_msgs[sent], tx_frames_count - sent, 0);
+				if(ret == -1)
 				{
+					if(errno == EINTR)
+						continue;
+					if(errno != ENOBUFS && errno != EAGAIN)
+					{
+						tx_frames_count = 0;
+						throw DashelException(DashelException::IOError, 0, "Write error", this);
+					}
+
+					const long long now = monotonic_ms();
+					if(deadline < 0)
+						deadline = now + timeout;
+					if(now >= deadline)
+					{
+						cerr << "socketcan: interface queue full for " << timeout << " ms, dropping " << tx_frames_count - sent << " frames" << endl;
+						break;
+					}
+
+					// The interface queue is full, poll() does not tell when it drains, so just wait a bit
 					struct pollfd pf;
 					pf.fd = fd;
 					pf.events = POLLOUT | POLLHUP;
 					pf.revents = 0;
-					if (poll(&pf, 1, 0) == -1)
-						perror("socketcan: can_write_frame: error while polling the socket");
+					if (poll(&pf, 1, 1) == -1)
+						perror("socketcan: send_frames: error while polling the socket");
 					continue;
 				}
+				sent += ret;
+			}
+			tx_frames_count = 0;
+		}
 
-				if(ret != sizeof(*f))
-					throw DashelException(DashelException::IOError, 0, "Write error", this);
-			} while(0);
+		void can_write_frame(struct can_frame * f)
+		{
+			if(tx_frames_count == TX_CAN_SIZE)
+				send_frames();
+			tx_frames[tx_frames_count++] = *f;
 		}
 
 		void send_aseba_packet()
@@ -250,6 +330,7 @@ class CanStream: public SelectableStream
 
 		virtual void flush() 
 		{
+			send_frames();
 		}
 	private:
 		void pack_fifo()
@@ -352,24 +433,47 @@ class CanStream: public SelectableStream
 			return i == rx_consume;
 		}
 
-		void read_iface(void)
+		// Receive at least one frame, and as many as are available up to the end of the fifo
+		void receive_frames(void)
 		{
-			int def;
-			while(1)
+			int count;
+			int i;
+
+			if(fifo_full())
+				throw DashelException(DashelException::IOError, 0, "Fifo full", this);
+
+			// frames are received in place, so do not wrap around in a batch
+			if(rx_insert >= rx_consume)
+				count = RX_CAN_SIZE - rx_insert - (rx_consume == 0 ? 1 : 0);
+			else
+				count = rx_consume - rx_insert - 1;
+			if(count > RX_CAN_BATCH)
+				count = RX_CAN_BATCH;
+
+			for(i = 0; i < count; i++)
 			{
-				while((def = defragment()) == -1);
-				if(def == 1)
-					break;
+				rx_iov[i].iov_base = &rx_fifo[rx_insert + i].f;
+				rx_msgs[i].msg_hdr.msg_control = rx_ctrlmsg[i];
+				rx_msgs[i].msg_hdr.msg_controllen = sizeof(rx_ctrlmsg[i]);
+				rx_msgs[i].msg_hdr.msg_flags = 0;
+			}
 
-				struct cmsghdr *cmsg;
-				iov.iov_len = sizeof(rframe);
-				msg.msg_flags = 0;
-				if(recvmsg(fd, &msg, 0) < (int) sizeof(rframe))
+			int ret;
+			do {
+				ret = recvmmsg(fd, rx_msgs, count, MSG_WAITFORONE, NULL);
+			} while(ret == -1 && errno == EINTR);
+			if(ret <= 0)
+				throw DashelException(DashelException::IOError, 0, "Read error", this);
+
+			for(i = 0; i < ret; i++)
+			{
+				if(rx_msgs[i].msg_len < sizeof(struct can_frame))
 					throw DashelException(DashelException::IOError, 0, "Read error", this);
 
-				for(cmsg = CMSG_FIRSTHDR(&msg); 
+				struct cmsghdr *cmsg;
+				for(cmsg = CMSG_FIRSTHDR(&rx_msgs[i].msg_hdr);
 					cmsg && (cmsg->cmsg_level == SOL_SOCKET);
-					cmsg = CMSG_NXTHDR(&msg,cmsg))
+					cmsg = CMSG_NXTHDR(&rx_msgs[i].msg_hdr,cmsg))
 				{
 					if(cmsg->cmsg_type == SO_RXQ_OVFL)
 					{
@@ -378,15 +482,27 @@ class CanStream: public SelectableStream
 							throw DashelException(DashelException::IOError, 0, "Packet dropped", this);
 					}
 				}
-			
-				if(fifo_full())
-					throw DashelException(DashelException::IOError, 0, "Fifo full", this);
 
 				// push to fifo ...
-				memcpy(&rx_fifo[rx_insert].f,&rframe,sizeof(rframe));
-				rx_fifo[rx_insert++].used = 1;
-				if(rx_insert == RX_CAN_SIZE)
-					rx_insert = 0;
+				rx_fifo[rx_insert + i].used = 1;
+			}
+			rx_insert += ret;
+			if(rx_insert == RX_CAN_SIZE)
+				rx_insert = 0;
+		}
+
+		void read_iface(void)
+		{
+			int def;
+			while(1)
+			{
+				while((def = defragment()) == -1);
+				if(def == 1)
+					break;
+
+				// We are going to wait for an answer, make sure the request is out
+				send_frames();
+				receive_frames();
 			}
 			pack_fifo();
 		}